@@ -100,6 +100,24 @@ build_core() {
         "src/core/compress.c"
         "src/core/utils.c"
         "src/core/remote.c"
+        "src/core/pack.c"
+        "src/core/delta.c"
+        "src/core/parallel.c"
+        "src/core/config.c"
+        "src/core/blake3.c"
+        "src/core/object_cache.c"
+        "src/core/loose_cache.c"
+        "src/core/write_batch.c"
+        "src/core/hash_set.c"
+        "src/core/gc.c"
+        "src/core/commit_graph.c"
+        "src/core/bitmap.c"
+        "src/core/pack_bitmap.c"
+        "src/core/midx.c"
+        "src/core/fsmonitor.c"
+        "src/core/untracked.c"
+        "src/core/sparse.c"
+        "src/core/cache_tree.c"
     )
     
     local core_cxx_sources=(
@@ -109,6 +127,9 @@ build_core() {
     
     local cflags="-std=c11 -Wall -Wextra -O2 -Iinclude -Isrc"
     cflags+=" $(pkg-config --cflags zlib openssl libcurl)"
+    if pkg-config --exists libzstd; then
+        cflags+=" -DHAVE_ZSTD $(pkg-config --cflags libzstd)"
+    fi
     
     for source in "${core_sources[@]}"; do
         local obj_file="build/core/$(basename "$source" .c).o"
@@ -179,7 +200,10 @@ build_cli() {
 link_executable() {
     print_status "Linking executable..."
     
-    local ldflags="$(pkg-config --libs zlib openssl libcurl json-c)"
+    local ldflags="$(pkg-config --libs zlib openssl libcurl json-c) -pthread"
+    if pkg-config --exists libzstd; then
+        ldflags+=" $(pkg-config --libs libzstd)"
+    fi
     
     g++ build/cli/*.o build/integration/*.o build/libsvcs_core.a $ldflags -o bin/svcs
     
@@ -195,6 +219,16 @@ build_tests() {
         "tests/test_object.c"
         "tests/test_repository.c"
         "tests/test_commit.c"
+        "tests/test_pack.c"
+        "tests/test_index.c"
+        "tests/test_write_batch.c"
+        "tests/test_gc.c"
+        "tests/test_commit_graph.c"
+        "tests/test_pack_bitmap.c"
+        "tests/test_midx.c"
+        "tests/test_fsmonitor.c"
+        "tests/test_untracked.c"
+        "tests/test_sparse.c"
     )
     
     local cflags="-std=c11 -Wall -Wextra -O2 -Iinclude -Isrc"
@@ -210,7 +244,10 @@ build_tests() {
     
     # Link test executable
     if ls build/tests/*.o 1> /dev/null 2>&1; then
-        local ldflags="$(pkg-config --libs zlib openssl)"
+        local ldflags="$(pkg-config --libs zlib openssl) -pthread"
+        if pkg-config --exists libzstd; then
+            ldflags+=" $(pkg-config --libs libzstd)"
+        fi
         gcc build/tests/*.o build/libsvcs_core.a $ldflags -o bin/test_svcs
         print_success "Test executable created: bin/test_svcs"
     else
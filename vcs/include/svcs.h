@@ -19,6 +19,8 @@ extern "C" {
 #define SVCS_MAX_PATH 4096
 #define SVCS_MAX_MESSAGE 1024
 #define SVCS_SIGNATURE_SIZE 256
+#define SVCS_REPOSITORY_FORMAT_VERSION 1
+#define SVCS_FSMONITOR_TOKEN_SIZE 64
 
 // Error codes
 typedef enum {
@@ -55,11 +57,25 @@ typedef struct {
     uint8_t bytes[SVCS_HASH_SIZE];
 } svcs_hash_t;
 
+// Object hash algorithms, selected per repository by core.objecthash
+typedef enum {
+    SVCS_HASH_SHA3_256 = 0,
+    SVCS_HASH_BLAKE3 = 1
+} svcs_hash_algo_t;
+
+// Incremental hash context
+typedef struct {
+    svcs_hash_algo_t algo;
+    void *state;        // Digest state for algo
+    void *thread_slot;  // Per-thread slot state was borrowed from, NULL if allocated
+} svcs_hash_ctx_t;
+
 // Object header
 typedef struct {
     svcs_object_type_t type;
     size_t size;
     svcs_hash_t hash;
+    void *data;  // Object content, owned by the object after svcs_object_read
 } svcs_object_t;
 
 // Tree entry
@@ -87,21 +103,68 @@ typedef struct {
     char signature[SVCS_SIGNATURE_SIZE];
 } svcs_commit_t;
 
-// Index entry
+#define SVCS_COMMIT_MAX_PARENTS 16
+#define SVCS_GENERATION_INFINITY UINT32_MAX
+
+// Commit metadata needed to walk history, from the commit graph when the
+// commit is in it and parsed from the commit object otherwise
 typedef struct {
-    char path[SVCS_MAX_PATH];
+    svcs_hash_t tree;
+    svcs_hash_t parents[SVCS_COMMIT_MAX_PARENTS];
+    size_t parent_count;
+    int64_t time;         // Committer time
+    uint32_t generation;  // 1 for root commits; SVCS_GENERATION_INFINITY outside the graph
+} svcs_commit_info_t;
+
+// Index entry. path lives in the index's path arena and stays valid until
+// the index is freed. The stat fields are what the file had when it was
+// last hashed; status trusts a file whose stat data still matches.
+typedef struct {
+    const char *path;
     svcs_hash_t hash;
     uint32_t mode;
     time_t mtime;
+    uint32_t mtime_nsec;
+    time_t ctime;
+    uint32_t ctime_nsec;
+    uint64_t dev;
+    uint64_t ino;
     size_t size;
     svcs_file_status_t status;
+    uint32_t flags;  // In-memory state, not saved
 } svcs_index_entry_t;
 
+// Flags for svcs_index_add_paths
+#define SVCS_ADD_IGNORE_MISSING (1 << 0)  // Skip paths that do not exist instead of failing
+
+// Flags for svcs_index_untracked
+#define SVCS_UNTRACKED_FILES (1 << 0)    // List files not in the index
+#define SVCS_UNTRACKED_IGNORED (1 << 1)  // List paths matching the ignore rules
+
+// Storage for index entry paths (opaque, see index.c)
+typedef struct svcs_path_arena svcs_path_arena_t;
+
+// Untracked-file cache (opaque, see untracked.c)
+typedef struct svcs_untracked_cache svcs_untracked_cache_t;
+
+// Tree hashes per directory (opaque, see cache_tree.c)
+typedef struct svcs_cache_tree svcs_cache_tree_t;
+
+// Split index state (opaque, see index.c)
+typedef struct svcs_split_index svcs_split_index_t;
+
 // Index
 typedef struct {
     size_t entry_count;
-    svcs_index_entry_t *entries;
-    time_t timestamp;
+    size_t entry_capacity;
+    svcs_index_entry_t *entries;  // Sorted by path
+    time_t timestamp;         // mtime of the index file; entries not older
+    uint32_t timestamp_nsec;  // than it are racy and always re-hashed
+    char fsmonitor_token[SVCS_FSMONITOR_TOKEN_SIZE];  // Empty without a monitor
+    svcs_untracked_cache_t *untracked;  // NULL until untracked files are listed
+    svcs_split_index_t *split;          // NULL unless split or core.splitindex is set
+    svcs_cache_tree_t *cache_tree;      // NULL until a tree is built
+    svcs_path_arena_t *paths;
 } svcs_index_t;
 
 // Branch
@@ -111,6 +174,49 @@ typedef struct {
     int is_current;
 } svcs_branch_t;
 
+// Pack file (opaque, see pack.c)
+typedef struct svcs_pack svcs_pack_t;
+
+// Commit graph file (opaque, see commit_graph.c)
+typedef struct svcs_commit_graph svcs_commit_graph_t;
+
+// Index over all packs (opaque, see midx.c)
+typedef struct svcs_midx svcs_midx_t;
+
+// Reachability bitmaps of a pack (opaque, see pack_bitmap.c)
+typedef struct svcs_pack_bitmap svcs_pack_bitmap_t;
+
+// Loose object codec settings and dictionaries (opaque, see compress.c)
+typedef struct svcs_codecs svcs_codecs_t;
+
+// Known loose objects (opaque, see loose_cache.c)
+typedef struct svcs_loose_cache svcs_loose_cache_t;
+
+// Writes made durable together (opaque, see write_batch.c)
+typedef struct svcs_write_batch svcs_write_batch_t;
+
+// Cache of decoded objects (opaque, see object_cache.c)
+typedef struct svcs_object_cache svcs_object_cache_t;
+
+// Hits, misses and evictions count up from when the repository was opened
+typedef struct {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t size;      // Bytes of object content held
+    size_t max_size;
+    size_t count;     // Objects held
+} svcs_cache_stats_t;
+
+// Result of svcs_gc
+typedef struct {
+    size_t reachable_objects;
+    size_t pruned_objects;   // Unreachable loose objects deleted
+    size_t removed_packs;    // Packs replaced by the new one
+    uint64_t size_before;    // Bytes under objects/
+    uint64_t size_after;
+} svcs_gc_stats_t;
+
 // Repository
 typedef struct {
     char path[SVCS_MAX_PATH];
@@ -118,6 +224,15 @@ typedef struct {
     char work_dir[SVCS_MAX_PATH];
     svcs_index_t *index;
     svcs_branch_t *current_branch;
+    svcs_pack_t *packs;
+    svcs_midx_t *midx;
+    svcs_hash_algo_t hash_algo;  // Object hash from core.objecthash
+    svcs_codecs_t *codecs;
+    svcs_object_cache_t *object_cache;
+    svcs_loose_cache_t *loose_cache;
+    svcs_write_batch_t *write_batch;  // Open write batch, if any
+    svcs_commit_graph_t *commit_graph;
+    svcs_pack_bitmap_t *pack_bitmap;
 } svcs_repository_t;
 
 // Diff line
@@ -157,8 +272,41 @@ int svcs_repository_is_valid(const char *path);
 
 // Object management
 svcs_error_t svcs_object_read(svcs_repository_t *repo, const svcs_hash_t *hash, svcs_object_t **obj);
+svcs_error_t svcs_object_info(svcs_repository_t *repo, const svcs_hash_t *hash,
+                              svcs_object_type_t *type, size_t *size);
 svcs_error_t svcs_object_write(svcs_repository_t *repo, svcs_object_t *obj);
 void svcs_object_free(svcs_object_t *obj);
+int svcs_object_exists(svcs_repository_t *repo, const svcs_hash_t *hash);
+svcs_error_t svcs_object_create_blob(svcs_repository_t *repo, const char *file_path, svcs_hash_t *hash);
+
+// Write batches. Objects, refs and the index written between begin and
+// commit become durable together with a constant number of flushes, and
+// appear on disk only once commit succeeds. Batches nest; only the
+// outermost commit publishes. Repository files written in a batch are not
+// visible to reads until then.
+svcs_error_t svcs_write_batch_begin(svcs_repository_t *repo);
+svcs_error_t svcs_write_batch_commit(svcs_repository_t *repo);
+void svcs_write_batch_abort(svcs_repository_t *repo);
+
+// Object cache. The limit comes from core.objectcachesize (default 32 MiB);
+// a limit of 0 disables caching.
+void svcs_object_cache_set_limit(svcs_repository_t *repo, size_t max_bytes);
+void svcs_object_cache_stats(svcs_repository_t *repo, svcs_cache_stats_t *stats);
+
+// Pack files
+svcs_error_t svcs_pack_write(svcs_repository_t *repo, const svcs_hash_t *hashes, size_t count, svcs_hash_t *pack_hash);
+svcs_error_t svcs_pack_list_loose(svcs_repository_t *repo, svcs_hash_t **hashes, size_t *count);
+
+// Multi-pack index: one sorted table mapping every packed object to its
+// pack and offset, kept up to date as packs are written and removed
+svcs_error_t svcs_midx_write(svcs_repository_t *repo);
+size_t svcs_midx_pack_count(svcs_repository_t *repo);
+size_t svcs_midx_object_count(svcs_repository_t *repo);
+
+// Garbage collection. Packs everything reachable from refs, HEAD, reflogs
+// and the index, and deletes unreachable loose objects and packs older than
+// prune_expire seconds (negative for the default of two weeks).
+svcs_error_t svcs_gc(svcs_repository_t *repo, long prune_expire, svcs_gc_stats_t *stats);
 
 // Hash functions
 void svcs_hash_init(svcs_hash_t *hash);
@@ -167,18 +315,77 @@ void svcs_hash_final(svcs_hash_t *hash);
 void svcs_hash_to_string(const svcs_hash_t *hash, char *str);
 svcs_error_t svcs_hash_from_string(svcs_hash_t *hash, const char *str);
 int svcs_hash_compare(const svcs_hash_t *a, const svcs_hash_t *b);
+svcs_error_t svcs_hash_file(const char *path, svcs_hash_t *hash);
+svcs_error_t svcs_hash_object(svcs_object_type_t type, const void *data, size_t size, svcs_hash_t *hash);
+const char* svcs_hash_algo_name(svcs_hash_algo_t algo);
+svcs_error_t svcs_hash_algo_from_name(const char *name, svcs_hash_algo_t *algo);
+svcs_error_t svcs_hash_file_algo(svcs_hash_algo_t algo, const char *path, svcs_hash_t *hash);
+svcs_error_t svcs_hash_object_algo(svcs_hash_algo_t algo, svcs_object_type_t type,
+                                   const void *data, size_t size, svcs_hash_t *hash);
+svcs_error_t svcs_hash_ctx_init(svcs_hash_ctx_t *ctx);
+svcs_error_t svcs_hash_ctx_init_algo(svcs_hash_ctx_t *ctx, svcs_hash_algo_t algo);
+svcs_error_t svcs_hash_ctx_init_object(svcs_hash_ctx_t *ctx, svcs_hash_algo_t algo,
+                                       svcs_object_type_t type, size_t size);
+void svcs_hash_ctx_update(svcs_hash_ctx_t *ctx, const void *data, size_t len);
+void svcs_hash_ctx_final(svcs_hash_ctx_t *ctx, svcs_hash_t *hash);
 
 // Index management
 svcs_error_t svcs_index_load(svcs_repository_t *repo);
+void svcs_index_free(svcs_index_t *index);
 svcs_error_t svcs_index_save(svcs_repository_t *repo);
 svcs_error_t svcs_index_add(svcs_repository_t *repo, const char *path);
+svcs_error_t svcs_index_add_paths(svcs_repository_t *repo, const char *const *paths, size_t count, int flags);
 svcs_error_t svcs_index_remove(svcs_repository_t *repo, const char *path);
 svcs_error_t svcs_index_status(svcs_repository_t *repo, svcs_index_entry_t **entries, size_t *count);
+// Lists worktree paths by SVCS_UNTRACKED_* flags, sorted within each
+// directory; an ignored directory is listed but not entered. Only
+// directories changed since the last call are read. Free *paths with free().
+svcs_error_t svcs_index_untracked(svcs_repository_t *repo, int flags, char ***paths, size_t *count);
+
+// Sparse checkout in cone mode. dirs are relative to the worktree; the
+// files at the top level, under dirs and directly inside their parents stay
+// checked out. Every other directory leaves the worktree and is kept in the
+// index as a single entry holding its tree. Fails with SVCS_ERROR_EXISTS,
+// changing nothing, if a file to be removed has unstaged changes or one to
+// be written is in the way.
+svcs_error_t svcs_sparse_checkout_set(svcs_repository_t *repo, const char *const *dirs, size_t count);
+svcs_error_t svcs_sparse_checkout_disable(svcs_repository_t *repo);
+
+// Filesystem monitor. svcs_fsmonitor_run watches the worktree with inotify
+// until svcs_fsmonitor_stop is called from another process; while it runs,
+// status only examines the paths it reports as changed. Linux only.
+svcs_error_t svcs_fsmonitor_run(svcs_repository_t *repo);
+svcs_error_t svcs_fsmonitor_stop(svcs_repository_t *repo);
 
 // Commit management
 svcs_error_t svcs_commit_create(svcs_repository_t *repo, const char *message, const char *author, svcs_hash_t *commit_hash);
 svcs_error_t svcs_commit_read(svcs_repository_t *repo, const svcs_hash_t *hash, svcs_commit_t **commit);
 void svcs_commit_free(svcs_commit_t *commit);
+svcs_error_t svcs_commit_info(svcs_repository_t *repo, const svcs_hash_t *hash, svcs_commit_info_t *info);
+svcs_error_t svcs_commit_is_ancestor(svcs_repository_t *repo, const svcs_hash_t *ancestor,
+                                     const svcs_hash_t *descendant, int *result);
+svcs_error_t svcs_commit_merge_base(svcs_repository_t *repo, const svcs_hash_t *one,
+                                    const svcs_hash_t *two, svcs_hash_t *base);
+
+// Commit graph. Every commit reachable from refs, with its tree, parents,
+// time and generation number, in one mapped file so history can be walked
+// without reading commit objects. svcs_gc rewrites it; commits made since
+// are read from their objects.
+svcs_error_t svcs_commit_graph_write(svcs_repository_t *repo, size_t *count);
+size_t svcs_commit_graph_count(svcs_repository_t *repo);
+svcs_error_t svcs_commit_graph_entry(svcs_repository_t *repo, size_t pos, svcs_hash_t *hash, svcs_commit_info_t *info);
+
+// Reachability bitmaps. svcs_gc stores, next to the pack it writes, the set
+// of objects reachable from each ref tip and from a sample of other
+// commits, so these compare whole histories with bitwise operations.
+// Without bitmaps, or for commits newer than the pack, they walk instead.
+svcs_error_t svcs_pack_bitmap_write(svcs_repository_t *repo, const svcs_hash_t *pack_hash, size_t *count);
+size_t svcs_pack_bitmap_count(svcs_repository_t *repo);
+svcs_error_t svcs_commit_ahead_behind(svcs_repository_t *repo, const svcs_hash_t *one, const svcs_hash_t *two,
+                                      size_t *ahead, size_t *behind);
+svcs_error_t svcs_objects_to_send(svcs_repository_t *repo, const svcs_hash_t *want, size_t want_count,
+                                  const svcs_hash_t *have, size_t have_count,
+                                  svcs_hash_t **objects, size_t *count);
 
 // Branch management
 svcs_error_t svcs_branch_create(svcs_repository_t *repo, const char *name, const svcs_hash_t *commit_hash);
@@ -186,6 +393,10 @@ svcs_error_t svcs_branch_list(svcs_repository_t *repo, svcs_branch_t **branches,
 svcs_error_t svcs_branch_checkout(svcs_repository_t *repo, const char *name);
 svcs_error_t svcs_branch_delete(svcs_repository_t *repo, const char *name);
 
+// Refs
+typedef svcs_error_t (*svcs_ref_fn)(const svcs_hash_t *hash, void *arg);
+svcs_error_t svcs_refs_for_each(svcs_repository_t *repo, svcs_ref_fn fn, void *arg);
+
 // Diff engine
 svcs_error_t svcs_diff_files(const char *old_path, const char *new_path, svcs_diff_file_t **diff);
 svcs_error_t svcs_diff_commits(svcs_repository_t *repo, const svcs_hash_t *old_hash, const svcs_hash_t *new_hash, svcs_diff_file_t **diffs, size_t *count);
@@ -194,6 +405,8 @@ void svcs_diff_free(svcs_diff_file_t *diff);
 // Compression
 svcs_error_t svcs_compress(const void *input, size_t input_size, void **output, size_t *output_size);
 svcs_error_t svcs_decompress(const void *input, size_t input_size, void **output, size_t *output_size);
+svcs_error_t svcs_decompress_into(const void *input, size_t input_size, void *output, size_t output_size);
+svcs_error_t svcs_compression_train_dict(svcs_repository_t *repo, size_t max_samples, uint32_t *dict_id);
 
 // Utilities
 svcs_error_t svcs_file_read(const char *path, void **data, size_t *size);
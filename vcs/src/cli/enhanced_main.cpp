@@ -6,6 +6,7 @@
 #include "advanced_parser.hpp"
 #include "dag.hpp"
 #include "terminal_ui.hpp"
+#include "performance_monitor.hpp"
 
 using namespace svcs::cli;
 using namespace svcs::core;
@@ -15,6 +16,7 @@ class EnhancedVCSApplication {
 private:
     std::unique_ptr<AdvancedArgumentParser> parser;
     std::unique_ptr<TerminalUI> ui;
+    svcs::CacheMonitor cache_monitor;  // Attached to repository; outlives it
     svcs_repository_t* repository = nullptr;
     std::unique_ptr<CommitDAG> dag;
     
@@ -190,6 +192,54 @@ private:
                 {"branch"},
                 [this](const auto& opts, const auto& args) { return handle_merge(opts, args); }
             })
+            .subcommand({
+                "maintenance",
+                "Run repository maintenance tasks",
+                "Run a maintenance task. Tasks: train-dict (train a zstd dictionary\n"
+                "from sampled blobs and use it to compress new small objects),\n"
+                "commit-graph (rewrite the commit graph used to walk history),\n"
+                "multi-pack-index (index objects across all packs).",
+                {
+                    make_int_option("", "samples", "Maximum number of blobs to sample", false, 1000),
+                },
+                {"task"},
+                [this](const auto& opts, const auto& args) { return handle_maintenance(opts, args); }
+            })
+            .subcommand({
+                "fsmonitor",
+                "Watch the working tree so status can skip unchanged files",
+                "Run a filesystem monitor in the foreground. While it runs, status\n"
+                "only examines the files it reports as changed.",
+                {
+                    make_flag_option("", "stop", "Stop the running monitor"),
+                },
+                {},
+                [this](const auto& opts, const auto& args) { return handle_fsmonitor(opts, args); }
+            })
+            .subcommand({
+                "sparse-checkout",
+                "Check out only some directories",
+                "Keep the given directories, their parents' files and the top-level\n"
+                "files in the working tree. Other directories are removed and kept in\n"
+                "the index as one entry each.",
+                {
+                    make_flag_option("", "disable", "Check out the whole working tree again"),
+                },
+                {"directories"},
+                [this](const auto& opts, const auto& args) { return handle_sparse_checkout(opts, args); }
+            })
+            .subcommand({
+                "gc",
+                "Pack reachable objects and prune unreachable ones",
+                "Write everything reachable from refs, HEAD, reflogs and the index\n"
+                "into a single pack, and delete unreachable objects older than the\n"
+                "prune expiry.",
+                {
+                    make_int_option("", "prune-expire", "Keep unreachable objects younger than this many days", false, 14),
+                },
+                {},
+                [this](const auto& opts, const auto& args) { return handle_gc(opts, args); }
+            })
             .subcommand({
                 "interactive",
                 "Interactive mode",
@@ -210,6 +260,7 @@ private:
                 ui->print_info("Use 'svcs init' to initialize a new repository");
                 return 1;
             }
+            cache_monitor.attach(repository);
             
             // Load DAG for commands that need commit history
             if (result.subcommand == "log" || result.subcommand == "branch" || 
@@ -258,20 +309,29 @@ private:
             ui->print_info("Adding all files...");
             // TODO: Implement add all
         } else {
+            std::vector<const char*> paths;
+            paths.reserve(args.size());
             for (const auto& file : args) {
                 if (verbose || dry_run) {
                     ui->print_info((dry_run ? "Would add: " : "Adding: ") + file);
                 }
                 
-                if (!dry_run) {
-                    svcs_error_t err = svcs_index_add(repository, file.c_str());
-                    if (err == SVCS_ERROR_NOT_FOUND) {
-                        ui->print_error("File not found: " + file);
-                        return 1;
-                    } else if (err != SVCS_OK) {
-                        ui->print_error("Failed to add file: " + file);
-                        return 1;
-                    }
+                if (!dry_run && !svcs_file_exists(file.c_str())) {
+                    ui->print_error("File not found: " + file);
+                    return 1;
+                }
+                paths.push_back(file.c_str());
+            }
+            
+            // Blobs are hashed and stored in parallel; the index is saved once
+            if (!dry_run) {
+                svcs_error_t err = svcs_index_add_paths(repository, paths.data(), paths.size(), 0);
+                if (err == SVCS_ERROR_NOT_FOUND) {
+                    ui->print_error("File disappeared while adding");
+                    return 1;
+                } else if (err != SVCS_OK) {
+                    ui->print_error("Failed to add files");
+                    return 1;
                 }
             }
         }
@@ -316,6 +376,7 @@ private:
     int handle_status(const std::map<std::string, ArgumentValue>& options, const std::vector<std::string>& args) {
         bool short_format = options.count("short") > 0;
         bool porcelain = options.count("porcelain") > 0;
+        bool show_ignored = options.count("ignored") > 0;
         
         svcs_index_entry_t* entries;
         size_t count;
@@ -326,24 +387,58 @@ private:
             return 1;
         }
         
-        if (count == 0) {
+        // Untracked files, then ignored ones if asked for; the second
+        // listing reuses the directories the first one cached
+        char** untracked = nullptr;
+        size_t untracked_count = 0;
+        char** ignored = nullptr;
+        size_t ignored_count = 0;
+        err = svcs_index_untracked(repository, SVCS_UNTRACKED_FILES, &untracked, &untracked_count);
+        if (err == SVCS_OK && show_ignored) {
+            err = svcs_index_untracked(repository, SVCS_UNTRACKED_IGNORED, &ignored, &ignored_count);
+        }
+        if (err != SVCS_OK) {
+            ui->print_error("Failed to list untracked files");
+            free(entries);
+            free(untracked);
+            return 1;
+        }
+        
+        if (count == 0 && untracked_count == 0 && ignored_count == 0) {
             if (!short_format && !porcelain) {
                 ui->print_info("Working tree clean");
             }
+            free(entries);
+            free(untracked);
+            free(ignored);
             return 0;
         }
         
         if (!short_format && !porcelain) {
             ui->print_header("Repository Status");
-            ui->print_info("Changes to be committed:");
+            if (count > 0) {
+                ui->print_info("Changes to be committed:");
+            }
         }
         
         // Create table for status display
         Table status_table({
-            {"Status", 8, Table::Column::LEFT, Color::BRIGHT_WHITE},
+            {"Status", 9, Table::Column::LEFT, Color::BRIGHT_WHITE},
             {"File", -1, Table::Column::LEFT, Color::RESET}
         });
         
+        auto add_row = [&](const std::string& status_str, const std::string& short_str,
+                           Color status_color, const char* path) {
+            if (short_format || porcelain) {
+                std::cout << (porcelain ? status_str : short_str) << " " << path << std::endl;
+            } else {
+                status_table.add_row({
+                    {status_str, status_color},
+                    {path}
+                });
+            }
+        };
+        
         for (size_t i = 0; i < count; i++) {
             std::string status_str;
             Color status_color = Color::RESET;
@@ -366,15 +461,14 @@ private:
                     break;
             }
             
-            if (short_format || porcelain) {
-                std::cout << (porcelain ? status_str : status_str.substr(0, 1)) 
-                         << " " << entries[i].path << std::endl;
-            } else {
-                status_table.add_row({
-                    {status_str, status_color},
-                    {entries[i].path}
-                });
-            }
+            add_row(status_str, status_str.substr(0, 1), status_color, entries[i].path);
+        }
+        
+        for (size_t i = 0; i < untracked_count; i++) {
+            add_row("untracked", "?", Color::BRIGHT_RED, untracked[i]);
+        }
+        for (size_t i = 0; i < ignored_count; i++) {
+            add_row("ignored", "!", Color::RESET, ignored[i]);
         }
         
         if (!short_format && !porcelain) {
@@ -382,6 +476,8 @@ private:
         }
         
         free(entries);
+        free(untracked);
+        free(ignored);
         return 0;
     }
     
@@ -417,11 +513,13 @@ private:
             std::cout << graph << std::endl;
         } else if (oneline) {
             for (const auto& commit : commits) {
+                dag->load_details(commit);
                 std::cout << commit->short_hash() << " " << commit->message << std::endl;
             }
         } else {
             // Detailed log format
             for (const auto& commit : commits) {
+                dag->load_details(commit);
                 ui->print_styled(StyledText("commit " + commit->hash_string(), Color::BRIGHT_YELLOW));
                 ui->print_line("Author: " + commit->author);
                 
@@ -552,6 +650,150 @@ private:
         return 0;
     }
     
+    int handle_maintenance(const std::map<std::string, ArgumentValue>& options, const std::vector<std::string>& args) {
+        if (args.empty()) {
+            ui->print_error("Maintenance task required");
+            return 1;
+        }
+        
+        const std::string& task = args[0];
+        if (task == "commit-graph") {
+            size_t count = 0;
+            if (svcs_commit_graph_write(repository, &count) != SVCS_OK) {
+                ui->print_error("Failed to write commit graph");
+                return 1;
+            }
+            ui->print_success("Wrote commit graph with " + std::to_string(count) + " commits");
+            return 0;
+        }
+        
+        if (task == "multi-pack-index") {
+            if (svcs_midx_write(repository) != SVCS_OK) {
+                ui->print_error("Failed to write multi-pack index");
+                return 1;
+            }
+            ui->print_success("Indexed " + std::to_string(svcs_midx_object_count(repository)) + " objects in " +
+                              std::to_string(svcs_midx_pack_count(repository)) + " packs");
+            return 0;
+        }
+        
+        if (task != "train-dict") {
+            ui->print_error("Unknown maintenance task: " + task);
+            return 1;
+        }
+        
+        int samples = 1000;
+        auto samples_it = options.find("samples");
+        if (samples_it != options.end()) {
+            samples = std::get<int>(samples_it->second);
+        }
+        
+        uint32_t dict_id = 0;
+        svcs_error_t err = svcs_compression_train_dict(repository, samples > 0 ? samples : 1, &dict_id);
+        if (err == SVCS_ERROR_INVALID) {
+            ui->print_error("Dictionary training requires zstd support and loose blobs to sample");
+            return 1;
+        } else if (err != SVCS_OK) {
+            ui->print_error("Failed to train dictionary (not enough small blobs?)");
+            return 1;
+        }
+        
+        ui->print_success("Trained compression dictionary " + std::to_string(dict_id));
+        return 0;
+    }
+    
+    int handle_fsmonitor(const std::map<std::string, ArgumentValue>& options, const std::vector<std::string>& args) {
+        if (options.count("stop")) {
+            svcs_error_t err = svcs_fsmonitor_stop(repository);
+            if (err == SVCS_ERROR_NOT_FOUND) {
+                ui->print_error("No filesystem monitor is running");
+                return 1;
+            } else if (err != SVCS_OK) {
+                ui->print_error("Failed to stop the filesystem monitor");
+                return 1;
+            }
+            ui->print_success("Stopped the filesystem monitor");
+            return 0;
+        }
+        
+        ui->print_info("Watching " + std::string(repository->work_dir) + " (stop with 'svcs fsmonitor --stop')");
+        svcs_error_t err = svcs_fsmonitor_run(repository);
+        if (err == SVCS_ERROR_EXISTS) {
+            ui->print_error("A filesystem monitor is already running");
+            return 1;
+        } else if (err != SVCS_OK) {
+            ui->print_error("Filesystem monitor failed");
+            return 1;
+        }
+        return 0;
+    }
+    
+    int handle_sparse_checkout(const std::map<std::string, ArgumentValue>& options, const std::vector<std::string>& args) {
+        svcs_error_t err;
+        if (options.count("disable")) {
+            err = svcs_sparse_checkout_disable(repository);
+        } else {
+            std::vector<const char*> dirs;
+            for (const auto& dir : args) {
+                dirs.push_back(dir.c_str());
+            }
+            err = svcs_sparse_checkout_set(repository, dirs.data(), dirs.size());
+        }
+        
+        if (err == SVCS_ERROR_EXISTS) {
+            ui->print_error("Files with unstaged changes or in the way would be overwritten");
+            return 1;
+        } else if (err != SVCS_OK) {
+            ui->print_error("Failed to update the sparse checkout");
+            return 1;
+        }
+        ui->print_success("Updated the sparse checkout");
+        return 0;
+    }
+    
+    int handle_gc(const std::map<std::string, ArgumentValue>& options, const std::vector<std::string>& args) {
+        int expire_days = 14;
+        auto expire_it = options.find("prune-expire");
+        if (expire_it != options.end()) {
+            expire_days = std::get<int>(expire_it->second);
+        }
+        
+        svcs_gc_stats_t stats;
+        svcs_error_t err;
+        {
+            PROFILE_OPERATION("gc");
+            err = svcs_gc(repository, expire_days >= 0 ? expire_days * 24L * 60 * 60 : -1, &stats);
+            if (err == SVCS_OK) {
+                double reclaimed = stats.size_before > stats.size_after ?
+                    (double)(stats.size_before - stats.size_after) : 0.0;
+                _prof.add_custom_metric("bytes_reclaimed", reclaimed);
+                _prof.add_custom_metric("objects_packed", (double)stats.reachable_objects);
+                _prof.add_custom_metric("objects_pruned", (double)stats.pruned_objects);
+            }
+        }
+        
+        if (err == SVCS_ERROR_CORRUPT) {
+            ui->print_error("Repository refers to missing objects; nothing was deleted");
+            return 1;
+        } else if (err != SVCS_OK) {
+            ui->print_error("Garbage collection failed");
+            return 1;
+        }
+        
+        auto metrics = svcs::PerformanceMonitor::instance().get_operation_metrics("gc");
+        ui->print_success("Packed " + std::to_string(stats.reachable_objects) + " objects, pruned " +
+                          std::to_string(stats.pruned_objects) + " unreachable objects and " +
+                          std::to_string(stats.removed_packs) + " old packs");
+        ui->print_info("Reclaimed " + std::to_string((uint64_t)metrics.custom_metrics["bytes_reclaimed"]) +
+                       " bytes in " + std::to_string(metrics.execution_time.count()) + " ms");
+        cache_monitor.poll();
+        auto cache = cache_monitor.get_stats("objects");
+        ui->print_info("Object cache: " + std::to_string(cache.hits) + " hits, " +
+                       std::to_string(cache.misses) + " misses, " +
+                       std::to_string(cache.evictions) + " evictions");
+        return 0;
+    }
+    
     int handle_interactive(const std::map<std::string, ArgumentValue>& options, const std::vector<std::string>& args) {
         ui->print_header("SnippetVCS Interactive Mode");
         
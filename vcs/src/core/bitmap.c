@@ -0,0 +1,155 @@
+#include "svcs.h"
+#include "internal.h"
+
+// Plain bitmaps for combining reachability sets, and the EWAH run-length
+// encoding they are stored in.
+//
+// An EWAH stream is a sequence of 64-bit big-endian words. Each run starts
+// with a marker word:
+//
+//   bit 0        value of the clean words (all zeros or all ones)
+//   bits 1-32    number of clean words
+//   bits 33-63   number of literal words that follow the marker
+//
+// Long stretches of history that a commit does or does not reach collapse
+// into a single marker, while mixed regions are copied as they are.
+
+#define EWAH_RUN_BIT 1ull
+#define EWAH_MAX_RUN 0xffffffffull
+#define EWAH_MAX_LITERALS 0x7fffffffull
+#define EWAH_HEADER_SIZE 8  // Bitmap word count, stream word count
+
+svcs_error_t svcs_bitmap_init(svcs_bitmap_t *bitmap, size_t bits) {
+    bitmap->word_count = (bits + 63) / 64;
+    bitmap->words = calloc(bitmap->word_count ? bitmap->word_count : 1, sizeof(uint64_t));
+    return bitmap->words ? SVCS_OK : SVCS_ERROR_MEMORY;
+}
+
+void svcs_bitmap_free(svcs_bitmap_t *bitmap) {
+    if (!bitmap) return;
+
+    free(bitmap->words);
+    bitmap->words = NULL;
+    bitmap->word_count = 0;
+}
+
+void svcs_bitmap_set(svcs_bitmap_t *bitmap, size_t bit) {
+    bitmap->words[bit / 64] |= 1ull << (bit % 64);
+}
+
+int svcs_bitmap_test(const svcs_bitmap_t *bitmap, size_t bit) {
+    return (bitmap->words[bit / 64] >> (bit % 64)) & 1;
+}
+
+// Both bitmaps must have been made for the same number of bits
+void svcs_bitmap_and(svcs_bitmap_t *bitmap, const svcs_bitmap_t *other) {
+    for (size_t i = 0; i < bitmap->word_count; i++) {
+        bitmap->words[i] &= other->words[i];
+    }
+}
+
+void svcs_bitmap_and_not(svcs_bitmap_t *bitmap, const svcs_bitmap_t *other) {
+    for (size_t i = 0; i < bitmap->word_count; i++) {
+        bitmap->words[i] &= ~other->words[i];
+    }
+}
+
+size_t svcs_bitmap_count(const svcs_bitmap_t *bitmap) {
+    size_t count = 0;
+    for (size_t i = 0; i < bitmap->word_count; i++) {
+        count += (size_t)__builtin_popcountll(bitmap->words[i]);
+    }
+    return count;
+}
+
+static int is_clean(uint64_t word) {
+    return word == 0 || word == ~0ull;
+}
+
+static svcs_error_t append_word(svcs_buffer_t *buf, uint64_t value) {
+    uint8_t word[8];
+    svcs_put_be64(word, value);
+    return svcs_buffer_append(buf, word, 8);
+}
+
+// Appends the bitmap's word count, the stream's word count and the stream
+svcs_error_t svcs_ewah_encode(const svcs_bitmap_t *bitmap, svcs_buffer_t *buf) {
+    size_t start = buf->size;
+    uint8_t header[EWAH_HEADER_SIZE] = {0};
+    svcs_error_t err = svcs_buffer_append(buf, header, sizeof(header));
+
+    uint32_t stream_words = 0;
+    size_t i = 0;
+    while (i < bitmap->word_count && err == SVCS_OK) {
+        uint64_t run_value = 0;
+        uint64_t run = 0;
+        if (is_clean(bitmap->words[i])) {
+            run_value = bitmap->words[i];
+            while (i < bitmap->word_count && bitmap->words[i] == run_value && run < EWAH_MAX_RUN) {
+                run++;
+                i++;
+            }
+        }
+
+        size_t literals = i;
+        while (literals < bitmap->word_count && !is_clean(bitmap->words[literals]) &&
+               literals - i < EWAH_MAX_LITERALS) {
+            literals++;
+        }
+
+        uint64_t marker = (run_value ? EWAH_RUN_BIT : 0) | (run << 1) | ((uint64_t)(literals - i) << 33);
+        err = append_word(buf, marker);
+        stream_words++;
+        for (; i < literals && err == SVCS_OK; i++) {
+            err = append_word(buf, bitmap->words[i]);
+            stream_words++;
+        }
+    }
+
+    if (err == SVCS_OK) {
+        svcs_put_be32(buf->data + start, (uint32_t)bitmap->word_count);
+        svcs_put_be32(buf->data + start + 4, stream_words);
+    }
+    return err;
+}
+
+// ORs an encoded bitmap into a plain one of the same size, without
+// expanding it first. *used is set to the encoded length in bytes.
+svcs_error_t svcs_ewah_or(const uint8_t *data, size_t size, svcs_bitmap_t *bitmap, size_t *used) {
+    if (size < EWAH_HEADER_SIZE) {
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    uint32_t word_count = svcs_get_be32(data);
+    uint32_t stream_words = svcs_get_be32(data + 4);
+    if (word_count != bitmap->word_count || stream_words > (size - EWAH_HEADER_SIZE) / 8) {
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    const uint8_t *stream = data + EWAH_HEADER_SIZE;
+    size_t pos = 0;
+    size_t out = 0;
+    while (pos < stream_words) {
+        uint64_t marker = svcs_get_be64(stream + pos++ * 8);
+        uint64_t run = (marker >> 1) & EWAH_MAX_RUN;
+        uint64_t literals = marker >> 33;
+        if (run > word_count - out || literals > word_count - out - run || literals > stream_words - pos) {
+            return SVCS_ERROR_CORRUPT;
+        }
+
+        if (marker & EWAH_RUN_BIT) {
+            for (uint64_t r = 0; r < run; r++) {
+                bitmap->words[out + r] = ~0ull;
+            }
+        }
+        out += run;
+        for (uint64_t l = 0; l < literals; l++) {
+            bitmap->words[out++] |= svcs_get_be64(stream + pos++ * 8);
+        }
+    }
+
+    if (used) {
+        *used = EWAH_HEADER_SIZE + (size_t)stream_words * 8;
+    }
+    return SVCS_OK;
+}
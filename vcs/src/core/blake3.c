@@ -0,0 +1,175 @@
+#include "svcs.h"
+#include "internal.h"
+
+// Portable BLAKE3 (hash mode only, 32-byte output), following the
+// reference implementation in the BLAKE3 specification. Input is split
+// into 1 KiB chunks whose chaining values are merged into a binary tree
+// using a stack of subtree roots.
+
+#define BLAKE3_CHUNK_START (1 << 0)
+#define BLAKE3_CHUNK_END   (1 << 1)
+#define BLAKE3_PARENT      (1 << 2)
+#define BLAKE3_ROOT        (1 << 3)
+
+static const uint32_t blake3_iv[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+    0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+static const uint8_t blake3_permutation[16] = {
+    2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8
+};
+
+static inline uint32_t rotr32(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static inline uint32_t load_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void g(uint32_t *s, int a, int b, int c, int d, uint32_t mx, uint32_t my) {
+    s[a] = s[a] + s[b] + mx;
+    s[d] = rotr32(s[d] ^ s[a], 16);
+    s[c] = s[c] + s[d];
+    s[b] = rotr32(s[b] ^ s[c], 12);
+    s[a] = s[a] + s[b] + my;
+    s[d] = rotr32(s[d] ^ s[a], 8);
+    s[c] = s[c] + s[d];
+    s[b] = rotr32(s[b] ^ s[c], 7);
+}
+
+// Compress one 64-byte block and return the first 8 output words
+static void compress(const uint32_t cv[8], const uint8_t block[SVCS_BLAKE3_BLOCK_LEN],
+                     uint64_t counter, uint32_t block_len, uint32_t flags, uint32_t out[8]) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = load_le32(block + 4 * i);
+    }
+
+    uint32_t s[16] = {
+        cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+        blake3_iv[0], blake3_iv[1], blake3_iv[2], blake3_iv[3],
+        (uint32_t)counter, (uint32_t)(counter >> 32), block_len, flags
+    };
+
+    for (int round = 0; round < 7; round++) {
+        g(s, 0, 4, 8, 12, m[0], m[1]);
+        g(s, 1, 5, 9, 13, m[2], m[3]);
+        g(s, 2, 6, 10, 14, m[4], m[5]);
+        g(s, 3, 7, 11, 15, m[6], m[7]);
+        g(s, 0, 5, 10, 15, m[8], m[9]);
+        g(s, 1, 6, 11, 12, m[10], m[11]);
+        g(s, 2, 7, 8, 13, m[12], m[13]);
+        g(s, 3, 4, 9, 14, m[14], m[15]);
+
+        uint32_t permuted[16];
+        for (int i = 0; i < 16; i++) {
+            permuted[i] = m[blake3_permutation[i]];
+        }
+        memcpy(m, permuted, sizeof(m));
+    }
+
+    for (int i = 0; i < 8; i++) {
+        out[i] = s[i] ^ s[i + 8];
+    }
+}
+
+static void chunk_reset(svcs_blake3_t *hasher, uint64_t chunk_counter) {
+    memcpy(hasher->chunk_cv, blake3_iv, sizeof(hasher->chunk_cv));
+    hasher->chunk_counter = chunk_counter;
+    memset(hasher->block, 0, sizeof(hasher->block));
+    hasher->block_len = 0;
+    hasher->blocks_compressed = 0;
+}
+
+static size_t chunk_len(const svcs_blake3_t *hasher) {
+    return (size_t)hasher->blocks_compressed * SVCS_BLAKE3_BLOCK_LEN + hasher->block_len;
+}
+
+static uint32_t chunk_start_flag(const svcs_blake3_t *hasher) {
+    return hasher->blocks_compressed == 0 ? BLAKE3_CHUNK_START : 0;
+}
+
+static void parent_cv(const uint32_t left[8], const uint32_t right[8], uint32_t flags, uint32_t out[8]) {
+    uint8_t block[SVCS_BLAKE3_BLOCK_LEN];
+    for (int i = 0; i < 16; i++) {
+        uint32_t word = i < 8 ? left[i] : right[i - 8];
+        block[4 * i] = (uint8_t)word;
+        block[4 * i + 1] = (uint8_t)(word >> 8);
+        block[4 * i + 2] = (uint8_t)(word >> 16);
+        block[4 * i + 3] = (uint8_t)(word >> 24);
+    }
+    compress(blake3_iv, block, 0, SVCS_BLAKE3_BLOCK_LEN, BLAKE3_PARENT | flags, out);
+}
+
+void svcs_blake3_init(svcs_blake3_t *hasher) {
+    chunk_reset(hasher, 0);
+    hasher->cv_stack_len = 0;
+}
+
+void svcs_blake3_update(svcs_blake3_t *hasher, const void *data, size_t len) {
+    const uint8_t *input = data;
+
+    while (len > 0) {
+        // A full chunk is only finalized once more input arrives, since the
+        // last chunk must be compressed with the ROOT flag instead
+        if (chunk_len(hasher) == SVCS_BLAKE3_CHUNK_LEN) {
+            uint32_t cv[8];
+            compress(hasher->chunk_cv, hasher->block, hasher->chunk_counter, hasher->block_len,
+                     chunk_start_flag(hasher) | BLAKE3_CHUNK_END, cv);
+
+            // Merge completed subtrees: one merge per trailing zero bit
+            uint64_t total_chunks = hasher->chunk_counter + 1;
+            while ((total_chunks & 1) == 0) {
+                hasher->cv_stack_len--;
+                parent_cv(hasher->cv_stack[hasher->cv_stack_len], cv, 0, cv);
+                total_chunks >>= 1;
+            }
+            memcpy(hasher->cv_stack[hasher->cv_stack_len++], cv, sizeof(cv));
+
+            chunk_reset(hasher, hasher->chunk_counter + 1);
+        }
+
+        if (hasher->block_len == SVCS_BLAKE3_BLOCK_LEN) {
+            compress(hasher->chunk_cv, hasher->block, hasher->chunk_counter, SVCS_BLAKE3_BLOCK_LEN,
+                     chunk_start_flag(hasher), hasher->chunk_cv);
+            hasher->blocks_compressed++;
+            memset(hasher->block, 0, sizeof(hasher->block));
+            hasher->block_len = 0;
+        }
+
+        size_t want = SVCS_BLAKE3_BLOCK_LEN - hasher->block_len;
+        size_t take = len < want ? len : want;
+        memcpy(hasher->block + hasher->block_len, input, take);
+        hasher->block_len += (uint8_t)take;
+        input += take;
+        len -= take;
+    }
+}
+
+void svcs_blake3_final(const svcs_blake3_t *hasher, uint8_t out[32]) {
+    uint32_t flags = chunk_start_flag(hasher) | BLAKE3_CHUNK_END;
+    uint32_t words[8];
+
+    if (hasher->cv_stack_len == 0) {
+        // Single chunk: the chunk itself is the root
+        compress(hasher->chunk_cv, hasher->block, hasher->chunk_counter, hasher->block_len,
+                 flags | BLAKE3_ROOT, words);
+    } else {
+        uint32_t cv[8];
+        compress(hasher->chunk_cv, hasher->block, hasher->chunk_counter, hasher->block_len, flags, cv);
+
+        for (size_t i = hasher->cv_stack_len; i-- > 0;) {
+            parent_cv(hasher->cv_stack[i], cv, i == 0 ? BLAKE3_ROOT : 0, i == 0 ? words : cv);
+        }
+    }
+
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = (uint8_t)words[i];
+        out[4 * i + 1] = (uint8_t)(words[i] >> 8);
+        out[4 * i + 2] = (uint8_t)(words[i] >> 16);
+        out[4 * i + 3] = (uint8_t)(words[i] >> 24);
+    }
+}
@@ -1,4 +1,6 @@
 #include "svcs.h"
+#include "internal.h"
+#include <sys/stat.h>
 
 svcs_error_t svcs_branch_create(svcs_repository_t *repo, const char *name, const svcs_hash_t *commit_hash) {
     if (!repo || !name || !commit_hash) {
@@ -25,7 +27,7 @@ svcs_error_t svcs_branch_create(svcs_repository_t *repo, const char *name, const
     char content[SVCS_HASH_HEX_SIZE + 1];
     snprintf(content, sizeof(content), "%s\n", hash_str);
     
-    return svcs_file_write(branch_path, content, strlen(content));
+    return svcs_repo_write_file(repo, branch_path, content, strlen(content));
 }
 
 svcs_error_t svcs_branch_list(svcs_repository_t *repo, svcs_branch_t **branches, size_t *count) {
@@ -136,7 +138,7 @@ svcs_error_t svcs_branch_checkout(svcs_repository_t *repo, const char *name) {
     char head_content[SVCS_MAX_PATH];
     snprintf(head_content, sizeof(head_content), "ref: refs/heads/%s\n", name);
     
-    svcs_error_t err = svcs_file_write(head_path, head_content, strlen(head_content));
+    svcs_error_t err = svcs_repo_write_file(repo, head_path, head_content, strlen(head_content));
     if (err != SVCS_OK) {
         return err;
     }
@@ -218,4 +220,77 @@ svcs_error_t svcs_branch_current(svcs_repository_t *repo, char *name, size_t nam
     
     free(head_data);
     return SVCS_ERROR_NOT_FOUND;
-}
\ No newline at end of file
+}
+
+// Call fn with the value of one ref file; symbolic refs are skipped since
+// the ref they name is visited on its own
+static svcs_error_t visit_ref_file(const char *path, svcs_ref_fn fn, void *arg) {
+    void *data;
+    size_t size;
+    if (svcs_file_read(path, &data, &size) != SVCS_OK) {
+        return SVCS_OK; // Deleted while we were looking
+    }
+    
+    char hash_str[SVCS_HASH_HEX_SIZE];
+    int valid = size >= SVCS_HASH_HEX_SIZE - 1;
+    if (valid) {
+        memcpy(hash_str, data, SVCS_HASH_HEX_SIZE - 1);
+        hash_str[SVCS_HASH_HEX_SIZE - 1] = '\0';
+        valid = svcs_is_hex_string(hash_str, SVCS_HASH_HEX_SIZE - 1);
+    }
+    free(data);
+    
+    if (!valid) {
+        return SVCS_OK;
+    }
+    
+    svcs_hash_t hash;
+    svcs_hash_from_string(&hash, hash_str);
+    return fn(&hash, arg);
+}
+
+static svcs_error_t visit_ref_dir(const char *dir_path, svcs_ref_fn fn, void *arg) {
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        return SVCS_OK;
+    }
+    
+    svcs_error_t err = SVCS_OK;
+    struct dirent *entry;
+    while (err == SVCS_OK && (entry = readdir(dir)) != NULL) {
+        // Skip dot files and temp files of writes in progress
+        if (entry->d_name[0] == '.' || strstr(entry->d_name, ".tmp_")) {
+            continue;
+        }
+        
+        char path[SVCS_MAX_PATH];
+        snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+        
+        struct stat st;
+        if (stat(path, &st) != 0) {
+            continue;
+        }
+        err = S_ISDIR(st.st_mode) ? visit_ref_dir(path, fn, arg) : visit_ref_file(path, fn, arg);
+    }
+    
+    closedir(dir);
+    return err;
+}
+
+// Call fn for every ref under refs/ and for HEAD when it is detached. The
+// same commit may be reported more than once.
+svcs_error_t svcs_refs_for_each(svcs_repository_t *repo, svcs_ref_fn fn, void *arg) {
+    if (!repo || !fn) {
+        return SVCS_ERROR_INVALID;
+    }
+    
+    char path[SVCS_MAX_PATH];
+    snprintf(path, sizeof(path), "%s/refs", repo->git_dir);
+    svcs_error_t err = visit_ref_dir(path, fn, arg);
+    
+    if (err == SVCS_OK) {
+        snprintf(path, sizeof(path), "%s/HEAD", repo->git_dir);
+        err = visit_ref_file(path, fn, arg);
+    }
+    return err;
+}
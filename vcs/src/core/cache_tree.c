@@ -0,0 +1,329 @@
+#include "svcs.h"
+#include "internal.h"
+
+// Tree building from the index, and the cache of tree hashes per
+// directory kept in the index as the TREE extension:
+//
+//   count      number of directories (4 bytes)
+//   per directory, sorted by path: the tree hash, then the path and a NUL
+//
+// Trees follow the entry paths as they are stored: each directory holds
+// one entry per file or subdirectory, named by that single component, in
+// name order with directories compared as if their name ended in '/'.
+// A directory in the cache holds exactly the tree its entries would give,
+// so a commit writes only the trees of directories with a change below
+// them. Adding or removing an entry drops the directories above it. gc
+// keeps every cached tree, since a commit may name one without writing it.
+
+typedef struct {
+    char *path;  // "" for the root
+    svcs_hash_t hash;
+} cache_dir_t;
+
+struct svcs_cache_tree {
+    cache_dir_t *dirs;  // Sorted by path
+    size_t count;
+    size_t capacity;
+};
+
+typedef struct {
+    svcs_repository_t *repo;
+    svcs_cache_tree_t *cache;
+    const svcs_index_entry_t *entries;
+} tree_builder_t;
+
+void svcs_cache_tree_free(svcs_cache_tree_t *cache) {
+    if (!cache) return;
+
+    for (size_t i = 0; i < cache->count; i++) {
+        free(cache->dirs[i].path);
+    }
+    free(cache->dirs);
+    free(cache);
+}
+
+static int compare_key(const char *path, const char *key, size_t len) {
+    int cmp = strncmp(path, key, len);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return path[len] != '\0' ? 1 : 0;
+}
+
+// Position of the directory key[0..len), or where it would go
+static int find_dir(const svcs_cache_tree_t *cache, const char *key, size_t len, size_t *pos) {
+    size_t lo = 0, hi = cache->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = compare_key(cache->dirs[mid].path, key, len);
+        if (cmp == 0) {
+            *pos = mid;
+            return 1;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *pos = lo;
+    return 0;
+}
+
+int svcs_cache_tree_lookup(const svcs_cache_tree_t *cache, const char *path, size_t len, svcs_hash_t *hash) {
+    size_t pos;
+    if (!cache || !find_dir(cache, path, len, &pos)) {
+        return 0;
+    }
+    *hash = cache->dirs[pos].hash;
+    return 1;
+}
+
+svcs_error_t svcs_cache_tree_for_each(const svcs_cache_tree_t *cache, svcs_ref_fn fn, void *arg) {
+    svcs_error_t err = SVCS_OK;
+    for (size_t i = 0; cache && i < cache->count && err == SVCS_OK; i++) {
+        err = fn(&cache->dirs[i].hash, arg);
+    }
+    return err;
+}
+
+static svcs_error_t store_dir(svcs_cache_tree_t *cache, const char *path, size_t len, const svcs_hash_t *hash) {
+    size_t pos;
+    if (find_dir(cache, path, len, &pos)) {
+        cache->dirs[pos].hash = *hash;
+        return SVCS_OK;
+    }
+
+    if (cache->count == cache->capacity) {
+        size_t capacity = cache->capacity ? cache->capacity * 2 : 64;
+        cache_dir_t *grown = realloc(cache->dirs, capacity * sizeof(cache_dir_t));
+        if (!grown) {
+            return SVCS_ERROR_MEMORY;
+        }
+        cache->dirs = grown;
+        cache->capacity = capacity;
+    }
+
+    char *copy = malloc(len + 1);
+    if (!copy) {
+        return SVCS_ERROR_MEMORY;
+    }
+    memcpy(copy, path, len);
+    copy[len] = '\0';
+    memmove(&cache->dirs[pos + 1], &cache->dirs[pos], (cache->count - pos) * sizeof(cache_dir_t));
+    cache->dirs[pos].path = copy;
+    cache->dirs[pos].hash = *hash;
+    cache->count++;
+    return SVCS_OK;
+}
+
+static void drop_dir(svcs_cache_tree_t *cache, const char *path, size_t len) {
+    size_t pos;
+    if (find_dir(cache, path, len, &pos)) {
+        free(cache->dirs[pos].path);
+        memmove(&cache->dirs[pos], &cache->dirs[pos + 1], (cache->count - pos - 1) * sizeof(cache_dir_t));
+        cache->count--;
+    }
+}
+
+void svcs_cache_tree_invalidate(svcs_cache_tree_t *cache, const char *path) {
+    if (!cache) return;
+
+    drop_dir(cache, "", 0);
+    for (const char *slash = strchr(path, '/'); slash; slash = strchr(slash + 1, '/')) {
+        drop_dir(cache, path, (size_t)(slash - path));
+    }
+}
+
+svcs_error_t svcs_cache_tree_parse(const uint8_t *data, size_t size, svcs_cache_tree_t **cache) {
+    *cache = NULL;
+    if (size < 4) {
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    const uint8_t *ptr = data + 4;
+    const uint8_t *end = data + size;
+    uint32_t count = svcs_get_be32(data);
+    if (count > (size_t)(end - ptr) / (SVCS_HASH_SIZE + 1)) {
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    svcs_cache_tree_t *result = calloc(1, sizeof(svcs_cache_tree_t));
+    cache_dir_t *dirs = calloc(count ? count : 1, sizeof(cache_dir_t));
+    if (!result || !dirs) {
+        free(result);
+        free(dirs);
+        return SVCS_ERROR_MEMORY;
+    }
+    result->dirs = dirs;
+    result->capacity = count ? count : 1;
+
+    svcs_error_t err = SVCS_OK;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *path = ptr + SVCS_HASH_SIZE;
+        const uint8_t *nul = (size_t)(end - ptr) > SVCS_HASH_SIZE ? memchr(path, '\0', (size_t)(end - path)) : NULL;
+        if (!nul || (result->count > 0 && strcmp(dirs[result->count - 1].path, (const char*)path) >= 0)) {
+            err = SVCS_ERROR_CORRUPT;
+            break;
+        }
+
+        cache_dir_t *dir = &dirs[result->count];
+        memcpy(dir->hash.bytes, ptr, SVCS_HASH_SIZE);
+        dir->path = malloc((size_t)(nul - path) + 1);
+        if (!dir->path) {
+            err = SVCS_ERROR_MEMORY;
+            break;
+        }
+        memcpy(dir->path, path, (size_t)(nul - path) + 1);
+        result->count++;
+        ptr = nul + 1;
+    }
+
+    if (err == SVCS_OK && ptr != end) {
+        err = SVCS_ERROR_CORRUPT;
+    }
+    if (err != SVCS_OK) {
+        svcs_cache_tree_free(result);
+        return err;
+    }
+    *cache = result;
+    return SVCS_OK;
+}
+
+svcs_error_t svcs_cache_tree_write(const svcs_cache_tree_t *cache, svcs_buffer_t *buf) {
+    uint8_t count[4];
+    svcs_put_be32(count, (uint32_t)cache->count);
+    svcs_error_t err = svcs_buffer_append(buf, count, sizeof(count));
+
+    for (size_t i = 0; i < cache->count && err == SVCS_OK; i++) {
+        err = svcs_buffer_append(buf, cache->dirs[i].hash.bytes, SVCS_HASH_SIZE);
+        if (err == SVCS_OK) {
+            err = svcs_buffer_append(buf, cache->dirs[i].path, strlen(cache->dirs[i].path) + 1);
+        }
+    }
+    return err;
+}
+
+// Directories sort as if their name ended in '/', so that a collapsed
+// directory lands where its entries would have been
+static int compare_items(const void *a, const void *b) {
+    const svcs_tree_item_t *x = a;
+    const svcs_tree_item_t *y = b;
+    size_t x_len = strlen(x->name);
+    size_t y_len = strlen(y->name);
+    size_t len = x_len < y_len ? x_len : y_len;
+    int cmp = memcmp(x->name, y->name, len);
+    if (cmp != 0) {
+        return cmp;
+    }
+    unsigned char x_next = x_len > len ? (unsigned char)x->name[len] : (x->mode == SVCS_TREE_MODE_DIR ? '/' : 0);
+    unsigned char y_next = y_len > len ? (unsigned char)y->name[len] : (y->mode == SVCS_TREE_MODE_DIR ? '/' : 0);
+    return (int)x_next - (int)y_next;
+}
+
+// End of the run of entries from first on whose path starts with
+// key[0..len) followed by '/'; the run is contiguous in path order
+static size_t run_end(const svcs_index_entry_t *entries, size_t first, size_t end, const char *key, size_t len) {
+    size_t lo = first + 1, hi = end;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const char *path = entries[mid].path;
+        if (strncmp(path, key, len) == 0 && path[len] == '/') {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Writes the tree of entries[first..end), which all lie below the
+// directory named by the first prefix_len bytes of their paths (without
+// its trailing '/'; nothing for the root)
+static svcs_error_t build_dir(tree_builder_t *b, size_t first, size_t end, size_t prefix_len, svcs_hash_t *hash) {
+    const char *key = b->entries[first].path;
+    size_t key_len = prefix_len > 0 ? prefix_len - 1 : 0;
+    if (svcs_cache_tree_lookup(b->cache, key, key_len, hash)) {
+        return SVCS_OK;
+    }
+
+    svcs_tree_item_t *items = calloc(end - first, sizeof(svcs_tree_item_t));
+    char **names = malloc((end - first) * sizeof(char*));
+    if (!items || !names) {
+        free(items);
+        free(names);
+        return SVCS_ERROR_MEMORY;
+    }
+
+    svcs_error_t err = SVCS_OK;
+    size_t count = 0, name_count = 0;
+    for (size_t i = first; i < end && err == SVCS_OK;) {
+        const svcs_index_entry_t *entry = &b->entries[i];
+        const char *name = entry->path + prefix_len;
+        while (*name == '/') {
+            name++;
+        }
+        const char *slash = strchr(name, '/');
+        svcs_tree_item_t *item = &items[count];
+
+        if (!slash) {
+            item->name = name;
+            item->mode = entry->mode;
+            item->hash = entry->hash;
+            count++;
+            i++;
+            continue;
+        }
+
+        size_t dir_len = (size_t)(slash - entry->path);
+        size_t run = run_end(b->entries, i, end, entry->path, dir_len);
+        char *dir_name = malloc((size_t)(slash - name) + 1);
+        if (!dir_name) {
+            err = SVCS_ERROR_MEMORY;
+            break;
+        }
+        memcpy(dir_name, name, (size_t)(slash - name));
+        dir_name[slash - name] = '\0';
+        names[name_count++] = dir_name;
+
+        item->name = dir_name;
+        item->mode = SVCS_TREE_MODE_DIR;
+        err = build_dir(b, i, run, dir_len + 1, &item->hash);
+        count++;
+        i = run;
+    }
+
+    if (err == SVCS_OK) {
+        if (count > 1) {
+            qsort(items, count, sizeof(svcs_tree_item_t), compare_items);
+        }
+        err = svcs_tree_write(b->repo, items, count, hash);
+    }
+    if (err == SVCS_OK) {
+        err = store_dir(b->cache, key, key_len, hash);
+    }
+
+    for (size_t i = 0; i < name_count; i++) {
+        free(names[i]);
+    }
+    free(names);
+    free(items);
+    return err;
+}
+
+svcs_error_t svcs_tree_build(svcs_repository_t *repo, const svcs_index_entry_t *entries, size_t count,
+                             size_t prefix_len, svcs_hash_t *tree_hash) {
+    if (!repo || !repo->index || !entries || count == 0 || !tree_hash) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    if (!repo->index->cache_tree) {
+        repo->index->cache_tree = calloc(1, sizeof(svcs_cache_tree_t));
+        if (!repo->index->cache_tree) {
+            return SVCS_ERROR_MEMORY;
+        }
+    }
+
+    tree_builder_t builder = { .repo = repo, .cache = repo->index->cache_tree, .entries = entries };
+    return build_dir(&builder, 0, count, prefix_len, tree_hash);
+}
@@ -1,55 +1,52 @@
 #include "svcs.h"
+#include "internal.h"
 
-static svcs_error_t create_tree_from_index(svcs_repository_t *repo, svcs_hash_t *tree_hash) {
-    if (!repo || !tree_hash || !repo->index) {
-        return SVCS_ERROR_INVALID;
-    }
-    
-    if (repo->index->entry_count == 0) {
-        // Empty tree
-        svcs_hash_init(tree_hash);
-        return SVCS_OK;
-    }
-    
-    // Create tree object from index entries
+// Tree entries are "<octal mode> <name>\0<hash>", in name order
+svcs_error_t svcs_tree_write(svcs_repository_t *repo, const svcs_tree_item_t *items, size_t count,
+                             svcs_hash_t *tree_hash) {
     size_t tree_size = 0;
-    for (size_t i = 0; i < repo->index->entry_count; i++) {
-        svcs_index_entry_t *entry = &repo->index->entries[i];
+    for (size_t i = 0; i < count; i++) {
         // Calculate size: mode + space + name + null + hash
-        tree_size += snprintf(NULL, 0, "%o", entry->mode) + 1 + strlen(entry->path) + 1 + SVCS_HASH_SIZE;
+        tree_size += snprintf(NULL, 0, "%o", items[i].mode) + 1 + strlen(items[i].name) + 1 + SVCS_HASH_SIZE;
     }
     
-    void *tree_data = malloc(tree_size);
+    void *tree_data = malloc(tree_size ? tree_size : 1);
     if (!tree_data) {
         return SVCS_ERROR_MEMORY;
     }
     
+    // Hash entries as they are serialized rather than in a second pass
+    svcs_hash_ctx_t ctx;
+    svcs_error_t err = svcs_hash_ctx_init_object(&ctx, repo->hash_algo, SVCS_OBJ_TREE, tree_size);
+    if (err != SVCS_OK) {
+        free(tree_data);
+        return err;
+    }
+    
     char *ptr = (char*)tree_data;
-    for (size_t i = 0; i < repo->index->entry_count; i++) {
-        svcs_index_entry_t *entry = &repo->index->entries[i];
+    for (size_t i = 0; i < count; i++) {
+        char *entry_start = ptr;
         
         // Write mode and name
-        int written = sprintf(ptr, "%o %s", entry->mode, entry->path);
+        int written = sprintf(ptr, "%o %s", items[i].mode, items[i].name);
         ptr += written;
         *ptr++ = '\0';
         
         // Write hash
-        memcpy(ptr, entry->hash.bytes, SVCS_HASH_SIZE);
+        memcpy(ptr, items[i].hash.bytes, SVCS_HASH_SIZE);
         ptr += SVCS_HASH_SIZE;
+        
+        svcs_hash_ctx_update(&ctx, entry_start, ptr - entry_start);
     }
     
-    // Compute tree hash
-    svcs_error_t err = svcs_hash_object(SVCS_OBJ_TREE, tree_data, tree_size, tree_hash);
-    if (err != SVCS_OK) {
-        free(tree_data);
-        return err;
-    }
+    svcs_hash_ctx_final(&ctx, tree_hash);
     
     // Create and write tree object
     svcs_object_t tree_obj = {
         .type = SVCS_OBJ_TREE,
         .size = tree_size,
-        .hash = *tree_hash
+        .hash = *tree_hash,
+        .data = tree_data
     };
     
     err = svcs_object_write(repo, &tree_obj);
@@ -58,11 +55,52 @@ static svcs_error_t create_tree_from_index(svcs_repository_t *repo, svcs_hash_t
     return err;
 }
 
-svcs_error_t svcs_commit_create(svcs_repository_t *repo, const char *message, const char *author, svcs_hash_t *commit_hash) {
-    if (!repo || !message || !author || !commit_hash) {
+svcs_error_t svcs_tree_next(const svcs_object_t *tree, size_t *offset, svcs_tree_item_t *item) {
+    const char *ptr = (const char*)tree->data + *offset;
+    const char *end = (const char*)tree->data + tree->size;
+    if (ptr >= end) {
+        return SVCS_ERROR_NOT_FOUND;
+    }
+    
+    const char *nul = memchr(ptr, '\0', (size_t)(end - ptr));
+    const char *space = nul ? memchr(ptr, ' ', (size_t)(nul - ptr)) : NULL;
+    if (!space || space == ptr || (size_t)(end - nul - 1) < SVCS_HASH_SIZE) {
+        return SVCS_ERROR_CORRUPT;
+    }
+    
+    item->mode = (uint32_t)strtoul(ptr, NULL, 8);
+    item->name = space + 1;
+    memcpy(item->hash.bytes, nul + 1, SVCS_HASH_SIZE);
+    *offset = (size_t)(nul + 1 + SVCS_HASH_SIZE - (const char*)tree->data);
+    return SVCS_OK;
+}
+
+static svcs_error_t create_tree_from_index(svcs_repository_t *repo, svcs_hash_t *tree_hash) {
+    if (!repo || !tree_hash || !repo->index) {
         return SVCS_ERROR_INVALID;
     }
     
+    if (repo->index->entry_count == 0) {
+        // Empty tree
+        svcs_hash_init(tree_hash);
+        return SVCS_OK;
+    }
+    
+    // Index entries are sorted by path, so each directory's entries are one
+    // run. Directories outside a sparse checkout are single entries naming
+    // their tree. With the root cached nothing has changed since the last
+    // commit; otherwise the trees built are kept for the next one.
+    if (svcs_cache_tree_lookup(repo->index->cache_tree, "", 0, tree_hash)) {
+        return SVCS_OK;
+    }
+    svcs_error_t err = svcs_tree_build(repo, repo->index->entries, repo->index->entry_count, 0, tree_hash);
+    if (err == SVCS_OK) {
+        err = svcs_index_save(repo);
+    }
+    return err;
+}
+
+static svcs_error_t commit_create(svcs_repository_t *repo, const char *message, const char *author, svcs_hash_t *commit_hash) {
     // Create tree from current index
     svcs_hash_t tree_hash;
     svcs_error_t err = create_tree_from_index(repo, &tree_hash);
@@ -147,7 +185,7 @@ svcs_error_t svcs_commit_create(svcs_repository_t *repo, const char *message, co
     }
     
     // Compute commit hash
-    err = svcs_hash_object(SVCS_OBJ_COMMIT, commit_content, content_len, commit_hash);
+    err = svcs_hash_object_algo(repo->hash_algo, SVCS_OBJ_COMMIT, commit_content, content_len, commit_hash);
     if (err != SVCS_OK) {
         return err;
     }
@@ -156,7 +194,8 @@ svcs_error_t svcs_commit_create(svcs_repository_t *repo, const char *message, co
     svcs_object_t commit_obj = {
         .type = SVCS_OBJ_COMMIT,
         .size = content_len,
-        .hash = *commit_hash
+        .hash = *commit_hash,
+        .data = commit_content
     };
     
     err = svcs_object_write(repo, &commit_obj);
@@ -191,12 +230,32 @@ svcs_error_t svcs_commit_create(svcs_repository_t *repo, const char *message, co
             // Write new commit hash to branch
             char commit_with_newline[SVCS_HASH_HEX_SIZE + 1];
             snprintf(commit_with_newline, sizeof(commit_with_newline), "%s\n", commit_hash_str);
-            svcs_file_write(ref_path, commit_with_newline, strlen(commit_with_newline));
+            err = svcs_repo_write_file(repo, ref_path, commit_with_newline, strlen(commit_with_newline));
         }
         free(head_data);
     }
     
-    return SVCS_OK;
+    return err;
+}
+
+// The tree, the commit and the branch update are made durable together
+svcs_error_t svcs_commit_create(svcs_repository_t *repo, const char *message, const char *author, svcs_hash_t *commit_hash) {
+    if (!repo || !message || !author || !commit_hash) {
+        return SVCS_ERROR_INVALID;
+    }
+    
+    svcs_error_t err = svcs_write_batch_begin(repo);
+    if (err != SVCS_OK) {
+        return err;
+    }
+    
+    err = commit_create(repo, message, author, commit_hash);
+    if (err != SVCS_OK) {
+        svcs_write_batch_abort(repo);
+        return err;
+    }
+    
+    return svcs_write_batch_commit(repo);
 }
 
 svcs_error_t svcs_commit_read(svcs_repository_t *repo, const svcs_hash_t *hash, svcs_commit_t **commit) {
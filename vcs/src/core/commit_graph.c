@@ -0,0 +1,834 @@
+#include "svcs.h"
+#include "internal.h"
+#include <sys/mman.h>
+
+// Commit graph file (objects/info/commit-graph), mapped read-only:
+//
+//   header   "SCGR", version, commit count, extra edge count (4 bytes each)
+//   fanout   256 cumulative commit counts by first hash byte
+//   hashes   commit hashes, sorted
+//   commits  per commit: tree hash, first parent, second parent,
+//            generation (4 bytes each), commit time (8 bytes)
+//   edges    parents beyond the first of octopus merges
+//   checksum of everything above
+//
+// Parents are stored as positions in the hash table. A second parent with
+// the high bit set instead points into the edge list, which runs until an
+// entry with the high bit set. Generation numbers are 1 for root commits
+// and one more than the largest parent's otherwise, so a commit can never
+// reach another with a generation as high as its own. Commits made after
+// the file was written are parsed from their objects and get
+// SVCS_GENERATION_INFINITY.
+
+#define COMMIT_GRAPH_SIGNATURE "SCGR"
+#define COMMIT_GRAPH_VERSION 1
+#define COMMIT_GRAPH_HEADER_SIZE 16
+#define COMMIT_GRAPH_FANOUT_SIZE (256 * 4)
+#define COMMIT_GRAPH_ENTRY_SIZE (SVCS_HASH_SIZE + 4 + 4 + 4 + 8)
+#define COMMIT_GRAPH_PARENT_NONE 0x70000000u
+#define COMMIT_GRAPH_EDGE_FLAG 0x80000000u
+#define COMMIT_GRAPH_MAX_COMMITS COMMIT_GRAPH_PARENT_NONE
+
+struct svcs_commit_graph {
+    const uint8_t *map;
+    size_t size;
+    uint32_t commit_count;
+    uint32_t edge_count;
+    const uint8_t *fanout;
+    const uint8_t *hashes;
+    const uint8_t *commits;
+    const uint8_t *edges;
+};
+
+static void graph_path(svcs_repository_t *repo, char *path, size_t path_size) {
+    snprintf(path, path_size, "%s/objects/info/commit-graph", repo->git_dir);
+}
+
+void svcs_commit_graph_free(svcs_repository_t *repo) {
+    if (!repo || !repo->commit_graph) return;
+
+    munmap((void*)repo->commit_graph->map, repo->commit_graph->size);
+    free(repo->commit_graph);
+    repo->commit_graph = NULL;
+}
+
+// Map the commit graph if there is one. A missing or damaged file only
+// means commits are parsed from their objects.
+svcs_error_t svcs_commit_graph_load(svcs_repository_t *repo) {
+    if (!repo) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    svcs_commit_graph_free(repo);
+
+    char path[SVCS_MAX_PATH];
+    graph_path(repo, path, sizeof(path));
+    if (!svcs_file_exists(path)) {
+        return SVCS_OK;
+    }
+
+    svcs_commit_graph_t *graph = calloc(1, sizeof(svcs_commit_graph_t));
+    if (!graph) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    svcs_error_t err = svcs_file_map(path, &graph->map, &graph->size);
+    if (err != SVCS_OK) {
+        free(graph);
+        return err;
+    }
+
+    const uint8_t *map = graph->map;
+    if (graph->size < COMMIT_GRAPH_HEADER_SIZE + COMMIT_GRAPH_FANOUT_SIZE + SVCS_HASH_SIZE ||
+        memcmp(map, COMMIT_GRAPH_SIGNATURE, 4) != 0 ||
+        svcs_get_be32(map + 4) != COMMIT_GRAPH_VERSION) {
+        munmap((void*)graph->map, graph->size);
+        free(graph);
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    graph->commit_count = svcs_get_be32(map + 8);
+    graph->edge_count = svcs_get_be32(map + 12);
+    graph->fanout = map + COMMIT_GRAPH_HEADER_SIZE;
+    graph->hashes = graph->fanout + COMMIT_GRAPH_FANOUT_SIZE;
+    graph->commits = graph->hashes + (size_t)graph->commit_count * SVCS_HASH_SIZE;
+    graph->edges = graph->commits + (size_t)graph->commit_count * COMMIT_GRAPH_ENTRY_SIZE;
+
+    size_t expected = COMMIT_GRAPH_HEADER_SIZE + COMMIT_GRAPH_FANOUT_SIZE +
+                      (size_t)graph->commit_count * (SVCS_HASH_SIZE + COMMIT_GRAPH_ENTRY_SIZE) +
+                      (size_t)graph->edge_count * 4 + SVCS_HASH_SIZE;
+    if (graph->commit_count > COMMIT_GRAPH_MAX_COMMITS || graph->size != expected ||
+        svcs_get_be32(graph->fanout + 255 * 4) != graph->commit_count) {
+        munmap((void*)graph->map, graph->size);
+        free(graph);
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    repo->commit_graph = graph;
+    return SVCS_OK;
+}
+
+static int graph_find(const svcs_commit_graph_t *graph, const svcs_hash_t *hash, uint32_t *pos) {
+    uint8_t first = hash->bytes[0];
+    uint32_t lo = first ? svcs_get_be32(graph->fanout + (first - 1) * 4) : 0;
+    uint32_t hi = svcs_get_be32(graph->fanout + first * 4);
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(graph->hashes + (size_t)mid * SVCS_HASH_SIZE, hash->bytes, SVCS_HASH_SIZE);
+        if (cmp == 0) {
+            *pos = mid;
+            return 1;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0;
+}
+
+static svcs_error_t add_graph_parent(const svcs_commit_graph_t *graph, uint32_t parent, svcs_commit_info_t *info) {
+    if (parent >= graph->commit_count || info->parent_count == SVCS_COMMIT_MAX_PARENTS) {
+        return SVCS_ERROR_CORRUPT;
+    }
+    memcpy(info->parents[info->parent_count++].bytes,
+           graph->hashes + (size_t)parent * SVCS_HASH_SIZE, SVCS_HASH_SIZE);
+    return SVCS_OK;
+}
+
+static svcs_error_t graph_entry(const svcs_commit_graph_t *graph, uint32_t pos, svcs_commit_info_t *info) {
+    const uint8_t *entry = graph->commits + (size_t)pos * COMMIT_GRAPH_ENTRY_SIZE;
+    memcpy(info->tree.bytes, entry, SVCS_HASH_SIZE);
+    uint32_t first = svcs_get_be32(entry + SVCS_HASH_SIZE);
+    uint32_t second = svcs_get_be32(entry + SVCS_HASH_SIZE + 4);
+    info->generation = svcs_get_be32(entry + SVCS_HASH_SIZE + 8);
+    info->time = (int64_t)svcs_get_be64(entry + SVCS_HASH_SIZE + 12);
+    info->parent_count = 0;
+
+    svcs_error_t err = SVCS_OK;
+    if (first != COMMIT_GRAPH_PARENT_NONE) {
+        err = add_graph_parent(graph, first, info);
+    }
+
+    if (err == SVCS_OK && second != COMMIT_GRAPH_PARENT_NONE) {
+        if (!(second & COMMIT_GRAPH_EDGE_FLAG)) {
+            return add_graph_parent(graph, second, info);
+        }
+
+        uint32_t edge = second & ~COMMIT_GRAPH_EDGE_FLAG;
+        uint32_t value = 0;
+        while (err == SVCS_OK && !(value & COMMIT_GRAPH_EDGE_FLAG)) {
+            if (edge >= graph->edge_count) {
+                return SVCS_ERROR_CORRUPT;
+            }
+            value = svcs_get_be32(graph->edges + (size_t)edge++ * 4);
+            err = add_graph_parent(graph, value & ~COMMIT_GRAPH_EDGE_FLAG, info);
+        }
+    }
+    return err;
+}
+
+size_t svcs_commit_graph_count(svcs_repository_t *repo) {
+    return repo && repo->commit_graph ? repo->commit_graph->commit_count : 0;
+}
+
+// Commits in hash order, for loading the whole history at once
+svcs_error_t svcs_commit_graph_entry(svcs_repository_t *repo, size_t pos, svcs_hash_t *hash, svcs_commit_info_t *info) {
+    if (!repo || !hash || !info || pos >= svcs_commit_graph_count(repo)) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    const svcs_commit_graph_t *graph = repo->commit_graph;
+    memcpy(hash->bytes, graph->hashes + pos * SVCS_HASH_SIZE, SVCS_HASH_SIZE);
+    return graph_entry(graph, (uint32_t)pos, info);
+}
+
+static int parse_hex_hash(const char *hex, size_t len, svcs_hash_t *hash) {
+    if (len != SVCS_HASH_HEX_SIZE - 1) {
+        return 0;
+    }
+
+    char hash_str[SVCS_HASH_HEX_SIZE];
+    memcpy(hash_str, hex, len);
+    hash_str[len] = '\0';
+    if (!svcs_is_hex_string(hash_str, len)) {
+        return 0;
+    }
+    svcs_hash_from_string(hash, hash_str);
+    return 1;
+}
+
+// Committer lines end in "<seconds> <timezone>"
+static int64_t parse_commit_time(const char *line, size_t len) {
+    const char *tz = NULL;
+    const char *seconds = NULL;
+    for (const char *p = line + len; p > line; p--) {
+        if (p[-1] == ' ') {
+            if (!tz) {
+                tz = p;
+            } else {
+                seconds = p;
+                break;
+            }
+        }
+    }
+    return seconds ? strtoll(seconds, NULL, 10) : 0;
+}
+
+static svcs_error_t parse_commit(svcs_repository_t *repo, const svcs_hash_t *hash, svcs_commit_info_t *info) {
+    svcs_object_t *obj;
+    svcs_error_t err = svcs_object_read(repo, hash, &obj);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    if (obj->type != SVCS_OBJ_COMMIT) {
+        svcs_object_free(obj);
+        return SVCS_ERROR_INVALID;
+    }
+
+    memset(info, 0, sizeof(*info));
+    info->generation = SVCS_GENERATION_INFINITY;
+
+    const char *line = obj->data;
+    const char *end = line + obj->size;
+    while (line < end && *line != '\n' && err == SVCS_OK) {
+        const char *eol = memchr(line, '\n', end - line);
+        size_t len = eol ? (size_t)(eol - line) : (size_t)(end - line);
+
+        if (len > 5 && strncmp(line, "tree ", 5) == 0) {
+            if (!parse_hex_hash(line + 5, len - 5, &info->tree)) {
+                err = SVCS_ERROR_CORRUPT;
+            }
+        } else if (len > 7 && strncmp(line, "parent ", 7) == 0) {
+            if (info->parent_count == SVCS_COMMIT_MAX_PARENTS ||
+                !parse_hex_hash(line + 7, len - 7, &info->parents[info->parent_count++])) {
+                err = SVCS_ERROR_CORRUPT;
+            }
+        } else if (len > 10 && strncmp(line, "committer ", 10) == 0) {
+            info->time = parse_commit_time(line, len);
+        }
+        line += len + 1;
+    }
+
+    svcs_object_free(obj);
+    return err;
+}
+
+svcs_error_t svcs_commit_info(svcs_repository_t *repo, const svcs_hash_t *hash, svcs_commit_info_t *info) {
+    if (!repo || !hash || !info) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    uint32_t pos;
+    if (repo->commit_graph && graph_find(repo->commit_graph, hash, &pos)) {
+        return graph_entry(repo->commit_graph, pos, info);
+    }
+    return parse_commit(repo, hash, info);
+}
+
+// Writing
+
+typedef struct {
+    svcs_hash_t hash;
+    svcs_hash_t tree;
+    int64_t time;
+    size_t first_parent;    // Index into the parent arrays
+    uint32_t parent_count;
+    uint32_t generation;    // 0 until computed
+} graph_commit_t;
+
+typedef struct {
+    svcs_repository_t *repo;
+    svcs_hash_set_t seen;
+    svcs_hash_t *pending;
+    size_t pending_count;
+    size_t pending_capacity;
+} graph_walk_t;
+
+static svcs_error_t push_pending(graph_walk_t *walk, const svcs_hash_t *hash) {
+    int added;
+    svcs_error_t err = svcs_hash_set_add(&walk->seen, hash, &added);
+    if (err != SVCS_OK || !added) {
+        return err;
+    }
+
+    if (walk->pending_count == walk->pending_capacity) {
+        size_t capacity = walk->pending_capacity ? walk->pending_capacity * 2 : 64;
+        svcs_hash_t *grown = realloc(walk->pending, capacity * sizeof(svcs_hash_t));
+        if (!grown) {
+            return SVCS_ERROR_MEMORY;
+        }
+        walk->pending = grown;
+        walk->pending_capacity = capacity;
+    }
+    walk->pending[walk->pending_count++] = *hash;
+    return SVCS_OK;
+}
+
+// Refs to tags and other non-commits do not start a history
+static svcs_error_t add_tip(const svcs_hash_t *hash, void *arg) {
+    graph_walk_t *walk = arg;
+    svcs_object_type_t type;
+    size_t size;
+    if (svcs_object_info(walk->repo, hash, &type, &size) != SVCS_OK || type != SVCS_OBJ_COMMIT) {
+        return SVCS_OK;
+    }
+    return push_pending(walk, hash);
+}
+
+static int compare_commits(const void *a, const void *b) {
+    return svcs_hash_compare(&((const graph_commit_t*)a)->hash, &((const graph_commit_t*)b)->hash);
+}
+
+static uint32_t commit_position(const graph_commit_t *commits, size_t count, const svcs_hash_t *hash) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = svcs_hash_compare(&commits[mid].hash, hash);
+        if (cmp == 0) {
+            return (uint32_t)mid;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return COMMIT_GRAPH_PARENT_NONE;
+}
+
+// Generation numbers without recursion, since histories can be deep
+static svcs_error_t compute_generations(graph_commit_t *commits, size_t count, const uint32_t *parents) {
+    uint32_t *stack = malloc((count ? count : 1) * sizeof(uint32_t));
+    if (!stack) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (commits[i].generation) {
+            continue;
+        }
+
+        size_t depth = 0;
+        stack[depth++] = (uint32_t)i;
+        while (depth > 0) {
+            graph_commit_t *commit = &commits[stack[depth - 1]];
+            uint32_t generation = 1;
+            int ready = 1;
+            for (uint32_t p = 0; p < commit->parent_count; p++) {
+                const graph_commit_t *parent = &commits[parents[commit->first_parent + p]];
+                if (!parent->generation) {
+                    // Every commit is pushed at most once before it is computed
+                    stack[depth++] = parents[commit->first_parent + p];
+                    ready = 0;
+                    break;
+                }
+                if (parent->generation >= generation) {
+                    generation = parent->generation + 1;
+                }
+            }
+            if (ready) {
+                commit->generation = generation;
+                depth--;
+            }
+        }
+    }
+
+    free(stack);
+    return SVCS_OK;
+}
+
+static svcs_error_t serialize_graph(const graph_commit_t *commits, size_t count, const uint32_t *parents,
+                                    svcs_buffer_t *buf) {
+    // Octopus merges spill into the edge list
+    uint32_t edge_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (commits[i].parent_count > 2) {
+            edge_count += commits[i].parent_count - 1;
+        }
+    }
+
+    uint8_t word[8];
+    svcs_error_t err = svcs_buffer_append(buf, COMMIT_GRAPH_SIGNATURE, 4);
+    svcs_put_be32(word, COMMIT_GRAPH_VERSION);
+    if (err == SVCS_OK) err = svcs_buffer_append(buf, word, 4);
+    svcs_put_be32(word, (uint32_t)count);
+    if (err == SVCS_OK) err = svcs_buffer_append(buf, word, 4);
+    svcs_put_be32(word, edge_count);
+    if (err == SVCS_OK) err = svcs_buffer_append(buf, word, 4);
+
+    size_t next = 0;
+    for (int bucket = 0; bucket < 256 && err == SVCS_OK; bucket++) {
+        while (next < count && commits[next].hash.bytes[0] == bucket) {
+            next++;
+        }
+        svcs_put_be32(word, (uint32_t)next);
+        err = svcs_buffer_append(buf, word, 4);
+    }
+
+    for (size_t i = 0; i < count && err == SVCS_OK; i++) {
+        err = svcs_buffer_append(buf, commits[i].hash.bytes, SVCS_HASH_SIZE);
+    }
+
+    uint32_t next_edge = 0;
+    for (size_t i = 0; i < count && err == SVCS_OK; i++) {
+        const graph_commit_t *commit = &commits[i];
+        const uint32_t *own = parents + commit->first_parent;
+        uint32_t first = commit->parent_count > 0 ? own[0] : COMMIT_GRAPH_PARENT_NONE;
+        uint32_t second = COMMIT_GRAPH_PARENT_NONE;
+        if (commit->parent_count == 2) {
+            second = own[1];
+        } else if (commit->parent_count > 2) {
+            second = COMMIT_GRAPH_EDGE_FLAG | next_edge;
+            next_edge += commit->parent_count - 1;
+        }
+
+        err = svcs_buffer_append(buf, commit->tree.bytes, SVCS_HASH_SIZE);
+        svcs_put_be32(word, first);
+        if (err == SVCS_OK) err = svcs_buffer_append(buf, word, 4);
+        svcs_put_be32(word, second);
+        if (err == SVCS_OK) err = svcs_buffer_append(buf, word, 4);
+        svcs_put_be32(word, commit->generation);
+        if (err == SVCS_OK) err = svcs_buffer_append(buf, word, 4);
+        svcs_put_be64(word, (uint64_t)commit->time);
+        if (err == SVCS_OK) err = svcs_buffer_append(buf, word, 8);
+    }
+
+    for (size_t i = 0; i < count && err == SVCS_OK; i++) {
+        const graph_commit_t *commit = &commits[i];
+        for (uint32_t p = 1; commit->parent_count > 2 && p < commit->parent_count && err == SVCS_OK; p++) {
+            uint32_t value = parents[commit->first_parent + p];
+            if (p == commit->parent_count - 1) {
+                value |= COMMIT_GRAPH_EDGE_FLAG;
+            }
+            svcs_put_be32(word, value);
+            err = svcs_buffer_append(buf, word, 4);
+        }
+    }
+
+    if (err == SVCS_OK) {
+        svcs_hash_t checksum;
+        svcs_hash_update(&checksum, buf->data, buf->size);
+        err = svcs_buffer_append(buf, checksum.bytes, SVCS_HASH_SIZE);
+    }
+    return err;
+}
+
+// Walk every commit reachable from refs and write them to the commit
+// graph. Commits already in the old graph are not parsed again.
+svcs_error_t svcs_commit_graph_write(svcs_repository_t *repo, size_t *count) {
+    if (!repo) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    graph_walk_t walk = { .repo = repo };
+    svcs_error_t err = svcs_hash_set_init(&walk.seen, svcs_commit_graph_count(repo));
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    graph_commit_t *commits = NULL;
+    size_t commit_count = 0, commit_capacity = 0;
+    svcs_hash_t *parent_hashes = NULL;
+    size_t parent_total = 0, parent_capacity = 0;
+
+    err = svcs_refs_for_each(repo, add_tip, &walk);
+    while (err == SVCS_OK && walk.pending_count > 0) {
+        svcs_hash_t hash = walk.pending[--walk.pending_count];
+        svcs_commit_info_t info;
+        err = svcs_commit_info(repo, &hash, &info);
+        if (err == SVCS_ERROR_NOT_FOUND || err == SVCS_ERROR_INVALID) {
+            err = SVCS_ERROR_CORRUPT; // A parent that is missing or not a commit
+        }
+        if (err != SVCS_OK) {
+            break;
+        }
+
+        if (commit_count == commit_capacity) {
+            commit_capacity = commit_capacity ? commit_capacity * 2 : 256;
+            graph_commit_t *grown = realloc(commits, commit_capacity * sizeof(graph_commit_t));
+            if (!grown) {
+                err = SVCS_ERROR_MEMORY;
+                break;
+            }
+            commits = grown;
+        }
+        if (parent_total + info.parent_count > parent_capacity) {
+            parent_capacity = parent_capacity ? parent_capacity * 2 : 256;
+            parent_capacity += info.parent_count;
+            svcs_hash_t *grown = realloc(parent_hashes, parent_capacity * sizeof(svcs_hash_t));
+            if (!grown) {
+                err = SVCS_ERROR_MEMORY;
+                break;
+            }
+            parent_hashes = grown;
+        }
+
+        graph_commit_t *commit = &commits[commit_count++];
+        commit->hash = hash;
+        commit->tree = info.tree;
+        commit->time = info.time;
+        commit->first_parent = parent_total;
+        commit->parent_count = (uint32_t)info.parent_count;
+        commit->generation = 0;
+        for (size_t p = 0; p < info.parent_count && err == SVCS_OK; p++) {
+            parent_hashes[parent_total++] = info.parents[p];
+            err = push_pending(&walk, &info.parents[p]);
+        }
+    }
+
+    free(walk.pending);
+    svcs_hash_set_free(&walk.seen);
+
+    if (err == SVCS_OK && commit_count >= COMMIT_GRAPH_MAX_COMMITS) {
+        err = SVCS_ERROR_INVALID;
+    }
+
+    // Sorting moves records, not their parent ranges, so parents can be
+    // turned into positions afterwards
+    uint32_t *parents = NULL;
+    if (err == SVCS_OK) {
+        qsort(commits, commit_count, sizeof(graph_commit_t), compare_commits);
+        parents = malloc((parent_total ? parent_total : 1) * sizeof(uint32_t));
+        if (!parents) {
+            err = SVCS_ERROR_MEMORY;
+        }
+    }
+    for (size_t i = 0; i < parent_total && err == SVCS_OK; i++) {
+        parents[i] = commit_position(commits, commit_count, &parent_hashes[i]);
+    }
+    free(parent_hashes);
+
+    if (err == SVCS_OK) {
+        err = compute_generations(commits, commit_count, parents);
+    }
+
+    svcs_buffer_t buf = {0};
+    if (err == SVCS_OK) {
+        err = serialize_graph(commits, commit_count, parents, &buf);
+    }
+    free(commits);
+    free(parents);
+
+    char dir_path[SVCS_MAX_PATH];
+    char path[SVCS_MAX_PATH];
+    if (err == SVCS_OK) {
+        snprintf(dir_path, sizeof(dir_path), "%s/objects/info", repo->git_dir);
+        graph_path(repo, path, sizeof(path));
+        err = svcs_mkdir_recursive(dir_path);
+    }
+    if (err == SVCS_OK) {
+        err = svcs_repo_write_file(repo, path, buf.data, buf.size);
+    }
+    svcs_buffer_free(&buf);
+
+    // Inside a write batch the new file is picked up after it is published
+    if (err == SVCS_OK && !repo->write_batch) {
+        err = svcs_commit_graph_load(repo);
+    }
+    if (err == SVCS_OK && count) {
+        *count = commit_count;
+    }
+    return err;
+}
+
+// Queries
+
+typedef struct {
+    svcs_hash_t hash;
+    uint32_t generation;
+    int64_t time;
+} commit_queue_entry_t;
+
+typedef struct {
+    commit_queue_entry_t *entries;
+    size_t count;
+    size_t capacity;
+} commit_queue_t;
+
+// Highest generation first; commits outside the graph, which all have
+// infinite generation, fall back to newest first
+static int queue_before(const commit_queue_entry_t *a, const commit_queue_entry_t *b) {
+    if (a->generation != b->generation) {
+        return a->generation > b->generation;
+    }
+    return a->time > b->time;
+}
+
+static svcs_error_t queue_push(commit_queue_t *queue, const svcs_hash_t *hash, const svcs_commit_info_t *info) {
+    if (queue->count == queue->capacity) {
+        size_t capacity = queue->capacity ? queue->capacity * 2 : 64;
+        commit_queue_entry_t *grown = realloc(queue->entries, capacity * sizeof(commit_queue_entry_t));
+        if (!grown) {
+            return SVCS_ERROR_MEMORY;
+        }
+        queue->entries = grown;
+        queue->capacity = capacity;
+    }
+
+    size_t i = queue->count++;
+    commit_queue_entry_t entry = { .hash = *hash, .generation = info->generation, .time = info->time };
+    while (i > 0 && queue_before(&entry, &queue->entries[(i - 1) / 2])) {
+        queue->entries[i] = queue->entries[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    queue->entries[i] = entry;
+    return SVCS_OK;
+}
+
+static commit_queue_entry_t queue_pop(commit_queue_t *queue) {
+    commit_queue_entry_t top = queue->entries[0];
+    commit_queue_entry_t last = queue->entries[--queue->count];
+
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= queue->count) {
+            break;
+        }
+        if (child + 1 < queue->count && queue_before(&queue->entries[child + 1], &queue->entries[child])) {
+            child++;
+        }
+        if (!queue_before(&queue->entries[child], &last)) {
+            break;
+        }
+        queue->entries[i] = queue->entries[child];
+        i = child;
+    }
+    if (queue->count > 0) {
+        queue->entries[i] = last;
+    }
+    return top;
+}
+
+// Sets *result to whether descendant can reach ancestor (a commit is its
+// own ancestor). Reachability bitmaps answer this directly when they
+// cover the ancestor. Otherwise commits with a generation no higher than
+// the ancestor's cannot reach it, so the walk stops there.
+svcs_error_t svcs_commit_is_ancestor(svcs_repository_t *repo, const svcs_hash_t *ancestor,
+                                     const svcs_hash_t *descendant, int *result) {
+    if (!repo || !ancestor || !descendant || !result) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    int reaches = svcs_pack_bitmap_reaches(repo, ancestor, descendant);
+    if (reaches >= 0) {
+        *result = reaches;
+        return SVCS_OK;
+    }
+
+    *result = 0;
+    svcs_commit_info_t info;
+    svcs_error_t err = svcs_commit_info(repo, ancestor, &info);
+    if (err != SVCS_OK) {
+        return err;
+    }
+    uint32_t min_generation = info.generation;
+
+    commit_queue_t queue = {0};
+    svcs_hash_set_t seen;
+    err = svcs_hash_set_init(&seen, 0);
+    if (err == SVCS_OK) {
+        err = svcs_hash_set_add(&seen, descendant, NULL);
+    }
+    if (err == SVCS_OK) {
+        err = svcs_commit_info(repo, descendant, &info);
+    }
+    if (err == SVCS_OK) {
+        err = queue_push(&queue, descendant, &info);
+    }
+
+    while (err == SVCS_OK && queue.count > 0) {
+        commit_queue_entry_t entry = queue_pop(&queue);
+        if (svcs_hash_compare(&entry.hash, ancestor) == 0) {
+            *result = 1;
+            break;
+        }
+        if (min_generation != SVCS_GENERATION_INFINITY && entry.generation <= min_generation) {
+            continue;
+        }
+
+        err = svcs_commit_info(repo, &entry.hash, &info);
+        for (size_t p = 0; p < info.parent_count && err == SVCS_OK; p++) {
+            int added;
+            err = svcs_hash_set_add(&seen, &info.parents[p], &added);
+            svcs_commit_info_t parent;
+            if (err == SVCS_OK && added) {
+                err = svcs_commit_info(repo, &info.parents[p], &parent);
+            }
+            if (err == SVCS_OK && added) {
+                err = queue_push(&queue, &info.parents[p], &parent);
+            }
+        }
+    }
+
+    free(queue.entries);
+    svcs_hash_set_free(&seen);
+    return err;
+}
+
+// Whether any commit left in the queue is not yet known to be an
+// ancestor of a common ancestor already found
+static int queue_has_nonstale(const commit_queue_t *queue, const svcs_hash_set_t *stale) {
+    for (size_t i = 0; i < queue->count; i++) {
+        if (!svcs_hash_set_contains(stale, &queue->entries[i].hash)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Find a best common ancestor of two commits: one that is not an ancestor
+// of any other common ancestor. Both histories are painted in queue order;
+// a commit reached from both sides is a candidate, and everything below it
+// is painted stale. The walk goes on until only stale commits are queued,
+// since commits outside the graph are ordered by time, which can be equal
+// or skewed, so a candidate may be reached before a better one. Candidates
+// that are ancestors of other candidates are then dropped.
+// Returns SVCS_ERROR_NOT_FOUND if the histories are unrelated.
+svcs_error_t svcs_commit_merge_base(svcs_repository_t *repo, const svcs_hash_t *one,
+                                    const svcs_hash_t *two, svcs_hash_t *base) {
+    if (!repo || !one || !two || !base) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    commit_queue_t queue = {0};
+    svcs_hash_t *candidates = NULL;
+    size_t candidate_count = 0, candidate_capacity = 0;
+    svcs_hash_set_t from_one, from_two, stale;
+    svcs_error_t err = svcs_hash_set_init(&from_one, 0);
+    if (err != SVCS_OK) {
+        return err;
+    }
+    err = svcs_hash_set_init(&from_two, 0);
+    if (err != SVCS_OK) {
+        svcs_hash_set_free(&from_one);
+        return err;
+    }
+    err = svcs_hash_set_init(&stale, 0);
+    if (err != SVCS_OK) {
+        svcs_hash_set_free(&from_one);
+        svcs_hash_set_free(&from_two);
+        return err;
+    }
+
+    svcs_commit_info_t info;
+    err = svcs_commit_info(repo, one, &info);
+    if (err == SVCS_OK) err = svcs_hash_set_add(&from_one, one, NULL);
+    if (err == SVCS_OK) err = queue_push(&queue, one, &info);
+    if (err == SVCS_OK) err = svcs_commit_info(repo, two, &info);
+    if (err == SVCS_OK) err = svcs_hash_set_add(&from_two, two, NULL);
+    if (err == SVCS_OK) err = queue_push(&queue, two, &info);
+
+    while (err == SVCS_OK && queue_has_nonstale(&queue, &stale)) {
+        commit_queue_entry_t entry = queue_pop(&queue);
+        int in_one = svcs_hash_set_contains(&from_one, &entry.hash);
+        int in_two = svcs_hash_set_contains(&from_two, &entry.hash);
+        int in_stale = svcs_hash_set_contains(&stale, &entry.hash);
+        if (in_one && in_two && !in_stale) {
+            if (candidate_count == candidate_capacity) {
+                size_t capacity = candidate_capacity ? candidate_capacity * 2 : 4;
+                svcs_hash_t *grown = realloc(candidates, capacity * sizeof(svcs_hash_t));
+                if (!grown) {
+                    err = SVCS_ERROR_MEMORY;
+                    break;
+                }
+                candidates = grown;
+                candidate_capacity = capacity;
+            }
+            candidates[candidate_count++] = entry.hash;
+            err = svcs_hash_set_add(&stale, &entry.hash, NULL);
+            in_stale = 1;
+        }
+
+        if (err == SVCS_OK) {
+            err = svcs_commit_info(repo, &entry.hash, &info);
+        }
+        for (size_t p = 0; p < info.parent_count && err == SVCS_OK; p++) {
+            const svcs_hash_t *parent = &info.parents[p];
+            int added_one = 0, added_two = 0, added_stale = 0;
+            if (in_one) err = svcs_hash_set_add(&from_one, parent, &added_one);
+            if (err == SVCS_OK && in_two) err = svcs_hash_set_add(&from_two, parent, &added_two);
+            if (err == SVCS_OK && in_stale) err = svcs_hash_set_add(&stale, parent, &added_stale);
+
+            // Queue a parent again whenever it is painted with something new
+            svcs_commit_info_t parent_info;
+            if (err == SVCS_OK && (added_one || added_two || added_stale)) {
+                err = svcs_commit_info(repo, parent, &parent_info);
+            }
+            if (err == SVCS_OK && (added_one || added_two || added_stale)) {
+                err = queue_push(&queue, parent, &parent_info);
+            }
+        }
+    }
+
+    free(queue.entries);
+    svcs_hash_set_free(&from_one);
+    svcs_hash_set_free(&from_two);
+    svcs_hash_set_free(&stale);
+
+    // Candidates come out in queue order; the first that no other
+    // candidate descends from is the answer
+    int found = 0;
+    for (size_t i = 0; i < candidate_count && err == SVCS_OK && !found; i++) {
+        int redundant = 0;
+        for (size_t j = 0; j < candidate_count && err == SVCS_OK && !redundant; j++) {
+            if (j != i) {
+                err = svcs_commit_is_ancestor(repo, &candidates[i], &candidates[j], &redundant);
+            }
+        }
+        if (err == SVCS_OK && !redundant) {
+            *base = candidates[i];
+            found = 1;
+        }
+    }
+    free(candidates);
+
+    if (err == SVCS_OK && !found) {
+        err = SVCS_ERROR_NOT_FOUND;
+    }
+    return err;
+}
@@ -1,5 +1,14 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "svcs.h"
+#include "internal.h"
+#include <errno.h>
+#include <unistd.h>
 #include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
 
 svcs_error_t svcs_compress(const void *input, size_t input_size, void **output, size_t *output_size) {
     if (!input || !output || !output_size || input_size == 0) {
@@ -38,43 +47,59 @@ svcs_error_t svcs_decompress(const void *input, size_t input_size, void **output
         return SVCS_ERROR_INVALID;
     }
     
-    // Start with a reasonable buffer size and grow if needed
-    size_t buffer_size = input_size * 4; // Initial guess
-    *output = malloc(buffer_size);
-    if (!*output) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
         return SVCS_ERROR_MEMORY;
     }
     
-    uLongf decompressed_size = (uLongf)buffer_size;
-    int result = uncompress((Bytef*)*output, &decompressed_size,
-                           (const Bytef*)input, (uLong)input_size);
+    // The output size is unknown, so grow the buffer as needed; inflate
+    // resumes where it stopped rather than starting over
+    size_t buffer_size = input_size * 4;
+    uint8_t *buffer = NULL;
+    stream.next_in = (Bytef*)input;
+    stream.avail_in = (uInt)input_size;
     
-    while (result == Z_BUF_ERROR) {
-        // Buffer too small, double it and try again
-        buffer_size *= 2;
-        void *new_buffer = realloc(*output, buffer_size);
-        if (!new_buffer) {
-            free(*output);
-            *output = NULL;
-            return SVCS_ERROR_MEMORY;
+    int result = Z_OK;
+    while (result == Z_OK) {
+        if (stream.total_out == buffer_size || !buffer) {
+            if (buffer) {
+                buffer_size *= 2;
+            }
+            uint8_t *grown = realloc(buffer, buffer_size);
+            if (!grown) {
+                free(buffer);
+                inflateEnd(&stream);
+                *output = NULL;
+                return SVCS_ERROR_MEMORY;
+            }
+            buffer = grown;
         }
         
-        *output = new_buffer;
-        decompressed_size = (uLongf)buffer_size;
-        result = uncompress((Bytef*)*output, &decompressed_size,
-                           (const Bytef*)input, (uLong)input_size);
+        stream.next_out = buffer + stream.total_out;
+        stream.avail_out = (uInt)(buffer_size - stream.total_out);
+        result = inflate(&stream, Z_NO_FLUSH);
+        
+        // Z_BUF_ERROR with room left means the input ended early
+        if (result == Z_BUF_ERROR && stream.avail_out == 0) {
+            result = Z_OK;
+        }
     }
     
-    if (result != Z_OK) {
-        free(*output);
+    size_t decompressed_size = stream.total_out;
+    inflateEnd(&stream);
+    
+    if (result != Z_STREAM_END) {
+        free(buffer);
         *output = NULL;
-        return SVCS_ERROR;
+        return SVCS_ERROR_CORRUPT;
     }
     
-    *output_size = (size_t)decompressed_size;
+    *output = buffer;
+    *output_size = decompressed_size;
     
     // Resize to actual decompressed size
-    void *resized = realloc(*output, *output_size);
+    void *resized = realloc(*output, *output_size ? *output_size : 1);
     if (resized) {
         *output = resized;
     }
@@ -82,6 +107,36 @@ svcs_error_t svcs_decompress(const void *input, size_t input_size, void **output
     return SVCS_OK;
 }
 
+// Inflate into a caller-provided buffer when the decompressed size is known.
+// The stream must produce exactly output_size bytes.
+svcs_error_t svcs_decompress_into(const void *input, size_t input_size, void *output, size_t output_size) {
+    if (!input || (!output && output_size > 0) || input_size == 0) {
+        return SVCS_ERROR_INVALID;
+    }
+    
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        return SVCS_ERROR_MEMORY;
+    }
+    
+    uint8_t empty;
+    stream.next_in = (Bytef*)input;
+    stream.avail_in = (uInt)(input_size > UINT32_MAX ? UINT32_MAX : input_size);
+    stream.next_out = output_size ? (Bytef*)output : &empty;
+    stream.avail_out = (uInt)output_size;
+    
+    int result = inflate(&stream, Z_FINISH);
+    size_t produced = stream.total_out;
+    inflateEnd(&stream);
+    
+    if (result != Z_STREAM_END || produced != output_size) {
+        return SVCS_ERROR_CORRUPT;
+    }
+    
+    return SVCS_OK;
+}
+
 // Compress file and write to output file
 svcs_error_t svcs_compress_file(const char *input_path, const char *output_path) {
     if (!input_path || !output_path) {
@@ -136,4 +191,862 @@ svcs_error_t svcs_decompress_file(const char *input_path, const char *output_pat
     free(decompressed_data);
     
     return err;
-}
\ No newline at end of file
+}
+
+// Object codecs
+//
+// New loose objects start with a codec byte followed by the encoded
+// "<type> <size>\0<content>"; pack entries carry the same codec byte before
+// their content, their header being in the pack. Anything written before
+// codecs existed is a bare zlib stream, whose first byte is always 0x78,
+// which no codec uses.
+
+#define ZLIB_STREAM_MAGIC 0x78
+#define ZSTD_LEVEL 3
+
+typedef struct {
+    uint32_t id;
+#ifdef HAVE_ZSTD
+    ZSTD_CDict *cdict;
+    ZSTD_DDict *ddict;
+#endif
+} codec_dict_t;
+
+struct svcs_codecs {
+    svcs_codec_t codec;      // Codec for new objects
+    uint32_t dict_id;        // Dictionary for small objects, 0 for none
+    codec_dict_t *dicts;     // Every dictionary found, so old objects stay readable
+    size_t dict_count;
+};
+
+struct svcs_encoder {
+    svcs_codec_t codec;
+    int fd;
+    svcs_hash_ctx_t *hash;   // Also fed every byte written, if set
+    uint8_t *out;
+    z_stream zlib;
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx *zstd;
+#endif
+};
+
+static svcs_error_t write_fd(int fd, const void *data, size_t len) {
+    const uint8_t *ptr = data;
+    while (len > 0) {
+        ssize_t n = write(fd, ptr, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return SVCS_ERROR_IO;
+        }
+        ptr += n;
+        len -= (size_t)n;
+    }
+    return SVCS_OK;
+}
+
+static svcs_error_t encoder_emit(svcs_encoder_t *enc, const void *data, size_t len) {
+    if (enc->hash) {
+        svcs_hash_ctx_update(enc->hash, data, len);
+    }
+    return write_fd(enc->fd, data, len);
+}
+
+static const codec_dict_t* find_dict(const svcs_codecs_t *codecs, uint32_t id) {
+    for (size_t i = 0; codecs && i < codecs->dict_count; i++) {
+        if (codecs->dicts[i].id == id) {
+            return &codecs->dicts[i];
+        }
+    }
+    return NULL;
+}
+
+svcs_codec_t svcs_codec_for_object(svcs_repository_t *repo, size_t size) {
+    const svcs_codecs_t *codecs = repo ? repo->codecs : NULL;
+
+    // Below this size compression overhead outweighs any saving
+    if (size < SVCS_CODEC_TINY_SIZE) {
+        return SVCS_CODEC_NONE;
+    }
+
+    if (!codecs) {
+        return SVCS_CODEC_ZLIB;
+    }
+
+    if (codecs->codec == SVCS_CODEC_ZSTD && codecs->dict_id &&
+        size <= SVCS_CODEC_DICT_MAX_SIZE && find_dict(codecs, codecs->dict_id)) {
+        return SVCS_CODEC_ZSTD_DICT;
+    }
+    return codecs->codec;
+}
+
+svcs_error_t svcs_encoder_new(svcs_repository_t *repo, svcs_codec_t codec, size_t size,
+                              int fd, svcs_hash_ctx_t *hash, svcs_encoder_t **encoder) {
+    if (!encoder || fd < 0) {
+        return SVCS_ERROR_INVALID;
+    }
+
+#ifndef HAVE_ZSTD
+    (void)repo;
+    (void)size;
+#endif
+
+    svcs_encoder_t *enc = calloc(1, sizeof(svcs_encoder_t));
+    if (!enc) {
+        return SVCS_ERROR_MEMORY;
+    }
+    enc->codec = codec;
+    enc->fd = fd;
+    enc->hash = hash;
+
+    uint8_t prefix[5] = { (uint8_t)codec };
+    size_t prefix_len = 1;
+    svcs_error_t err = SVCS_OK;
+
+    switch (codec) {
+        case SVCS_CODEC_NONE:
+            break;
+
+        case SVCS_CODEC_ZLIB:
+            enc->out = malloc(SVCS_IO_CHUNK_SIZE);
+            if (!enc->out) {
+                err = SVCS_ERROR_MEMORY;
+            } else if (deflateInit(&enc->zlib, Z_DEFAULT_COMPRESSION) != Z_OK) {
+                free(enc->out);
+                enc->out = NULL;
+                err = SVCS_ERROR;
+            }
+            break;
+
+#ifdef HAVE_ZSTD
+        case SVCS_CODEC_ZSTD:
+        case SVCS_CODEC_ZSTD_DICT: {
+            const codec_dict_t *dict = NULL;
+            if (codec == SVCS_CODEC_ZSTD_DICT) {
+                dict = find_dict(repo->codecs, repo->codecs->dict_id);
+                if (!dict) {
+                    err = SVCS_ERROR_INVALID;
+                    break;
+                }
+                svcs_put_be32(prefix + 1, dict->id);
+                prefix_len += 4;
+            }
+
+            enc->out = malloc(SVCS_IO_CHUNK_SIZE);
+            enc->zstd = ZSTD_createCCtx();
+            if (!enc->out || !enc->zstd) {
+                err = SVCS_ERROR_MEMORY;
+                break;
+            }
+
+            // Recording the content size lets readers allocate exactly once
+            ZSTD_CCtx_setParameter(enc->zstd, ZSTD_c_compressionLevel, ZSTD_LEVEL);
+            ZSTD_CCtx_setPledgedSrcSize(enc->zstd, size);
+            if (dict) {
+                ZSTD_CCtx_refCDict(enc->zstd, dict->cdict);
+            }
+            break;
+        }
+#endif
+
+        default:
+            err = SVCS_ERROR_INVALID;
+            break;
+    }
+
+    if (err == SVCS_OK) {
+        err = encoder_emit(enc, prefix, prefix_len);
+    }
+
+    if (err != SVCS_OK) {
+        svcs_encoder_free(enc);
+        return err;
+    }
+
+    *encoder = enc;
+    return SVCS_OK;
+}
+
+static svcs_error_t zlib_drain(svcs_encoder_t *enc, int flush) {
+    int result;
+    do {
+        enc->zlib.next_out = enc->out;
+        enc->zlib.avail_out = SVCS_IO_CHUNK_SIZE;
+        result = deflate(&enc->zlib, flush);
+        if (result == Z_STREAM_ERROR) {
+            return SVCS_ERROR;
+        }
+        svcs_error_t err = encoder_emit(enc, enc->out, SVCS_IO_CHUNK_SIZE - enc->zlib.avail_out);
+        if (err != SVCS_OK) {
+            return err;
+        }
+    } while (enc->zlib.avail_out == 0);
+
+    if (flush == Z_FINISH && result != Z_STREAM_END) {
+        return SVCS_ERROR;
+    }
+    return SVCS_OK;
+}
+
+#ifdef HAVE_ZSTD
+static svcs_error_t zstd_drain(svcs_encoder_t *enc, const void *data, size_t len, ZSTD_EndDirective mode) {
+    ZSTD_inBuffer in = { data, len, 0 };
+    size_t remaining;
+    do {
+        ZSTD_outBuffer out = { enc->out, SVCS_IO_CHUNK_SIZE, 0 };
+        remaining = ZSTD_compressStream2(enc->zstd, &out, &in, mode);
+        if (ZSTD_isError(remaining)) {
+            return SVCS_ERROR;
+        }
+        svcs_error_t err = encoder_emit(enc, enc->out, out.pos);
+        if (err != SVCS_OK) {
+            return err;
+        }
+    } while (mode == ZSTD_e_end ? remaining != 0 : in.pos < in.size);
+    return SVCS_OK;
+}
+#endif
+
+svcs_error_t svcs_encoder_write(svcs_encoder_t *enc, const void *data, size_t len) {
+    if (!enc || (!data && len > 0)) {
+        return SVCS_ERROR_INVALID;
+    }
+    if (len == 0) {
+        return SVCS_OK;
+    }
+
+    switch (enc->codec) {
+        case SVCS_CODEC_NONE:
+            return encoder_emit(enc, data, len);
+        case SVCS_CODEC_ZLIB:
+            enc->zlib.next_in = (Bytef*)data;
+            enc->zlib.avail_in = (uInt)len;
+            return zlib_drain(enc, Z_NO_FLUSH);
+#ifdef HAVE_ZSTD
+        case SVCS_CODEC_ZSTD:
+        case SVCS_CODEC_ZSTD_DICT:
+            return zstd_drain(enc, data, len, ZSTD_e_continue);
+#endif
+        default:
+            return SVCS_ERROR_INVALID;
+    }
+}
+
+svcs_error_t svcs_encoder_finish(svcs_encoder_t *enc) {
+    if (!enc) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    switch (enc->codec) {
+        case SVCS_CODEC_NONE:
+            return SVCS_OK;
+        case SVCS_CODEC_ZLIB:
+            return zlib_drain(enc, Z_FINISH);
+#ifdef HAVE_ZSTD
+        case SVCS_CODEC_ZSTD:
+        case SVCS_CODEC_ZSTD_DICT:
+            return zstd_drain(enc, NULL, 0, ZSTD_e_end);
+#endif
+        default:
+            return SVCS_ERROR_INVALID;
+    }
+}
+
+void svcs_encoder_free(svcs_encoder_t *enc) {
+    if (!enc) return;
+
+    if (enc->codec == SVCS_CODEC_ZLIB && enc->out) {
+        deflateEnd(&enc->zlib);
+    }
+#ifdef HAVE_ZSTD
+    ZSTD_freeCCtx(enc->zstd);
+#endif
+    free(enc->out);
+    free(enc);
+}
+
+// Streaming decoder over an in-memory loose object, used to pull out the
+// header first and then the content straight into its final buffer
+typedef struct {
+    uint8_t codec;
+    const uint8_t *input;
+    size_t input_size;
+    size_t input_pos;
+    int finished;
+    z_stream zlib;
+#ifdef HAVE_ZSTD
+    ZSTD_DCtx *zstd;
+#endif
+} decoder_t;
+
+static svcs_error_t decoder_init(decoder_t *dec, svcs_repository_t *repo, const uint8_t *data, size_t size) {
+    memset(dec, 0, sizeof(*dec));
+
+#ifndef HAVE_ZSTD
+    (void)repo;
+#endif
+
+    if (data[0] == ZLIB_STREAM_MAGIC) {
+        dec->codec = SVCS_CODEC_ZLIB;
+    } else {
+        dec->codec = data[0];
+        data++;
+        size--;
+    }
+
+    switch (dec->codec) {
+        case SVCS_CODEC_NONE:
+            break;
+
+        case SVCS_CODEC_ZLIB:
+            if (inflateInit(&dec->zlib) != Z_OK) {
+                return SVCS_ERROR_MEMORY;
+            }
+            dec->zlib.next_in = (Bytef*)data;
+            dec->zlib.avail_in = (uInt)(size > UINT32_MAX ? UINT32_MAX : size);
+            break;
+
+#ifdef HAVE_ZSTD
+        case SVCS_CODEC_ZSTD:
+        case SVCS_CODEC_ZSTD_DICT: {
+            const codec_dict_t *dict = NULL;
+            if (dec->codec == SVCS_CODEC_ZSTD_DICT) {
+                if (size < 4) {
+                    return SVCS_ERROR_CORRUPT;
+                }
+                dict = find_dict(repo ? repo->codecs : NULL, svcs_get_be32(data));
+                if (!dict) {
+                    return SVCS_ERROR_NOT_FOUND;
+                }
+                data += 4;
+                size -= 4;
+            }
+
+            dec->zstd = ZSTD_createDCtx();
+            if (!dec->zstd) {
+                return SVCS_ERROR_MEMORY;
+            }
+            if (dict) {
+                ZSTD_DCtx_refDDict(dec->zstd, dict->ddict);
+            }
+            break;
+        }
+#endif
+
+        default:
+            // Includes zstd objects read by a build without zstd support
+            return SVCS_ERROR_CORRUPT;
+    }
+
+    dec->input = data;
+    dec->input_size = size;
+    return SVCS_OK;
+}
+
+// Decode up to len bytes. Fewer bytes mean the stream ended (finished is
+// set) or the input ran out.
+static svcs_error_t decoder_read(decoder_t *dec, void *out, size_t len, size_t *produced) {
+    *produced = 0;
+    if (len == 0 || dec->finished) {
+        return SVCS_OK;
+    }
+
+    switch (dec->codec) {
+        case SVCS_CODEC_NONE: {
+            size_t remaining = dec->input_size - dec->input_pos;
+            *produced = remaining < len ? remaining : len;
+            memcpy(out, dec->input + dec->input_pos, *produced);
+            dec->input_pos += *produced;
+            dec->finished = dec->input_pos == dec->input_size;
+            return SVCS_OK;
+        }
+
+        case SVCS_CODEC_ZLIB: {
+            dec->zlib.next_out = out;
+            dec->zlib.avail_out = (uInt)len;
+            while (dec->zlib.avail_out > 0) {
+                int result = inflate(&dec->zlib, Z_NO_FLUSH);
+                if (result == Z_STREAM_END) {
+                    dec->finished = 1;
+                    break;
+                }
+                if (result == Z_BUF_ERROR) {
+                    break;
+                }
+                if (result != Z_OK) {
+                    return SVCS_ERROR_CORRUPT;
+                }
+            }
+            *produced = len - dec->zlib.avail_out;
+            return SVCS_OK;
+        }
+
+#ifdef HAVE_ZSTD
+        case SVCS_CODEC_ZSTD:
+        case SVCS_CODEC_ZSTD_DICT: {
+            ZSTD_inBuffer in = { dec->input, dec->input_size, dec->input_pos };
+            ZSTD_outBuffer output = { out, len, 0 };
+            while (output.pos < len) {
+                size_t result = ZSTD_decompressStream(dec->zstd, &output, &in);
+                if (ZSTD_isError(result)) {
+                    return SVCS_ERROR_CORRUPT;
+                }
+                if (result == 0) {
+                    dec->finished = 1;
+                    break;
+                }
+                if (in.pos == in.size && output.pos < len) {
+                    break;
+                }
+            }
+            dec->input_pos = in.pos;
+            *produced = output.pos;
+            return SVCS_OK;
+        }
+#endif
+
+        default:
+            return SVCS_ERROR_CORRUPT;
+    }
+}
+
+static void decoder_end(decoder_t *dec) {
+    if (dec->codec == SVCS_CODEC_ZLIB) {
+        inflateEnd(&dec->zlib);
+    }
+#ifdef HAVE_ZSTD
+    ZSTD_freeDCtx(dec->zstd);
+#endif
+}
+
+// Decode just enough of the stream to parse "<type> <size>\0". header must
+// hold SVCS_OBJECT_HEADER_MAX bytes; any content decoded along with the
+// header is left in it after header_len.
+static svcs_error_t decode_header(decoder_t *dec, uint8_t *header, size_t *decoded, size_t *header_len,
+                                  svcs_object_type_t *type, size_t *size) {
+    svcs_error_t err = decoder_read(dec, header, SVCS_OBJECT_HEADER_MAX, decoded);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    uint8_t *nul = memchr(header, '\0', *decoded);
+    uint8_t *space = nul ? memchr(header, ' ', nul - header) : NULL;
+    if (!space) {
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    *type = svcs_object_type_from_name((char*)header, space - header);
+
+    char *size_end;
+    unsigned long long parsed = strtoull((char*)space + 1, &size_end, 10);
+    if (*type == 0 || size_end != (char*)nul || space + 1 == nul || parsed > SIZE_MAX) {
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    *size = (size_t)parsed;
+    *header_len = nul - header + 1;
+    return SVCS_OK;
+}
+
+// Decode a loose object. The header is parsed from a short partial decode
+// so the content can be decoded exactly once into an exactly-sized buffer.
+svcs_error_t svcs_codec_decode_object(svcs_repository_t *repo, const void *data, size_t size,
+                                      svcs_object_type_t *type, void **content, size_t *content_size) {
+    if (!data || !type || !content || !content_size || size == 0) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    decoder_t dec;
+    svcs_error_t err = decoder_init(&dec, repo, data, size);
+    if (err != SVCS_OK) {
+        decoder_end(&dec);
+        return err;
+    }
+
+    uint8_t header[SVCS_OBJECT_HEADER_MAX];
+    size_t decoded = 0;
+    size_t header_len = 0;
+    size_t object_size = 0;
+    err = decode_header(&dec, header, &decoded, &header_len, type, &object_size);
+
+    uint8_t *buffer = NULL;
+    size_t already = decoded - header_len;
+    if (err == SVCS_OK && already > object_size) {
+        err = SVCS_ERROR_CORRUPT;
+    }
+    if (err == SVCS_OK) {
+        buffer = malloc(object_size ? object_size : 1);
+        if (!buffer) {
+            err = SVCS_ERROR_MEMORY;
+        }
+    }
+
+    if (err == SVCS_OK) {
+        memcpy(buffer, header + header_len, already);
+
+        size_t produced;
+        err = decoder_read(&dec, buffer + already, object_size - already, &produced);
+        if (err == SVCS_OK && already + produced != object_size) {
+            err = SVCS_ERROR_CORRUPT;
+        }
+    }
+
+    // The stream must end exactly at the declared size
+    if (err == SVCS_OK && !dec.finished) {
+        uint8_t extra;
+        size_t produced;
+        err = decoder_read(&dec, &extra, 1, &produced);
+        if (err == SVCS_OK && (produced != 0 || !dec.finished)) {
+            err = SVCS_ERROR_CORRUPT;
+        }
+    }
+
+    decoder_end(&dec);
+
+    if (err != SVCS_OK) {
+        free(buffer);
+        return err;
+    }
+
+    *content = buffer;
+    *content_size = object_size;
+    return SVCS_OK;
+}
+
+// Decode only the "<type> <size>\0" header of a loose object. data may be
+// just a prefix of the object; if it is too short to hold the whole header
+// this fails and the caller can retry with more.
+svcs_error_t svcs_codec_decode_header(svcs_repository_t *repo, const void *data, size_t size,
+                                      svcs_object_type_t *type, size_t *object_size) {
+    if (!data || !type || !object_size || size == 0) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    decoder_t dec;
+    svcs_error_t err = decoder_init(&dec, repo, data, size);
+    if (err == SVCS_OK) {
+        uint8_t header[SVCS_OBJECT_HEADER_MAX];
+        size_t decoded;
+        size_t header_len;
+        err = decode_header(&dec, header, &decoded, &header_len, type, object_size);
+    }
+
+    decoder_end(&dec);
+    return err;
+}
+
+// Decode pack entry content: a codec byte and the encoded content with no
+// object header. The content must come out at exactly size bytes. data may
+// run on past the entry, so stored entries simply end after size bytes.
+svcs_error_t svcs_codec_decode_into(svcs_repository_t *repo, const void *data, size_t data_size,
+                                    void *output, size_t size) {
+    if (!data || (!output && size > 0) || data_size == 0) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    decoder_t dec;
+    svcs_error_t err = decoder_init(&dec, repo, data, data_size);
+
+    size_t produced = 0;
+    if (err == SVCS_OK) {
+        err = decoder_read(&dec, output, size, &produced);
+    }
+    if (err == SVCS_OK && produced != size) {
+        err = SVCS_ERROR_CORRUPT;
+    }
+
+    if (err == SVCS_OK && dec.codec != SVCS_CODEC_NONE && !dec.finished) {
+        uint8_t extra;
+        err = decoder_read(&dec, &extra, 1, &produced);
+        if (err == SVCS_OK && (produced != 0 || !dec.finished)) {
+            err = SVCS_ERROR_CORRUPT;
+        }
+    }
+
+    decoder_end(&dec);
+    return err;
+}
+
+// Decode only the first output_size bytes of pack entry content. Shorter
+// output means the content ended first.
+svcs_error_t svcs_codec_decode_prefix(svcs_repository_t *repo, const void *data, size_t data_size,
+                                      void *output, size_t output_size, size_t *produced) {
+    if (!data || !output || !produced || data_size == 0) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    decoder_t dec;
+    svcs_error_t err = decoder_init(&dec, repo, data, data_size);
+    if (err == SVCS_OK) {
+        err = decoder_read(&dec, output, output_size, produced);
+    }
+
+    decoder_end(&dec);
+    return err;
+}
+
+const char* svcs_codec_name(svcs_codec_t codec) {
+    switch (codec) {
+        case SVCS_CODEC_NONE: return "none";
+        case SVCS_CODEC_ZLIB: return "zlib";
+        case SVCS_CODEC_ZSTD: return "zstd";
+        default: return NULL;
+    }
+}
+
+// The codec new repositories are created with
+svcs_codec_t svcs_codec_default(void) {
+#ifdef HAVE_ZSTD
+    return SVCS_CODEC_ZSTD;
+#else
+    return SVCS_CODEC_ZLIB;
+#endif
+}
+
+#ifdef HAVE_ZSTD
+static svcs_error_t load_dict(svcs_repository_t *repo, svcs_codecs_t *codecs, const char *name) {
+    char path[SVCS_MAX_PATH];
+    snprintf(path, sizeof(path), "%s/%s/%s", repo->git_dir, SVCS_DICT_DIR, name);
+
+    void *data;
+    size_t size;
+    svcs_error_t err = svcs_file_read(path, &data, &size);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    uint32_t id = ZDICT_getDictID(data, size);
+    codec_dict_t *grown = realloc(codecs->dicts, (codecs->dict_count + 1) * sizeof(codec_dict_t));
+    if (!id || !grown) {
+        free(data);
+        return id ? SVCS_ERROR_MEMORY : SVCS_ERROR_CORRUPT;
+    }
+    codecs->dicts = grown;
+
+    // Both digested forms copy the dictionary content
+    codec_dict_t *dict = &codecs->dicts[codecs->dict_count];
+    dict->id = id;
+    dict->cdict = ZSTD_createCDict(data, size, ZSTD_LEVEL);
+    dict->ddict = ZSTD_createDDict(data, size);
+    free(data);
+
+    if (!dict->cdict || !dict->ddict) {
+        ZSTD_freeCDict(dict->cdict);
+        ZSTD_freeDDict(dict->ddict);
+        return SVCS_ERROR_MEMORY;
+    }
+
+    codecs->dict_count++;
+    return SVCS_OK;
+}
+#endif
+
+// Read core.compression / core.compressiondict and every stored dictionary.
+// Everything is loaded up front so concurrent readers and writers never
+// have to modify the codec state.
+svcs_error_t svcs_codec_load(svcs_repository_t *repo) {
+    if (!repo) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    svcs_codec_free(repo);
+
+    svcs_codecs_t *codecs = calloc(1, sizeof(svcs_codecs_t));
+    if (!codecs) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    // Repositories from before codecs existed only ever used zlib
+    char value[64];
+    codecs->codec = SVCS_CODEC_ZLIB;
+    if (svcs_config_get(repo, "core.compression", value, sizeof(value)) == SVCS_OK) {
+        if (strcmp(value, "none") == 0) {
+            codecs->codec = SVCS_CODEC_NONE;
+        } else if (strcmp(value, "zstd") == 0) {
+#ifdef HAVE_ZSTD
+            codecs->codec = SVCS_CODEC_ZSTD;
+#endif
+        } else if (strcmp(value, "zlib") != 0) {
+            free(codecs);
+            return SVCS_ERROR_INVALID;
+        }
+    }
+
+    if (svcs_config_get(repo, "core.compressiondict", value, sizeof(value)) == SVCS_OK) {
+        codecs->dict_id = (uint32_t)strtoul(value, NULL, 10);
+    }
+
+#ifdef HAVE_ZSTD
+    char dir_path[SVCS_MAX_PATH];
+    snprintf(dir_path, sizeof(dir_path), "%s/%s", repo->git_dir, SVCS_DICT_DIR);
+    DIR *dir = opendir(dir_path);
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            const char *ext = strrchr(entry->d_name, '.');
+            if (ext && strcmp(ext, ".zdict") == 0) {
+                load_dict(repo, codecs, entry->d_name);
+            }
+        }
+        closedir(dir);
+    }
+#endif
+
+    repo->codecs = codecs;
+    return SVCS_OK;
+}
+
+void svcs_codec_free(svcs_repository_t *repo) {
+    if (!repo || !repo->codecs) return;
+
+#ifdef HAVE_ZSTD
+    for (size_t i = 0; i < repo->codecs->dict_count; i++) {
+        ZSTD_freeCDict(repo->codecs->dicts[i].cdict);
+        ZSTD_freeDDict(repo->codecs->dicts[i].ddict);
+    }
+#endif
+    free(repo->codecs->dicts);
+    free(repo->codecs);
+    repo->codecs = NULL;
+}
+
+#ifdef HAVE_ZSTD
+static int compare_hashes(const void *a, const void *b) {
+    return memcmp(a, b, SVCS_HASH_SIZE);
+}
+
+// Every object in the repository, loose or packed, in hash order
+static svcs_error_t list_all_objects(svcs_repository_t *repo, svcs_hash_t **hashes, size_t *count) {
+    svcs_error_t err = svcs_pack_list_loose(repo, hashes, count);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    size_t total = *count;
+    for (svcs_pack_t *pack = svcs_pack_next(repo, NULL); pack; pack = svcs_pack_next(repo, pack)) {
+        total += svcs_pack_object_count(pack);
+    }
+
+    svcs_hash_t *all = realloc(*hashes, (total ? total : 1) * sizeof(svcs_hash_t));
+    if (!all) {
+        free(*hashes);
+        return SVCS_ERROR_MEMORY;
+    }
+    for (svcs_pack_t *pack = svcs_pack_next(repo, NULL); pack; pack = svcs_pack_next(repo, pack)) {
+        for (uint32_t pos = 0; pos < svcs_pack_object_count(pack); pos++) {
+            svcs_pack_hash_at(pack, pos, &all[(*count)++]);
+        }
+    }
+
+    // An object may be both loose and packed, or in several packs
+    qsort(all, *count, sizeof(svcs_hash_t), compare_hashes);
+    size_t unique = 0;
+    for (size_t i = 0; i < *count; i++) {
+        if (unique == 0 || svcs_hash_compare(&all[unique - 1], &all[i]) != 0) {
+            all[unique++] = all[i];
+        }
+    }
+
+    *hashes = all;
+    *count = unique;
+    return SVCS_OK;
+}
+#endif
+
+// Train a zstd dictionary from a sample of the repository's blobs and make
+// it the dictionary for new small objects
+svcs_error_t svcs_compression_train_dict(svcs_repository_t *repo, size_t max_samples, uint32_t *dict_id) {
+    if (!repo || !dict_id || max_samples == 0) {
+        return SVCS_ERROR_INVALID;
+    }
+
+#ifndef HAVE_ZSTD
+    return SVCS_ERROR_INVALID;
+#else
+    svcs_hash_t *hashes;
+    size_t count;
+    svcs_error_t err = list_all_objects(repo, &hashes, &count);
+    if (err != SVCS_OK) {
+        return err;
+    }
+    if (count == 0) {
+        free(hashes);
+        return SVCS_ERROR_INVALID;
+    }
+
+    // Spread the sample evenly over the (hash-ordered, so effectively random) objects
+    size_t stride = count > max_samples ? count / max_samples : 1;
+    svcs_buffer_t samples = {0};
+    size_t *sizes = malloc((count / stride + 1) * sizeof(size_t));
+    unsigned sample_count = 0;
+    if (!sizes) {
+        free(hashes);
+        return SVCS_ERROR_MEMORY;
+    }
+
+    for (size_t i = 0; i < count && sample_count < max_samples && err == SVCS_OK; i += stride) {
+        // Only decode objects that would actually be sampled
+        svcs_object_type_t type;
+        size_t size;
+        if (svcs_object_info(repo, &hashes[i], &type, &size) != SVCS_OK ||
+            type != SVCS_OBJ_BLOB || size == 0 || size > SVCS_CODEC_DICT_MAX_SIZE) {
+            continue;
+        }
+
+        svcs_object_t *obj;
+        if (svcs_object_read(repo, &hashes[i], &obj) != SVCS_OK) {
+            continue;
+        }
+        err = svcs_buffer_append(&samples, obj->data, obj->size);
+        sizes[sample_count++] = obj->size;
+        svcs_object_free(obj);
+    }
+    free(hashes);
+
+    // Nothing to learn from; zstd would only fail on it
+    if (err == SVCS_OK && sample_count == 0) {
+        svcs_buffer_free(&samples);
+        free(sizes);
+        return SVCS_ERROR_INVALID;
+    }
+
+    void *dict = malloc(SVCS_DICT_SIZE);
+    size_t dict_size = 0;
+    if (err == SVCS_OK && !dict) {
+        err = SVCS_ERROR_MEMORY;
+    }
+    if (err == SVCS_OK) {
+        // zstd rejects sample sets too small to learn anything from
+        dict_size = ZDICT_trainFromBuffer(dict, SVCS_DICT_SIZE, samples.data, sizes, sample_count);
+        if (ZDICT_isError(dict_size)) {
+            err = SVCS_ERROR;
+        }
+    }
+    svcs_buffer_free(&samples);
+    free(sizes);
+
+    char dir_path[SVCS_MAX_PATH];
+    char path[SVCS_MAX_PATH];
+    char value[32];
+    if (err == SVCS_OK) {
+        *dict_id = ZDICT_getDictID(dict, dict_size);
+        snprintf(dir_path, sizeof(dir_path), "%s/%s", repo->git_dir, SVCS_DICT_DIR);
+        snprintf(path, sizeof(path), "%s/%08x.zdict", dir_path, *dict_id);
+        snprintf(value, sizeof(value), "%u", *dict_id);
+        err = svcs_mkdir_recursive(dir_path);
+    }
+    if (err == SVCS_OK) {
+        err = svcs_file_write(path, dict, dict_size);
+    }
+    free(dict);
+
+    if (err == SVCS_OK) {
+        err = svcs_config_set(repo, "core.compressiondict", value);
+    }
+    if (err == SVCS_OK) {
+        err = svcs_codec_load(repo);
+    }
+    return err;
+#endif
+}
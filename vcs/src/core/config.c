@@ -0,0 +1,207 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "svcs.h"
+#include "internal.h"
+#include <strings.h>
+
+// Reader for .svcs/config, which uses git-config syntax:
+//
+//   [core]
+//   	objecthash = blake3
+//   [remote "origin"]
+//   	url = https://...
+//
+// Keys are looked up as "section.key" and match case-insensitively.
+// Subsection headers ([remote "origin"]) never match a plain section name.
+
+static const char* trim(const char *start, const char *end, size_t *len) {
+    while (start < end && (*start == ' ' || *start == '\t')) start++;
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+    *len = (size_t)(end - start);
+    return start;
+}
+
+svcs_error_t svcs_config_get(svcs_repository_t *repo, const char *name, char *value, size_t value_size) {
+    if (!repo || !name || !value || value_size == 0) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    const char *dot = strrchr(name, '.');
+    if (!dot || dot == name || dot[1] == '\0') {
+        return SVCS_ERROR_INVALID;
+    }
+    size_t section_len = (size_t)(dot - name);
+    const char *key = dot + 1;
+    size_t key_len = strlen(key);
+
+    char config_path[SVCS_MAX_PATH];
+    snprintf(config_path, sizeof(config_path), "%s/config", repo->git_dir);
+    if (!svcs_file_exists(config_path)) {
+        return SVCS_ERROR_NOT_FOUND;
+    }
+
+    void *data;
+    size_t size;
+    svcs_error_t err = svcs_file_read(config_path, &data, &size);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    // Later assignments override earlier ones, as in git
+    err = SVCS_ERROR_NOT_FOUND;
+    int in_section = 0;
+    const char *ptr = data;
+    const char *end = ptr + size;
+
+    while (ptr < end) {
+        const char *eol = memchr(ptr, '\n', (size_t)(end - ptr));
+        if (!eol) eol = end;
+
+        size_t len;
+        const char *line = trim(ptr, eol, &len);
+        ptr = eol + 1;
+
+        if (len == 0 || line[0] == '#' || line[0] == ';') {
+            continue;
+        }
+
+        if (line[0] == '[') {
+            const char *close = memchr(line, ']', len);
+            size_t header_len;
+            const char *header = close ? trim(line + 1, close, &header_len) : NULL;
+            in_section = header && header_len == section_len &&
+                         strncasecmp(header, name, section_len) == 0;
+            continue;
+        }
+
+        const char *eq = memchr(line, '=', len);
+        if (!in_section || !eq) {
+            continue;
+        }
+
+        size_t found_key_len;
+        const char *found_key = trim(line, eq, &found_key_len);
+        if (found_key_len != key_len || strncasecmp(found_key, key, key_len) != 0) {
+            continue;
+        }
+
+        size_t found_value_len;
+        const char *found_value = trim(eq + 1, line + len, &found_value_len);
+        if (found_value_len >= value_size) {
+            err = SVCS_ERROR_INVALID;
+            continue;
+        }
+        memcpy(value, found_value, found_value_len);
+        value[found_value_len] = '\0';
+        err = SVCS_OK;
+    }
+
+    free(data);
+    return err;
+}
+
+// Set "section.key" to value, replacing the last existing assignment or
+// adding the key to the end of the section (creating it if needed)
+svcs_error_t svcs_config_set(svcs_repository_t *repo, const char *name, const char *value) {
+    if (!repo || !name || !value || strchr(value, '\n')) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    const char *dot = strrchr(name, '.');
+    if (!dot || dot == name || dot[1] == '\0') {
+        return SVCS_ERROR_INVALID;
+    }
+    size_t section_len = (size_t)(dot - name);
+    const char *key = dot + 1;
+    size_t key_len = strlen(key);
+
+    char config_path[SVCS_MAX_PATH];
+    snprintf(config_path, sizeof(config_path), "%s/config", repo->git_dir);
+
+    void *data = NULL;
+    size_t size = 0;
+    if (svcs_file_exists(config_path)) {
+        svcs_error_t err = svcs_file_read(config_path, &data, &size);
+        if (err != SVCS_OK) {
+            return err;
+        }
+    }
+
+    // Offsets into the old file: the line to replace, or where to insert
+    const char *base = data;
+    const char *replace_start = NULL;
+    const char *replace_end = NULL;
+    const char *section_end = NULL;
+    int in_section = 0;
+
+    const char *ptr = base;
+    const char *end = base + size;
+    while (ptr < end) {
+        const char *eol = memchr(ptr, '\n', (size_t)(end - ptr));
+        const char *next = eol ? eol + 1 : end;
+        if (!eol) eol = end;
+
+        size_t len;
+        const char *line = trim(ptr, eol, &len);
+
+        if (len > 0 && line[0] == '[') {
+            const char *close = memchr(line, ']', len);
+            size_t header_len;
+            const char *header = close ? trim(line + 1, close, &header_len) : NULL;
+            in_section = header && header_len == section_len &&
+                         strncasecmp(header, name, section_len) == 0;
+        } else if (in_section) {
+            const char *eq = memchr(line, '=', len);
+            size_t found_key_len;
+            const char *found_key = eq ? trim(line, eq, &found_key_len) : NULL;
+            if (found_key && found_key_len == key_len && strncasecmp(found_key, key, key_len) == 0) {
+                replace_start = ptr;
+                replace_end = next;
+            }
+        }
+
+        if (in_section) {
+            section_end = next;
+        }
+        ptr = next;
+    }
+
+    svcs_buffer_t out = {0};
+    char assignment[1024];
+    int assignment_len = snprintf(assignment, sizeof(assignment), "\t%s = %s\n", key, value);
+    if (assignment_len < 0 || (size_t)assignment_len >= sizeof(assignment)) {
+        free(data);
+        return SVCS_ERROR_INVALID;
+    }
+
+    svcs_error_t err;
+    if (replace_start) {
+        err = svcs_buffer_append(&out, base, (size_t)(replace_start - base));
+        if (err == SVCS_OK) err = svcs_buffer_append(&out, assignment, assignment_len);
+        if (err == SVCS_OK) err = svcs_buffer_append(&out, replace_end, (size_t)(end - replace_end));
+    } else if (section_end) {
+        err = svcs_buffer_append(&out, base, (size_t)(section_end - base));
+        if (err == SVCS_OK && section_end > base && section_end[-1] != '\n') {
+            err = svcs_buffer_append(&out, "\n", 1);
+        }
+        if (err == SVCS_OK) err = svcs_buffer_append(&out, assignment, assignment_len);
+        if (err == SVCS_OK) err = svcs_buffer_append(&out, section_end, (size_t)(end - section_end));
+    } else {
+        char header[256];
+        int header_len = snprintf(header, sizeof(header), "[%.*s]\n", (int)section_len, name);
+        err = svcs_buffer_append(&out, base, size);
+        if (err == SVCS_OK && size > 0 && base[size - 1] != '\n') {
+            err = svcs_buffer_append(&out, "\n", 1);
+        }
+        if (err == SVCS_OK) err = svcs_buffer_append(&out, header, header_len);
+        if (err == SVCS_OK) err = svcs_buffer_append(&out, assignment, assignment_len);
+    }
+
+    if (err == SVCS_OK) {
+        err = svcs_repo_write_file(repo, config_path, out.data, out.size);
+    }
+
+    svcs_buffer_free(&out);
+    free(data);
+    return err;
+}
@@ -27,6 +27,9 @@ std::string CommitNode::short_hash() const {
 CommitDAG::CommitDAG(svcs_repository_t* repo) : repository(repo) {
 }
 
+// Commits in the commit graph come straight from the mapped file, and only
+// commits made since it was written are parsed. Messages and authors are
+// not in the graph; load_details reads them for the commits that are shown.
 svcs_error_t CommitDAG::load_from_repository() {
     if (!repository) {
         return SVCS_ERROR_INVALID;
@@ -34,46 +37,135 @@ svcs_error_t CommitDAG::load_from_repository() {
     
     clear();
     
-    // Load all commits from repository
-    // This is a simplified implementation - in a real system, you'd walk the commit graph
-    char refs_dir[SVCS_MAX_PATH];
-    snprintf(refs_dir, sizeof(refs_dir), "%s/refs/heads", repository->git_dir);
-    
-    DIR* dir = opendir(refs_dir);
-    if (!dir) {
-        return SVCS_ERROR_NOT_FOUND;
+    std::vector<std::pair<std::shared_ptr<CommitNode>, std::vector<svcs_hash_t>>> links;
+    auto add_node = [&](const svcs_hash_t& hash, const svcs_commit_info_t& info) {
+        auto node = std::make_shared<CommitNode>(hash, "", "", static_cast<time_t>(info.time));
+        node->generation = info.generation;
+        nodes[node->hash_string()] = node;
+        links.emplace_back(node, std::vector<svcs_hash_t>(info.parents, info.parents + info.parent_count));
+    };
+    
+    size_t graph_count = svcs_commit_graph_count(repository);
+    nodes.reserve(graph_count);
+    links.reserve(graph_count);
+    for (size_t i = 0; i < graph_count; i++) {
+        svcs_hash_t hash;
+        svcs_commit_info_t info;
+        svcs_error_t err = svcs_commit_graph_entry(repository, i, &hash, &info);
+        if (err != SVCS_OK) {
+            return err;
+        }
+        add_node(hash, info);
     }
     
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_name[0] == '.') continue;
+    // Walk back from the refs until reaching commits already in the graph
+    std::vector<svcs_hash_t> pending;
+    svcs_refs_for_each(repository, [](const svcs_hash_t* hash, void* arg) -> svcs_error_t {
+        static_cast<std::vector<svcs_hash_t>*>(arg)->push_back(*hash);
+        return SVCS_OK;
+    }, &pending);
+    
+    while (!pending.empty()) {
+        svcs_hash_t hash = pending.back();
+        pending.pop_back();
         
-        char branch_file[SVCS_MAX_PATH];
-        snprintf(branch_file, sizeof(branch_file), "%s/%s", refs_dir, entry->d_name);
+        char hash_str[SVCS_HASH_HEX_SIZE];
+        svcs_hash_to_string(&hash, hash_str);
+        if (nodes.count(hash_str)) {
+            continue;
+        }
         
-        void* branch_data;
-        size_t branch_size;
-        if (svcs_file_read(branch_file, &branch_data, &branch_size) == SVCS_OK) {
-            char* hash_str = (char*)branch_data;
-            char* newline = strchr(hash_str, '\n');
-            if (newline) *newline = '\0';
-            
-            // Load commit chain from this branch head
-            svcs_hash_t current_hash;
-            if (svcs_hash_from_string(&current_hash, hash_str) == SVCS_OK) {
-                load_commit_chain(current_hash, entry->d_name);
+        // Refs may name tags or other non-commits
+        svcs_commit_info_t info;
+        if (svcs_commit_info(repository, &hash, &info) != SVCS_OK) {
+            continue;
+        }
+        add_node(hash, info);
+        pending.insert(pending.end(), info.parents, info.parents + info.parent_count);
+    }
+    
+    for (auto& [node, parent_hashes] : links) {
+        for (const auto& parent_hash : parent_hashes) {
+            char parent_str[SVCS_HASH_HEX_SIZE];
+            svcs_hash_to_string(&parent_hash, parent_str);
+            auto parent_it = nodes.find(parent_str);
+            if (parent_it != nodes.end()) {
+                node->parents.push_back(parent_it->second);
+                parent_it->second->children.push_back(node);
             }
-            
-            free(branch_data);
         }
     }
     
-    closedir(dir);
+    for (auto& [node, parent_hashes] : links) {
+        if (node->is_root_commit()) {
+            roots.push_back(node);
+        }
+        if (node->is_leaf_commit()) {
+            heads.push_back(node);
+        }
+    }
+    
+    svcs_branch_t* branches = nullptr;
+    size_t branch_count = 0;
+    if (svcs_branch_list(repository, &branches, &branch_count) == SVCS_OK) {
+        for (size_t i = 0; i < branch_count; i++) {
+            char hash_str[SVCS_HASH_HEX_SIZE];
+            svcs_hash_to_string(&branches[i].commit_hash, hash_str);
+            auto it = nodes.find(hash_str);
+            if (it != nodes.end()) {
+                it->second->branch_name = branches[i].name;
+            }
+        }
+        free(branches);
+    }
     
     calculate_depths();
     return SVCS_OK;
 }
 
+// Fill in the message and author of a commit from its object
+svcs_error_t CommitDAG::load_details(const std::shared_ptr<CommitNode>& node) const {
+    if (!node || node->details_loaded) {
+        return SVCS_OK;
+    }
+    
+    svcs_object_t* obj;
+    svcs_error_t err = svcs_object_read(repository, &node->hash, &obj);
+    if (err != SVCS_OK) {
+        return err;
+    }
+    
+    std::string content(static_cast<const char*>(obj->data), obj->size);
+    svcs_object_free(obj);
+    
+    size_t body = content.find("\n\n");
+    std::string headers = content.substr(0, body);
+    size_t author_pos = headers.rfind("author ", 0) == 0 ? 0 : headers.find("\nauthor ");
+    if (author_pos != std::string::npos) {
+        size_t start = author_pos == 0 ? 7 : author_pos + 8;
+        size_t end = headers.find('\n', start);
+        std::string author = headers.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        
+        // Drop the trailing "<seconds> <timezone>"
+        for (int i = 0; i < 2; i++) {
+            size_t space = author.rfind(' ');
+            if (space != std::string::npos) {
+                author.resize(space);
+            }
+        }
+        node->author = author;
+    }
+    
+    if (body != std::string::npos) {
+        std::string message = content.substr(body + 2);
+        size_t newline = message.find('\n');
+        node->message = message.substr(0, newline);
+    }
+    
+    node->details_loaded = true;
+    return SVCS_OK;
+}
+
 svcs_error_t CommitDAG::add_commit(const svcs_hash_t& hash, const std::string& message,
                                   const std::string& author, time_t timestamp,
                                   const std::vector<svcs_hash_t>& parent_hashes) {
@@ -336,34 +428,22 @@ std::shared_ptr<CommitNode> CommitDAG::resolve_reference(const std::string& ref)
     return nullptr;
 }
 
-// Helper method to load commit chain (simplified implementation)
-svcs_error_t CommitDAG::load_commit_chain(const svcs_hash_t& start_hash, const std::string& branch_name) {
-    // This is a simplified implementation
-    // In a real system, you'd recursively load commits and their parents
-    
-    std::string hash_str;
-    char hash_cstr[SVCS_HASH_HEX_SIZE];
-    svcs_hash_to_string(&start_hash, hash_cstr);
-    hash_str = hash_cstr;
-    
-    // Check if already loaded
-    if (nodes.find(hash_str) != nodes.end()) {
-        return SVCS_OK;
+std::shared_ptr<CommitNode> CommitDAG::get_merge_base(const std::string& commit1, const std::string& commit2) const {
+    auto node1 = get_commit(commit1);
+    auto node2 = get_commit(commit2);
+    if (!node1 || !node2) {
+        return nullptr;
     }
     
-    // Create a mock commit for demonstration
-    auto commit_node = std::make_shared<CommitNode>(
-        start_hash, 
-        "Sample commit message", 
-        "Author <author@example.com>", 
-        time(nullptr)
-    );
-    commit_node->branch_name = branch_name;
-    
-    nodes[hash_str] = commit_node;
-    heads.push_back(commit_node);
+    svcs_hash_t base;
+    if (svcs_commit_merge_base(repository, &node1->hash, &node2->hash, &base) != SVCS_OK) {
+        return nullptr;
+    }
     
-    return SVCS_OK;
+    char base_str[SVCS_HASH_HEX_SIZE];
+    svcs_hash_to_string(&base, base_str);
+    auto it = nodes.find(base_str);
+    return it != nodes.end() ? it->second : nullptr;
 }
 
 // GraphVisualizer implementation
@@ -385,6 +465,9 @@ std::string GraphVisualizer::generate_ascii_tree(const CommitDAG& dag, const Vis
         }
         
         // Add commit info
+        if (options.show_commit_messages || options.show_authors) {
+            dag.load_details(commit);
+        }
         std::string commit_info = format_commit_info(commit, options);
         
         oss << graph_part << commit_info << std::endl;
@@ -425,6 +508,7 @@ std::string GraphVisualizer::generate_compact_log(const CommitDAG& dag, const Co
     auto commits = dag.get_commits_in_range(range);
     
     for (const auto& commit : commits) {
+        dag.load_details(commit);
         oss << commit->short_hash() << " " << commit->message << std::endl;
     }
     
@@ -29,6 +29,8 @@ public:
     std::vector<std::weak_ptr<CommitNode>> children;
     
     // Metadata
+    uint32_t generation = SVCS_GENERATION_INFINITY;  // From the commit graph
+    bool details_loaded = false;  // Message and author read (see CommitDAG::load_details)
     int depth = 0;  // Distance from root
     bool visited = false;  // For traversal algorithms
     std::string branch_name;
@@ -91,6 +93,7 @@ public:
                            const std::string& author, time_t timestamp,
                            const std::vector<svcs_hash_t>& parent_hashes);
     svcs_error_t rebuild();
+    svcs_error_t load_details(const std::shared_ptr<CommitNode>& node) const;
     
     // Querying
     std::shared_ptr<CommitNode> get_commit(const std::string& hash_or_ref) const;
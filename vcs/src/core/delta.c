@@ -0,0 +1,298 @@
+#include "svcs.h"
+#include "internal.h"
+
+// Deltas describe a target object as a stream of instructions against a
+// base object:
+//
+//   varint base size | varint target size | instructions...
+//
+//   copy:   1xxxxxxx [offset bytes] [size bytes]
+//           bits 0-3 select which little-endian offset bytes follow,
+//           bits 4-6 select which size bytes follow (size 0 means 64 KiB)
+//   insert: 0nnnnnnn followed by n (1-127) literal bytes
+
+#define DELTA_BLOCK_SIZE 16
+#define DELTA_MAX_CHAIN 64
+#define DELTA_MAX_COPY 0x10000
+#define DELTA_MAX_INSERT 127
+
+typedef struct {
+    uint32_t *heads;  // block hash -> base offset + 1 of the latest block
+    uint32_t *next;   // block number -> base offset + 1 of the previous block
+    uint32_t mask;
+} delta_index_t;
+
+static uint32_t hash_block(const uint8_t *data) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < DELTA_BLOCK_SIZE; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static svcs_error_t index_base(delta_index_t *index, const uint8_t *base, size_t base_size) {
+    size_t blocks = base_size / DELTA_BLOCK_SIZE;
+    size_t buckets = 16;
+    while (buckets < blocks) {
+        buckets <<= 1;
+    }
+
+    index->heads = calloc(buckets, sizeof(uint32_t));
+    index->next = calloc(blocks ? blocks : 1, sizeof(uint32_t));
+    index->mask = (uint32_t)(buckets - 1);
+    if (!index->heads || !index->next) {
+        free(index->heads);
+        free(index->next);
+        return SVCS_ERROR_MEMORY;
+    }
+
+    for (size_t block = 0; block < blocks; block++) {
+        uint32_t offset = (uint32_t)(block * DELTA_BLOCK_SIZE);
+        uint32_t bucket = hash_block(base + offset) & index->mask;
+        index->next[block] = index->heads[bucket];
+        index->heads[bucket] = offset + 1;
+    }
+
+    return SVCS_OK;
+}
+
+static size_t encode_varint(uint8_t *out, size_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+static int decode_varint(const uint8_t **ptr, const uint8_t *end, size_t *value) {
+    size_t result = 0;
+    unsigned shift = 0;
+    while (*ptr < end && shift < 64) {
+        uint8_t byte = *(*ptr)++;
+        result |= (size_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 1;
+        }
+        shift += 7;
+    }
+    return 0;
+}
+
+static int emit_inserts(svcs_buffer_t *out, const uint8_t *data, size_t len, size_t max_size) {
+    while (len > 0) {
+        uint8_t n = (uint8_t)(len > DELTA_MAX_INSERT ? DELTA_MAX_INSERT : len);
+        if (svcs_buffer_append(out, &n, 1) != SVCS_OK ||
+            svcs_buffer_append(out, data, n) != SVCS_OK) {
+            return 0;
+        }
+        data += n;
+        len -= n;
+        if (out->size > max_size) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int emit_copy(svcs_buffer_t *out, size_t offset, size_t len, size_t max_size) {
+    while (len > 0) {
+        size_t chunk = len > DELTA_MAX_COPY ? DELTA_MAX_COPY : len;
+        uint8_t op[8];
+        size_t n = 1;
+        op[0] = 0x80;
+
+        for (int i = 0; i < 4; i++) {
+            uint8_t byte = (uint8_t)(offset >> (8 * i));
+            if (byte) {
+                op[0] |= (uint8_t)(1 << i);
+                op[n++] = byte;
+            }
+        }
+
+        size_t encoded = chunk == DELTA_MAX_COPY ? 0 : chunk;
+        for (int i = 0; i < 3; i++) {
+            uint8_t byte = (uint8_t)(encoded >> (8 * i));
+            if (byte) {
+                op[0] |= (uint8_t)(0x10 << i);
+                op[n++] = byte;
+            }
+        }
+
+        if (svcs_buffer_append(out, op, n) != SVCS_OK || out->size > max_size) {
+            return 0;
+        }
+
+        offset += chunk;
+        len -= chunk;
+    }
+    return 1;
+}
+
+svcs_error_t svcs_delta_create(const void *base_data, size_t base_size,
+                               const void *target_data, size_t target_size,
+                               size_t max_delta_size, void **delta, size_t *delta_size) {
+    if (!base_data || !target_data || !delta || !delta_size || base_size > UINT32_MAX) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    const uint8_t *base = base_data;
+    const uint8_t *target = target_data;
+
+    delta_index_t index;
+    svcs_error_t err = index_base(&index, base, base_size);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    svcs_buffer_t out = {0};
+    uint8_t header[20];
+    size_t header_len = encode_varint(header, base_size);
+    header_len += encode_varint(header + header_len, target_size);
+    int ok = svcs_buffer_append(&out, header, header_len) == SVCS_OK;
+
+    size_t pos = 0;
+    size_t literal_start = 0;
+
+    while (ok && pos + DELTA_BLOCK_SIZE <= target_size) {
+        uint32_t bucket = hash_block(target + pos) & index.mask;
+        size_t best_offset = 0;
+        size_t best_len = 0;
+        int chain = 0;
+
+        for (uint32_t entry = index.heads[bucket]; entry && chain < DELTA_MAX_CHAIN;
+             entry = index.next[(entry - 1) / DELTA_BLOCK_SIZE], chain++) {
+            size_t offset = entry - 1;
+            if (memcmp(base + offset, target + pos, DELTA_BLOCK_SIZE) != 0) {
+                continue;
+            }
+
+            size_t len = DELTA_BLOCK_SIZE;
+            while (offset + len < base_size && pos + len < target_size &&
+                   base[offset + len] == target[pos + len]) {
+                len++;
+            }
+
+            if (len > best_len) {
+                best_len = len;
+                best_offset = offset;
+            }
+        }
+
+        if (best_len < DELTA_BLOCK_SIZE) {
+            pos++;
+            continue;
+        }
+
+        // Grow the match backwards over bytes that would otherwise be inserted
+        while (best_offset > 0 && pos > literal_start && base[best_offset - 1] == target[pos - 1]) {
+            best_offset--;
+            pos--;
+            best_len++;
+        }
+
+        ok = emit_inserts(&out, target + literal_start, pos - literal_start, max_delta_size) &&
+             emit_copy(&out, best_offset, best_len, max_delta_size);
+
+        pos += best_len;
+        literal_start = pos;
+    }
+
+    if (ok) {
+        ok = emit_inserts(&out, target + literal_start, target_size - literal_start, max_delta_size);
+    }
+
+    free(index.heads);
+    free(index.next);
+
+    if (!ok || out.size > max_delta_size) {
+        svcs_buffer_free(&out);
+        return SVCS_ERROR;
+    }
+
+    *delta = out.data;
+    *delta_size = out.size;
+    return SVCS_OK;
+}
+
+svcs_error_t svcs_delta_target_size(const void *delta, size_t delta_size, size_t *target_size) {
+    const uint8_t *ptr = delta;
+    const uint8_t *end = ptr + delta_size;
+    size_t base_size;
+
+    if (!decode_varint(&ptr, end, &base_size) || !decode_varint(&ptr, end, target_size)) {
+        return SVCS_ERROR_CORRUPT;
+    }
+    return SVCS_OK;
+}
+
+svcs_error_t svcs_delta_apply(const void *base_data, size_t base_size,
+                              const void *delta, size_t delta_size,
+                              void **target, size_t *target_size) {
+    if (!base_data || !delta || !target || !target_size) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    const uint8_t *base = base_data;
+    const uint8_t *ptr = delta;
+    const uint8_t *end = ptr + delta_size;
+    size_t expected_base;
+    size_t size;
+
+    if (!decode_varint(&ptr, end, &expected_base) || !decode_varint(&ptr, end, &size) ||
+        expected_base != base_size) {
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    uint8_t *out = malloc(size ? size : 1);
+    if (!out) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    size_t written = 0;
+    while (ptr < end) {
+        uint8_t op = *ptr++;
+
+        if (op & 0x80) {
+            size_t offset = 0;
+            size_t len = 0;
+            for (int i = 0; i < 4; i++) {
+                if (op & (1 << i)) {
+                    if (ptr >= end) goto corrupt;
+                    offset |= (size_t)*ptr++ << (8 * i);
+                }
+            }
+            for (int i = 0; i < 3; i++) {
+                if (op & (0x10 << i)) {
+                    if (ptr >= end) goto corrupt;
+                    len |= (size_t)*ptr++ << (8 * i);
+                }
+            }
+            if (len == 0) {
+                len = DELTA_MAX_COPY;
+            }
+            if (offset + len > base_size || written + len > size) goto corrupt;
+            memcpy(out + written, base + offset, len);
+            written += len;
+        } else if (op > 0) {
+            if ((size_t)(end - ptr) < op || written + op > size) goto corrupt;
+            memcpy(out + written, ptr, op);
+            ptr += op;
+            written += op;
+        } else {
+            goto corrupt;
+        }
+    }
+
+    if (written != size) goto corrupt;
+
+    *target = out;
+    *target_size = size;
+    return SVCS_OK;
+
+corrupt:
+    free(out);
+    return SVCS_ERROR_CORRUPT;
+}
@@ -0,0 +1,604 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "svcs.h"
+#include "internal.h"
+#include <errno.h>
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+// Filesystem monitor. `svcs fsmonitor` watches every directory of the
+// worktree with inotify and journals the paths that change, each under a
+// sequence number. Status asks it over a Unix socket in the repository
+// directory what changed since the token it saved last time, and only
+// looks at those paths; entries it found clean before and that are not
+// named are taken as they are.
+//
+// One request per connection:
+//
+//   request   "query <token>\n" or "stop\n"
+//   response  "ok <token>\n" followed by the paths changed since the old
+//             token, relative to the worktree and each ending in NUL, or
+//             "all <token>\n" when the journal cannot answer for it
+//
+// A token is "<instance>:<sequence>". The instance changes with every
+// start, so tokens from an earlier daemon get "all". So do tokens from
+// before an inotify queue overflow or a journal reset, since changes from
+// that time may be missing.
+
+#define FSMONITOR_SOCKET "fsmonitor.sock"
+#define FSMONITOR_TIMEOUT_MS 1000
+#define FSMONITOR_REQUEST_MAX (SVCS_FSMONITOR_TOKEN_SIZE + 16)
+
+static svcs_error_t socket_address(svcs_repository_t *repo, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    int len = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/%s", repo->git_dir, FSMONITOR_SOCKET);
+    return len > 0 && (size_t)len < sizeof(addr->sun_path) ? SVCS_OK : SVCS_ERROR_INVALID;
+}
+
+static void set_timeouts(int fd) {
+    struct timeval timeout = { FSMONITOR_TIMEOUT_MS / 1000, (FSMONITOR_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+// A daemon that stops answering costs status at most the timeout
+static int connect_monitor(svcs_repository_t *repo) {
+    struct sockaddr_un addr;
+    if (socket_address(repo, &addr) != SVCS_OK) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    set_timeouts(fd);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static svcs_error_t send_all(int fd, const void *data, size_t size) {
+    const uint8_t *ptr = data;
+    while (size > 0) {
+        ssize_t n = send(fd, ptr, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return SVCS_ERROR_IO;
+        }
+        ptr += n;
+        size -= (size_t)n;
+    }
+    return SVCS_OK;
+}
+
+static svcs_error_t recv_all(int fd, svcs_buffer_t *buf) {
+    uint8_t chunk[4096];
+    for (;;) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return SVCS_ERROR_IO;
+        }
+        if (n == 0) {
+            return SVCS_OK;
+        }
+        svcs_error_t err = svcs_buffer_append(buf, chunk, (size_t)n);
+        if (err != SVCS_OK) {
+            return err;
+        }
+    }
+}
+
+// Sends a request and returns the whole response
+static svcs_error_t monitor_request(svcs_repository_t *repo, const char *request, svcs_buffer_t *response) {
+    int fd = connect_monitor(repo);
+    if (fd < 0) {
+        return SVCS_ERROR_NOT_FOUND;
+    }
+
+    svcs_error_t err = send_all(fd, request, strlen(request));
+    if (err == SVCS_OK) {
+        shutdown(fd, SHUT_WR);
+        err = recv_all(fd, response);
+    }
+    close(fd);
+    return err;
+}
+
+svcs_error_t svcs_fsmonitor_query(svcs_repository_t *repo, const char *token, char *new_token, size_t token_size,
+                                  svcs_buffer_t *changed, int *complete) {
+    if (!repo || !token || !new_token || !changed || !complete) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    char request[FSMONITOR_REQUEST_MAX];
+    int len = snprintf(request, sizeof(request), "query %s\n", token);
+    if (len < 0 || (size_t)len >= sizeof(request) || strchr(token, '\n') || strchr(token, ' ')) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    svcs_buffer_t response = {0};
+    svcs_error_t err = monitor_request(repo, request, &response);
+    if (err != SVCS_OK) {
+        svcs_buffer_free(&response);
+        return err;
+    }
+
+    // Status line, then NUL-terminated paths
+    uint8_t *line_end = response.size ? memchr(response.data, '\n', response.size) : NULL;
+    const char *word_end = line_end ? memchr(response.data, ' ', (size_t)(line_end - response.data)) : NULL;
+    size_t rest = line_end ? response.size - (size_t)(line_end + 1 - response.data) : 0;
+    if (!word_end || (size_t)(line_end - (const uint8_t*)word_end - 1) >= token_size ||
+        (rest > 0 && response.data[response.size - 1] != '\0')) {
+        svcs_buffer_free(&response);
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    size_t word_len = (size_t)(word_end - (const char*)response.data);
+    if (word_len == 2 && memcmp(response.data, "ok", 2) == 0) {
+        *complete = 1;
+    } else if (word_len == 3 && memcmp(response.data, "all", 3) == 0) {
+        *complete = 0;
+    } else {
+        svcs_buffer_free(&response);
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    size_t new_len = (size_t)(line_end - (const uint8_t*)word_end - 1);
+    memcpy(new_token, word_end + 1, new_len);
+    new_token[new_len] = '\0';
+
+    changed->size = 0;
+    err = svcs_buffer_append(changed, line_end + 1, rest);
+    svcs_buffer_free(&response);
+    return err;
+}
+
+svcs_error_t svcs_fsmonitor_stop(svcs_repository_t *repo) {
+    if (!repo) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    svcs_buffer_t response = {0};
+    svcs_error_t err = monitor_request(repo, "stop\n", &response);
+    svcs_buffer_free(&response);
+    return err;
+}
+
+#ifdef __linux__
+
+#define FSMONITOR_EVENTS (IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | \
+                          IN_DELETE_SELF | IN_ONLYDIR)
+#define FSMONITOR_JOURNAL_MAX (1 << 16)
+
+typedef struct {
+    uint64_t seq;
+    char *path;  // Relative to the worktree
+} journal_entry_t;
+
+typedef struct {
+    svcs_repository_t *repo;
+    int inotify_fd;
+    char instance[32];
+    uint64_t seq;   // Last sequence number handed out
+    uint64_t base;  // Tokens from before this get "all"
+    journal_entry_t *journal;
+    size_t journal_count;
+    size_t journal_capacity;
+    char **watches;  // Directory relative to the worktree, by watch descriptor
+    size_t watch_capacity;
+    int rewatch;     // A directory moved; its watches name the old path
+} monitor_t;
+
+// Drops the journal. Tokens handed out so far can no longer be answered.
+static void journal_reset(monitor_t *m) {
+    for (size_t i = 0; i < m->journal_count; i++) {
+        free(m->journal[i].path);
+    }
+    m->journal_count = 0;
+    m->base = ++m->seq;
+}
+
+static void journal_add(monitor_t *m, const char *path) {
+    // Writers touch the same file many times in a row
+    if (m->journal_count > 0 && strcmp(m->journal[m->journal_count - 1].path, path) == 0) {
+        m->journal[m->journal_count - 1].seq = ++m->seq;
+        return;
+    }
+
+    if (m->journal_count == FSMONITOR_JOURNAL_MAX) {
+        journal_reset(m);
+    }
+    if (m->journal_count == m->journal_capacity) {
+        size_t capacity = m->journal_capacity ? m->journal_capacity * 2 : 256;
+        journal_entry_t *grown = realloc(m->journal, capacity * sizeof(journal_entry_t));
+        if (!grown) {
+            journal_reset(m);
+            return;
+        }
+        m->journal = grown;
+        m->journal_capacity = capacity;
+    }
+
+    char *copy = strdup(path);
+    if (!copy) {
+        journal_reset(m);
+        return;
+    }
+    m->journal[m->journal_count].seq = ++m->seq;
+    m->journal[m->journal_count++].path = copy;
+}
+
+static void join_path(char *out, size_t size, const char *dir, const char *name) {
+    if (dir[0]) {
+        snprintf(out, size, "%s/%s", dir, name);
+    } else {
+        snprintf(out, size, "%s", name);
+    }
+}
+
+static svcs_error_t add_watch(monitor_t *m, const char *abs_path, const char *rel) {
+    int wd = inotify_add_watch(m->inotify_fd, abs_path, FSMONITOR_EVENTS);
+    if (wd < 0) {
+        // Gone again already; its removal is in the journal
+        return errno == ENOENT || errno == ENOTDIR ? SVCS_OK : SVCS_ERROR_IO;
+    }
+
+    if ((size_t)wd >= m->watch_capacity) {
+        size_t capacity = m->watch_capacity ? m->watch_capacity : 64;
+        while (capacity <= (size_t)wd) {
+            capacity *= 2;
+        }
+        char **grown = realloc(m->watches, capacity * sizeof(char*));
+        if (!grown) {
+            return SVCS_ERROR_MEMORY;
+        }
+        memset(grown + m->watch_capacity, 0, (capacity - m->watch_capacity) * sizeof(char*));
+        m->watches = grown;
+        m->watch_capacity = capacity;
+    }
+
+    char *copy = strdup(rel);
+    if (!copy) {
+        return SVCS_ERROR_MEMORY;
+    }
+    free(m->watches[wd]);
+    m->watches[wd] = copy;
+    return SVCS_OK;
+}
+
+// Watches rel and every directory below it. For a directory created while
+// running, its contents may have been written before the watch existed,
+// so they are journaled as well.
+static svcs_error_t watch_tree(monitor_t *m, const char *rel, int journal) {
+    char abs_path[SVCS_MAX_PATH];
+    join_path(abs_path, sizeof(abs_path), m->repo->work_dir, rel);
+    if (!rel[0]) {
+        snprintf(abs_path, sizeof(abs_path), "%s", m->repo->work_dir);
+    }
+
+    svcs_error_t err = add_watch(m, abs_path, rel);
+    DIR *dir = err == SVCS_OK ? opendir(abs_path) : NULL;
+    if (!dir) {
+        return err;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && err == SVCS_OK) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+            (!rel[0] && strcmp(entry->d_name, ".svcs") == 0)) {
+            continue;
+        }
+
+        char child[SVCS_MAX_PATH];
+        char child_abs[SVCS_MAX_PATH];
+        join_path(child, sizeof(child), rel, entry->d_name);
+        join_path(child_abs, sizeof(child_abs), m->repo->work_dir, child);
+        if (journal) {
+            journal_add(m, child);
+        }
+
+        struct stat st;
+        if (lstat(child_abs, &st) == 0 && S_ISDIR(st.st_mode)) {
+            err = watch_tree(m, child, journal);
+        }
+    }
+    closedir(dir);
+    return err;
+}
+
+static void free_watches(monitor_t *m) {
+    for (size_t i = 0; i < m->watch_capacity; i++) {
+        free(m->watches[i]);
+    }
+    free(m->watches);
+    m->watches = NULL;
+    m->watch_capacity = 0;
+}
+
+// Watches the whole worktree from scratch
+static svcs_error_t watch_all(monitor_t *m) {
+    if (m->inotify_fd >= 0) {
+        close(m->inotify_fd);
+    }
+    free_watches(m);
+    m->rewatch = 0;
+
+    m->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m->inotify_fd < 0) {
+        return SVCS_ERROR_IO;
+    }
+    return watch_tree(m, "", 0);
+}
+
+static svcs_error_t handle_event(monitor_t *m, const struct inotify_event *event) {
+    if (event->mask & IN_Q_OVERFLOW) {
+        journal_reset(m);
+        return SVCS_OK;
+    }
+    if (event->wd < 0 || (size_t)event->wd >= m->watch_capacity || !m->watches[event->wd]) {
+        return SVCS_OK;
+    }
+    if (event->mask & IN_IGNORED) {
+        free(m->watches[event->wd]);
+        m->watches[event->wd] = NULL;
+        return SVCS_OK;
+    }
+
+    const char *dir = m->watches[event->wd];
+    char path[SVCS_MAX_PATH];
+    join_path(path, sizeof(path), dir, event->len ? event->name : "");
+    if (!event->len) {
+        snprintf(path, sizeof(path), "%s", dir);
+    }
+    if (!path[0] || strcmp(path, ".svcs") == 0) {
+        return SVCS_OK;
+    }
+
+    // Watches below a moved directory still carry its old path
+    if ((event->mask & IN_ISDIR) && (event->mask & (IN_MOVED_FROM | IN_MOVED_TO))) {
+        m->rewatch = 1;
+        return SVCS_OK;
+    }
+
+    journal_add(m, path);
+    if ((event->mask & IN_ISDIR) && (event->mask & IN_CREATE)) {
+        return watch_tree(m, path, 1);
+    }
+    return SVCS_OK;
+}
+
+// Journals every event queued so far. Events are queued by the change
+// itself, so everything done before a request arrived is seen.
+static svcs_error_t drain_events(monitor_t *m) {
+    _Alignas(struct inotify_event) char buf[16384];
+    svcs_error_t err = SVCS_OK;
+
+    while (err == SVCS_OK) {
+        ssize_t n = read(m->inotify_fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        for (char *ptr = buf; ptr < buf + n && err == SVCS_OK; ) {
+            const struct inotify_event *event = (const struct inotify_event*)ptr;
+            err = handle_event(m, event);
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    // A new set of watches; the old journal cannot be trusted for paths
+    // below the moved directory
+    if (err == SVCS_OK && m->rewatch) {
+        journal_reset(m);
+        err = watch_all(m);
+    }
+    return err;
+}
+
+// Whether token is from this daemon and recent enough to be answered
+static int token_answerable(const monitor_t *m, const char *token, uint64_t *seq) {
+    size_t len = strlen(m->instance);
+    if (strncmp(token, m->instance, len) != 0 || token[len] != ':') {
+        return 0;
+    }
+
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(token + len + 1, &end, 10);
+    if (errno != 0 || end == token + len + 1 || *end != '\0') {
+        return 0;
+    }
+    *seq = (uint64_t)value;
+    return *seq >= m->base && *seq <= m->seq;
+}
+
+static svcs_error_t answer_query(monitor_t *m, int client, const char *token) {
+    uint64_t since = 0;
+    int answerable = token_answerable(m, token, &since);
+
+    char header[FSMONITOR_REQUEST_MAX];
+    snprintf(header, sizeof(header), "%s %s:%llu\n", answerable ? "ok" : "all", m->instance,
+             (unsigned long long)m->seq);
+
+    svcs_buffer_t buf = {0};
+    svcs_error_t err = svcs_buffer_append(&buf, header, strlen(header));
+
+    // The journal is in sequence order
+    size_t lo = 0, hi = answerable ? m->journal_count : 0;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (m->journal[mid].seq <= since) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (size_t i = lo; answerable && i < m->journal_count && err == SVCS_OK; i++) {
+        err = svcs_buffer_append(&buf, m->journal[i].path, strlen(m->journal[i].path) + 1);
+    }
+
+    if (err == SVCS_OK) {
+        err = send_all(client, buf.data, buf.size);
+    }
+    svcs_buffer_free(&buf);
+    return err;
+}
+
+// Returns 1 if the client asked the daemon to stop
+static int serve_client(monitor_t *m, int client) {
+    set_timeouts(client);
+
+    char request[FSMONITOR_REQUEST_MAX];
+    size_t len = 0;
+    while (len < sizeof(request) - 1 && (len == 0 || request[len - 1] != '\n')) {
+        ssize_t n = recv(client, request + len, sizeof(request) - 1 - len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        len += (size_t)n;
+    }
+    if (len == 0 || request[len - 1] != '\n') {
+        return 0;
+    }
+    request[len - 1] = '\0';
+
+    if (strcmp(request, "stop") == 0) {
+        send_all(client, "ok\n", 3);
+        return 1;
+    }
+    if (strncmp(request, "query ", 6) == 0) {
+        // Failures here leave the journal as it was; the client falls back
+        // to a full scan
+        if (drain_events(m) != SVCS_OK) {
+            journal_reset(m);
+        }
+        answer_query(m, client, request + 6);
+    }
+    return 0;
+}
+
+static svcs_error_t open_socket(svcs_repository_t *repo, int *listen_fd) {
+    struct sockaddr_un addr;
+    svcs_error_t err = socket_address(repo, &addr);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    // A socket left behind by a daemon that died is replaced
+    int other = connect_monitor(repo);
+    if (other >= 0) {
+        close(other);
+        return SVCS_ERROR_EXISTS;
+    }
+
+    // Bound under a temporary name, so clients never find a socket that
+    // is not listening yet
+    struct sockaddr_un tmp_addr = addr;
+    int len = snprintf(tmp_addr.sun_path, sizeof(tmp_addr.sun_path), "%s.%ld", addr.sun_path, (long)getpid());
+    if (len < 0 || (size_t)len >= sizeof(tmp_addr.sun_path)) {
+        return SVCS_ERROR_INVALID;
+    }
+    unlink(tmp_addr.sun_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return SVCS_ERROR_IO;
+    }
+    if (bind(fd, (struct sockaddr*)&tmp_addr, sizeof(tmp_addr)) != 0 || listen(fd, 16) != 0 ||
+        rename(tmp_addr.sun_path, addr.sun_path) != 0) {
+        unlink(tmp_addr.sun_path);
+        close(fd);
+        return SVCS_ERROR_IO;
+    }
+    *listen_fd = fd;
+    return SVCS_OK;
+}
+
+svcs_error_t svcs_fsmonitor_run(svcs_repository_t *repo) {
+    if (!repo) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    monitor_t m = {
+        .repo = repo,
+        .inotify_fd = -1
+    };
+    snprintf(m.instance, sizeof(m.instance), "%lx-%lx", (unsigned long)time(NULL), (unsigned long)getpid());
+
+    // Watching starts before the first client can get a token
+    svcs_error_t err = watch_all(&m);
+    int listen_fd = -1;
+    if (err == SVCS_OK) {
+        err = open_socket(repo, &listen_fd);
+    }
+
+    int stop = 0;
+    while (err == SVCS_OK && !stop) {
+        struct pollfd fds[2] = {
+            { .fd = m.inotify_fd, .events = POLLIN },
+            { .fd = listen_fd, .events = POLLIN }
+        };
+        if (poll(fds, 2, -1) < 0) {
+            err = errno == EINTR ? SVCS_OK : SVCS_ERROR_IO;
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            err = drain_events(&m);
+        }
+        if (err == SVCS_OK && (fds[1].revents & POLLIN)) {
+            int client = accept(listen_fd, NULL, NULL);
+            if (client >= 0) {
+                stop = serve_client(&m, client);
+                close(client);
+            }
+        }
+    }
+
+    if (listen_fd >= 0) {
+        struct sockaddr_un addr;
+        socket_address(repo, &addr);
+        unlink(addr.sun_path);
+        close(listen_fd);
+    }
+    if (m.inotify_fd >= 0) {
+        close(m.inotify_fd);
+    }
+    free_watches(&m);
+    for (size_t i = 0; i < m.journal_count; i++) {
+        free(m.journal[i].path);
+    }
+    free(m.journal);
+    return err;
+}
+
+#else
+
+svcs_error_t svcs_fsmonitor_run(svcs_repository_t *repo) {
+    (void)repo;
+    return SVCS_ERROR_INVALID;
+}
+
+#endif
@@ -0,0 +1,498 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "svcs.h"
+#include "internal.h"
+#include <errno.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Garbage collection. Everything reachable from refs, HEAD, the index and
+// reflogs is marked, written into one fresh pack, and then every loose
+// object and older pack it replaces is deleted. Unreachable loose objects
+// are only pruned once they are older than the grace period, so objects a
+// concurrent writer has stored but not yet referenced survive. The commit
+// graph is rewritten at the end, followed by reachability bitmaps for the
+// new pack.
+//
+// Marking walks the object graph one level at a time: all objects on the
+// current frontier are read and parsed in parallel, then their children
+// are merged into the visited set on this thread to form the next level.
+
+#define GC_DEFAULT_PRUNE_EXPIRE (14L * 24 * 60 * 60)
+#define GC_MARK_PER_WORKER 16
+#define GC_MODE_TREE 040000
+#define GC_MODE_GITLINK 0160000
+
+typedef struct {
+    svcs_hash_t hash;
+    int expand;  // Read it and follow its links; otherwise it must just exist
+    uint32_t name_hash;  // Of the path it was first reached through, for packing
+} gc_ref_t;
+
+typedef struct {
+    gc_ref_t *items;
+    size_t count;
+    size_t capacity;
+} gc_list_t;
+
+typedef struct {
+    svcs_repository_t *repo;
+    const gc_ref_t *frontier;
+    gc_list_t *children;  // One list per frontier entry
+    svcs_error_t *errors;
+} gc_mark_job_t;
+
+static int is_null_hash(const svcs_hash_t *hash) {
+    for (int i = 0; i < SVCS_HASH_SIZE; i++) {
+        if (hash->bytes[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static svcs_error_t list_push_named(gc_list_t *list, const svcs_hash_t *hash, int expand, uint32_t name_hash) {
+    // Commits without a tree or parent record the null hash
+    if (is_null_hash(hash)) {
+        return SVCS_OK;
+    }
+
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 16;
+        gc_ref_t *grown = realloc(list->items, capacity * sizeof(gc_ref_t));
+        if (!grown) {
+            return SVCS_ERROR_MEMORY;
+        }
+        list->items = grown;
+        list->capacity = capacity;
+    }
+
+    list->items[list->count].hash = *hash;
+    list->items[list->count].expand = expand;
+    list->items[list->count].name_hash = name_hash;
+    list->count++;
+    return SVCS_OK;
+}
+
+static svcs_error_t list_push(gc_list_t *list, const svcs_hash_t *hash, int expand) {
+    return list_push_named(list, hash, expand, 0);
+}
+
+static svcs_error_t push_hex(gc_list_t *list, const char *hex, size_t len, int expand) {
+    if (len < SVCS_HASH_HEX_SIZE - 1) {
+        return SVCS_OK;
+    }
+
+    char hash_str[SVCS_HASH_HEX_SIZE];
+    memcpy(hash_str, hex, SVCS_HASH_HEX_SIZE - 1);
+    hash_str[SVCS_HASH_HEX_SIZE - 1] = '\0';
+    if (!svcs_is_hex_string(hash_str, SVCS_HASH_HEX_SIZE - 1)) {
+        return SVCS_OK;
+    }
+
+    svcs_hash_t hash;
+    svcs_hash_from_string(&hash, hash_str);
+    return list_push(list, &hash, expand);
+}
+
+// Roots
+
+static svcs_error_t add_ref(const svcs_hash_t *hash, void *arg) {
+    return list_push(arg, hash, 1);
+}
+
+// Reflog lines start with the old and new value of the ref
+static svcs_error_t add_reflog_file(gc_list_t *roots, const char *path) {
+    void *data;
+    size_t size;
+    if (svcs_file_read(path, &data, &size) != SVCS_OK) {
+        return SVCS_OK;
+    }
+
+    const size_t hex_len = SVCS_HASH_HEX_SIZE - 1;
+    svcs_error_t err = SVCS_OK;
+    const char *line = data;
+    const char *end = line + size;
+    while (line < end && err == SVCS_OK) {
+        const char *eol = memchr(line, '\n', end - line);
+        size_t len = eol ? (size_t)(eol - line) : (size_t)(end - line);
+
+        err = push_hex(roots, line, len, 1);
+        if (err == SVCS_OK && len > hex_len + 1) {
+            err = push_hex(roots, line + hex_len + 1, len - hex_len - 1, 1);
+        }
+        line += len + 1;
+    }
+
+    free(data);
+    return err;
+}
+
+static svcs_error_t walk_reflogs(gc_list_t *roots, const char *dir_path) {
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        return errno == ENOENT ? SVCS_OK : SVCS_ERROR_IO;
+    }
+
+    svcs_error_t err = SVCS_OK;
+    struct dirent *entry;
+    while (err == SVCS_OK && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.' || strstr(entry->d_name, ".tmp_")) {
+            continue;
+        }
+
+        char path[SVCS_MAX_PATH];
+        snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+
+        struct stat st;
+        if (stat(path, &st) != 0) {
+            continue;
+        }
+        err = S_ISDIR(st.st_mode) ? walk_reflogs(roots, path) : add_reflog_file(roots, path);
+    }
+
+    closedir(dir);
+    return err;
+}
+
+static svcs_error_t collect_roots(svcs_repository_t *repo, gc_list_t *roots) {
+    char path[SVCS_MAX_PATH];
+
+    svcs_error_t err = svcs_refs_for_each(repo, add_ref, roots);
+
+    if (err == SVCS_OK) {
+        snprintf(path, sizeof(path), "%s/logs", repo->git_dir);
+        err = walk_reflogs(roots, path);
+    }
+
+    // Staged blobs are about to be committed, as are the trees of
+    // directories outside a sparse checkout. Cached directory trees are
+    // reused by the next commit without being written again.
+    if (repo->index) {
+        for (size_t i = 0; i < repo->index->entry_count && err == SVCS_OK; i++) {
+            const svcs_index_entry_t *entry = &repo->index->entries[i];
+            err = list_push(roots, &entry->hash, entry->mode == GC_MODE_TREE);
+        }
+        if (err == SVCS_OK) {
+            err = svcs_cache_tree_for_each(repo->index->cache_tree, add_ref, roots);
+        }
+    }
+
+    return err;
+}
+
+// Mark phase
+
+// Commits and tags name the objects they point to in their header lines
+static svcs_error_t parse_header_links(const svcs_object_t *obj, gc_list_t *children) {
+    const char *line = obj->data;
+    const char *end = line + obj->size;
+    svcs_error_t err = SVCS_OK;
+
+    while (line < end && *line != '\n' && err == SVCS_OK) {
+        const char *eol = memchr(line, '\n', end - line);
+        size_t len = eol ? (size_t)(eol - line) : (size_t)(end - line);
+
+        if (len > 5 && strncmp(line, "tree ", 5) == 0) {
+            err = push_hex(children, line + 5, len - 5, 1);
+        } else if (len > 7 && strncmp(line, "parent ", 7) == 0) {
+            err = push_hex(children, line + 7, len - 7, 1);
+        } else if (len > 7 && strncmp(line, "object ", 7) == 0) {
+            err = push_hex(children, line + 7, len - 7, 1);
+        }
+        line += len + 1;
+    }
+    return err;
+}
+
+// Tree entries are "<octal mode> <name>\0<hash>". Each child's name hash
+// extends that of the tree it was found in.
+static svcs_error_t parse_tree_links(const svcs_object_t *obj, uint32_t name_hash, gc_list_t *children) {
+    const uint8_t *ptr = obj->data;
+    const uint8_t *end = ptr + obj->size;
+    uint32_t dir_hash = svcs_pack_name_hash(name_hash, "/", 1);
+
+    while (ptr < end) {
+        const uint8_t *nul = memchr(ptr, '\0', end - ptr);
+        if (!nul || (size_t)(end - nul - 1) < SVCS_HASH_SIZE) {
+            return SVCS_ERROR_CORRUPT;
+        }
+
+        unsigned int mode = (unsigned int)strtoul((const char*)ptr, NULL, 8);
+        const uint8_t *space = memchr(ptr, ' ', nul - ptr);
+        const uint8_t *name = space ? space + 1 : nul;
+        uint32_t child_hash = svcs_pack_name_hash(dir_hash, (const char*)name, nul - name);
+
+        svcs_hash_t hash;
+        memcpy(hash.bytes, nul + 1, SVCS_HASH_SIZE);
+        ptr = nul + 1 + SVCS_HASH_SIZE;
+
+        // Gitlinks name commits in another repository
+        if (mode == GC_MODE_GITLINK) {
+            continue;
+        }
+
+        svcs_error_t err = list_push_named(children, &hash, mode == GC_MODE_TREE, child_hash);
+        if (err != SVCS_OK) {
+            return err;
+        }
+    }
+    return SVCS_OK;
+}
+
+static void mark_worker(void *arg, size_t i) {
+    gc_mark_job_t *job = arg;
+    const gc_ref_t *ref = &job->frontier[i];
+
+    // Blobs have no links, so knowing they exist is enough
+    if (!ref->expand) {
+        job->errors[i] = svcs_object_exists(job->repo, &ref->hash) ? SVCS_OK : SVCS_ERROR_CORRUPT;
+        return;
+    }
+
+    svcs_object_t *obj;
+    svcs_error_t err = svcs_object_read(job->repo, &ref->hash, &obj);
+    if (err == SVCS_ERROR_NOT_FOUND) {
+        err = SVCS_ERROR_CORRUPT;
+    }
+
+    if (err == SVCS_OK) {
+        if (obj->type == SVCS_OBJ_COMMIT || obj->type == SVCS_OBJ_TAG) {
+            err = parse_header_links(obj, &job->children[i]);
+        } else if (obj->type == SVCS_OBJ_TREE) {
+            err = parse_tree_links(obj, ref->name_hash, &job->children[i]);
+        }
+        svcs_object_free(obj);
+    }
+    job->errors[i] = err;
+}
+
+// Add refs not seen before to the reachable set, the list of everything
+// marked and the next frontier
+static svcs_error_t merge_level(svcs_hash_set_t *reachable, gc_list_t *marked,
+                                const gc_ref_t *refs, size_t count, gc_list_t *next) {
+    for (size_t i = 0; i < count; i++) {
+        int added;
+        svcs_error_t err = svcs_hash_set_add(reachable, &refs[i].hash, &added);
+        if (err == SVCS_OK && added) {
+            err = list_push_named(marked, &refs[i].hash, refs[i].expand, refs[i].name_hash);
+        }
+        if (err == SVCS_OK && added) {
+            err = list_push_named(next, &refs[i].hash, refs[i].expand, refs[i].name_hash);
+        }
+        if (err != SVCS_OK) {
+            return err;
+        }
+    }
+    return SVCS_OK;
+}
+
+static svcs_error_t mark_reachable(svcs_repository_t *repo, svcs_hash_set_t *reachable, gc_list_t *marked) {
+    gc_list_t roots = {0};
+    gc_list_t frontier = {0};
+    svcs_error_t err = collect_roots(repo, &roots);
+    if (err == SVCS_OK) {
+        err = merge_level(reachable, marked, roots.items, roots.count, &frontier);
+    }
+    free(roots.items);
+
+    while (err == SVCS_OK && frontier.count > 0) {
+        gc_mark_job_t job = {
+            .repo = repo,
+            .frontier = frontier.items,
+            .children = calloc(frontier.count, sizeof(gc_list_t)),
+            .errors = calloc(frontier.count, sizeof(svcs_error_t))
+        };
+
+        if (!job.children || !job.errors) {
+            err = SVCS_ERROR_MEMORY;
+        } else {
+            svcs_parallel_for(frontier.count, GC_MARK_PER_WORKER, mark_worker, &job);
+        }
+
+        gc_list_t next = {0};
+        for (size_t i = 0; job.children && i < frontier.count; i++) {
+            if (err == SVCS_OK) {
+                err = job.errors[i];
+            }
+            if (err == SVCS_OK) {
+                err = merge_level(reachable, marked, job.children[i].items, job.children[i].count, &next);
+            }
+            free(job.children[i].items);
+        }
+
+        free(job.children);
+        free(job.errors);
+        free(frontier.items);
+        frontier = next;
+    }
+
+    free(frontier.items);
+    return err;
+}
+
+// Sweep
+
+static uint64_t disk_usage(const char *path) {
+    struct stat st;
+    if (lstat(path, &st) != 0) {
+        return 0;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        return (uint64_t)st.st_size;
+    }
+
+    uint64_t total = 0;
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return 0;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        char child[SVCS_MAX_PATH];
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        total += disk_usage(child);
+    }
+    closedir(dir);
+    return total;
+}
+
+// Delete loose objects that are now packed, and unreachable ones whose
+// grace period is over
+static svcs_error_t prune_loose(svcs_repository_t *repo, const svcs_hash_set_t *reachable,
+                                int packed, time_t expire_before, svcs_gc_stats_t *stats) {
+    svcs_hash_t *loose;
+    size_t count;
+    svcs_error_t err = svcs_pack_list_loose(repo, &loose, &count);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    uint8_t touched[256] = {0};
+    for (size_t i = 0; i < count; i++) {
+        char path[SVCS_MAX_PATH];
+        if (svcs_loose_object_path(repo, &loose[i], path, sizeof(path)) != SVCS_OK) {
+            continue;
+        }
+
+        if (svcs_hash_set_contains(reachable, &loose[i])) {
+            if (!packed) {
+                continue;
+            }
+        } else {
+            struct stat st;
+            if (stat(path, &st) != 0 || st.st_mtime >= expire_before) {
+                continue;
+            }
+            stats->pruned_objects++;
+        }
+
+        if (unlink(path) == 0) {
+            touched[loose[i].bytes[0]] = 1;
+        }
+    }
+    free(loose);
+
+    // Empty fanout directories go too; rmdir leaves the others alone
+    for (int fanout = 0; fanout < 256; fanout++) {
+        if (touched[fanout]) {
+            char dir_path[SVCS_MAX_PATH];
+            snprintf(dir_path, sizeof(dir_path), "%s/objects/%02x", repo->git_dir, fanout);
+            rmdir(dir_path);
+            svcs_loose_cache_forget(repo, (uint8_t)fanout);
+        }
+    }
+    return SVCS_OK;
+}
+
+svcs_error_t svcs_gc(svcs_repository_t *repo, long prune_expire, svcs_gc_stats_t *stats) {
+    if (!repo || !stats) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    // Objects staged in an open batch have no refs yet and are not on disk
+    if (repo->write_batch) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    if (prune_expire < 0) {
+        prune_expire = GC_DEFAULT_PRUNE_EXPIRE;
+    }
+    time_t expire_before = time(NULL) - prune_expire;
+
+    char objects_dir[SVCS_MAX_PATH];
+    snprintf(objects_dir, sizeof(objects_dir), "%s/objects", repo->git_dir);
+    stats->size_before = disk_usage(objects_dir);
+
+    svcs_hash_set_t reachable;
+    svcs_error_t err = svcs_hash_set_init(&reachable, 0);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    // A dangling link means the repository is already damaged; deleting
+    // anything now could make it worse
+    gc_list_t marked = {0};
+    err = mark_reachable(repo, &reachable, &marked);
+    stats->reachable_objects = reachable.count;
+
+    svcs_hash_t *hashes = NULL;
+    uint32_t *name_hashes = NULL;
+    if (err == SVCS_OK && marked.count > 0) {
+        hashes = malloc(marked.count * sizeof(svcs_hash_t));
+        name_hashes = malloc(marked.count * sizeof(uint32_t));
+        if (!hashes || !name_hashes) {
+            err = SVCS_ERROR_MEMORY;
+        } else {
+            for (size_t i = 0; i < marked.count; i++) {
+                hashes[i] = marked.items[i].hash;
+                name_hashes[i] = marked.items[i].name_hash;
+            }
+        }
+    }
+    free(marked.items);
+
+    // The new pack is durable before anything it replaces is deleted
+    svcs_hash_t pack_hash;
+    int packed = 0;
+    if (err == SVCS_OK && reachable.count > 0) {
+        err = svcs_pack_write_named(repo, hashes, name_hashes, reachable.count, &pack_hash);
+        packed = err == SVCS_OK;
+    }
+    free(hashes);
+    free(name_hashes);
+
+    if (err == SVCS_OK) {
+        err = svcs_pack_remove_old(repo, packed ? &pack_hash : NULL, expire_before, &stats->removed_packs);
+    }
+
+    if (err == SVCS_OK) {
+        err = prune_loose(repo, &reachable, packed, expire_before, stats);
+    }
+    svcs_hash_set_free(&reachable);
+
+    // History was just walked in full, so the commit graph is cheap to refresh
+    if (err == SVCS_OK) {
+        err = svcs_commit_graph_write(repo, NULL);
+    }
+    if (err == SVCS_OK && packed) {
+        err = svcs_pack_bitmap_write(repo, &pack_hash, NULL);
+    }
+
+    // Drop cached copies of anything that was pruned
+    if (err == SVCS_OK && repo->object_cache) {
+        svcs_cache_stats_t cache_stats;
+        svcs_object_cache_stats(repo, &cache_stats);
+        svcs_object_cache_set_limit(repo, 0);
+        svcs_object_cache_set_limit(repo, cache_stats.max_size);
+    }
+
+    stats->size_after = disk_usage(objects_dir);
+    return err;
+}
@@ -1,6 +1,168 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "svcs.h"
+#include "internal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
 #include <openssl/evp.h>
-#include <openssl/sha.h>
+
+// Each thread keeps one digest state per algorithm around and re-initializes
+// it for every hash instead of allocating a fresh context. A context that is
+// initialized while the thread's slot is already in use (nested hashing)
+// falls back to its own allocation. Contexts must be finalized on the
+// thread that initialized them.
+typedef struct {
+    EVP_MD_CTX *sha3;
+    svcs_blake3_t blake3;
+    int busy;
+} hash_thread_slot_t;
+
+static pthread_key_t hash_slot_key;
+static pthread_once_t hash_slot_once = PTHREAD_ONCE_INIT;
+
+static void free_thread_slot(void *ptr) {
+    hash_thread_slot_t *slot = ptr;
+    EVP_MD_CTX_free(slot->sha3);
+    free(slot);
+}
+
+static void create_slot_key(void) {
+    pthread_key_create(&hash_slot_key, free_thread_slot);
+}
+
+static hash_thread_slot_t* get_thread_slot(void) {
+    pthread_once(&hash_slot_once, create_slot_key);
+
+    hash_thread_slot_t *slot = pthread_getspecific(hash_slot_key);
+    if (!slot) {
+        slot = calloc(1, sizeof(hash_thread_slot_t));
+        if (!slot) {
+            return NULL;
+        }
+        slot->sha3 = EVP_MD_CTX_new();
+        if (!slot->sha3 || pthread_setspecific(hash_slot_key, slot) != 0) {
+            EVP_MD_CTX_free(slot->sha3);
+            free(slot);
+            return NULL;
+        }
+    }
+    return slot;
+}
+
+const char* svcs_hash_algo_name(svcs_hash_algo_t algo) {
+    switch (algo) {
+        case SVCS_HASH_SHA3_256: return "sha3-256";
+        case SVCS_HASH_BLAKE3: return "blake3";
+        default: return NULL;
+    }
+}
+
+svcs_error_t svcs_hash_algo_from_name(const char *name, svcs_hash_algo_t *algo) {
+    if (!name || !algo) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    if (strcmp(name, "sha3-256") == 0) {
+        *algo = SVCS_HASH_SHA3_256;
+    } else if (strcmp(name, "blake3") == 0) {
+        *algo = SVCS_HASH_BLAKE3;
+    } else {
+        return SVCS_ERROR_INVALID;
+    }
+    return SVCS_OK;
+}
+
+svcs_error_t svcs_hash_ctx_init_algo(svcs_hash_ctx_t *ctx, svcs_hash_algo_t algo) {
+    if (!ctx || !svcs_hash_algo_name(algo)) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    ctx->algo = algo;
+    ctx->state = NULL;
+    ctx->thread_slot = NULL;
+
+    hash_thread_slot_t *slot = get_thread_slot();
+    if (slot && !slot->busy) {
+        slot->busy = 1;
+        ctx->thread_slot = slot;
+        ctx->state = algo == SVCS_HASH_BLAKE3 ? (void*)&slot->blake3 : (void*)slot->sha3;
+    } else if (algo == SVCS_HASH_BLAKE3) {
+        ctx->state = malloc(sizeof(svcs_blake3_t));
+    } else {
+        ctx->state = EVP_MD_CTX_new();
+    }
+
+    if (!ctx->state) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    if (algo == SVCS_HASH_BLAKE3) {
+        svcs_blake3_init(ctx->state);
+    } else if (EVP_DigestInit_ex(ctx->state, EVP_sha3_256(), NULL) != 1) {
+        svcs_hash_ctx_final(ctx, NULL);
+        return SVCS_ERROR;
+    }
+
+    return SVCS_OK;
+}
+
+svcs_error_t svcs_hash_ctx_init(svcs_hash_ctx_t *ctx) {
+    return svcs_hash_ctx_init_algo(ctx, SVCS_HASH_SHA3_256);
+}
+
+// Start hashing an object: feeds the "<type> <size>\0" header
+svcs_error_t svcs_hash_ctx_init_object(svcs_hash_ctx_t *ctx, svcs_hash_algo_t algo,
+                                       svcs_object_type_t type, size_t size) {
+    const char *type_str = svcs_object_type_name(type);
+    if (!ctx || !type_str) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    svcs_error_t err = svcs_hash_ctx_init_algo(ctx, algo);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    char header[64];
+    int header_len = snprintf(header, sizeof(header), "%s %zu", type_str, size);
+    svcs_hash_ctx_update(ctx, header, header_len + 1);
+
+    return SVCS_OK;
+}
+
+void svcs_hash_ctx_update(svcs_hash_ctx_t *ctx, const void *data, size_t len) {
+    if (!ctx || !ctx->state || !data || len == 0) return;
+
+    if (ctx->algo == SVCS_HASH_BLAKE3) {
+        svcs_blake3_update(ctx->state, data, len);
+    } else {
+        EVP_DigestUpdate(ctx->state, data, len);
+    }
+}
+
+void svcs_hash_ctx_final(svcs_hash_ctx_t *ctx, svcs_hash_t *hash) {
+    if (!ctx || !ctx->state) return;
+
+    if (hash && ctx->algo == SVCS_HASH_BLAKE3) {
+        svcs_blake3_final(ctx->state, hash->bytes);
+    } else if (hash) {
+        unsigned int hash_len = SVCS_HASH_SIZE;
+        EVP_DigestFinal_ex(ctx->state, hash->bytes, &hash_len);
+    }
+
+    if (ctx->thread_slot) {
+        ((hash_thread_slot_t*)ctx->thread_slot)->busy = 0;
+    } else if (ctx->algo == SVCS_HASH_BLAKE3) {
+        free(ctx->state);
+    } else {
+        EVP_MD_CTX_free(ctx->state);
+    }
+    ctx->state = NULL;
+    ctx->thread_slot = NULL;
+}
 
 void svcs_hash_init(svcs_hash_t *hash) {
     if (hash) {
@@ -8,23 +170,19 @@ void svcs_hash_init(svcs_hash_t *hash) {
     }
 }
 
+// One-shot digest of a single buffer; use svcs_hash_ctx_t to hash in pieces
 void svcs_hash_update(svcs_hash_t *hash, const void *data, size_t len) {
     if (!hash || !data || len == 0) return;
-    
-    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
-    if (!ctx) return;
-    
-    EVP_DigestInit_ex(ctx, EVP_sha3_256(), NULL);
-    EVP_DigestUpdate(ctx, data, len);
-    
-    unsigned int hash_len = SVCS_HASH_SIZE;
-    EVP_DigestFinal_ex(ctx, hash->bytes, &hash_len);
-    EVP_MD_CTX_free(ctx);
+
+    svcs_hash_ctx_t ctx;
+    if (svcs_hash_ctx_init(&ctx) != SVCS_OK) return;
+
+    svcs_hash_ctx_update(&ctx, data, len);
+    svcs_hash_ctx_final(&ctx, hash);
 }
 
 void svcs_hash_final(svcs_hash_t *hash) {
-    // SHA1 is already finalized in svcs_hash_update
-    // This function exists for API compatibility
+    // svcs_hash_update is already final; kept for API compatibility
     (void)hash;
 }
 
@@ -59,74 +217,90 @@ int svcs_hash_compare(const svcs_hash_t *a, const svcs_hash_t *b) {
     return memcmp(a->bytes, b->bytes, SVCS_HASH_SIZE);
 }
 
-// Compute hash of file content
-svcs_error_t svcs_hash_file(const char *path, svcs_hash_t *hash) {
+// Compute hash of file content, streaming it in chunks
+svcs_error_t svcs_hash_file_algo(svcs_hash_algo_t algo, const char *path, svcs_hash_t *hash) {
     if (!path || !hash) {
         return SVCS_ERROR_INVALID;
     }
-    
-    void *data;
-    size_t size;
-    svcs_error_t err = svcs_file_read(path, &data, &size);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return SVCS_ERROR_IO;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return SVCS_ERROR_IO;
+    }
+
+    svcs_hash_ctx_t ctx;
+    svcs_error_t err = svcs_hash_ctx_init_object(&ctx, algo, SVCS_OBJ_BLOB, (size_t)st.st_size);
     if (err != SVCS_OK) {
+        close(fd);
         return err;
     }
-    
-    // Create object header for blob
-    char header[64];
-    int header_len = snprintf(header, sizeof(header), "blob %zu", size);
-    
-    // Hash header + null byte + content using SHA-3
-    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
-    if (!ctx) {
-        free(data);
+
+    uint8_t *chunk = malloc(SVCS_IO_CHUNK_SIZE);
+    if (!chunk) {
+        svcs_hash_ctx_final(&ctx, NULL);
+        close(fd);
         return SVCS_ERROR_MEMORY;
     }
-    
-    EVP_DigestInit_ex(ctx, EVP_sha3_256(), NULL);
-    EVP_DigestUpdate(ctx, header, header_len);
-    EVP_DigestUpdate(ctx, "\0", 1);
-    EVP_DigestUpdate(ctx, data, size);
-    
-    unsigned int hash_len = SVCS_HASH_SIZE;
-    EVP_DigestFinal_ex(ctx, hash->bytes, &hash_len);
-    EVP_MD_CTX_free(ctx);
-    
-    free(data);
+
+    // The header already committed to st_size bytes; a file that changes
+    // size underneath us must not produce a hash for the wrong content
+    size_t remaining = (size_t)st.st_size;
+    while (remaining > 0) {
+        size_t want = remaining < SVCS_IO_CHUNK_SIZE ? remaining : SVCS_IO_CHUNK_SIZE;
+        ssize_t n = read(fd, chunk, want);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            err = SVCS_ERROR_IO;
+            break;
+        }
+        svcs_hash_ctx_update(&ctx, chunk, (size_t)n);
+        remaining -= (size_t)n;
+    }
+
+    free(chunk);
+    close(fd);
+
+    if (err != SVCS_OK) {
+        svcs_hash_ctx_final(&ctx, NULL);
+        return err;
+    }
+
+    svcs_hash_ctx_final(&ctx, hash);
     return SVCS_OK;
 }
 
 // Compute hash of data with object type
-svcs_error_t svcs_hash_object(svcs_object_type_t type, const void *data, size_t size, svcs_hash_t *hash) {
-    if (!data || !hash) {
+svcs_error_t svcs_hash_object_algo(svcs_hash_algo_t algo, svcs_object_type_t type,
+                                   const void *data, size_t size, svcs_hash_t *hash) {
+    if ((!data && size > 0) || !hash) {
         return SVCS_ERROR_INVALID;
     }
-    
-    const char *type_str;
-    switch (type) {
-        case SVCS_OBJ_BLOB: type_str = "blob"; break;
-        case SVCS_OBJ_TREE: type_str = "tree"; break;
-        case SVCS_OBJ_COMMIT: type_str = "commit"; break;
-        case SVCS_OBJ_TAG: type_str = "tag"; break;
-        default: return SVCS_ERROR_INVALID;
-    }
-    
-    char header[64];
-    int header_len = snprintf(header, sizeof(header), "%s %zu", type_str, size);
-    
-    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
-    if (!ctx) {
-        return SVCS_ERROR_MEMORY;
+
+    svcs_hash_ctx_t ctx;
+    svcs_error_t err = svcs_hash_ctx_init_object(&ctx, algo, type, size);
+    if (err != SVCS_OK) {
+        return err;
     }
-    
-    EVP_DigestInit_ex(ctx, EVP_sha3_256(), NULL);
-    EVP_DigestUpdate(ctx, header, header_len);
-    EVP_DigestUpdate(ctx, "\0", 1);
-    EVP_DigestUpdate(ctx, data, size);
-    
-    unsigned int hash_len = SVCS_HASH_SIZE;
-    EVP_DigestFinal_ex(ctx, hash->bytes, &hash_len);
-    EVP_MD_CTX_free(ctx);
-    
+
+    svcs_hash_ctx_update(&ctx, data, size);
+    svcs_hash_ctx_final(&ctx, hash);
+
     return SVCS_OK;
-}
\ No newline at end of file
+}
+
+// Repositories without a core.objecthash setting predate the choice and use SHA3-256
+svcs_error_t svcs_hash_file(const char *path, svcs_hash_t *hash) {
+    return svcs_hash_file_algo(SVCS_HASH_SHA3_256, path, hash);
+}
+
+svcs_error_t svcs_hash_object(svcs_object_type_t type, const void *data, size_t size, svcs_hash_t *hash) {
+    return svcs_hash_object_algo(SVCS_HASH_SHA3_256, type, data, size, hash);
+}
@@ -0,0 +1,123 @@
+#include "svcs.h"
+#include "internal.h"
+
+// Open-addressing set of object hashes. Hashes are uniformly distributed,
+// so their bytes pick the first probe slot directly.
+
+#define HASH_SET_MIN_SLOTS 64
+
+static size_t probe_start(const svcs_hash_set_t *set, const svcs_hash_t *hash) {
+    return svcs_get_be32(hash->bytes + 4) & (set->slot_count - 1);
+}
+
+static int insert_slot(svcs_hash_set_t *set, const svcs_hash_t *hash) {
+    size_t i = probe_start(set, hash);
+    while (set->used[i]) {
+        if (svcs_hash_compare(&set->slots[i], hash) == 0) {
+            return 0;
+        }
+        i = (i + 1) & (set->slot_count - 1);
+    }
+    set->slots[i] = *hash;
+    set->used[i] = 1;
+    set->count++;
+    return 1;
+}
+
+static svcs_error_t alloc_slots(svcs_hash_set_t *set, size_t slot_count) {
+    set->slots = malloc(slot_count * sizeof(svcs_hash_t));
+    set->used = calloc(slot_count, 1);
+    if (!set->slots || !set->used) {
+        free(set->slots);
+        free(set->used);
+        set->slots = NULL;
+        set->used = NULL;
+        return SVCS_ERROR_MEMORY;
+    }
+    set->slot_count = slot_count;
+    set->count = 0;
+    return SVCS_OK;
+}
+
+svcs_error_t svcs_hash_set_init(svcs_hash_set_t *set, size_t expected) {
+    if (!set) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    // Keep the table at most half full
+    size_t slot_count = HASH_SET_MIN_SLOTS;
+    while (slot_count < expected * 2) {
+        slot_count *= 2;
+    }
+    return alloc_slots(set, slot_count);
+}
+
+void svcs_hash_set_free(svcs_hash_set_t *set) {
+    if (!set) return;
+
+    free(set->slots);
+    free(set->used);
+    set->slots = NULL;
+    set->used = NULL;
+    set->slot_count = set->count = 0;
+}
+
+void svcs_hash_set_clear(svcs_hash_set_t *set) {
+    memset(set->used, 0, set->slot_count);
+    set->count = 0;
+}
+
+int svcs_hash_set_contains(const svcs_hash_set_t *set, const svcs_hash_t *hash) {
+    if (!set->slot_count) {
+        return 0;
+    }
+
+    for (size_t i = probe_start(set, hash); set->used[i]; i = (i + 1) & (set->slot_count - 1)) {
+        if (svcs_hash_compare(&set->slots[i], hash) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Sets *added (if given) to whether hash was new
+svcs_error_t svcs_hash_set_add(svcs_hash_set_t *set, const svcs_hash_t *hash, int *added) {
+    if ((set->count + 1) * 2 > set->slot_count) {
+        svcs_hash_set_t grown;
+        svcs_error_t err = alloc_slots(&grown, set->slot_count ? set->slot_count * 2 : HASH_SET_MIN_SLOTS);
+        if (err != SVCS_OK) {
+            return err;
+        }
+        for (size_t i = 0; i < set->slot_count; i++) {
+            if (set->used[i]) {
+                insert_slot(&grown, &set->slots[i]);
+            }
+        }
+        svcs_hash_set_free(set);
+        *set = grown;
+    }
+
+    int inserted = insert_slot(set, hash);
+    if (added) {
+        *added = inserted;
+    }
+    return SVCS_OK;
+}
+
+// Keep only hashes for which keep() returns true
+svcs_error_t svcs_hash_set_filter(svcs_hash_set_t *set, int (*keep)(const svcs_hash_t *hash, void *arg), void *arg) {
+    svcs_hash_set_t kept;
+    svcs_error_t err = alloc_slots(&kept, set->slot_count);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    for (size_t i = 0; i < set->slot_count; i++) {
+        if (set->used[i] && keep(&set->slots[i], arg)) {
+            insert_slot(&kept, &set->slots[i]);
+        }
+    }
+    svcs_hash_set_free(set);
+    *set = kept;
+    return SVCS_OK;
+}
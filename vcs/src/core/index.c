@@ -1,4 +1,567 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "svcs.h"
+#include "internal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Index file, version 2:
+//
+//   header      "SNDX", version, entry count (4 bytes each)
+//   entries     per entry: hash, mtime seconds (8 bytes) and nanoseconds
+//               (4), ctime seconds (8) and nanoseconds (4), dev (8), inode
+//               (8), size (8), mode (4), status (4), flags (4), then the
+//               path as the length of the prefix it shares with the
+//               previous entry's path and the length of the rest
+//               (varints), followed by the rest
+//   extensions  each a signature (4 bytes), a size (4) and that many bytes;
+//               unknown ones are skipped
+//   checksum of everything above
+//
+// Extensions:
+//
+//   FSMN  token of the filesystem monitor as of the last status
+//   UNTR  untracked and ignored names per directory (see untracked.c)
+//   TREE  tree hash per directory as of the last commit (see cache_tree.c)
+//   LINK  split index: checksum of the base file, then the base paths
+//         removed since it was written, each ending in NUL
+//
+// Version 1 files, a count followed by raw entry structs with the path
+// inline, are still read and are rewritten as version 2 on the next save.
+// The file is mapped and decoded in one pass. Every path is copied into an
+// arena owned by the index.
+//
+// A file whose stat data matches its entry is taken to be unchanged, except
+// when its mtime is not older than the index file's: it may have been
+// written again within the same timestamp tick. Such racy entries are
+// re-hashed by status, and saved with size 0 if their content turns out to
+// differ, so the stat check cannot pass for them later.
+//
+// With core.splitindex = true the entries are kept in a base file,
+// .svcs/sharedindex.<checksum>, in the same format without extensions, and
+// the index file holds only the entries added or changed since, plus LINK.
+// The two are merged on load, so a save writes only what changed. Once the
+// changes pass core.splitindexmaxpercent (default 20) of the base, the
+// base is rewritten with every entry. Entries taken from the base are racy
+// against the base file's mtime, since that is when they were written.
+
+#define INDEX_SIGNATURE "SNDX"
+#define INDEX_VERSION 2
+#define INDEX_HEADER_SIZE 12
+#define INDEX_ENTRY_FIXED_SIZE (SVCS_HASH_SIZE + 8 + 4 + 8 + 4 + 8 + 8 + 8 + 4 + 4 + 4)
+#define INDEX_EXTENSION_HEADER_SIZE 8
+#define INDEX_ARENA_BLOCK_SIZE (64 * 1024)
+
+#define INDEX_ENTRY_UPTODATE (1u << 0)        // Hashed or verified since the last stat
+#define INDEX_ENTRY_FSMONITOR_VALID (1u << 1)  // Clean, and the monitor has seen no change since
+#define INDEX_ENTRY_SHARED (1u << 2)          // Unchanged since the split index base was written
+#define INDEX_ENTRY_SAVED_FLAGS INDEX_ENTRY_FSMONITOR_VALID
+#define SPLIT_INDEX_DEFAULT_MAX_PERCENT 20
+
+struct svcs_path_arena {
+    struct svcs_path_arena *next;
+    size_t used;
+    size_t capacity;
+    char data[];
+};
+
+struct svcs_split_index {
+    int enabled;              // core.splitindex; without it the next save unsplits
+    int max_percent;          // Changes, against the base size, before it is rewritten
+    int has_base;
+    svcs_hash_t base;         // Checksum of the base file, which names it
+    time_t timestamp;         // mtime of the base file
+    uint32_t timestamp_nsec;
+    const char **base_paths;  // Every path in the base, sorted, pointing into the arena
+    size_t base_count;
+    const char **deleted;     // While loading, the base paths LINK removes
+    size_t deleted_count;
+    int has_stale;            // A replaced base, removed once no index file on
+    svcs_hash_t stale;        // disk can still name it
+};
+
+// Layout of an entry in version 1 files
+typedef struct {
+    char path[SVCS_MAX_PATH];
+    svcs_hash_t hash;
+    uint32_t mode;
+    time_t mtime;
+    size_t size;
+    svcs_file_status_t status;
+} index_v1_entry_t;
+
+// Room for a path of len bytes plus its terminator. Blocks never move, so
+// entries can point into them for as long as the index lives.
+static char* arena_alloc(svcs_index_t *index, size_t len) {
+    svcs_path_arena_t *block = index->paths;
+    if (!block || block->capacity - block->used < len + 1) {
+        size_t capacity = len + 1 > INDEX_ARENA_BLOCK_SIZE ? len + 1 : INDEX_ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(svcs_path_arena_t) + capacity);
+        if (!block) {
+            return NULL;
+        }
+        block->next = index->paths;
+        block->used = 0;
+        block->capacity = capacity;
+        index->paths = block;
+    }
+
+    char *path = block->data + block->used;
+    block->used += len + 1;
+    return path;
+}
+
+static const char* arena_copy(svcs_index_t *index, const char *path, size_t len) {
+    char *copy = arena_alloc(index, len);
+    if (copy) {
+        memcpy(copy, path, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+void svcs_index_free(svcs_index_t *index) {
+    if (!index) return;
+
+    svcs_path_arena_t *block = index->paths;
+    while (block) {
+        svcs_path_arena_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    svcs_untracked_cache_free(index->untracked);
+    svcs_cache_tree_free(index->cache_tree);
+    if (index->split) {
+        free(index->split->base_paths);
+        free(index->split->deleted);
+        free(index->split);
+    }
+    free(index->entries);
+    free(index);
+}
+
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(((const svcs_index_entry_t*)a)->path, ((const svcs_index_entry_t*)b)->path);
+}
+
+// Entries are kept sorted by path, which is the order trees list them in.
+// Returns whether path is present; *pos is where it is or would go.
+static int index_find(const svcs_index_t *index, const char *path, size_t *pos) {
+    size_t lo = 0, hi = index->entry_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(index->entries[mid].path, path);
+        if (cmp == 0) {
+            *pos = mid;
+            return 1;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *pos = lo;
+    return 0;
+}
+
+static svcs_error_t index_reserve(svcs_index_t *index, size_t count) {
+    if (count <= index->entry_capacity) {
+        return SVCS_OK;
+    }
+
+    size_t capacity = index->entry_capacity ? index->entry_capacity : 16;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    svcs_index_entry_t *entries = realloc(index->entries, capacity * sizeof(svcs_index_entry_t));
+    if (!entries) {
+        return SVCS_ERROR_MEMORY;
+    }
+    index->entries = entries;
+    index->entry_capacity = capacity;
+    return SVCS_OK;
+}
+
+static size_t put_varint(uint8_t *out, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+// Returns the number of bytes read, or 0 if the varint is truncated
+static size_t get_varint(const uint8_t *ptr, const uint8_t *end, uint64_t *value) {
+    size_t n = 0;
+    unsigned shift = 0;
+    *value = 0;
+    while (ptr + n < end && shift <= 63) {
+        uint8_t byte = ptr[n++];
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return n;
+        }
+        shift += 7;
+    }
+    return 0;
+}
+
+static svcs_error_t parse_index_v1(svcs_index_t *index, const uint8_t *data, size_t size) {
+    uint32_t entry_count;
+    memcpy(&entry_count, data + 4, sizeof(entry_count));
+    if (entry_count > (size - 8) / sizeof(index_v1_entry_t)) {
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    index->entries = calloc(entry_count ? entry_count : 1, sizeof(svcs_index_entry_t));
+    if (!index->entries) {
+        return SVCS_ERROR_MEMORY;
+    }
+    index->entry_capacity = entry_count ? entry_count : 1;
+
+    const uint8_t *ptr = data + 8;
+    for (uint32_t i = 0; i < entry_count; i++, ptr += sizeof(index_v1_entry_t)) {
+        index_v1_entry_t old;
+        memcpy(&old, ptr, sizeof(old));
+
+        svcs_index_entry_t *entry = &index->entries[i];
+        entry->path = arena_copy(index, old.path, strnlen(old.path, sizeof(old.path) - 1));
+        if (!entry->path) {
+            return SVCS_ERROR_MEMORY;
+        }
+        entry->hash = old.hash;
+        entry->mode = old.mode;
+        entry->mtime = old.mtime;
+        entry->size = old.size;
+        entry->status = old.status;
+        index->entry_count++;
+    }
+    return SVCS_OK;
+}
+
+static void fill_stat(svcs_index_entry_t *entry, const struct stat *st) {
+    entry->mode = st->st_mode;
+    entry->mtime = st->st_mtim.tv_sec;
+    entry->mtime_nsec = (uint32_t)st->st_mtim.tv_nsec;
+    entry->ctime = st->st_ctim.tv_sec;
+    entry->ctime_nsec = (uint32_t)st->st_ctim.tv_nsec;
+    entry->dev = (uint64_t)st->st_dev;
+    entry->ino = (uint64_t)st->st_ino;
+    entry->size = (size_t)st->st_size;
+}
+
+static int stat_matches(const svcs_index_entry_t *entry, const struct stat *st) {
+    return entry->mtime == st->st_mtim.tv_sec && entry->mtime_nsec == (uint32_t)st->st_mtim.tv_nsec &&
+           entry->ctime == st->st_ctim.tv_sec && entry->ctime_nsec == (uint32_t)st->st_ctim.tv_nsec &&
+           entry->size == (size_t)st->st_size && entry->ino == (uint64_t)st->st_ino &&
+           entry->dev == (uint64_t)st->st_dev && entry->mode == st->st_mode;
+}
+
+const char* svcs_index_intern_path(svcs_index_t *index, const char *path) {
+    return arena_copy(index, path, strlen(path));
+}
+
+void svcs_index_entry_set_stat(svcs_index_entry_t *entry, const struct stat *st) {
+    fill_stat(entry, st);
+    entry->flags = (entry->flags | INDEX_ENTRY_UPTODATE) & ~(INDEX_ENTRY_FSMONITOR_VALID | INDEX_ENTRY_SHARED);
+}
+
+static int is_racy(const svcs_index_t *index, const svcs_index_entry_t *entry) {
+    time_t timestamp = index->timestamp;
+    uint32_t timestamp_nsec = index->timestamp_nsec;
+    if ((entry->flags & INDEX_ENTRY_SHARED) && index->split) {
+        timestamp = index->split->timestamp;
+        timestamp_nsec = index->split->timestamp_nsec;
+    }
+    return entry->mtime > timestamp || (entry->mtime == timestamp && entry->mtime_nsec >= timestamp_nsec);
+}
+
+static void split_base_path(const svcs_repository_t *repo, const svcs_hash_t *base, char *path, size_t size) {
+    char hex[SVCS_HASH_HEX_SIZE];
+    svcs_hash_to_string(base, hex);
+    snprintf(path, size, "%s/sharedindex.%s", repo->git_dir, hex);
+}
+
+static svcs_error_t parse_link(svcs_index_t *index, const uint8_t *data, size_t size) {
+    if (index->split || size < SVCS_HASH_SIZE || (size > SVCS_HASH_SIZE && data[size - 1] != '\0')) {
+        return SVCS_ERROR_CORRUPT;
+    }
+    svcs_split_index_t *split = calloc(1, sizeof(svcs_split_index_t));
+    if (!split) {
+        return SVCS_ERROR_MEMORY;
+    }
+    index->split = split;
+    split->has_base = 1;
+    memcpy(split->base.bytes, data, SVCS_HASH_SIZE);
+    
+    const char *paths = (const char*)data + SVCS_HASH_SIZE;
+    const char *end = (const char*)data + size;
+    size_t count = 0;
+    for (const char *ptr = paths; ptr < end; ptr++) {
+        count += *ptr == '\0';
+    }
+    split->deleted = malloc((count ? count : 1) * sizeof(char*));
+    if (!split->deleted) {
+        return SVCS_ERROR_MEMORY;
+    }
+    for (const char *ptr = paths; ptr < end; ptr += strlen(ptr) + 1) {
+        const char *path = arena_copy(index, ptr, strlen(ptr));
+        if (!path) {
+            return SVCS_ERROR_MEMORY;
+        }
+        if (split->deleted_count > 0 && strcmp(split->deleted[split->deleted_count - 1], path) >= 0) {
+            return SVCS_ERROR_CORRUPT;
+        }
+        split->deleted[split->deleted_count++] = path;
+    }
+    return SVCS_OK;
+}
+
+static svcs_error_t parse_extensions(svcs_index_t *index, const uint8_t *ptr, const uint8_t *end) {
+    while (ptr < end) {
+        if ((size_t)(end - ptr) < INDEX_EXTENSION_HEADER_SIZE) {
+            return SVCS_ERROR_CORRUPT;
+        }
+        uint32_t size = svcs_get_be32(ptr + 4);
+        const uint8_t *data = ptr + INDEX_EXTENSION_HEADER_SIZE;
+        if (size > (size_t)(end - data)) {
+            return SVCS_ERROR_CORRUPT;
+        }
+        
+        if (memcmp(ptr, "FSMN", 4) == 0) {
+            if (size >= sizeof(index->fsmonitor_token)) {
+                return SVCS_ERROR_CORRUPT;
+            }
+            memcpy(index->fsmonitor_token, data, size);
+            index->fsmonitor_token[size] = '\0';
+        } else if (memcmp(ptr, "LINK", 4) == 0) {
+            svcs_error_t err = parse_link(index, data, size);
+            if (err != SVCS_OK) {
+                return err;
+            }
+        } else if (memcmp(ptr, "UNTR", 4) == 0 && !index->untracked) {
+            // Only a cache; a damaged one is rebuilt by the next listing
+            svcs_untracked_cache_parse(data, size, &index->untracked);
+        } else if (memcmp(ptr, "TREE", 4) == 0 && !index->cache_tree) {
+            // Likewise; without it the next commit writes every tree
+            svcs_cache_tree_parse(data, size, &index->cache_tree);
+        }
+        ptr = data + size;
+    }
+    return SVCS_OK;
+}
+
+static svcs_error_t parse_index(svcs_index_t *index, const uint8_t *data, size_t size) {
+    if (size < INDEX_HEADER_SIZE + SVCS_HASH_SIZE) {
+        return SVCS_ERROR_CORRUPT;
+    }
+    if (svcs_get_be32(data + 4) != INDEX_VERSION) {
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    svcs_hash_t checksum;
+    svcs_hash_update(&checksum, data, size - SVCS_HASH_SIZE);
+    if (memcmp(checksum.bytes, data + size - SVCS_HASH_SIZE, SVCS_HASH_SIZE) != 0) {
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    const uint8_t *ptr = data + INDEX_HEADER_SIZE;
+    const uint8_t *end = data + size - SVCS_HASH_SIZE;
+    uint32_t entry_count = svcs_get_be32(data + 8);
+    if (entry_count > (size_t)(end - ptr) / INDEX_ENTRY_FIXED_SIZE) {
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    index->entries = calloc(entry_count ? entry_count : 1, sizeof(svcs_index_entry_t));
+    if (!index->entries) {
+        return SVCS_ERROR_MEMORY;
+    }
+    index->entry_capacity = entry_count ? entry_count : 1;
+
+    const char *prev = "";
+    size_t prev_len = 0;
+    for (uint32_t i = 0; i < entry_count; i++) {
+        if ((size_t)(end - ptr) < INDEX_ENTRY_FIXED_SIZE) {
+            return SVCS_ERROR_CORRUPT;
+        }
+
+        svcs_index_entry_t *entry = &index->entries[i];
+        memcpy(entry->hash.bytes, ptr, SVCS_HASH_SIZE);
+        ptr += SVCS_HASH_SIZE;
+        entry->mtime = (time_t)(int64_t)svcs_get_be64(ptr);
+        entry->mtime_nsec = svcs_get_be32(ptr + 8);
+        entry->ctime = (time_t)(int64_t)svcs_get_be64(ptr + 12);
+        entry->ctime_nsec = svcs_get_be32(ptr + 20);
+        entry->dev = svcs_get_be64(ptr + 24);
+        entry->ino = svcs_get_be64(ptr + 32);
+        entry->size = (size_t)svcs_get_be64(ptr + 40);
+        entry->mode = svcs_get_be32(ptr + 48);
+        entry->status = (svcs_file_status_t)svcs_get_be32(ptr + 52);
+        entry->flags = svcs_get_be32(ptr + 56) & INDEX_ENTRY_SAVED_FLAGS;
+        ptr += 60;
+
+        uint64_t shared, rest;
+        size_t n = get_varint(ptr, end, &shared);
+        ptr += n;
+        size_t m = n ? get_varint(ptr, end, &rest) : 0;
+        ptr += m;
+        if (!m || shared > prev_len || rest > (uint64_t)(end - ptr) || shared + rest >= SVCS_MAX_PATH) {
+            return SVCS_ERROR_CORRUPT;
+        }
+
+        char *path = arena_alloc(index, (size_t)(shared + rest));
+        if (!path) {
+            return SVCS_ERROR_MEMORY;
+        }
+        memcpy(path, prev, (size_t)shared);
+        memcpy(path + shared, ptr, (size_t)rest);
+        path[shared + rest] = '\0';
+        ptr += rest;
+
+        entry->path = path;
+        index->entry_count++;
+        prev = path;
+        prev_len = (size_t)(shared + rest);
+    }
+
+    return parse_extensions(index, ptr, end);
+}
+
+// Entries from the base not removed or replaced by the index file are
+// marked shared; the index file's own entries go in where they sort
+static svcs_error_t merge_split_base(svcs_index_t *index, const svcs_index_t *base) {
+    svcs_split_index_t *split = index->split;
+    size_t total = base->entry_count + index->entry_count;
+    svcs_index_entry_t *entries = malloc((total ? total : 1) * sizeof(svcs_index_entry_t));
+    split->base_paths = malloc((base->entry_count ? base->entry_count : 1) * sizeof(char*));
+    if (!entries || !split->base_paths) {
+        free(entries);
+        return SVCS_ERROR_MEMORY;
+    }
+    
+    size_t i = 0, j = 0, deleted = 0, out = 0;
+    while (i < base->entry_count || j < index->entry_count) {
+        int cmp = i == base->entry_count ? 1 :
+                  j == index->entry_count ? -1 : strcmp(base->entries[i].path, index->entries[j].path);
+        if (cmp > 0) {
+            entries[out++] = index->entries[j++];
+            continue;
+        }
+        
+        const svcs_index_entry_t *entry = &base->entries[i++];
+        if (split->base_count > 0 && strcmp(split->base_paths[split->base_count - 1], entry->path) >= 0) {
+            free(entries);
+            return SVCS_ERROR_CORRUPT;
+        }
+        split->base_paths[split->base_count++] = entry->path;
+        if (cmp == 0) {
+            entries[out++] = index->entries[j++];
+            continue;
+        }
+        
+        while (deleted < split->deleted_count && strcmp(split->deleted[deleted], entry->path) < 0) {
+            deleted++;
+        }
+        if (deleted < split->deleted_count && strcmp(split->deleted[deleted], entry->path) == 0) {
+            continue;
+        }
+        entries[out] = *entry;
+        entries[out++].flags |= INDEX_ENTRY_SHARED;
+    }
+    
+    free(index->entries);
+    index->entries = entries;
+    index->entry_count = out;
+    index->entry_capacity = total ? total : 1;
+    free(split->deleted);
+    split->deleted = NULL;
+    split->deleted_count = 0;
+    return SVCS_OK;
+}
+
+static svcs_error_t load_split_base(svcs_repository_t *repo, svcs_index_t *index) {
+    svcs_split_index_t *split = index->split;
+    char base_path[SVCS_MAX_PATH];
+    split_base_path(repo, &split->base, base_path, sizeof(base_path));
+    
+    struct stat st;
+    if (stat(base_path, &st) != 0) {
+        return SVCS_ERROR_CORRUPT;
+    }
+    split->timestamp = st.st_mtim.tv_sec;
+    split->timestamp_nsec = (uint32_t)st.st_mtim.tv_nsec;
+    
+    svcs_index_t *base = calloc(1, sizeof(svcs_index_t));
+    if (!base) {
+        return SVCS_ERROR_MEMORY;
+    }
+    
+    const uint8_t *data;
+    size_t size;
+    svcs_error_t err = svcs_file_map(base_path, &data, &size);
+    if (err == SVCS_OK) {
+        if (size < INDEX_HEADER_SIZE + SVCS_HASH_SIZE || memcmp(data, INDEX_SIGNATURE, 4) != 0 ||
+            memcmp(data + size - SVCS_HASH_SIZE, split->base.bytes, SVCS_HASH_SIZE) != 0) {
+            err = SVCS_ERROR_CORRUPT;
+        } else {
+            err = parse_index(base, data, size);
+        }
+        munmap((void*)data, size);
+    }
+    
+    // The base's paths move to the index's arena
+    if (base->paths) {
+        svcs_path_arena_t *tail = base->paths;
+        while (tail->next) {
+            tail = tail->next;
+        }
+        tail->next = index->paths;
+        index->paths = base->paths;
+        base->paths = NULL;
+    }
+    
+    if (err == SVCS_OK && base->split) {
+        err = SVCS_ERROR_CORRUPT;
+    }
+    if (err == SVCS_OK) {
+        err = merge_split_base(index, base);
+    }
+    svcs_index_free(base);
+    return err;
+}
+
+// core.splitindex turns the split index on or off; the file follows on
+// the next save
+static svcs_error_t configure_split(svcs_repository_t *repo, svcs_index_t *index) {
+    char value[64];
+    int enabled = svcs_config_get(repo, "core.splitindex", value, sizeof(value)) == SVCS_OK &&
+                  strcmp(value, "true") == 0;
+    if (!enabled && !index->split) {
+        return SVCS_OK;
+    }
+    
+    if (!index->split) {
+        index->split = calloc(1, sizeof(svcs_split_index_t));
+        if (!index->split) {
+            return SVCS_ERROR_MEMORY;
+        }
+    }
+    index->split->enabled = enabled;
+    index->split->max_percent = SPLIT_INDEX_DEFAULT_MAX_PERCENT;
+    if (svcs_config_get(repo, "core.splitindexmaxpercent", value, sizeof(value)) == SVCS_OK) {
+        int percent = atoi(value);
+        if (percent >= 0 && percent <= 100) {
+            index->split->max_percent = percent;
+        }
+    }
+    return SVCS_OK;
+}
 
 svcs_error_t svcs_index_load(svcs_repository_t *repo) {
     if (!repo) {
@@ -8,90 +571,269 @@ svcs_error_t svcs_index_load(svcs_repository_t *repo) {
     char index_path[SVCS_MAX_PATH];
     snprintf(index_path, sizeof(index_path), "%s/index", repo->git_dir);
     
-    if (!svcs_file_exists(index_path)) {
-        // Create empty index
-        repo->index = calloc(1, sizeof(svcs_index_t));
-        if (!repo->index) {
-            return SVCS_ERROR_MEMORY;
+    svcs_index_t *index = calloc(1, sizeof(svcs_index_t));
+    if (!index) {
+        return SVCS_ERROR_MEMORY;
+    }
+    
+    // A missing or empty file is an empty index
+    struct stat st;
+    if (stat(index_path, &st) != 0 || st.st_size == 0) {
+        svcs_error_t err = configure_split(repo, index);
+        if (err != SVCS_OK) {
+            svcs_index_free(index);
+            return err;
         }
-        repo->index->timestamp = time(NULL);
+        repo->index = index;
         return SVCS_OK;
     }
+    index->timestamp = st.st_mtim.tv_sec;
+    index->timestamp_nsec = (uint32_t)st.st_mtim.tv_nsec;
     
-    void *data;
+    const uint8_t *data;
     size_t size;
-    svcs_error_t err = svcs_file_read(index_path, &data, &size);
+    svcs_error_t err = svcs_file_map(index_path, &data, &size);
+    if (err == SVCS_OK) {
+        if (size >= 4 && memcmp(data, INDEX_SIGNATURE, 4) == 0) {
+            err = parse_index(index, data, size);
+        } else if (size >= 8 && memcmp(data, &(uint32_t){1}, 4) == 0) {
+            err = parse_index_v1(index, data, size);
+        } else {
+            err = SVCS_ERROR_CORRUPT;
+        }
+        munmap((void*)data, size);
+    }
+    
+    if (err == SVCS_OK && index->split) {
+        err = load_split_base(repo, index);
+    }
+    if (err == SVCS_OK) {
+        err = configure_split(repo, index);
+    }
     if (err != SVCS_OK) {
+        svcs_index_free(index);
         return err;
     }
     
-    if (size == 0) {
-        // Empty index file
-        repo->index = calloc(1, sizeof(svcs_index_t));
-        if (!repo->index) {
-            free(data);
-            return SVCS_ERROR_MEMORY;
+    // Files from before entries were kept sorted
+    for (size_t i = 1; i < index->entry_count; i++) {
+        if (strcmp(index->entries[i - 1].path, index->entries[i].path) > 0) {
+            qsort(index->entries, index->entry_count, sizeof(svcs_index_entry_t), compare_entries);
+            break;
         }
-        repo->index->timestamp = time(NULL);
-        free(data);
-        return SVCS_OK;
     }
     
-    // Parse index file (simplified binary format)
-    char *ptr = (char*)data;
-    
-    // Read header
-    if (size < sizeof(uint32_t) * 2) {
-        free(data);
-        return SVCS_ERROR_CORRUPT;
+    repo->index = index;
+    return SVCS_OK;
+}
+
+static svcs_error_t append_extension(svcs_buffer_t *buf, const char *signature, const void *data, size_t size) {
+    uint8_t header[INDEX_EXTENSION_HEADER_SIZE];
+    memcpy(header, signature, 4);
+    svcs_put_be32(header + 4, (uint32_t)size);
+    svcs_error_t err = svcs_buffer_append(buf, header, sizeof(header));
+    if (err == SVCS_OK) {
+        err = svcs_buffer_append(buf, data, size);
+    }
+    return err;
+}
+
+// A racy entry that nothing has verified since it was loaded, and whose
+// file still matches its stat data but no longer its hash
+static int needs_smudge(svcs_repository_t *repo, const svcs_index_entry_t *entry) {
+    if ((entry->flags & INDEX_ENTRY_UPTODATE) || !is_racy(repo->index, entry)) {
+        return 0;
     }
     
-    uint32_t version = *(uint32_t*)ptr;
-    ptr += sizeof(uint32_t);
-    
-    uint32_t entry_count = *(uint32_t*)ptr;
-    ptr += sizeof(uint32_t);
+    struct stat st;
+    if (lstat(entry->path, &st) != 0 || !stat_matches(entry, &st)) {
+        return 0;
+    }
     
-    if (version != 1) {
-        free(data);
-        return SVCS_ERROR_CORRUPT;
+    svcs_hash_t hash;
+    return svcs_hash_file_algo(repo->hash_algo, entry->path, &hash) != SVCS_OK ||
+           svcs_hash_compare(&hash, &entry->hash) != 0;
+}
+
+int svcs_index_entry_clean(svcs_repository_t *repo, const svcs_index_entry_t *entry) {
+    struct stat st;
+    if (lstat(entry->path, &st) != 0) {
+        return errno == ENOENT;
+    }
+    if (stat_matches(entry, &st) && !is_racy(repo->index, entry)) {
+        return 1;
     }
     
-    repo->index = calloc(1, sizeof(svcs_index_t));
-    if (!repo->index) {
-        free(data);
-        return SVCS_ERROR_MEMORY;
+    svcs_hash_t hash;
+    return S_ISREG(st.st_mode) && svcs_hash_file_algo(repo->hash_algo, entry->path, &hash) == SVCS_OK &&
+           svcs_hash_compare(&hash, &entry->hash) == 0;
+}
+
+// The header and entries; with delta_only, those a split index keeps in
+// the index file itself
+static svcs_error_t append_entries(svcs_repository_t *repo, svcs_buffer_t *buf, int delta_only) {
+    svcs_index_t *index = repo->index;
+    size_t count = 0;
+    for (size_t i = 0; i < index->entry_count; i++) {
+        count += !delta_only || !(index->entries[i].flags & INDEX_ENTRY_SHARED);
     }
     
-    repo->index->entry_count = entry_count;
-    repo->index->timestamp = time(NULL);
+    uint8_t header[INDEX_HEADER_SIZE];
+    memcpy(header, INDEX_SIGNATURE, 4);
+    svcs_put_be32(header + 4, INDEX_VERSION);
+    svcs_put_be32(header + 8, (uint32_t)count);
+    svcs_error_t err = svcs_buffer_append(buf, header, sizeof(header));
     
-    if (entry_count > 0) {
-        repo->index->entries = calloc(entry_count, sizeof(svcs_index_entry_t));
-        if (!repo->index->entries) {
-            free(repo->index);
-            free(data);
-            return SVCS_ERROR_MEMORY;
+    const char *prev = "";
+    for (size_t i = 0; i < index->entry_count && err == SVCS_OK; i++) {
+        const svcs_index_entry_t *entry = &index->entries[i];
+        if (delta_only && (entry->flags & INDEX_ENTRY_SHARED)) {
+            continue;
         }
+        uint8_t fixed[INDEX_ENTRY_FIXED_SIZE + 20];
+        uint8_t *ptr = fixed;
+        memcpy(ptr, entry->hash.bytes, SVCS_HASH_SIZE);
+        ptr += SVCS_HASH_SIZE;
+        svcs_put_be64(ptr, (uint64_t)(int64_t)entry->mtime);
+        svcs_put_be32(ptr + 8, entry->mtime_nsec);
+        svcs_put_be64(ptr + 12, (uint64_t)(int64_t)entry->ctime);
+        svcs_put_be32(ptr + 20, entry->ctime_nsec);
+        svcs_put_be64(ptr + 24, entry->dev);
+        svcs_put_be64(ptr + 32, entry->ino);
+        svcs_put_be64(ptr + 40, needs_smudge(repo, entry) ? 0 : (uint64_t)entry->size);
+        svcs_put_be32(ptr + 48, entry->mode);
+        svcs_put_be32(ptr + 52, (uint32_t)entry->status);
+        svcs_put_be32(ptr + 56, entry->flags & INDEX_ENTRY_SAVED_FLAGS);
         
-        // Read entries (simplified format)
-        for (size_t i = 0; i < entry_count; i++) {
-            if (ptr + sizeof(svcs_index_entry_t) > (char*)data + size) {
-                free(repo->index->entries);
-                free(repo->index);
-                free(data);
-                return SVCS_ERROR_CORRUPT;
-            }
-            
-            memcpy(&repo->index->entries[i], ptr, sizeof(svcs_index_entry_t));
-            ptr += sizeof(svcs_index_entry_t);
+        size_t shared = 0;
+        while (prev[shared] && prev[shared] == entry->path[shared]) {
+            shared++;
+        }
+        size_t rest = strlen(entry->path + shared);
+        size_t len = INDEX_ENTRY_FIXED_SIZE;
+        len += put_varint(fixed + len, shared);
+        len += put_varint(fixed + len, rest);
+        
+        err = svcs_buffer_append(buf, fixed, len);
+        if (err == SVCS_OK) {
+            err = svcs_buffer_append(buf, entry->path + shared, rest);
+        }
+        prev = entry->path;
+    }
+    return err;
+}
+
+static svcs_error_t append_checksum(svcs_buffer_t *buf, svcs_hash_t *checksum) {
+    svcs_hash_update(checksum, buf->data, buf->size);
+    return svcs_buffer_append(buf, checksum->bytes, SVCS_HASH_SIZE);
+}
+
+// The LINK payload, and how many entries differ from the base: those in
+// the index file plus the base paths removed. Both lists are sorted.
+static svcs_error_t build_link(const svcs_index_t *index, svcs_buffer_t *link, size_t *changes) {
+    const svcs_split_index_t *split = index->split;
+    *changes = 0;
+    for (size_t i = 0; i < index->entry_count; i++) {
+        *changes += !(index->entries[i].flags & INDEX_ENTRY_SHARED);
+    }
+    
+    svcs_error_t err = svcs_buffer_append(link, split->base.bytes, SVCS_HASH_SIZE);
+    size_t j = 0;
+    for (size_t i = 0; i < split->base_count && err == SVCS_OK; i++) {
+        const char *path = split->base_paths[i];
+        while (j < index->entry_count && strcmp(index->entries[j].path, path) < 0) {
+            j++;
         }
+        if (j == index->entry_count || strcmp(index->entries[j].path, path) != 0) {
+            err = svcs_buffer_append(link, path, strlen(path) + 1);
+            (*changes)++;
+        }
+    }
+    return err;
+}
+
+// Writes every entry as a new base, which they then all share
+static svcs_error_t write_split_base(svcs_repository_t *repo) {
+    svcs_index_t *index = repo->index;
+    svcs_split_index_t *split = index->split;
+    const char **base_paths = malloc((index->entry_count ? index->entry_count : 1) * sizeof(char*));
+    if (!base_paths) {
+        return SVCS_ERROR_MEMORY;
+    }
+    
+    svcs_buffer_t buf = {0};
+    svcs_hash_t checksum;
+    char base_path[SVCS_MAX_PATH];
+    svcs_error_t err = append_entries(repo, &buf, 0);
+    if (err == SVCS_OK) {
+        err = append_checksum(&buf, &checksum);
+    }
+    if (err == SVCS_OK) {
+        split_base_path(repo, &checksum, base_path, sizeof(base_path));
+        err = svcs_repo_write_file(repo, base_path, buf.data, buf.size);
+    }
+    svcs_buffer_free(&buf);
+    if (err != SVCS_OK) {
+        free(base_paths);
+        return err;
+    }
+    
+    // Inside a batch the file is not in place yet; the index file's
+    // timestamp is older still, which only makes more entries racy
+    struct stat st;
+    if (stat(base_path, &st) == 0) {
+        split->timestamp = st.st_mtim.tv_sec;
+        split->timestamp_nsec = (uint32_t)st.st_mtim.tv_nsec;
+    } else {
+        split->timestamp = index->timestamp;
+        split->timestamp_nsec = index->timestamp_nsec;
     }
     
-    free(data);
+    if (split->has_base && !split->has_stale && svcs_hash_compare(&split->base, &checksum) != 0) {
+        split->stale = split->base;
+        split->has_stale = 1;
+    }
+    split->base = checksum;
+    split->has_base = 1;
+    free(split->base_paths);
+    split->base_paths = base_paths;
+    split->base_count = index->entry_count;
+    for (size_t i = 0; i < index->entry_count; i++) {
+        index->entries[i].flags |= INDEX_ENTRY_SHARED;
+        base_paths[i] = index->entries[i].path;
+    }
     return SVCS_OK;
 }
 
+// Once an index file naming it has replaced the one on disk
+void svcs_index_remove_stale_base(svcs_repository_t *repo) {
+    svcs_split_index_t *split = repo->index->split;
+    if (!split || !split->has_stale || repo->write_batch) {
+        return;
+    }
+    
+    char base_path[SVCS_MAX_PATH];
+    split_base_path(repo, &split->stale, base_path, sizeof(base_path));
+    unlink(base_path);
+    split->has_stale = 0;
+}
+
+// Stops sharing a base the index file no longer names
+static void drop_split_base(svcs_index_t *index) {
+    svcs_split_index_t *split = index->split;
+    if (split->has_base && !split->has_stale) {
+        split->stale = split->base;
+        split->has_stale = 1;
+    }
+    split->has_base = 0;
+    free(split->base_paths);
+    split->base_paths = NULL;
+    split->base_count = 0;
+    for (size_t i = 0; i < index->entry_count; i++) {
+        index->entries[i].flags &= ~INDEX_ENTRY_SHARED;
+    }
+}
+
 svcs_error_t svcs_index_save(svcs_repository_t *repo) {
     if (!repo || !repo->index) {
         return SVCS_ERROR_INVALID;
@@ -100,35 +842,207 @@ svcs_error_t svcs_index_save(svcs_repository_t *repo) {
     char index_path[SVCS_MAX_PATH];
     snprintf(index_path, sizeof(index_path), "%s/index", repo->git_dir);
     
-    // Calculate total size
-    size_t total_size = sizeof(uint32_t) * 2; // version + entry_count
-    total_size += repo->index->entry_count * sizeof(svcs_index_entry_t);
+    svcs_index_t *index = repo->index;
+    svcs_split_index_t *split = index->split;
+    int split_mode = split && split->enabled;
+    svcs_buffer_t link = {0};
+    svcs_error_t err = SVCS_OK;
     
-    void *data = malloc(total_size);
-    if (!data) {
-        return SVCS_ERROR_MEMORY;
+    if (split_mode) {
+        // A base that never made it to disk, such as from an aborted batch
+        char base_path[SVCS_MAX_PATH];
+        if (split->has_base && !repo->write_batch) {
+            split_base_path(repo, &split->base, base_path, sizeof(base_path));
+            if (!svcs_file_exists(base_path)) {
+                int had_stale = split->has_stale;
+                drop_split_base(index);
+                split->has_stale = had_stale;
+            }
+        }
+        
+        // The base is rewritten once enough has changed against it. Within
+        // a batch that already replaced it, the old one is still on disk
+        // and the next save does it.
+        size_t changes = 0;
+        if (split->has_base) {
+            err = build_link(index, &link, &changes);
+        }
+        int rewrite = !split->has_base ||
+                      (changes * 100 > split->base_count * (size_t)split->max_percent &&
+                       !(split->has_stale && repo->write_batch));
+        if (err == SVCS_OK && rewrite) {
+            err = write_split_base(repo);
+            link.size = 0;
+            if (err == SVCS_OK) {
+                err = build_link(index, &link, &changes);
+            }
+        }
+    } else if (split && split->has_base) {
+        drop_split_base(index);
+    }
+    
+    svcs_buffer_t buf = {0};
+    if (err == SVCS_OK) {
+        err = append_entries(repo, &buf, split_mode);
+    }
+    
+    if (err == SVCS_OK && split_mode) {
+        err = append_extension(&buf, "LINK", link.data, link.size);
+    }
+    svcs_buffer_free(&link);
+    
+    if (err == SVCS_OK && index->fsmonitor_token[0]) {
+        err = append_extension(&buf, "FSMN", index->fsmonitor_token, strlen(index->fsmonitor_token));
+    }
+    
+    if (err == SVCS_OK && index->untracked) {
+        svcs_buffer_t untracked = {0};
+        err = svcs_untracked_cache_write(index->untracked, &untracked);
+        if (err == SVCS_OK) {
+            err = append_extension(&buf, "UNTR", untracked.data, untracked.size);
+        }
+        svcs_buffer_free(&untracked);
     }
     
-    char *ptr = (char*)data;
+    if (err == SVCS_OK && index->cache_tree) {
+        svcs_buffer_t trees = {0};
+        err = svcs_cache_tree_write(index->cache_tree, &trees);
+        if (err == SVCS_OK) {
+            err = append_extension(&buf, "TREE", trees.data, trees.size);
+        }
+        svcs_buffer_free(&trees);
+    }
     
-    // Write header
-    uint32_t version = 1;
-    memcpy(ptr, &version, sizeof(uint32_t));
-    ptr += sizeof(uint32_t);
+    if (err == SVCS_OK) {
+        svcs_hash_t checksum;
+        err = append_checksum(&buf, &checksum);
+    }
     
-    uint32_t entry_count = (uint32_t)repo->index->entry_count;
-    memcpy(ptr, &entry_count, sizeof(uint32_t));
-    ptr += sizeof(uint32_t);
+    if (err == SVCS_OK) {
+        err = svcs_repo_write_file(repo, index_path, buf.data, buf.size);
+    }
+    svcs_buffer_free(&buf);
     
-    // Write entries
-    for (size_t i = 0; i < repo->index->entry_count; i++) {
-        memcpy(ptr, &repo->index->entries[i], sizeof(svcs_index_entry_t));
-        ptr += sizeof(svcs_index_entry_t);
+    // Entries are racy against the file just written. Inside a batch this
+    // still sees the previous file, which only makes more entries racy.
+    struct stat st;
+    if (err == SVCS_OK && stat(index_path, &st) == 0) {
+        index->timestamp = st.st_mtim.tv_sec;
+        index->timestamp_nsec = (uint32_t)st.st_mtim.tv_nsec;
+    }
+    
+    if (err == SVCS_OK) {
+        svcs_index_remove_stale_base(repo);
+    }
+    return err;
+}
+
+// Store the blob for path and report the stat data it was read with.
+// One open serves the stat, the hash and the blob write.
+static svcs_error_t stage_file(svcs_repository_t *repo, const char *path, svcs_hash_t *hash, struct stat *st) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno == ENOENT ? SVCS_ERROR_NOT_FOUND : SVCS_ERROR_IO;
     }
     
-    svcs_error_t err = svcs_file_write(index_path, data, total_size);
-    free(data);
+    if (fstat(fd, st) != 0) {
+        close(fd);
+        return SVCS_ERROR_IO;
+    }
     
+    svcs_error_t err = svcs_object_write_blob_fd(repo, fd, (size_t)st->st_size, hash);
+    close(fd);
+    return err;
+}
+
+static void set_entry_stat(svcs_index_entry_t *entry, const svcs_hash_t *hash, const struct stat *st) {
+    entry->hash = *hash;
+    fill_stat(entry, st);
+    entry->status = SVCS_STATUS_ADDED;
+    entry->flags = (entry->flags | INDEX_ENTRY_UPTODATE) & ~(INDEX_ENTRY_FSMONITOR_VALID | INDEX_ENTRY_SHARED);
+}
+
+typedef struct {
+    const char *path;
+    size_t order;  // Position in the caller's list; the last copy wins
+} pending_entry_t;
+
+static int compare_pending(const void *a, const void *b) {
+    const pending_entry_t *x = a, *y = b;
+    int cmp = strcmp(x->path, y->path);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return x->order < y->order ? -1 : (x->order > y->order);
+}
+
+// Paths already in the index are updated where they are. New ones are
+// sorted and merged in from the back in one pass, so adding k paths to n
+// entries costs O(k log k + n) rather than a shift per path.
+static svcs_error_t apply_staged(svcs_index_t *index, const char *const *paths, const svcs_hash_t *hashes,
+                                 const struct stat *stats, const svcs_error_t *errors, size_t count) {
+    pending_entry_t *pending = malloc(count * sizeof(pending_entry_t));
+    if (!pending) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    size_t pending_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t pos;
+        if (errors[i] != SVCS_OK) {
+            continue;
+        }
+        if (index_find(index, paths[i], &pos)) {
+            // Staging the same content again keeps its trees
+            svcs_index_entry_t *entry = &index->entries[pos];
+            if (svcs_hash_compare(&entry->hash, &hashes[i]) != 0 || entry->mode != stats[i].st_mode) {
+                svcs_cache_tree_invalidate(index->cache_tree, paths[i]);
+            }
+            set_entry_stat(entry, &hashes[i], &stats[i]);
+        } else {
+            svcs_cache_tree_invalidate(index->cache_tree, paths[i]);
+            pending[pending_count].path = paths[i];
+            pending[pending_count++].order = i;
+        }
+    }
+
+    qsort(pending, pending_count, sizeof(pending_entry_t), compare_pending);
+    size_t unique = 0;
+    for (size_t i = 0; i < pending_count; i++) {
+        if (i + 1 < pending_count && strcmp(pending[i].path, pending[i + 1].path) == 0) {
+            continue;
+        }
+        pending[unique++] = pending[i];
+    }
+
+    // Nothing can fail once the merge starts
+    svcs_error_t err = index_reserve(index, index->entry_count + unique);
+    for (size_t i = 0; i < unique && err == SVCS_OK; i++) {
+        pending[i].path = arena_copy(index, pending[i].path, strlen(pending[i].path));
+        if (!pending[i].path) {
+            err = SVCS_ERROR_MEMORY;
+        }
+    }
+
+    if (err == SVCS_OK) {
+        size_t old = index->entry_count;
+        size_t next = unique;
+        size_t out = old + unique;
+        while (next > 0) {
+            svcs_index_entry_t *dst = &index->entries[--out];
+            if (old > 0 && strcmp(index->entries[old - 1].path, pending[next - 1].path) > 0) {
+                *dst = index->entries[--old];
+            } else {
+                const pending_entry_t *added = &pending[--next];
+                memset(dst, 0, sizeof(*dst));
+                dst->path = added->path;
+                set_entry_stat(dst, &hashes[added->order], &stats[added->order]);
+            }
+        }
+        index->entry_count += unique;
+    }
+
+    free(pending);
     return err;
 }
 
@@ -137,62 +1051,122 @@ svcs_error_t svcs_index_add(svcs_repository_t *repo, const char *path) {
         return SVCS_ERROR_INVALID;
     }
     
-    // Check if file exists
-    if (!svcs_file_exists(path)) {
-        return SVCS_ERROR_NOT_FOUND;
+    return svcs_index_add_paths(repo, &path, 1, 0);
+}
+
+// Files handed to each worker before another thread is worth starting
+#define ADD_PATHS_PER_WORKER 8
+
+typedef struct {
+    svcs_repository_t *repo;
+    const char *const *paths;
+    svcs_hash_t *hashes;
+    struct stat *stats;
+    svcs_error_t *errors;
+} add_paths_job_t;
+
+// Directories outside a sparse checkout are staged as a whole
+static int in_collapsed_dir(const svcs_index_t *index, const char *path) {
+    char prefix[SVCS_MAX_PATH];
+    snprintf(prefix, sizeof(prefix), "%s", path);
+    if (prefix[0] == '\0' || prefix[1] == '\0') {
+        return 0;
+    }
+    for (char *slash = strchr(prefix + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        size_t pos;
+        int found = index_find(index, prefix, &pos) && S_ISDIR(index->entries[pos].mode);
+        *slash = '/';
+        if (found) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void add_paths_worker(void *arg, size_t i) {
+    add_paths_job_t *job = arg;
+    job->errors[i] = stage_file(job->repo, job->paths[i], &job->hashes[i], &job->stats[i]);
+}
+
+svcs_error_t svcs_index_add_paths(svcs_repository_t *repo, const char *const *paths, size_t count, int flags) {
+    if (!repo || !repo->index || (!paths && count > 0)) {
+        return SVCS_ERROR_INVALID;
     }
     
-    // Get file stats
-    struct stat st;
-    if (stat(path, &st) != 0) {
-        return SVCS_ERROR_IO;
+    if (count == 0) {
+        return SVCS_OK;
     }
     
-    // Compute file hash
-    svcs_hash_t hash;
-    svcs_error_t err = svcs_hash_file(path, &hash);
-    if (err != SVCS_OK) {
-        return err;
+    add_paths_job_t job = {
+        .repo = repo,
+        .paths = paths,
+        .hashes = malloc(count * sizeof(svcs_hash_t)),
+        .stats = malloc(count * sizeof(struct stat)),
+        .errors = malloc(count * sizeof(svcs_error_t))
+    };
+    
+    svcs_error_t err = SVCS_OK;
+    if (!job.hashes || !job.stats || !job.errors) {
+        err = SVCS_ERROR_MEMORY;
     }
     
-    // Create blob object
-    err = svcs_object_create_blob(repo, path, &hash);
-    if (err != SVCS_OK) {
-        return err;
+    for (size_t i = 0; i < count && err == SVCS_OK; i++) {
+        if (in_collapsed_dir(repo->index, paths[i])) {
+            err = SVCS_ERROR_INVALID;
+        }
     }
     
-    // Find existing entry or create new one
-    svcs_index_entry_t *entry = NULL;
-    for (size_t i = 0; i < repo->index->entry_count; i++) {
-        if (strcmp(repo->index->entries[i].path, path) == 0) {
-            entry = &repo->index->entries[i];
-            break;
+    // Blobs and the index are flushed to disk together at the end
+    if (err == SVCS_OK) {
+        err = svcs_write_batch_begin(repo);
+    }
+    int batch_open = err == SVCS_OK;
+    
+    // Hashing and compressing blobs is independent per file; only the
+    // index update below needs to be serialized
+    if (err == SVCS_OK) {
+        svcs_parallel_for(count, ADD_PATHS_PER_WORKER, add_paths_worker, &job);
+    }
+    
+    // Nothing is staged unless every path could be stored
+    for (size_t i = 0; i < count && err == SVCS_OK; i++) {
+        if (job.errors[i] == SVCS_ERROR_NOT_FOUND && (flags & SVCS_ADD_IGNORE_MISSING)) {
+            continue;
         }
+        err = job.errors[i];
     }
     
-    if (!entry) {
-        // Add new entry
-        repo->index->entries = realloc(repo->index->entries, 
-                                     (repo->index->entry_count + 1) * sizeof(svcs_index_entry_t));
-        if (!repo->index->entries) {
-            return SVCS_ERROR_MEMORY;
+    if (err == SVCS_OK) {
+        err = apply_staged(repo->index, paths, job.hashes, job.stats, job.errors, count);
+    }
+    
+    // Newly tracked files leave their directory's untracked list
+    for (size_t i = 0; i < count && err == SVCS_OK; i++) {
+        if (job.errors[i] == SVCS_OK) {
+            svcs_untracked_cache_invalidate(repo, paths[i]);
         }
-        
-        entry = &repo->index->entries[repo->index->entry_count];
-        repo->index->entry_count++;
-        
-        strncpy(entry->path, path, sizeof(entry->path) - 1);
-        entry->path[sizeof(entry->path) - 1] = '\0';
     }
     
-    // Update entry
-    entry->hash = hash;
-    entry->mode = st.st_mode;
-    entry->mtime = st.st_mtime;
-    entry->size = st.st_size;
-    entry->status = SVCS_STATUS_ADDED;
+    if (err == SVCS_OK) {
+        err = svcs_index_save(repo);
+    }
+    
+    if (batch_open && err == SVCS_OK) {
+        err = svcs_write_batch_commit(repo);
+    } else if (batch_open) {
+        svcs_write_batch_abort(repo);
+    }
     
-    return svcs_index_save(repo);
+    // A split index base the batch replaced
+    if (err == SVCS_OK) {
+        svcs_index_remove_stale_base(repo);
+    }
+    
+    free(job.hashes);
+    free(job.stats);
+    free(job.errors);
+    return err;
 }
 
 svcs_error_t svcs_index_remove(svcs_repository_t *repo, const char *path) {
@@ -200,19 +1174,208 @@ svcs_error_t svcs_index_remove(svcs_repository_t *repo, const char *path) {
         return SVCS_ERROR_INVALID;
     }
     
-    // Find entry
-    for (size_t i = 0; i < repo->index->entry_count; i++) {
-        if (strcmp(repo->index->entries[i].path, path) == 0) {
-            // Remove entry by shifting remaining entries
-            memmove(&repo->index->entries[i], &repo->index->entries[i + 1],
-                   (repo->index->entry_count - i - 1) * sizeof(svcs_index_entry_t));
-            repo->index->entry_count--;
-            
-            return svcs_index_save(repo);
+    size_t pos;
+    if (!index_find(repo->index, path, &pos)) {
+        return SVCS_ERROR_NOT_FOUND;
+    }
+    
+    // One shift keeps the array sorted; entries are small now
+    memmove(&repo->index->entries[pos], &repo->index->entries[pos + 1],
+            (repo->index->entry_count - pos - 1) * sizeof(svcs_index_entry_t));
+    repo->index->entry_count--;
+    svcs_untracked_cache_invalidate(repo, path);
+    svcs_cache_tree_invalidate(repo->index->cache_tree, path);
+    
+    // Saved as add saves: a split index base rewritten here lands
+    // together with the index file, and the one it replaced goes
+    svcs_error_t err = svcs_write_batch_begin(repo);
+    if (err == SVCS_OK) {
+        err = svcs_index_save(repo);
+        if (err == SVCS_OK) {
+            err = svcs_write_batch_commit(repo);
+        } else {
+            svcs_write_batch_abort(repo);
+        }
+    }
+    if (err == SVCS_OK) {
+        svcs_index_remove_stale_base(repo);
+    }
+    return err;
+}
+
+// Entries each status worker takes at a time. Slices keep the shared work
+// counter out of the way of the lstat calls.
+#define STATUS_SLICE_SIZE 64
+
+typedef struct {
+    svcs_repository_t *repo;
+    svcs_index_entry_t *entries;
+    size_t count;
+    int monitored;   // The monitor answered; clean entries can be marked
+    size_t *dirty;   // Per slice, index entries changed
+} status_job_t;
+
+// The path relative to the worktree, the way the monitor and the
+// untracked cache name it, or NULL if it cannot be mapped safely
+const char* svcs_worktree_path(const svcs_repository_t *repo, const char *path) {
+    size_t len = strlen(repo->work_dir);
+    if (strcmp(repo->work_dir, ".") == 0 && path[0] != '/') {
+        while (strncmp(path, "./", 2) == 0) {
+            path += 2;
+        }
+    } else if (strncmp(path, repo->work_dir, len) == 0 && path[len] == '/') {
+        path += len + 1;
+    } else {
+        return NULL;
+    }
+    
+    if (!path[0] || strstr(path, "..") || strstr(path, "//") || strstr(path, "/./")) {
+        return NULL;
+    }
+    return path;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(const char *const*)a, *(const char *const*)b);
+}
+
+// A change to a directory, such as its removal, covers everything in it
+static int path_changed(const char **changed, size_t count, const char *path) {
+    char prefix[SVCS_MAX_PATH];
+    snprintf(prefix, sizeof(prefix), "%s", path);
+    
+    for (;;) {
+        const char *key = prefix;
+        if (bsearch(&key, changed, count, sizeof(char*), compare_paths)) {
+            return 1;
+        }
+        char *slash = strrchr(prefix, '/');
+        if (!slash) {
+            return 0;
+        }
+        *slash = '\0';
+    }
+}
+
+// Entries whose saved flags change leave the split index base
+static void clear_monitor_flag(svcs_index_entry_t *entry) {
+    if (entry->flags & INDEX_ENTRY_FSMONITOR_VALID) {
+        entry->flags &= ~(INDEX_ENTRY_FSMONITOR_VALID | INDEX_ENTRY_SHARED);
+    }
+}
+
+static void clear_monitor_flags(svcs_index_t *index) {
+    for (size_t i = 0; i < index->entry_count; i++) {
+        clear_monitor_flag(&index->entries[i]);
+    }
+}
+
+// Asks the monitor what changed since the index's token, and clears the
+// mark of entries under those paths, or of all entries if it cannot say.
+// Returns whether the monitor answered.
+static int fsmonitor_prepare(svcs_repository_t *repo, char *token) {
+    svcs_index_t *index = repo->index;
+    svcs_buffer_t changed = {0};
+    int complete = 0;
+    int answered = svcs_fsmonitor_query(repo, index->fsmonitor_token, token, SVCS_FSMONITOR_TOKEN_SIZE,
+                                        &changed, &complete) == SVCS_OK;
+    
+    size_t count = 0;
+    for (size_t i = 0; i < changed.size; i++) {
+        count += changed.data[i] == '\0';
+    }
+    const char **paths = count ? malloc(count * sizeof(char*)) : NULL;
+    
+    if (!answered || !complete || (count && !paths)) {
+        clear_monitor_flags(index);
+    } else if (count) {
+        const char *ptr = (const char*)changed.data;
+        for (size_t i = 0; i < count; i++) {
+            paths[i] = ptr;
+            ptr += strlen(ptr) + 1;
+        }
+        qsort(paths, count, sizeof(char*), compare_paths);
+        
+        for (size_t i = 0; i < index->entry_count; i++) {
+            svcs_index_entry_t *entry = &index->entries[i];
+            if (entry->flags & INDEX_ENTRY_FSMONITOR_VALID) {
+                const char *path = svcs_worktree_path(repo, entry->path);
+                if (!path || path_changed(paths, count, path)) {
+                    clear_monitor_flag(entry);
+                }
+            }
         }
     }
     
-    return SVCS_ERROR_NOT_FOUND;
+    free(paths);
+    svcs_buffer_free(&changed);
+    return answered;
+}
+
+// Marks an entry found clean, if the monitor will report its next change
+static int mark_clean(const status_job_t *job, svcs_index_entry_t *cached) {
+    if (!job->monitored || !svcs_worktree_path(job->repo, cached->path)) {
+        return 0;
+    }
+    cached->flags = (cached->flags | INDEX_ENTRY_FSMONITOR_VALID) & ~INDEX_ENTRY_SHARED;
+    return 1;
+}
+
+// Fills entries[i] from the index entry and the file, and returns whether
+// the index entry changed. Each index entry and result slot is touched by
+// one worker only, so no locking is needed.
+static int check_entry(const status_job_t *job, size_t i, svcs_index_entry_t *entry) {
+    svcs_repository_t *repo = job->repo;
+    svcs_index_entry_t *cached = &repo->index->entries[i];
+    *entry = *cached;
+    
+    // Clean when last checked, and the monitor has seen nothing since.
+    // Directories outside a sparse checkout are not in the worktree.
+    if ((cached->flags & INDEX_ENTRY_FSMONITOR_VALID) || S_ISDIR(cached->mode)) {
+        return 0;
+    }
+    
+    struct stat st;
+    if (lstat(cached->path, &st) != 0) {
+        entry->status = SVCS_STATUS_DELETED;
+        return 0;
+    }
+    
+    // Unchanged stat data is enough, unless the file is racy
+    if (stat_matches(cached, &st) && ((cached->flags & INDEX_ENTRY_UPTODATE) || !is_racy(repo->index, cached))) {
+        return mark_clean(job, cached);
+    }
+    
+    svcs_hash_t current_hash;
+    if (svcs_hash_file_algo(repo->hash_algo, cached->path, &current_hash) != SVCS_OK) {
+        return 0;
+    }
+    if (svcs_hash_compare(&current_hash, &cached->hash) != 0) {
+        entry->status = SVCS_STATUS_MODIFIED;
+        return 0;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        return 0;
+    }
+    
+    // Same content: keep the new stat data so the next status does not
+    // read the file again
+    fill_stat(cached, &st);
+    cached->flags = (cached->flags | INDEX_ENTRY_UPTODATE) & ~INDEX_ENTRY_SHARED;
+    mark_clean(job, cached);
+    return 1;
+}
+
+static void status_worker(void *arg, size_t slice) {
+    status_job_t *job = arg;
+    size_t start = slice * STATUS_SLICE_SIZE;
+    size_t end = start + STATUS_SLICE_SIZE < job->count ? start + STATUS_SLICE_SIZE : job->count;
+    
+    size_t dirty = 0;
+    for (size_t i = start; i < end; i++) {
+        dirty += (size_t)check_entry(job, i, &job->entries[i]);
+    }
+    job->dirty[slice] = dirty;
 }
 
 svcs_error_t svcs_index_status(svcs_repository_t *repo, svcs_index_entry_t **entries, size_t *count) {
@@ -223,37 +1386,51 @@ svcs_error_t svcs_index_status(svcs_repository_t *repo, svcs_index_entry_t **ent
     *entries = NULL;
     *count = 0;
     
-    if (repo->index->entry_count == 0) {
+    size_t entry_count = repo->index->entry_count;
+    if (entry_count == 0) {
         return SVCS_OK;
     }
     
-    *entries = malloc(repo->index->entry_count * sizeof(svcs_index_entry_t));
-    if (!*entries) {
+    size_t slices = (entry_count + STATUS_SLICE_SIZE - 1) / STATUS_SLICE_SIZE;
+    status_job_t job = {
+        .repo = repo,
+        .entries = malloc(entry_count * sizeof(svcs_index_entry_t)),
+        .count = entry_count,
+        .dirty = calloc(slices, sizeof(size_t))
+    };
+    if (!job.entries || !job.dirty) {
+        free(job.entries);
+        free(job.dirty);
         return SVCS_ERROR_MEMORY;
     }
     
-    *count = repo->index->entry_count;
+    // The token is taken before any file is looked at, so a change made
+    // while status runs is reported next time
+    char token[SVCS_FSMONITOR_TOKEN_SIZE];
+    job.monitored = fsmonitor_prepare(repo, token);
     
-    // Check status of each file
-    for (size_t i = 0; i < repo->index->entry_count; i++) {
-        svcs_index_entry_t *entry = &(*entries)[i];
-        *entry = repo->index->entries[i];
-        
-        if (!svcs_file_exists(entry->path)) {
-            entry->status = SVCS_STATUS_DELETED;
-        } else {
-            // Check if file has been modified
-            time_t current_mtime = svcs_file_mtime(entry->path);
-            if (current_mtime != entry->mtime) {
-                svcs_hash_t current_hash;
-                if (svcs_hash_file(entry->path, &current_hash) == SVCS_OK) {
-                    if (svcs_hash_compare(&current_hash, &entry->hash) != 0) {
-                        entry->status = SVCS_STATUS_MODIFIED;
-                    }
-                }
-            }
-        }
+    // The lstat calls dominate on cold caches and network filesystems, and
+    // overlap well. Results land in index order whichever thread ran them.
+    svcs_parallel_for(slices, 1, status_worker, &job);
+    
+    size_t dirty = 0;
+    for (size_t i = 0; i < slices; i++) {
+        dirty += job.dirty[i];
+    }
+    free(job.dirty);
+    
+    if (job.monitored && strcmp(token, repo->index->fsmonitor_token) != 0) {
+        snprintf(repo->index->fsmonitor_token, sizeof(repo->index->fsmonitor_token), "%s", token);
+        dirty++;
     }
     
+    // Saving also moves the index timestamp past the files just verified.
+    // If it fails they are only checked again next time.
+    if (dirty > 0) {
+        svcs_index_save(repo);
+    }
+    
+    *entries = job.entries;
+    *count = entry_count;
     return SVCS_OK;
-}
\ No newline at end of file
+}
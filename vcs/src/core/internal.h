@@ -0,0 +1,332 @@
+#ifndef SVCS_INTERNAL_H
+#define SVCS_INTERNAL_H
+
+// Private helpers shared between the core C sources. Not installed.
+
+#include "svcs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Read size for streaming file I/O
+#define SVCS_IO_CHUNK_SIZE (64 * 1024)
+
+// Big-endian encoding used by all on-disk binary formats
+static inline uint32_t svcs_get_be32(const void *ptr) {
+    const uint8_t *p = (const uint8_t*)ptr;
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline uint64_t svcs_get_be64(const void *ptr) {
+    const uint8_t *p = (const uint8_t*)ptr;
+    return ((uint64_t)svcs_get_be32(p) << 32) | svcs_get_be32(p + 4);
+}
+
+static inline void svcs_put_be32(void *ptr, uint32_t value) {
+    uint8_t *p = (uint8_t*)ptr;
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+static inline void svcs_put_be64(void *ptr, uint64_t value) {
+    uint8_t *p = (uint8_t*)ptr;
+    svcs_put_be32(p, (uint32_t)(value >> 32));
+    svcs_put_be32(p + 4, (uint32_t)value);
+}
+
+// True if str is exactly len lowercase hex digits
+static inline int svcs_is_hex_string(const char *str, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = str[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+            return 0;
+        }
+    }
+    return str[len] == '\0';
+}
+
+// Set of object hashes (hash_set.c)
+typedef struct {
+    svcs_hash_t *slots;
+    uint8_t *used;
+    size_t slot_count;
+    size_t count;
+} svcs_hash_set_t;
+
+svcs_error_t svcs_hash_set_init(svcs_hash_set_t *set, size_t expected);
+void svcs_hash_set_free(svcs_hash_set_t *set);
+void svcs_hash_set_clear(svcs_hash_set_t *set);
+int svcs_hash_set_contains(const svcs_hash_set_t *set, const svcs_hash_t *hash);
+svcs_error_t svcs_hash_set_add(svcs_hash_set_t *set, const svcs_hash_t *hash, int *added);
+svcs_error_t svcs_hash_set_filter(svcs_hash_set_t *set, int (*keep)(const svcs_hash_t *hash, void *arg), void *arg);
+
+// Growable byte buffer used when assembling binary files in memory
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} svcs_buffer_t;
+
+static inline svcs_error_t svcs_buffer_append(svcs_buffer_t *buf, const void *data, size_t len) {
+    if (buf->size + len > buf->capacity) {
+        size_t capacity = buf->capacity ? buf->capacity : 4096;
+        while (capacity < buf->size + len) {
+            capacity *= 2;
+        }
+        uint8_t *grown = realloc(buf->data, capacity);
+        if (!grown) {
+            return SVCS_ERROR_MEMORY;
+        }
+        buf->data = grown;
+        buf->capacity = capacity;
+    }
+    if (len > 0) {
+        memcpy(buf->data + buf->size, data, len);
+        buf->size += len;
+    }
+    return SVCS_OK;
+}
+
+static inline void svcs_buffer_free(svcs_buffer_t *buf) {
+    free(buf->data);
+    buf->data = NULL;
+    buf->size = buf->capacity = 0;
+}
+
+// BLAKE3 (blake3.c)
+#define SVCS_BLAKE3_BLOCK_LEN 64
+#define SVCS_BLAKE3_CHUNK_LEN 1024
+#define SVCS_BLAKE3_MAX_DEPTH 54
+
+typedef struct {
+    uint32_t chunk_cv[8];
+    uint64_t chunk_counter;
+    uint8_t block[SVCS_BLAKE3_BLOCK_LEN];
+    uint8_t block_len;
+    uint8_t blocks_compressed;
+    size_t cv_stack_len;
+    uint32_t cv_stack[SVCS_BLAKE3_MAX_DEPTH][8];
+} svcs_blake3_t;
+
+void svcs_blake3_init(svcs_blake3_t *hasher);
+void svcs_blake3_update(svcs_blake3_t *hasher, const void *data, size_t len);
+void svcs_blake3_final(const svcs_blake3_t *hasher, uint8_t out[32]);
+
+// Object codecs (compress.c). New loose objects and pack entries start with
+// a codec byte; those from before codecs existed are bare zlib streams.
+typedef enum {
+    SVCS_CODEC_NONE = 0,
+    SVCS_CODEC_ZLIB = 1,
+    SVCS_CODEC_ZSTD = 2,
+    SVCS_CODEC_ZSTD_DICT = 3  // Followed by the be32 dictionary id
+} svcs_codec_t;
+
+#define SVCS_CODEC_TINY_SIZE 64                // Stored uncompressed below this size
+#define SVCS_CODEC_DICT_MAX_SIZE (32 * 1024)   // Dictionaries only pay off for small objects
+#define SVCS_DICT_SIZE (64 * 1024)
+#define SVCS_DICT_DIR "objects/info/dictionaries"
+#define SVCS_OBJECT_HEADER_MAX 32              // "<type> <size>\0" always fits
+
+typedef struct svcs_encoder svcs_encoder_t;
+
+const char* svcs_codec_name(svcs_codec_t codec);
+svcs_codec_t svcs_codec_default(void);
+svcs_codec_t svcs_codec_for_object(svcs_repository_t *repo, size_t size);
+svcs_error_t svcs_codec_load(svcs_repository_t *repo);
+void svcs_codec_free(svcs_repository_t *repo);
+svcs_error_t svcs_codec_decode_object(svcs_repository_t *repo, const void *data, size_t size,
+                                      svcs_object_type_t *type, void **content, size_t *content_size);
+svcs_error_t svcs_codec_decode_header(svcs_repository_t *repo, const void *data, size_t size,
+                                      svcs_object_type_t *type, size_t *object_size);
+svcs_error_t svcs_codec_decode_into(svcs_repository_t *repo, const void *data, size_t data_size,
+                                    void *output, size_t size);
+svcs_error_t svcs_codec_decode_prefix(svcs_repository_t *repo, const void *data, size_t data_size,
+                                      void *output, size_t output_size, size_t *produced);
+
+// Streaming encoder writing a codec byte and the encoded stream to fd, and
+// feeding the same bytes to hash if it is set. size is the total number of
+// bytes that will be written through it.
+svcs_error_t svcs_encoder_new(svcs_repository_t *repo, svcs_codec_t codec, size_t size,
+                              int fd, svcs_hash_ctx_t *hash, svcs_encoder_t **encoder);
+svcs_error_t svcs_encoder_write(svcs_encoder_t *enc, const void *data, size_t len);
+svcs_error_t svcs_encoder_finish(svcs_encoder_t *enc);
+void svcs_encoder_free(svcs_encoder_t *enc);
+
+// Object type names as they appear in object headers
+const char* svcs_object_type_name(svcs_object_type_t type);
+svcs_object_type_t svcs_object_type_from_name(const char *name, size_t len);
+
+// Loose object storage
+int svcs_loose_object_exists(svcs_repository_t *repo, const svcs_hash_t *hash);
+svcs_error_t svcs_loose_object_path(svcs_repository_t *repo, const svcs_hash_t *hash, char *path, size_t path_size);
+svcs_error_t svcs_object_write_blob_fd(svcs_repository_t *repo, int fd, size_t size, svcs_hash_t *hash);
+
+// Object cache (object_cache.c)
+#define SVCS_OBJECT_CACHE_DEFAULT_SIZE (32 * 1024 * 1024)
+
+svcs_error_t svcs_object_cache_new(size_t max_bytes, svcs_object_cache_t **cache);
+void svcs_object_cache_free(svcs_object_cache_t *cache);
+int svcs_object_cache_get(svcs_object_cache_t *cache, const svcs_hash_t *hash,
+                          svcs_object_type_t *type, void **data, size_t *size);
+void svcs_object_cache_put(svcs_object_cache_t *cache, const svcs_hash_t *hash,
+                           svcs_object_type_t type, const void *data, size_t size);
+
+// Loose object existence cache (loose_cache.c). svcs_loose_cache_has
+// returns -1 when it cannot tell.
+svcs_error_t svcs_loose_cache_new(svcs_loose_cache_t **cache);
+void svcs_loose_cache_free(svcs_loose_cache_t *cache);
+int svcs_loose_cache_has(svcs_repository_t *repo, const svcs_hash_t *hash);
+void svcs_loose_cache_add(svcs_repository_t *repo, const svcs_hash_t *hash);
+void svcs_loose_cache_forget(svcs_repository_t *repo, uint8_t fanout);
+svcs_error_t svcs_loose_cache_mkdir(svcs_repository_t *repo, const svcs_hash_t *hash);
+
+// Durable writes (utils.c, write_batch.c)
+svcs_error_t svcs_file_write_temp(const char *path, const void *data, size_t size, int sync,
+                                  char *tmp_path, size_t tmp_size);
+svcs_error_t svcs_fsync_parent_dir(const char *path);
+svcs_error_t svcs_file_map(const char *path, const uint8_t **map, size_t *size);
+svcs_error_t svcs_repo_write_file(svcs_repository_t *repo, const char *path, const void *data, size_t size);
+svcs_error_t svcs_repo_install_file(svcs_repository_t *repo, const char *tmp_path, const char *path);
+svcs_error_t svcs_write_batch_add_object(svcs_repository_t *repo, const char *tmp_path, const svcs_hash_t *hash);
+const char* svcs_write_batch_find_object(svcs_repository_t *repo, const svcs_hash_t *hash);
+
+// Repository configuration (config.c). name is "section.key".
+svcs_error_t svcs_config_get(svcs_repository_t *repo, const char *name, char *value, size_t value_size);
+svcs_error_t svcs_config_set(svcs_repository_t *repo, const char *name, const char *value);
+
+// Parallel loops (parallel.c). fn is called once for every index in
+// [0, count) across a pool of threads; it returns once all calls are done.
+typedef void (*svcs_parallel_fn)(void *arg, size_t i);
+size_t svcs_parallel_workers(size_t count, size_t min_items_per_worker);
+void svcs_parallel_for(size_t count, size_t min_items_per_worker, svcs_parallel_fn fn, void *arg);
+
+// Pack storage (pack.c)
+svcs_error_t svcs_pack_load_all(svcs_repository_t *repo);
+void svcs_pack_free_all(svcs_repository_t *repo);
+int svcs_pack_has_object(svcs_repository_t *repo, const svcs_hash_t *hash);
+int svcs_pack_freshen_object(svcs_repository_t *repo, const svcs_hash_t *hash);
+svcs_error_t svcs_pack_read_object(svcs_repository_t *repo, const svcs_hash_t *hash,
+                                   svcs_object_type_t *type, void **data, size_t *size);
+svcs_error_t svcs_pack_object_info(svcs_repository_t *repo, const svcs_hash_t *hash,
+                                   svcs_object_type_t *type, size_t *size);
+svcs_error_t svcs_pack_remove_old(svcs_repository_t *repo, const svcs_hash_t *keep,
+                                  time_t expire_before, size_t *removed);
+svcs_pack_t* svcs_pack_by_checksum(svcs_repository_t *repo, const svcs_hash_t *checksum);
+svcs_pack_t* svcs_pack_next(svcs_repository_t *repo, const svcs_pack_t *pack);
+const char* svcs_pack_file(const svcs_pack_t *pack);
+const svcs_hash_t* svcs_pack_checksum(const svcs_pack_t *pack);
+uint32_t svcs_pack_object_count(const svcs_pack_t *pack);
+int svcs_pack_position(const svcs_pack_t *pack, const svcs_hash_t *hash, uint32_t *pos);
+void svcs_pack_hash_at(const svcs_pack_t *pack, uint32_t pos, svcs_hash_t *hash);
+uint64_t svcs_pack_offset_at(const svcs_pack_t *pack, uint32_t pos);
+void svcs_pack_set_in_midx(svcs_pack_t *pack, int in_midx);
+uint32_t svcs_pack_name_hash(uint32_t hash, const char *name, size_t len);
+svcs_error_t svcs_pack_write_named(svcs_repository_t *repo, const svcs_hash_t *hashes, const uint32_t *name_hashes,
+                                   size_t count, svcs_hash_t *pack_hash);
+
+// Multi-pack index (midx.c)
+svcs_error_t svcs_midx_load(svcs_repository_t *repo);
+void svcs_midx_free(svcs_repository_t *repo);
+int svcs_midx_find(svcs_repository_t *repo, const svcs_hash_t *hash, const svcs_pack_t **pack, uint64_t *offset);
+
+// Commit graph (commit_graph.c)
+svcs_error_t svcs_commit_graph_load(svcs_repository_t *repo);
+void svcs_commit_graph_free(svcs_repository_t *repo);
+
+// Plain and EWAH-compressed bitmaps (bitmap.c)
+typedef struct {
+    uint64_t *words;
+    size_t word_count;
+} svcs_bitmap_t;
+
+svcs_error_t svcs_bitmap_init(svcs_bitmap_t *bitmap, size_t bits);
+void svcs_bitmap_free(svcs_bitmap_t *bitmap);
+void svcs_bitmap_set(svcs_bitmap_t *bitmap, size_t bit);
+int svcs_bitmap_test(const svcs_bitmap_t *bitmap, size_t bit);
+void svcs_bitmap_and(svcs_bitmap_t *bitmap, const svcs_bitmap_t *other);
+void svcs_bitmap_and_not(svcs_bitmap_t *bitmap, const svcs_bitmap_t *other);
+size_t svcs_bitmap_count(const svcs_bitmap_t *bitmap);
+svcs_error_t svcs_ewah_encode(const svcs_bitmap_t *bitmap, svcs_buffer_t *buf);
+svcs_error_t svcs_ewah_or(const uint8_t *data, size_t size, svcs_bitmap_t *bitmap, size_t *used);
+
+// Reachability bitmaps (pack_bitmap.c)
+svcs_error_t svcs_pack_bitmap_load(svcs_repository_t *repo);
+void svcs_pack_bitmap_free(svcs_repository_t *repo);
+int svcs_pack_bitmap_reaches(svcs_repository_t *repo, const svcs_hash_t *ancestor, const svcs_hash_t *descendant);
+
+// Ignore rules (utils.c)
+int svcs_path_is_ignored(const char *path);
+void svcs_ignore_rules_hash(svcs_hash_t *hash);
+
+// Index helpers (index.c). svcs_worktree_path returns an entry path
+// relative to the worktree, or NULL if it cannot be mapped into it.
+// svcs_index_entry_clean tells whether the entry's file is gone or still
+// holds the staged content. svcs_index_remove_stale_base deletes the split
+// index base a save replaced, once the write batch holding it committed.
+struct stat;
+const char* svcs_worktree_path(const svcs_repository_t *repo, const char *path);
+const char* svcs_index_intern_path(svcs_index_t *index, const char *path);
+void svcs_index_entry_set_stat(svcs_index_entry_t *entry, const struct stat *st);
+int svcs_index_entry_clean(svcs_repository_t *repo, const svcs_index_entry_t *entry);
+void svcs_index_remove_stale_base(svcs_repository_t *repo);
+
+// Tree objects (commit.c). Entries are in name order; a directory entry
+// (mode 040000) names the tree holding the paths below it, relative to it.
+#define SVCS_TREE_MODE_DIR 040000
+
+typedef struct {
+    const char *name;
+    uint32_t mode;
+    svcs_hash_t hash;
+} svcs_tree_item_t;
+
+svcs_error_t svcs_tree_write(svcs_repository_t *repo, const svcs_tree_item_t *items, size_t count,
+                             svcs_hash_t *tree_hash);
+// Reads the entry at *offset and advances it; SVCS_ERROR_NOT_FOUND at the end
+svcs_error_t svcs_tree_next(const svcs_object_t *tree, size_t *offset, svcs_tree_item_t *item);
+
+// Tree building (cache_tree.c). svcs_tree_build writes the nested trees of
+// entries, sorted by path and all below the directory named by the first
+// prefix_len bytes of each path ("dir/", or 0 for the root). Directories
+// unchanged since their tree was last built are not written again.
+svcs_error_t svcs_tree_build(svcs_repository_t *repo, const svcs_index_entry_t *entries, size_t count,
+                             size_t prefix_len, svcs_hash_t *tree_hash);
+svcs_error_t svcs_cache_tree_parse(const uint8_t *data, size_t size, svcs_cache_tree_t **cache);
+svcs_error_t svcs_cache_tree_write(const svcs_cache_tree_t *cache, svcs_buffer_t *buf);
+void svcs_cache_tree_free(svcs_cache_tree_t *cache);
+int svcs_cache_tree_lookup(const svcs_cache_tree_t *cache, const char *path, size_t len, svcs_hash_t *hash);
+svcs_error_t svcs_cache_tree_for_each(const svcs_cache_tree_t *cache, svcs_ref_fn fn, void *arg);
+void svcs_cache_tree_invalidate(svcs_cache_tree_t *cache, const char *path);
+
+// Untracked-file cache (untracked.c), stored as an index extension. Each
+// directory's untracked, ignored and subdirectory names are kept with its
+// mtime, and read again only once that changes.
+svcs_error_t svcs_untracked_cache_parse(const uint8_t *data, size_t size, svcs_untracked_cache_t **cache);
+svcs_error_t svcs_untracked_cache_write(const svcs_untracked_cache_t *cache, svcs_buffer_t *buf);
+void svcs_untracked_cache_free(svcs_untracked_cache_t *cache);
+void svcs_untracked_cache_invalidate(svcs_repository_t *repo, const char *path);
+
+// Filesystem monitor client (fsmonitor.c). changed receives the paths
+// changed since token, relative to the worktree and each ending in NUL;
+// *complete is cleared when the monitor cannot list them all.
+svcs_error_t svcs_fsmonitor_query(svcs_repository_t *repo, const char *token, char *new_token, size_t token_size,
+                                  svcs_buffer_t *changed, int *complete);
+
+// Delta encoding (delta.c)
+svcs_error_t svcs_delta_create(const void *base_data, size_t base_size,
+                               const void *target_data, size_t target_size,
+                               size_t max_delta_size, void **delta, size_t *delta_size);
+svcs_error_t svcs_delta_apply(const void *base_data, size_t base_size,
+                              const void *delta, size_t delta_size,
+                              void **target, size_t *target_size);
+svcs_error_t svcs_delta_target_size(const void *delta, size_t delta_size, size_t *target_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SVCS_INTERNAL_H
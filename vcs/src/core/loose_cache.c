@@ -0,0 +1,186 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "svcs.h"
+#include "internal.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+// In-memory record of which loose objects exist, so writers can skip the
+// stat() and mkdir() they would otherwise make for every object.
+//
+// A fanout directory is listed with one readdir the first time any hash in
+// it is asked about; after that its objects are answered from a hash set
+// that writers keep up to date. Objects written by other processes after a
+// directory was listed are missed, which only costs a redundant write of
+// identical content.
+
+#define LOOSE_CACHE_MIN_OBJECTS 512
+
+struct svcs_loose_cache {
+    pthread_mutex_t lock;
+    uint8_t listed[256 / 8];     // Fanout directories read into the set
+    uint8_t dir_exists[256 / 8]; // Fanout directories known to exist
+    svcs_hash_set_t objects;
+};
+
+static int bit_test(const uint8_t *bits, uint8_t i) {
+    return (bits[i / 8] >> (i % 8)) & 1;
+}
+
+static void bit_set(uint8_t *bits, uint8_t i) {
+    bits[i / 8] |= (uint8_t)(1 << (i % 8));
+}
+
+static void bit_clear(uint8_t *bits, uint8_t i) {
+    bits[i / 8] &= (uint8_t)~(1 << (i % 8));
+}
+
+// Read one fanout directory into the set. Called with the lock held.
+static svcs_error_t list_fanout(svcs_repository_t *repo, svcs_loose_cache_t *cache, uint8_t fanout) {
+    char dir_path[SVCS_MAX_PATH];
+    snprintf(dir_path, sizeof(dir_path), "%s/objects/%02x", repo->git_dir, fanout);
+
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        if (errno != ENOENT) {
+            return SVCS_ERROR_IO;
+        }
+        bit_set(cache->listed, fanout);
+        return SVCS_OK;
+    }
+
+    svcs_error_t err = SVCS_OK;
+    struct dirent *entry;
+    while (err == SVCS_OK && (entry = readdir(dir)) != NULL) {
+        if (!svcs_is_hex_string(entry->d_name, SVCS_HASH_HEX_SIZE - 3)) {
+            continue;
+        }
+
+        char hash_str[SVCS_HASH_HEX_SIZE];
+        snprintf(hash_str, sizeof(hash_str), "%02x%s", fanout, entry->d_name);
+        svcs_hash_t hash;
+        svcs_hash_from_string(&hash, hash_str);
+        err = svcs_hash_set_add(&cache->objects, &hash, NULL);
+    }
+    closedir(dir);
+
+    if (err == SVCS_OK) {
+        bit_set(cache->listed, fanout);
+        bit_set(cache->dir_exists, fanout);
+    }
+    return err;
+}
+
+svcs_error_t svcs_loose_cache_new(svcs_loose_cache_t **cache) {
+    if (!cache) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    svcs_loose_cache_t *c = calloc(1, sizeof(svcs_loose_cache_t));
+    if (!c) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    if (svcs_hash_set_init(&c->objects, LOOSE_CACHE_MIN_OBJECTS) != SVCS_OK) {
+        free(c);
+        return SVCS_ERROR_MEMORY;
+    }
+
+    pthread_mutex_init(&c->lock, NULL);
+    *cache = c;
+    return SVCS_OK;
+}
+
+void svcs_loose_cache_free(svcs_loose_cache_t *cache) {
+    if (!cache) return;
+
+    pthread_mutex_destroy(&cache->lock);
+    svcs_hash_set_free(&cache->objects);
+    free(cache);
+}
+
+// Returns -1 if the answer is unknown (the directory could not be read),
+// in which case callers fall back to stat()
+int svcs_loose_cache_has(svcs_repository_t *repo, const svcs_hash_t *hash) {
+    svcs_loose_cache_t *cache = repo->loose_cache;
+    if (!cache) {
+        return -1;
+    }
+
+    uint8_t fanout = hash->bytes[0];
+    pthread_mutex_lock(&cache->lock);
+
+    int found = -1;
+    if (bit_test(cache->listed, fanout) || list_fanout(repo, cache, fanout) == SVCS_OK) {
+        found = svcs_hash_set_contains(&cache->objects, hash);
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+    return found;
+}
+
+// Record an object this process has just moved into place
+void svcs_loose_cache_add(svcs_repository_t *repo, const svcs_hash_t *hash) {
+    svcs_loose_cache_t *cache = repo->loose_cache;
+    if (!cache) return;
+
+    pthread_mutex_lock(&cache->lock);
+    bit_set(cache->dir_exists, hash->bytes[0]);
+    if (bit_test(cache->listed, hash->bytes[0]) &&
+        svcs_hash_set_add(&cache->objects, hash, NULL) != SVCS_OK) {
+        // Relist the directory next time rather than give a wrong answer
+        bit_clear(cache->listed, hash->bytes[0]);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+static int outside_fanout(const svcs_hash_t *hash, void *arg) {
+    return hash->bytes[0] != *(const uint8_t*)arg;
+}
+
+// Drop everything known about a fanout directory, e.g. after objects in
+// it were removed or it vanished underneath a writer
+void svcs_loose_cache_forget(svcs_repository_t *repo, uint8_t fanout) {
+    svcs_loose_cache_t *cache = repo->loose_cache;
+    if (!cache) return;
+
+    pthread_mutex_lock(&cache->lock);
+    if (bit_test(cache->listed, fanout) &&
+        svcs_hash_set_filter(&cache->objects, outside_fanout, &fanout) != SVCS_OK) {
+        // Out of memory: forget every directory instead
+        svcs_hash_set_clear(&cache->objects);
+        memset(cache->listed, 0, sizeof(cache->listed));
+    }
+    bit_clear(cache->listed, fanout);
+    bit_clear(cache->dir_exists, fanout);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Make sure the fanout directory for hash exists, creating it at most once
+svcs_error_t svcs_loose_cache_mkdir(svcs_repository_t *repo, const svcs_hash_t *hash) {
+    svcs_loose_cache_t *cache = repo->loose_cache;
+    uint8_t fanout = hash->bytes[0];
+
+    if (cache) {
+        pthread_mutex_lock(&cache->lock);
+        int exists = bit_test(cache->dir_exists, fanout);
+        pthread_mutex_unlock(&cache->lock);
+        if (exists) {
+            return SVCS_OK;
+        }
+    }
+
+    char dir_path[SVCS_MAX_PATH];
+    snprintf(dir_path, sizeof(dir_path), "%s/objects/%02x", repo->git_dir, fanout);
+    if (mkdir(dir_path, 0755) != 0 && errno != EEXIST) {
+        return SVCS_ERROR_IO;
+    }
+
+    if (cache) {
+        pthread_mutex_lock(&cache->lock);
+        bit_set(cache->dir_exists, fanout);
+        pthread_mutex_unlock(&cache->lock);
+    }
+    return SVCS_OK;
+}
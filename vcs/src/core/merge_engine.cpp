@@ -94,44 +94,17 @@ bool MergeEngine::can_fast_forward(const std::string& source_branch, const std::
     return is_ancestor(target_commit->hash, source_commit->hash);
 }
 
+// Generation numbers from the commit graph bound both walks, so only
+// commits between the two tips and their merge base are visited
 std::shared_ptr<CommitNode> MergeEngine::find_merge_base(const svcs_hash_t& commit1, const svcs_hash_t& commit2) {
-    // Simple implementation - find lowest common ancestor
-    auto node1 = dag->get_commit(std::string(reinterpret_cast<const char*>(&commit1), sizeof(commit1)));
-    auto node2 = dag->get_commit(std::string(reinterpret_cast<const char*>(&commit2), sizeof(commit2)));
-    
-    if (!node1 || !node2) {
+    svcs_hash_t base;
+    if (svcs_commit_merge_base(repository, &commit1, &commit2, &base) != SVCS_OK) {
         return nullptr;
     }
     
-    // Get all ancestors of commit1
-    std::set<std::string> ancestors1;
-    std::function<void(std::shared_ptr<CommitNode>)> collect_ancestors = [&](std::shared_ptr<CommitNode> node) {
-        if (!node) return;
-        ancestors1.insert(node->hash_string());
-        for (auto& parent : node->parents) {
-            collect_ancestors(parent);
-        }
-    };
-    collect_ancestors(node1);
-    
-    // Find first common ancestor in commit2's ancestry
-    std::function<std::shared_ptr<CommitNode>(std::shared_ptr<CommitNode>)> find_common = 
-        [&](std::shared_ptr<CommitNode> node) -> std::shared_ptr<CommitNode> {
-        if (!node) return nullptr;
-        
-        if (ancestors1.count(node->hash_string())) {
-            return node;
-        }
-        
-        for (auto& parent : node->parents) {
-            auto result = find_common(parent);
-            if (result) return result;
-        }
-        
-        return nullptr;
-    };
-    
-    return find_common(node2);
+    char base_str[SVCS_HASH_HEX_SIZE];
+    svcs_hash_to_string(&base, base_str);
+    return dag->get_commit(base_str);
 }
 
 ThreeWayMergeResult MergeEngine::three_way_merge_files(const std::string& base_content,
@@ -336,37 +309,8 @@ std::string MergeEngine::generate_conflict_markers(const MergeConflict& conflict
 }
 
 bool MergeEngine::is_ancestor(const svcs_hash_t& ancestor, const svcs_hash_t& descendant) {
-    auto ancestor_node = dag->get_commit(std::string(reinterpret_cast<const char*>(&ancestor), sizeof(ancestor)));
-    auto descendant_node = dag->get_commit(std::string(reinterpret_cast<const char*>(&descendant), sizeof(descendant)));
-    
-    if (!ancestor_node || !descendant_node) {
-        return false;
-    }
-    
-    // BFS to check if ancestor is reachable from descendant
-    std::queue<std::shared_ptr<CommitNode>> queue;
-    std::set<std::string> visited;
-    
-    queue.push(descendant_node);
-    visited.insert(descendant_node->hash_string());
-    
-    while (!queue.empty()) {
-        auto current = queue.front();
-        queue.pop();
-        
-        if (current->hash_string() == ancestor_node->hash_string()) {
-            return true;
-        }
-        
-        for (auto& parent : current->parents) {
-            if (visited.find(parent->hash_string()) == visited.end()) {
-                visited.insert(parent->hash_string());
-                queue.push(parent);
-            }
-        }
-    }
-    
-    return false;
+    int result = 0;
+    return svcs_commit_is_ancestor(repository, &ancestor, &descendant, &result) == SVCS_OK && result;
 }
 
 std::vector<std::string> MergeEngine::split_into_lines(const std::string& content) {
@@ -414,9 +358,14 @@ std::string MergeEngine::format_merge_message(const std::string& source_branch,
     return \"Merge branch '\" + source_branch + \"' into \" + target_branch;
 }
 
+// Commits in head that base does not have, from reachability bitmaps
+// where the pack has them
 int MergeEngine::count_commits_between(const svcs_hash_t& base, const svcs_hash_t& head) {
-    // Simplified implementation
-    return 1;
+    size_t ahead = 0, behind = 0;
+    if (svcs_commit_ahead_behind(repository, &head, &base, &ahead, &behind) != SVCS_OK) {
+        return 0;
+    }
+    return static_cast<int>(ahead);
 }
 
 // InteractiveMergeResolver implementation
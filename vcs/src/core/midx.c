@@ -0,0 +1,394 @@
+#include "svcs.h"
+#include "internal.h"
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Multi-pack index (objects/pack/multi-pack-index), mapped read-only:
+//
+//   header   "SMPX", version, pack count, object count (4 bytes each)
+//   packs    checksums of the packs covered, sorted
+//   fanout   256 cumulative object counts by first hash byte
+//   hashes   object hashes across all packs, sorted and unique
+//   entries  per object: pack number (4 bytes), offset in that pack (8)
+//   checksum of everything above
+//
+// Without it every lookup searches each pack's .idx in turn, so reads slow
+// down as small packs from pushes and imports pile up. Writing a pack
+// merges it into the existing index, which is cheaper than a repack.
+// Packs added by other processes since the index was written are still
+// searched one at a time; an index naming a pack that is gone is ignored
+// until it is rewritten.
+
+#define MIDX_SIGNATURE "SMPX"
+#define MIDX_VERSION 1
+#define MIDX_HEADER_SIZE 16
+#define MIDX_FANOUT_SIZE (256 * 4)
+#define MIDX_ENTRY_SIZE 12
+
+struct svcs_midx {
+    const uint8_t *map;
+    size_t size;
+    uint32_t pack_count;
+    uint32_t object_count;
+    const uint8_t *pack_names;
+    const uint8_t *fanout;
+    const uint8_t *hashes;
+    const uint8_t *entries;
+    svcs_pack_t **packs;  // Loaded pack for each pack number
+};
+
+static void midx_path(svcs_repository_t *repo, char *path, size_t path_size) {
+    snprintf(path, path_size, "%s/objects/pack/multi-pack-index", repo->git_dir);
+}
+
+static void midx_unmap(svcs_midx_t *midx) {
+    munmap((void*)midx->map, midx->size);
+    free(midx->packs);
+    free(midx);
+}
+
+void svcs_midx_free(svcs_repository_t *repo) {
+    if (!repo || !repo->midx) return;
+
+    for (uint32_t i = 0; i < repo->midx->pack_count; i++) {
+        svcs_pack_set_in_midx(repo->midx->packs[i], 0);
+    }
+    midx_unmap(repo->midx);
+    repo->midx = NULL;
+}
+
+// Map the multi-pack index over the loaded packs, if there is one that
+// still matches them
+svcs_error_t svcs_midx_load(svcs_repository_t *repo) {
+    if (!repo) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    svcs_midx_free(repo);
+
+    char path[SVCS_MAX_PATH];
+    midx_path(repo, path, sizeof(path));
+    if (!svcs_file_exists(path)) {
+        return SVCS_OK;
+    }
+
+    svcs_midx_t *midx = calloc(1, sizeof(svcs_midx_t));
+    if (!midx) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    svcs_error_t err = svcs_file_map(path, &midx->map, &midx->size);
+    if (err != SVCS_OK) {
+        free(midx);
+        return err;
+    }
+
+    const uint8_t *map = midx->map;
+    if (midx->size < MIDX_HEADER_SIZE + MIDX_FANOUT_SIZE + SVCS_HASH_SIZE ||
+        memcmp(map, MIDX_SIGNATURE, 4) != 0 ||
+        svcs_get_be32(map + 4) != MIDX_VERSION) {
+        midx_unmap(midx);
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    midx->pack_count = svcs_get_be32(map + 8);
+    midx->object_count = svcs_get_be32(map + 12);
+    midx->pack_names = map + MIDX_HEADER_SIZE;
+    midx->fanout = midx->pack_names + (size_t)midx->pack_count * SVCS_HASH_SIZE;
+    midx->hashes = midx->fanout + MIDX_FANOUT_SIZE;
+    midx->entries = midx->hashes + (size_t)midx->object_count * SVCS_HASH_SIZE;
+
+    size_t expected = MIDX_HEADER_SIZE + (size_t)midx->pack_count * SVCS_HASH_SIZE + MIDX_FANOUT_SIZE +
+                      (size_t)midx->object_count * (SVCS_HASH_SIZE + MIDX_ENTRY_SIZE) + SVCS_HASH_SIZE;
+    if (midx->size != expected || svcs_get_be32(midx->fanout + 255 * 4) != midx->object_count) {
+        midx_unmap(midx);
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    midx->packs = calloc(midx->pack_count ? midx->pack_count : 1, sizeof(svcs_pack_t*));
+    if (!midx->packs) {
+        midx_unmap(midx);
+        return SVCS_ERROR_MEMORY;
+    }
+
+    for (uint32_t i = 0; i < midx->pack_count; i++) {
+        svcs_hash_t checksum;
+        memcpy(checksum.bytes, midx->pack_names + (size_t)i * SVCS_HASH_SIZE, SVCS_HASH_SIZE);
+        midx->packs[i] = svcs_pack_by_checksum(repo, &checksum);
+
+        // An object the index puts in a removed pack may live in another
+        // pack that the index does not mention for it
+        if (!midx->packs[i]) {
+            midx_unmap(midx);
+            return SVCS_OK;
+        }
+    }
+
+    for (uint32_t i = 0; i < midx->pack_count; i++) {
+        svcs_pack_set_in_midx(midx->packs[i], 1);
+    }
+    repo->midx = midx;
+    return SVCS_OK;
+}
+
+int svcs_midx_find(svcs_repository_t *repo, const svcs_hash_t *hash, const svcs_pack_t **pack, uint64_t *offset) {
+    const svcs_midx_t *midx = repo->midx;
+    if (!midx) {
+        return 0;
+    }
+
+    uint8_t first = hash->bytes[0];
+    uint32_t lo = first ? svcs_get_be32(midx->fanout + (first - 1) * 4) : 0;
+    uint32_t hi = svcs_get_be32(midx->fanout + first * 4);
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(midx->hashes + (size_t)mid * SVCS_HASH_SIZE, hash->bytes, SVCS_HASH_SIZE);
+        if (cmp == 0) {
+            const uint8_t *entry = midx->entries + (size_t)mid * MIDX_ENTRY_SIZE;
+            uint32_t pack_number = svcs_get_be32(entry);
+            if (pack_number >= midx->pack_count) {
+                return 0;
+            }
+            *pack = midx->packs[pack_number];
+            *offset = svcs_get_be64(entry + 4);
+            return 1;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0;
+}
+
+size_t svcs_midx_pack_count(svcs_repository_t *repo) {
+    return repo && repo->midx ? repo->midx->pack_count : 0;
+}
+
+size_t svcs_midx_object_count(svcs_repository_t *repo) {
+    return repo && repo->midx ? repo->midx->object_count : 0;
+}
+
+// Writing
+
+// The old index counts as one sorted source, and each pack it does not
+// cover as another; they are merged through a small heap
+typedef struct {
+    const svcs_midx_t *midx;
+    const svcs_pack_t *pack;
+    uint32_t pos;
+    uint32_t count;
+    svcs_hash_t hash;  // At pos
+} midx_source_t;
+
+typedef struct {
+    svcs_hash_t checksum;
+    const svcs_pack_t *pack;
+} midx_pack_name_t;
+
+static void source_load(midx_source_t *source) {
+    if (source->midx) {
+        memcpy(source->hash.bytes, source->midx->hashes + (size_t)source->pos * SVCS_HASH_SIZE, SVCS_HASH_SIZE);
+    } else {
+        svcs_pack_hash_at(source->pack, source->pos, &source->hash);
+    }
+}
+
+static int source_before(const midx_source_t *a, const midx_source_t *b) {
+    return svcs_hash_compare(&a->hash, &b->hash) < 0;
+}
+
+static void heap_sift_down(midx_source_t *heap, size_t count, size_t i) {
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= count) {
+            break;
+        }
+        if (child + 1 < count && source_before(&heap[child + 1], &heap[child])) {
+            child++;
+        }
+        if (!source_before(&heap[child], &heap[i])) {
+            break;
+        }
+        midx_source_t tmp = heap[i];
+        heap[i] = heap[child];
+        heap[child] = tmp;
+        i = child;
+    }
+}
+
+static int compare_pack_names(const void *a, const void *b) {
+    return svcs_hash_compare(&((const midx_pack_name_t*)a)->checksum, &((const midx_pack_name_t*)b)->checksum);
+}
+
+static uint32_t pack_number(const midx_pack_name_t *names, size_t count, const svcs_pack_t *pack) {
+    midx_pack_name_t key = { .checksum = *svcs_pack_checksum(pack) };
+    const midx_pack_name_t *found = bsearch(&key, names, count, sizeof(midx_pack_name_t), compare_pack_names);
+    return (uint32_t)(found - names);
+}
+
+// Pack and offset of the object a source is at
+static void source_entry(const midx_source_t *source, const svcs_pack_t **pack, uint64_t *offset) {
+    if (source->midx) {
+        const uint8_t *entry = source->midx->entries + (size_t)source->pos * MIDX_ENTRY_SIZE;
+        *pack = source->midx->packs[svcs_get_be32(entry)];
+        *offset = svcs_get_be64(entry + 4);
+    } else {
+        *pack = source->pack;
+        *offset = svcs_pack_offset_at(source->pack, source->pos);
+    }
+}
+
+static svcs_error_t merge_sources(midx_source_t *heap, size_t heap_count, const midx_pack_name_t *names,
+                                  size_t name_count, svcs_buffer_t *hashes, svcs_buffer_t *entries,
+                                  uint32_t *fanout, uint32_t *object_count) {
+    for (size_t i = heap_count; i-- > 0;) {
+        heap_sift_down(heap, heap_count, i);
+    }
+
+    svcs_error_t err = SVCS_OK;
+    uint64_t count = 0;
+    while (heap_count > 0 && err == SVCS_OK) {
+        midx_source_t *source = &heap[0];
+
+        // Objects in several packs are kept from the first source
+        if (count == 0 || memcmp(hashes->data + hashes->size - SVCS_HASH_SIZE,
+                                 source->hash.bytes, SVCS_HASH_SIZE) != 0) {
+            const svcs_pack_t *pack;
+            uint64_t offset;
+            source_entry(source, &pack, &offset);
+
+            uint8_t entry[MIDX_ENTRY_SIZE];
+            svcs_put_be32(entry, pack_number(names, name_count, pack));
+            svcs_put_be64(entry + 4, offset);
+            err = svcs_buffer_append(hashes, source->hash.bytes, SVCS_HASH_SIZE);
+            if (err == SVCS_OK) err = svcs_buffer_append(entries, entry, sizeof(entry));
+            fanout[source->hash.bytes[0]]++;
+            count++;
+        }
+
+        if (++source->pos < source->count) {
+            source_load(source);
+        } else {
+            heap[0] = heap[--heap_count];
+        }
+        heap_sift_down(heap, heap_count, 0);
+    }
+
+    if (err == SVCS_OK && count > UINT32_MAX) {
+        err = SVCS_ERROR_INVALID;
+    }
+    *object_count = (uint32_t)count;
+    return err;
+}
+
+static svcs_error_t serialize_midx(const midx_pack_name_t *names, size_t name_count, const uint32_t *fanout,
+                                   uint32_t object_count, const svcs_buffer_t *hashes,
+                                   const svcs_buffer_t *entries, svcs_buffer_t *buf) {
+    uint8_t word[4];
+    svcs_error_t err = svcs_buffer_append(buf, MIDX_SIGNATURE, 4);
+    svcs_put_be32(word, MIDX_VERSION);
+    if (err == SVCS_OK) err = svcs_buffer_append(buf, word, 4);
+    svcs_put_be32(word, (uint32_t)name_count);
+    if (err == SVCS_OK) err = svcs_buffer_append(buf, word, 4);
+    svcs_put_be32(word, object_count);
+    if (err == SVCS_OK) err = svcs_buffer_append(buf, word, 4);
+
+    for (size_t i = 0; i < name_count && err == SVCS_OK; i++) {
+        err = svcs_buffer_append(buf, names[i].checksum.bytes, SVCS_HASH_SIZE);
+    }
+
+    uint32_t total = 0;
+    for (int bucket = 0; bucket < 256 && err == SVCS_OK; bucket++) {
+        total += fanout[bucket];
+        svcs_put_be32(word, total);
+        err = svcs_buffer_append(buf, word, 4);
+    }
+
+    if (err == SVCS_OK) err = svcs_buffer_append(buf, hashes->data, hashes->size);
+    if (err == SVCS_OK) err = svcs_buffer_append(buf, entries->data, entries->size);
+
+    if (err == SVCS_OK) {
+        svcs_hash_t checksum;
+        svcs_hash_update(&checksum, buf->data, buf->size);
+        err = svcs_buffer_append(buf, checksum.bytes, SVCS_HASH_SIZE);
+    }
+    return err;
+}
+
+// Rewrite the multi-pack index to cover every loaded pack. Entries of the
+// current index are reused as they are, so adding a pack costs one merge
+// with its .idx rather than a pass over every pack.
+svcs_error_t svcs_midx_write(svcs_repository_t *repo) {
+    if (!repo) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    char path[SVCS_MAX_PATH];
+    midx_path(repo, path, sizeof(path));
+
+    size_t pack_count = 0;
+    for (svcs_pack_t *pack = svcs_pack_next(repo, NULL); pack; pack = svcs_pack_next(repo, pack)) {
+        pack_count++;
+    }
+    if (pack_count == 0) {
+        unlink(path);
+        svcs_midx_free(repo);
+        return SVCS_OK;
+    }
+
+    midx_pack_name_t *names = malloc(pack_count * sizeof(midx_pack_name_t));
+    midx_source_t *sources = malloc((pack_count + 1) * sizeof(midx_source_t));
+    if (!names || !sources) {
+        free(names);
+        free(sources);
+        return SVCS_ERROR_MEMORY;
+    }
+
+    size_t name_count = 0, source_count = 0;
+    if (repo->midx && repo->midx->object_count > 0) {
+        sources[source_count++] = (midx_source_t){ .midx = repo->midx, .count = repo->midx->object_count };
+    }
+    for (svcs_pack_t *pack = svcs_pack_next(repo, NULL); pack; pack = svcs_pack_next(repo, pack)) {
+        names[name_count].checksum = *svcs_pack_checksum(pack);
+        names[name_count++].pack = pack;
+
+        int covered = 0;
+        for (uint32_t i = 0; repo->midx && i < repo->midx->pack_count && !covered; i++) {
+            covered = repo->midx->packs[i] == pack;
+        }
+        if (!covered && svcs_pack_object_count(pack) > 0) {
+            sources[source_count++] = (midx_source_t){ .pack = pack, .count = svcs_pack_object_count(pack) };
+        }
+    }
+    qsort(names, name_count, sizeof(midx_pack_name_t), compare_pack_names);
+    for (size_t i = 0; i < source_count; i++) {
+        source_load(&sources[i]);
+    }
+
+    svcs_buffer_t hashes = {0}, entries = {0}, buf = {0};
+    uint32_t fanout[256] = {0};
+    uint32_t object_count = 0;
+    svcs_error_t err = merge_sources(sources, source_count, names, name_count,
+                                     &hashes, &entries, fanout, &object_count);
+    if (err == SVCS_OK) {
+        err = serialize_midx(names, name_count, fanout, object_count, &hashes, &entries, &buf);
+    }
+    svcs_buffer_free(&hashes);
+    svcs_buffer_free(&entries);
+    free(names);
+    free(sources);
+
+    if (err == SVCS_OK) {
+        err = svcs_repo_write_file(repo, path, buf.data, buf.size);
+    }
+    svcs_buffer_free(&buf);
+
+    // Inside a write batch the new file is picked up after it is published
+    if (err == SVCS_OK && !repo->write_batch) {
+        err = svcs_midx_load(repo);
+    }
+    return err;
+}
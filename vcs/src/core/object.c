@@ -1,198 +1,434 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "svcs.h"
+#include "internal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define LOOSE_INFO_PREFIX_SIZE 4096
+
+const char* svcs_object_type_name(svcs_object_type_t type) {
+    switch (type) {
+        case SVCS_OBJ_BLOB: return "blob";
+        case SVCS_OBJ_TREE: return "tree";
+        case SVCS_OBJ_COMMIT: return "commit";
+        case SVCS_OBJ_TAG: return "tag";
+        default: return NULL;
+    }
+}
+
+svcs_object_type_t svcs_object_type_from_name(const char *name, size_t len) {
+    if (len == 4 && memcmp(name, "blob", 4) == 0) return SVCS_OBJ_BLOB;
+    if (len == 4 && memcmp(name, "tree", 4) == 0) return SVCS_OBJ_TREE;
+    if (len == 6 && memcmp(name, "commit", 6) == 0) return SVCS_OBJ_COMMIT;
+    if (len == 3 && memcmp(name, "tag", 3) == 0) return SVCS_OBJ_TAG;
+    return 0;
+}
 
-static char* get_object_path(svcs_repository_t *repo, const svcs_hash_t *hash) {
+svcs_error_t svcs_loose_object_path(svcs_repository_t *repo, const svcs_hash_t *hash, char *path, size_t path_size) {
     char hash_str[SVCS_HASH_HEX_SIZE];
     svcs_hash_to_string(hash, hash_str);
-    
-    char *path = malloc(SVCS_MAX_PATH);
-    if (!path) return NULL;
-    
-    snprintf(path, SVCS_MAX_PATH, "%s/objects/%.2s/%s", 
-             repo->git_dir, hash_str, hash_str + 2);
-    
-    return path;
-}
 
-svcs_error_t svcs_object_read(svcs_repository_t *repo, const svcs_hash_t *hash, svcs_object_t **obj) {
-    if (!repo || !hash || !obj) {
+    int written = snprintf(path, path_size, "%s/objects/%.2s/%s",
+                           repo->git_dir, hash_str, hash_str + 2);
+    if (written < 0 || (size_t)written >= path_size) {
         return SVCS_ERROR_INVALID;
     }
-    
-    char *path = get_object_path(repo, hash);
-    if (!path) {
-        return SVCS_ERROR_MEMORY;
+
+    return SVCS_OK;
+}
+
+int svcs_loose_object_exists(svcs_repository_t *repo, const svcs_hash_t *hash) {
+    if (svcs_write_batch_find_object(repo, hash)) {
+        return 1;
     }
-    
+
+    int cached = svcs_loose_cache_has(repo, hash);
+    if (cached >= 0) {
+        return cached;
+    }
+
+    char path[SVCS_MAX_PATH];
+    if (svcs_loose_object_path(repo, hash, path, sizeof(path)) != SVCS_OK) {
+        return 0;
+    }
+    return svcs_file_exists(path);
+}
+
+int svcs_object_exists(svcs_repository_t *repo, const svcs_hash_t *hash) {
+    if (!repo || !hash) return 0;
+
+    return svcs_pack_has_object(repo, hash) || svcs_loose_object_exists(repo, hash);
+}
+
+// Whether the object already exists, bumping the mtime of its loose file
+// or pack if so: a write that reuses an old unreachable object makes it
+// reachable again, and gc must not prune it within the grace period.
+// Where the mtime cannot be changed the object is written loose again.
+static int freshen_object(svcs_repository_t *repo, const svcs_hash_t *hash) {
+    if (svcs_write_batch_find_object(repo, hash)) {
+        return 1;
+    }
+    if (svcs_pack_freshen_object(repo, hash)) {
+        return 1;
+    }
+    if (svcs_loose_cache_has(repo, hash) == 0) {
+        return 0;
+    }
+
+    char path[SVCS_MAX_PATH];
+    return svcs_loose_object_path(repo, hash, path, sizeof(path)) == SVCS_OK &&
+           utimensat(AT_FDCWD, path, NULL, 0) == 0;
+}
+
+// Where a loose object's data is: its temp file while it waits in an open
+// write batch, its place in objects/ otherwise
+static svcs_error_t loose_object_file(svcs_repository_t *repo, const svcs_hash_t *hash,
+                                      char *path, size_t path_size) {
+    const char *pending = svcs_write_batch_find_object(repo, hash);
+    if (pending) {
+        snprintf(path, path_size, "%s", pending);
+        return SVCS_OK;
+    }
+    return svcs_loose_object_path(repo, hash, path, path_size);
+}
+
+static svcs_error_t read_loose_object(svcs_repository_t *repo, const svcs_hash_t *hash,
+                                      svcs_object_type_t *type, void **content, size_t *content_size) {
+    char path[SVCS_MAX_PATH];
+    svcs_error_t err = loose_object_file(repo, hash, path, sizeof(path));
+    if (err != SVCS_OK) {
+        return err;
+    }
+
     if (!svcs_file_exists(path)) {
-        free(path);
         return SVCS_ERROR_NOT_FOUND;
     }
-    
+
     void *compressed_data;
     size_t compressed_size;
-    svcs_error_t err = svcs_file_read(path, &compressed_data, &compressed_size);
-    free(path);
-    
+    err = svcs_file_read(path, &compressed_data, &compressed_size);
     if (err != SVCS_OK) {
         return err;
     }
-    
-    // Decompress object data
-    void *data;
-    size_t size;
-    err = svcs_decompress(compressed_data, compressed_size, &data, &size);
+
+    // Decode straight into a buffer sized from the object header
+    err = svcs_codec_decode_object(repo, compressed_data, compressed_size, type, content, content_size);
     free(compressed_data);
-    
+
+    return err;
+}
+
+// Read up to size bytes from the start of a file
+static svcs_error_t read_file_prefix(const char *path, void *buffer, size_t size,
+                                     size_t *read_size, size_t *file_size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno == ENOENT ? SVCS_ERROR_NOT_FOUND : SVCS_ERROR_IO;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return SVCS_ERROR_IO;
+    }
+
+    size_t total = 0;
+    while (total < size) {
+        ssize_t n = read(fd, (uint8_t*)buffer + total, size - total);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            close(fd);
+            return SVCS_ERROR_IO;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += (size_t)n;
+    }
+
+    close(fd);
+    *read_size = total;
+    *file_size = (size_t)st.st_size;
+    return SVCS_OK;
+}
+
+static svcs_error_t loose_object_info(svcs_repository_t *repo, const svcs_hash_t *hash,
+                                      svcs_object_type_t *type, size_t *size) {
+    char path[SVCS_MAX_PATH];
+    svcs_error_t err = loose_object_file(repo, hash, path, sizeof(path));
     if (err != SVCS_OK) {
         return err;
     }
-    
-    // Parse object header
-    char *header_end = memchr(data, '\0', size);
-    if (!header_end) {
-        free(data);
-        return SVCS_ERROR_CORRUPT;
+
+    // The header sits in the first few decoded bytes, which a short
+    // prefix of the file almost always covers
+    uint8_t prefix[LOOSE_INFO_PREFIX_SIZE];
+    size_t prefix_size;
+    size_t file_size;
+    err = read_file_prefix(path, prefix, sizeof(prefix), &prefix_size, &file_size);
+    if (err != SVCS_OK) {
+        return err;
     }
-    
-    char *header = (char*)data;
-    char *space = strchr(header, ' ');
-    if (!space) {
-        free(data);
+    if (prefix_size == 0) {
         return SVCS_ERROR_CORRUPT;
     }
-    
-    *space = '\0';
-    size_t object_size = strtoul(space + 1, NULL, 10);
-    
+
+    err = svcs_codec_decode_header(repo, prefix, prefix_size, type, size);
+    if (err == SVCS_OK || prefix_size == file_size) {
+        return err;
+    }
+
+    // Codecs that emit output a whole block at a time need the full file
+    void *data;
+    size_t data_size;
+    err = svcs_file_read(path, &data, &data_size);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    err = svcs_codec_decode_header(repo, data, data_size, type, size);
+    free(data);
+    return err;
+}
+
+// Type and size of an object without decoding its content
+svcs_error_t svcs_object_info(svcs_repository_t *repo, const svcs_hash_t *hash,
+                              svcs_object_type_t *type, size_t *size) {
+    if (!repo || !hash || !type || !size) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    svcs_error_t err = svcs_pack_object_info(repo, hash, type, size);
+    if (err == SVCS_ERROR_NOT_FOUND) {
+        err = loose_object_info(repo, hash, type, size);
+    }
+    return err;
+}
+
+svcs_error_t svcs_object_read(svcs_repository_t *repo, const svcs_hash_t *hash, svcs_object_t **obj) {
+    if (!repo || !hash || !obj) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    *obj = NULL;
+
+    svcs_object_type_t type;
+    void *data;
+    size_t size;
+
+    svcs_error_t err = SVCS_OK;
+    if (!svcs_object_cache_get(repo->object_cache, hash, &type, &data, &size)) {
+        // Packs first: an mmap'd index lookup is far cheaper than a loose open()
+        err = svcs_pack_read_object(repo, hash, &type, &data, &size);
+        if (err == SVCS_ERROR_NOT_FOUND) {
+            err = read_loose_object(repo, hash, &type, &data, &size);
+        }
+
+        if (err != SVCS_OK) {
+            return err;
+        }
+        // Objects still pending in a write batch may yet be discarded
+        if (!svcs_write_batch_find_object(repo, hash)) {
+            svcs_object_cache_put(repo->object_cache, hash, type, data, size);
+        }
+    }
+
     *obj = malloc(sizeof(svcs_object_t));
     if (!*obj) {
         free(data);
         return SVCS_ERROR_MEMORY;
     }
-    
-    // Determine object type
-    if (strcmp(header, "blob") == 0) {
-        (*obj)->type = SVCS_OBJ_BLOB;
-    } else if (strcmp(header, "tree") == 0) {
-        (*obj)->type = SVCS_OBJ_TREE;
-    } else if (strcmp(header, "commit") == 0) {
-        (*obj)->type = SVCS_OBJ_COMMIT;
-    } else if (strcmp(header, "tag") == 0) {
-        (*obj)->type = SVCS_OBJ_TAG;
-    } else {
-        free(data);
-        free(*obj);
-        return SVCS_ERROR_CORRUPT;
-    }
-    
-    (*obj)->size = object_size;
+
+    (*obj)->type = type;
+    (*obj)->size = size;
     (*obj)->hash = *hash;
-    
-    // Store object content (after header + null byte)
-    size_t content_size = size - (header_end - (char*)data + 1);
-    if (content_size != object_size) {
-        free(data);
-        free(*obj);
-        return SVCS_ERROR_CORRUPT;
-    }
-    
-    free(data);
+    (*obj)->data = data;
+
     return SVCS_OK;
 }
 
-svcs_error_t svcs_object_write(svcs_repository_t *repo, svcs_object_t *obj) {
-    if (!repo || !obj) {
+// A loose object being written: content goes through the codec into a
+// temp file in objects/, which is renamed into place once the hash is known
+typedef struct {
+    char tmp_path[SVCS_MAX_PATH];
+    int fd;
+    svcs_encoder_t *encoder;
+} loose_writer_t;
+
+static svcs_error_t loose_writer_begin(svcs_repository_t *repo, svcs_object_type_t type,
+                                       size_t size, loose_writer_t *writer) {
+    const char *type_str = svcs_object_type_name(type);
+    if (!type_str) {
         return SVCS_ERROR_INVALID;
     }
-    
-    char *path = get_object_path(repo, &obj->hash);
-    if (!path) {
-        return SVCS_ERROR_MEMORY;
+
+    writer->encoder = NULL;
+    int written = snprintf(writer->tmp_path, sizeof(writer->tmp_path), "%s/objects/tmp_obj_XXXXXX", repo->git_dir);
+    if (written < 0 || (size_t)written >= sizeof(writer->tmp_path)) {
+        return SVCS_ERROR_INVALID;
     }
-    
-    // Create directory if it doesn't exist
-    char dir_path[SVCS_MAX_PATH];
-    strncpy(dir_path, path, sizeof(dir_path) - 1);
-    char *last_slash = strrchr(dir_path, '/');
-    if (last_slash) {
-        *last_slash = '\0';
-        svcs_mkdir_recursive(dir_path);
-    }
-    
-    // Object already exists
-    if (svcs_file_exists(path)) {
-        free(path);
-        return SVCS_OK;
+
+    writer->fd = mkstemp(writer->tmp_path);
+    if (writer->fd < 0) {
+        return SVCS_ERROR_IO;
     }
-    
-    // Create object data with header
-    const char *type_str;
-    switch (obj->type) {
-        case SVCS_OBJ_BLOB: type_str = "blob"; break;
-        case SVCS_OBJ_TREE: type_str = "tree"; break;
-        case SVCS_OBJ_COMMIT: type_str = "commit"; break;
-        case SVCS_OBJ_TAG: type_str = "tag"; break;
-        default:
-            free(path);
-            return SVCS_ERROR_INVALID;
-    }
-    
+
+    // Loose objects encode "<type> <size>\0<content>"
     char header[64];
-    int header_len = snprintf(header, sizeof(header), "%s %zu", type_str, obj->size);
-    
-    // For now, we'll write uncompressed data
-    // In a real implementation, you'd compress with zlib
-    FILE *file = fopen(path, "wb");
-    if (!file) {
-        free(path);
-        return SVCS_ERROR_IO;
+    int header_len = snprintf(header, sizeof(header), "%s %zu", type_str, size) + 1;
+
+    svcs_error_t err = svcs_encoder_new(repo, svcs_codec_for_object(repo, size),
+                                        header_len + size, writer->fd, NULL, &writer->encoder);
+    if (err == SVCS_OK) {
+        err = svcs_encoder_write(writer->encoder, header, header_len);
+    }
+
+    if (err != SVCS_OK) {
+        svcs_encoder_free(writer->encoder);
+        close(writer->fd);
+        unlink(writer->tmp_path);
+    }
+    return err;
+}
+
+// Finish the object, or abandon it if err is already set
+static svcs_error_t loose_writer_end(svcs_repository_t *repo, loose_writer_t *writer,
+                                     const svcs_hash_t *hash, svcs_error_t err) {
+    if (err == SVCS_OK) {
+        err = svcs_encoder_finish(writer->encoder);
+    }
+    svcs_encoder_free(writer->encoder);
+
+    if (close(writer->fd) != 0 && err == SVCS_OK) {
+        err = SVCS_ERROR_IO;
     }
-    
-    fwrite(header, 1, header_len, file);
-    fwrite("\0", 1, 1, file);
-    // Note: In a complete implementation, you'd write the actual object content here
-    
-    fclose(file);
-    free(path);
-    
+
+    if (err != SVCS_OK || freshen_object(repo, hash)) {
+        unlink(writer->tmp_path);
+        return err;
+    }
+
+    if (repo->write_batch) {
+        return svcs_write_batch_add_object(repo, writer->tmp_path, hash);
+    }
+
+    char path[SVCS_MAX_PATH];
+    err = svcs_loose_object_path(repo, hash, path, sizeof(path));
+    if (err == SVCS_OK) {
+        err = svcs_loose_cache_mkdir(repo, hash);
+    }
+    if (err == SVCS_OK && rename(writer->tmp_path, path) != 0) {
+        // The fanout directory may have been removed since it was cached
+        svcs_loose_cache_forget(repo, hash->bytes[0]);
+        if (errno != ENOENT || svcs_loose_cache_mkdir(repo, hash) != SVCS_OK ||
+            rename(writer->tmp_path, path) != 0) {
+            err = SVCS_ERROR_IO;
+        }
+    }
+
+    if (err != SVCS_OK) {
+        unlink(writer->tmp_path);
+        return err;
+    }
+
+    svcs_loose_cache_add(repo, hash);
     return SVCS_OK;
 }
 
+svcs_error_t svcs_object_write(svcs_repository_t *repo, svcs_object_t *obj) {
+    if (!repo || !obj || (!obj->data && obj->size > 0)) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    // Object already exists, either loose or in a pack
+    if (freshen_object(repo, &obj->hash)) {
+        return SVCS_OK;
+    }
+
+    loose_writer_t writer;
+    svcs_error_t err = loose_writer_begin(repo, obj->type, obj->size, &writer);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    err = svcs_encoder_write(writer.encoder, obj->data, obj->size);
+    return loose_writer_end(repo, &writer, &obj->hash, err);
+}
+
 void svcs_object_free(svcs_object_t *obj) {
     if (obj) {
+        free(obj->data);
         free(obj);
     }
 }
 
+// Store the blob behind fd in one pass: every chunk read feeds both the
+// hash and the encoder, and the object is only kept if the hash is new.
+svcs_error_t svcs_object_write_blob_fd(svcs_repository_t *repo, int fd, size_t size, svcs_hash_t *hash) {
+    if (!repo || fd < 0 || !hash) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    uint8_t *chunk = malloc(SVCS_IO_CHUNK_SIZE);
+    if (!chunk) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    loose_writer_t writer;
+    svcs_error_t err = loose_writer_begin(repo, SVCS_OBJ_BLOB, size, &writer);
+    if (err != SVCS_OK) {
+        free(chunk);
+        return err;
+    }
+
+    svcs_hash_ctx_t ctx;
+    err = svcs_hash_ctx_init_object(&ctx, repo->hash_algo, SVCS_OBJ_BLOB, size);
+
+    // The header committed to size bytes, so read exactly that many
+    size_t remaining = size;
+    while (err == SVCS_OK && remaining > 0) {
+        size_t want = remaining < SVCS_IO_CHUNK_SIZE ? remaining : SVCS_IO_CHUNK_SIZE;
+        ssize_t n = read(fd, chunk, want);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            err = SVCS_ERROR_IO;
+            break;
+        }
+
+        svcs_hash_ctx_update(&ctx, chunk, (size_t)n);
+        err = svcs_encoder_write(writer.encoder, chunk, (size_t)n);
+        remaining -= (size_t)n;
+    }
+
+    svcs_hash_ctx_final(&ctx, err == SVCS_OK ? hash : NULL);
+    free(chunk);
+
+    return loose_writer_end(repo, &writer, hash, err);
+}
+
 // Create blob object from file
 svcs_error_t svcs_object_create_blob(svcs_repository_t *repo, const char *file_path, svcs_hash_t *hash) {
     if (!repo || !file_path || !hash) {
         return SVCS_ERROR_INVALID;
     }
-    
-    void *data;
-    size_t size;
-    svcs_error_t err = svcs_file_read(file_path, &data, &size);
-    if (err != SVCS_OK) {
-        return err;
+
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) {
+        return errno == ENOENT ? SVCS_ERROR_NOT_FOUND : SVCS_ERROR_IO;
     }
-    
-    // Compute hash
-    err = svcs_hash_object(SVCS_OBJ_BLOB, data, size, hash);
-    if (err != SVCS_OK) {
-        free(data);
-        return err;
+
+    struct stat st;
+    svcs_error_t err = fstat(fd, &st) == 0 ? SVCS_OK : SVCS_ERROR_IO;
+    if (err == SVCS_OK) {
+        err = svcs_object_write_blob_fd(repo, fd, (size_t)st.st_size, hash);
     }
-    
-    // Create object
-    svcs_object_t obj = {
-        .type = SVCS_OBJ_BLOB,
-        .size = size,
-        .hash = *hash
-    };
-    
-    err = svcs_object_write(repo, &obj);
-    free(data);
-    
+
+    close(fd);
     return err;
-}
\ No newline at end of file
+}
@@ -0,0 +1,302 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "svcs.h"
+#include "internal.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Cache of decoded objects, keyed by hash and bounded by the bytes of
+// content it holds. It is split into shards, each with its own lock, hash
+// table and LRU list, so parallel readers rarely contend. Entries hand out
+// copies: callers own what svcs_object_read returns and free it as usual.
+
+#define OBJECT_CACHE_SHARDS 16
+#define OBJECT_CACHE_MIN_BUCKETS 64
+
+typedef struct cache_entry {
+    svcs_hash_t hash;
+    svcs_object_type_t type;
+    size_t size;
+    void *data;
+    struct cache_entry *chain;  // Next entry in the same bucket
+    struct cache_entry *prev;   // LRU list, most recently used first
+    struct cache_entry *next;
+} cache_entry_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    cache_entry_t **buckets;
+    size_t bucket_count;
+    size_t entry_count;
+    size_t used;
+    cache_entry_t *head;
+    cache_entry_t *tail;
+    atomic_size_t hits;       // Counted without the lock, and read by
+    atomic_size_t misses;     // svcs_object_cache_stats without it too
+    atomic_size_t evictions;
+} cache_shard_t;
+
+// The limit can change while other threads use the cache, so it is atomic
+struct svcs_object_cache {
+    cache_shard_t shards[OBJECT_CACHE_SHARDS];
+    atomic_size_t max_bytes;
+    atomic_size_t used;
+};
+
+// Hashes are already uniformly distributed, so their bytes index directly
+static size_t shard_of(const svcs_hash_t *hash) {
+    return hash->bytes[0] % OBJECT_CACHE_SHARDS;
+}
+
+static size_t bucket_of(const cache_shard_t *shard, const svcs_hash_t *hash) {
+    return svcs_get_be32(hash->bytes + 4) & (shard->bucket_count - 1);
+}
+
+static size_t shard_limit(const svcs_object_cache_t *cache) {
+    return atomic_load(&cache->max_bytes) / OBJECT_CACHE_SHARDS;
+}
+
+static void lru_unlink(cache_shard_t *shard, cache_entry_t *entry) {
+    if (entry->prev) entry->prev->next = entry->next;
+    else shard->head = entry->next;
+    if (entry->next) entry->next->prev = entry->prev;
+    else shard->tail = entry->prev;
+    entry->prev = entry->next = NULL;
+}
+
+static void lru_push_front(cache_shard_t *shard, cache_entry_t *entry) {
+    entry->prev = NULL;
+    entry->next = shard->head;
+    if (shard->head) shard->head->prev = entry;
+    shard->head = entry;
+    if (!shard->tail) shard->tail = entry;
+}
+
+static cache_entry_t* shard_find(cache_shard_t *shard, const svcs_hash_t *hash) {
+    for (cache_entry_t *entry = shard->buckets[bucket_of(shard, hash)]; entry; entry = entry->chain) {
+        if (svcs_hash_compare(&entry->hash, hash) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void shard_remove(svcs_object_cache_t *cache, cache_shard_t *shard, cache_entry_t *entry) {
+    cache_entry_t **link = &shard->buckets[bucket_of(shard, &entry->hash)];
+    while (*link != entry) {
+        link = &(*link)->chain;
+    }
+    *link = entry->chain;
+
+    lru_unlink(shard, entry);
+    shard->entry_count--;
+    shard->used -= entry->size;
+    atomic_fetch_sub(&cache->used, entry->size);
+
+    free(entry->data);
+    free(entry);
+}
+
+// Evict from the cold end until the shard fits its share of the budget
+static void shard_trim(svcs_object_cache_t *cache, cache_shard_t *shard, size_t limit) {
+    size_t evicted = 0;
+    while (shard->tail && shard->used > limit) {
+        shard_remove(cache, shard, shard->tail);
+        evicted++;
+    }
+    atomic_fetch_add_explicit(&shard->evictions, evicted, memory_order_relaxed);
+}
+
+// Keep chains short; growing is skipped if memory is tight
+static void shard_grow(cache_shard_t *shard) {
+    if (shard->entry_count < shard->bucket_count) {
+        return;
+    }
+
+    size_t bucket_count = shard->bucket_count * 2;
+    cache_entry_t **buckets = calloc(bucket_count, sizeof(cache_entry_t*));
+    if (!buckets) {
+        return;
+    }
+
+    cache_entry_t **old = shard->buckets;
+    size_t old_count = shard->bucket_count;
+    shard->buckets = buckets;
+    shard->bucket_count = bucket_count;
+
+    for (size_t i = 0; i < old_count; i++) {
+        cache_entry_t *entry = old[i];
+        while (entry) {
+            cache_entry_t *chain = entry->chain;
+            size_t bucket = bucket_of(shard, &entry->hash);
+            entry->chain = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = chain;
+        }
+    }
+    free(old);
+}
+
+svcs_error_t svcs_object_cache_new(size_t max_bytes, svcs_object_cache_t **cache) {
+    if (!cache) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    svcs_object_cache_t *c = calloc(1, sizeof(svcs_object_cache_t));
+    if (!c) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    atomic_init(&c->max_bytes, max_bytes);
+    atomic_init(&c->used, 0);
+
+    for (size_t i = 0; i < OBJECT_CACHE_SHARDS; i++) {
+        cache_shard_t *shard = &c->shards[i];
+        shard->bucket_count = OBJECT_CACHE_MIN_BUCKETS;
+        shard->buckets = calloc(shard->bucket_count, sizeof(cache_entry_t*));
+        if (!shard->buckets) {
+            for (size_t j = 0; j < i; j++) {
+                pthread_mutex_destroy(&c->shards[j].lock);
+                free(c->shards[j].buckets);
+            }
+            free(c);
+            return SVCS_ERROR_MEMORY;
+        }
+        pthread_mutex_init(&shard->lock, NULL);
+        atomic_init(&shard->hits, 0);
+        atomic_init(&shard->misses, 0);
+        atomic_init(&shard->evictions, 0);
+    }
+
+    *cache = c;
+    return SVCS_OK;
+}
+
+void svcs_object_cache_free(svcs_object_cache_t *cache) {
+    if (!cache) return;
+
+    for (size_t i = 0; i < OBJECT_CACHE_SHARDS; i++) {
+        cache_shard_t *shard = &cache->shards[i];
+        cache_entry_t *entry = shard->head;
+        while (entry) {
+            cache_entry_t *next = entry->next;
+            free(entry->data);
+            free(entry);
+            entry = next;
+        }
+        free(shard->buckets);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    free(cache);
+}
+
+// On a hit, *data is a fresh copy of the cached content
+int svcs_object_cache_get(svcs_object_cache_t *cache, const svcs_hash_t *hash,
+                          svcs_object_type_t *type, void **data, size_t *size) {
+    if (!cache || atomic_load(&cache->max_bytes) == 0) {
+        return 0;
+    }
+
+    cache_shard_t *shard = &cache->shards[shard_of(hash)];
+    pthread_mutex_lock(&shard->lock);
+
+    cache_entry_t *entry = shard_find(shard, hash);
+    void *copy = NULL;
+    if (entry) {
+        copy = malloc(entry->size ? entry->size : 1);
+    }
+
+    if (copy) {
+        memcpy(copy, entry->data, entry->size);
+        *type = entry->type;
+        *size = entry->size;
+        *data = copy;
+
+        lru_unlink(shard, entry);
+        lru_push_front(shard, entry);
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    atomic_fetch_add_explicit(copy ? &shard->hits : &shard->misses, 1, memory_order_relaxed);
+    return copy != NULL;
+}
+
+// Remember a copy of an object. Objects too large for a shard's share of
+// the budget are not cached, so one big blob cannot flush everything else.
+void svcs_object_cache_put(svcs_object_cache_t *cache, const svcs_hash_t *hash,
+                           svcs_object_type_t type, const void *data, size_t size) {
+    if (!cache || size > shard_limit(cache) / 4) {
+        return;
+    }
+
+    cache_entry_t *entry = malloc(sizeof(cache_entry_t));
+    void *copy = malloc(size ? size : 1);
+    if (!entry || !copy) {
+        free(entry);
+        free(copy);
+        return;
+    }
+    memcpy(copy, data, size);
+
+    entry->hash = *hash;
+    entry->type = type;
+    entry->size = size;
+    entry->data = copy;
+
+    cache_shard_t *shard = &cache->shards[shard_of(hash)];
+    pthread_mutex_lock(&shard->lock);
+
+    // Another reader may have inserted it in the meantime
+    if (shard_find(shard, hash)) {
+        pthread_mutex_unlock(&shard->lock);
+        free(copy);
+        free(entry);
+        return;
+    }
+
+    shard_grow(shard);
+    size_t bucket = bucket_of(shard, hash);
+    entry->chain = shard->buckets[bucket];
+    shard->buckets[bucket] = entry;
+    lru_push_front(shard, entry);
+    shard->entry_count++;
+    shard->used += size;
+    atomic_fetch_add(&cache->used, size);
+
+    shard_trim(cache, shard, shard_limit(cache));
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void svcs_object_cache_set_limit(svcs_repository_t *repo, size_t max_bytes) {
+    if (!repo || !repo->object_cache) return;
+
+    svcs_object_cache_t *cache = repo->object_cache;
+    atomic_store(&cache->max_bytes, max_bytes);
+
+    for (size_t i = 0; i < OBJECT_CACHE_SHARDS; i++) {
+        cache_shard_t *shard = &cache->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        shard_trim(cache, shard, shard_limit(cache));
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+void svcs_object_cache_stats(svcs_repository_t *repo, svcs_cache_stats_t *stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (!repo || !repo->object_cache) return;
+
+    svcs_object_cache_t *cache = repo->object_cache;
+    stats->max_size = atomic_load(&cache->max_bytes);
+
+    for (size_t i = 0; i < OBJECT_CACHE_SHARDS; i++) {
+        cache_shard_t *shard = &cache->shards[i];
+        stats->hits += atomic_load_explicit(&shard->hits, memory_order_relaxed);
+        stats->misses += atomic_load_explicit(&shard->misses, memory_order_relaxed);
+        stats->evictions += atomic_load_explicit(&shard->evictions, memory_order_relaxed);
+        pthread_mutex_lock(&shard->lock);
+        stats->size += shard->used;
+        stats->count += shard->entry_count;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
@@ -0,0 +1,1004 @@
+#define _POSIX_C_SOURCE 200809L
+#include "svcs.h"
+#include "internal.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <ctype.h>
+
+// Pack files concatenate compressed objects so that a repository does not
+// need one inode (and one open()) per object.
+//
+//   pack-<checksum>.pack
+//     "SPCK" | version (be32) | object count (be32)
+//     entries: type/size varint header, then a codec byte and the content
+//     encoded with it (see compress.c); older packs have a bare zlib stream
+//     checksum of everything above (32 bytes)
+//
+//   Delta entries (type 7) store the base object hash after the header and
+//   an encoded delta (see delta.c) instead of the full content; the size
+//   in the header is the delta size. Bases always live in the same pack.
+//
+//   pack-<checksum>.idx
+//     "SIDX" | version (be32)
+//     fanout[256] (be32): number of objects whose first byte is <= i
+//     sorted object hashes (32 bytes each)
+//     pack offsets (be64 each), in hash order
+//     pack checksum | idx checksum
+
+#define PACK_SIGNATURE "SPCK"
+#define PACK_IDX_SIGNATURE "SIDX"
+#define PACK_VERSION 1
+#define PACK_HEADER_SIZE 12
+#define PACK_IDX_HEADER_SIZE 8
+#define PACK_FANOUT_SIZE (256 * 4)
+
+#define PACK_OBJ_REF_DELTA 7
+#define PACK_DELTA_WINDOW 10
+#define PACK_MAX_DELTA_DEPTH 16
+#define PACK_DELTA_DEPTH_LIMIT 64  // reject longer chains as corrupt
+#define PACK_DELTA_MIN_SIZE 64
+
+struct svcs_pack {
+    char pack_path[SVCS_MAX_PATH];
+    svcs_hash_t checksum;
+    const uint8_t *pack_map;
+    size_t pack_size;
+    const uint8_t *idx_map;
+    size_t idx_size;
+    uint32_t object_count;
+    const uint8_t *fanout;
+    const uint8_t *hashes;
+    const uint8_t *offsets;
+    int in_midx;  // Its objects are found through the multi-pack index
+    int freshened;  // Its mtime was bumped by this process
+    struct svcs_pack *next;
+};
+
+static void pack_dir_path(svcs_repository_t *repo, char *path, size_t path_size) {
+    snprintf(path, path_size, "%s/objects/pack", repo->git_dir);
+}
+
+static void pack_free(svcs_pack_t *pack) {
+    if (!pack) return;
+
+    if (pack->pack_map) munmap((void*)pack->pack_map, pack->pack_size);
+    if (pack->idx_map) munmap((void*)pack->idx_map, pack->idx_size);
+    free(pack);
+}
+
+static svcs_error_t pack_open(const char *idx_path, svcs_pack_t **out) {
+    svcs_pack_t *pack = calloc(1, sizeof(svcs_pack_t));
+    if (!pack) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    svcs_error_t err = svcs_file_map(idx_path, &pack->idx_map, &pack->idx_size);
+    if (err != SVCS_OK) {
+        free(pack);
+        return err;
+    }
+
+    const uint8_t *idx = pack->idx_map;
+    if (pack->idx_size < PACK_IDX_HEADER_SIZE + PACK_FANOUT_SIZE + 2 * SVCS_HASH_SIZE ||
+        memcmp(idx, PACK_IDX_SIGNATURE, 4) != 0 ||
+        svcs_get_be32(idx + 4) != PACK_VERSION) {
+        pack_free(pack);
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    // Lookups search between neighbouring fanout entries, so they must never
+    // decrease, and the last one must count no more objects than fit
+    pack->fanout = idx + PACK_IDX_HEADER_SIZE;
+    for (int i = 1; i < 256; i++) {
+        if (svcs_get_be32(pack->fanout + i * 4) < svcs_get_be32(pack->fanout + (i - 1) * 4)) {
+            pack_free(pack);
+            return SVCS_ERROR_CORRUPT;
+        }
+    }
+    pack->object_count = svcs_get_be32(pack->fanout + 255 * 4);
+    size_t table_size = pack->idx_size - (PACK_IDX_HEADER_SIZE + PACK_FANOUT_SIZE + 2 * SVCS_HASH_SIZE);
+    if (pack->object_count > table_size / (SVCS_HASH_SIZE + 8) ||
+        table_size != (size_t)pack->object_count * (SVCS_HASH_SIZE + 8)) {
+        pack_free(pack);
+        return SVCS_ERROR_CORRUPT;
+    }
+    pack->hashes = pack->fanout + PACK_FANOUT_SIZE;
+    pack->offsets = pack->hashes + (size_t)pack->object_count * SVCS_HASH_SIZE;
+
+    memcpy(pack->checksum.bytes, pack->offsets + (size_t)pack->object_count * 8, SVCS_HASH_SIZE);
+
+    // The pack lives next to its index
+    size_t len = strlen(idx_path);
+    if (len < 4 || len >= sizeof(pack->pack_path)) {
+        pack_free(pack);
+        return SVCS_ERROR_INVALID;
+    }
+    snprintf(pack->pack_path, sizeof(pack->pack_path), "%.*s.pack", (int)(len - 4), idx_path);
+
+    err = svcs_file_map(pack->pack_path, &pack->pack_map, &pack->pack_size);
+    if (err != SVCS_OK) {
+        pack_free(pack);
+        return err;
+    }
+
+    if (pack->pack_size < PACK_HEADER_SIZE + SVCS_HASH_SIZE ||
+        memcmp(pack->pack_map, PACK_SIGNATURE, 4) != 0 ||
+        svcs_get_be32(pack->pack_map + 4) != PACK_VERSION ||
+        svcs_get_be32(pack->pack_map + 8) != pack->object_count ||
+        memcmp(pack->pack_map + pack->pack_size - SVCS_HASH_SIZE,
+               pack->checksum.bytes, SVCS_HASH_SIZE) != 0) {
+        pack_free(pack);
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    *out = pack;
+    return SVCS_OK;
+}
+
+static int pack_is_loaded(svcs_repository_t *repo, const svcs_hash_t *checksum) {
+    for (svcs_pack_t *pack = repo->packs; pack; pack = pack->next) {
+        if (svcs_hash_compare(&pack->checksum, checksum) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+svcs_error_t svcs_pack_load_all(svcs_repository_t *repo) {
+    if (!repo) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    char dir_path[SVCS_MAX_PATH];
+    pack_dir_path(repo, dir_path, sizeof(dir_path));
+
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        return SVCS_OK; // No packs yet
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len < 5 || strncmp(entry->d_name, "pack-", 5) != 0 ||
+            strcmp(entry->d_name + len - 4, ".idx") != 0) {
+            continue;
+        }
+
+        char idx_path[SVCS_MAX_PATH];
+        snprintf(idx_path, sizeof(idx_path), "%s/%s", dir_path, entry->d_name);
+
+        // A damaged pack must not make the rest of the repository unreadable
+        svcs_pack_t *pack;
+        if (pack_open(idx_path, &pack) != SVCS_OK) {
+            continue;
+        }
+
+        if (pack_is_loaded(repo, &pack->checksum)) {
+            pack_free(pack);
+            continue;
+        }
+
+        pack->next = repo->packs;
+        repo->packs = pack;
+    }
+
+    closedir(dir);
+
+    // A damaged multi-pack index only means packs are searched one by one
+    svcs_midx_load(repo);
+    return SVCS_OK;
+}
+
+void svcs_pack_free_all(svcs_repository_t *repo) {
+    if (!repo) return;
+
+    svcs_midx_free(repo);
+    svcs_pack_t *pack = repo->packs;
+    while (pack) {
+        svcs_pack_t *next = pack->next;
+        pack_free(pack);
+        pack = next;
+    }
+    repo->packs = NULL;
+}
+
+// Binary search within the fanout bucket of the first hash byte
+static int pack_position(const svcs_pack_t *pack, const svcs_hash_t *hash, uint32_t *pos) {
+    uint8_t first = hash->bytes[0];
+    uint32_t lo = first == 0 ? 0 : svcs_get_be32(pack->fanout + (first - 1) * 4);
+    uint32_t hi = svcs_get_be32(pack->fanout + first * 4);
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(pack->hashes + (size_t)mid * SVCS_HASH_SIZE, hash->bytes, SVCS_HASH_SIZE);
+        if (cmp == 0) {
+            *pos = mid;
+            return 1;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return 0;
+}
+
+static int pack_find(const svcs_pack_t *pack, const svcs_hash_t *hash, uint64_t *offset) {
+    uint32_t pos;
+    if (!pack_position(pack, hash, &pos)) {
+        return 0;
+    }
+    if (offset) {
+        *offset = svcs_get_be64(pack->offsets + (size_t)pos * 8);
+    }
+    return 1;
+}
+
+// Objects are numbered by their position in the pack index, which is
+// hash order. Reachability bitmaps use these numbers as bit positions.
+svcs_pack_t* svcs_pack_by_checksum(svcs_repository_t *repo, const svcs_hash_t *checksum) {
+    for (svcs_pack_t *pack = repo->packs; pack; pack = pack->next) {
+        if (svcs_hash_compare(&pack->checksum, checksum) == 0) {
+            return pack;
+        }
+    }
+    return NULL;
+}
+
+svcs_pack_t* svcs_pack_next(svcs_repository_t *repo, const svcs_pack_t *pack) {
+    return pack ? pack->next : repo->packs;
+}
+
+const char* svcs_pack_file(const svcs_pack_t *pack) {
+    return pack->pack_path;
+}
+
+const svcs_hash_t* svcs_pack_checksum(const svcs_pack_t *pack) {
+    return &pack->checksum;
+}
+
+uint32_t svcs_pack_object_count(const svcs_pack_t *pack) {
+    return pack->object_count;
+}
+
+int svcs_pack_position(const svcs_pack_t *pack, const svcs_hash_t *hash, uint32_t *pos) {
+    return pack_position(pack, hash, pos);
+}
+
+void svcs_pack_hash_at(const svcs_pack_t *pack, uint32_t pos, svcs_hash_t *hash) {
+    memcpy(hash->bytes, pack->hashes + (size_t)pos * SVCS_HASH_SIZE, SVCS_HASH_SIZE);
+}
+
+uint64_t svcs_pack_offset_at(const svcs_pack_t *pack, uint32_t pos) {
+    return svcs_get_be64(pack->offsets + (size_t)pos * 8);
+}
+
+void svcs_pack_set_in_midx(svcs_pack_t *pack, int in_midx) {
+    pack->in_midx = in_midx;
+}
+
+// The multi-pack index answers for every pack it covers with one search;
+// packs added since it was written are searched one at a time
+static const svcs_pack_t* pack_locate(svcs_repository_t *repo, const svcs_hash_t *hash, uint64_t *offset) {
+    const svcs_pack_t *found;
+    if (svcs_midx_find(repo, hash, &found, offset)) {
+        return found;
+    }
+
+    for (const svcs_pack_t *pack = repo->packs; pack; pack = pack->next) {
+        if (!pack->in_midx && pack_find(pack, hash, offset)) {
+            return pack;
+        }
+    }
+    return NULL;
+}
+
+int svcs_pack_has_object(svcs_repository_t *repo, const svcs_hash_t *hash) {
+    if (!repo || !hash) return 0;
+
+    uint64_t offset;
+    return pack_locate(repo, hash, &offset) != NULL;
+}
+
+// A write that finds its object already packed bumps the pack's mtime
+// instead, so gc's grace period covers the pack holding it. Returns
+// whether the object is packed and its pack could be touched.
+int svcs_pack_freshen_object(svcs_repository_t *repo, const svcs_hash_t *hash) {
+    if (!repo || !hash) return 0;
+
+    uint64_t offset;
+    const svcs_pack_t *found = pack_locate(repo, hash, &offset);
+    svcs_pack_t *pack = found ? svcs_pack_by_checksum(repo, &found->checksum) : NULL;
+    if (!pack) {
+        return 0;
+    }
+    if (!pack->freshened) {
+        if (utimensat(AT_FDCWD, pack->pack_path, NULL, 0) != 0) {
+            return 0;
+        }
+        pack->freshened = 1;
+    }
+    return 1;
+}
+
+// Entry header: bit 7 continues, bits 6-4 type, bits 3-0 low size bits,
+// followed by 7-bit size groups.
+static size_t encode_entry_header(uint8_t *out, svcs_object_type_t type, size_t size) {
+    size_t n = 0;
+    uint8_t byte = (uint8_t)(((type & 7) << 4) | (size & 0x0f));
+    size >>= 4;
+    while (size) {
+        out[n++] = byte | 0x80;
+        byte = size & 0x7f;
+        size >>= 7;
+    }
+    out[n++] = byte;
+    return n;
+}
+
+static svcs_error_t decode_entry_header(const uint8_t *data, size_t avail, svcs_object_type_t *type,
+                                        size_t *size, size_t *header_len) {
+    if (avail == 0) {
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    size_t n = 0;
+    uint8_t byte = data[n++];
+    *type = (svcs_object_type_t)((byte >> 4) & 7);
+    size_t value = byte & 0x0f;
+    unsigned shift = 4;
+
+    while (byte & 0x80) {
+        if (n >= avail || shift > 57) {
+            return SVCS_ERROR_CORRUPT;
+        }
+        byte = data[n++];
+        value |= (size_t)(byte & 0x7f) << shift;
+        shift += 7;
+    }
+
+    *size = value;
+    *header_len = n;
+    return SVCS_OK;
+}
+
+// Decode entry content whose size is known up front
+static svcs_error_t decode_exact(svcs_repository_t *repo, const uint8_t *input, size_t avail,
+                                 void **output, size_t size) {
+    uint8_t *buffer = malloc(size ? size : 1);
+    if (!buffer) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    svcs_error_t err = svcs_codec_decode_into(repo, input, avail, buffer, size);
+    if (err != SVCS_OK) {
+        free(buffer);
+        return err;
+    }
+
+    *output = buffer;
+    return SVCS_OK;
+}
+
+static svcs_error_t pack_read_entry(svcs_repository_t *repo, const svcs_pack_t *pack, uint64_t offset,
+                                    svcs_object_type_t *type, void **data, size_t *size, int depth) {
+    size_t end = pack->pack_size - SVCS_HASH_SIZE;
+    if (offset < PACK_HEADER_SIZE || offset >= end) {
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    svcs_object_type_t entry_type;
+    size_t entry_size;
+    size_t header_len;
+    svcs_error_t err = decode_entry_header(pack->pack_map + offset, end - offset,
+                                           &entry_type, &entry_size, &header_len);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    const uint8_t *stream = pack->pack_map + offset + header_len;
+    size_t avail = end - offset - header_len;
+
+    if (entry_type != PACK_OBJ_REF_DELTA) {
+        if (!svcs_object_type_name(entry_type)) {
+            return SVCS_ERROR_CORRUPT;
+        }
+        *type = entry_type;
+        *size = entry_size;
+        return decode_exact(repo, stream, avail, data, entry_size);
+    }
+
+    // Delta: resolve the base first, then replay the instructions over it
+    if (depth >= PACK_DELTA_DEPTH_LIMIT || avail < SVCS_HASH_SIZE) {
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    svcs_hash_t base_hash;
+    memcpy(base_hash.bytes, stream, SVCS_HASH_SIZE);
+
+    uint64_t base_offset;
+    if (!pack_find(pack, &base_hash, &base_offset)) {
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    void *delta;
+    err = decode_exact(repo, stream + SVCS_HASH_SIZE, avail - SVCS_HASH_SIZE, &delta, entry_size);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    void *base;
+    size_t base_size;
+    err = pack_read_entry(repo, pack, base_offset, type, &base, &base_size, depth + 1);
+    if (err == SVCS_OK) {
+        err = svcs_delta_apply(base, base_size, delta, entry_size, data, size);
+        free(base);
+    }
+
+    free(delta);
+    return err;
+}
+
+svcs_error_t svcs_pack_read_object(svcs_repository_t *repo, const svcs_hash_t *hash,
+                                   svcs_object_type_t *type, void **data, size_t *size) {
+    if (!repo || !hash || !type || !data || !size) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    uint64_t offset;
+    const svcs_pack_t *pack = pack_locate(repo, hash, &offset);
+    if (!pack) {
+        return SVCS_ERROR_NOT_FOUND;
+    }
+    return pack_read_entry(repo, pack, offset, type, data, size, 0);
+}
+
+// Type and size straight from entry headers. A delta's type is that of the
+// end of its chain, and its size is the target size at the start of the
+// delta, so only those first few bytes are decoded.
+static svcs_error_t pack_entry_info(svcs_repository_t *repo, const svcs_pack_t *pack, uint64_t offset,
+                                    svcs_object_type_t *type, size_t *size) {
+    size_t end = pack->pack_size - SVCS_HASH_SIZE;
+    int have_size = 0;
+
+    for (int depth = 0; depth <= PACK_DELTA_DEPTH_LIMIT; depth++) {
+        if (offset < PACK_HEADER_SIZE || offset >= end) {
+            return SVCS_ERROR_CORRUPT;
+        }
+
+        svcs_object_type_t entry_type;
+        size_t entry_size;
+        size_t header_len;
+        svcs_error_t err = decode_entry_header(pack->pack_map + offset, end - offset,
+                                               &entry_type, &entry_size, &header_len);
+        if (err != SVCS_OK) {
+            return err;
+        }
+
+        const uint8_t *stream = pack->pack_map + offset + header_len;
+        size_t avail = end - offset - header_len;
+
+        if (entry_type != PACK_OBJ_REF_DELTA) {
+            if (!svcs_object_type_name(entry_type)) {
+                return SVCS_ERROR_CORRUPT;
+            }
+            *type = entry_type;
+            if (!have_size) {
+                *size = entry_size;
+            }
+            return SVCS_OK;
+        }
+
+        if (avail < SVCS_HASH_SIZE) {
+            return SVCS_ERROR_CORRUPT;
+        }
+
+        if (!have_size) {
+            // Base and target size varints, at most 10 bytes each
+            uint8_t prefix[20];
+            size_t want = entry_size < sizeof(prefix) ? entry_size : sizeof(prefix);
+            size_t produced;
+            err = svcs_codec_decode_prefix(repo, stream + SVCS_HASH_SIZE, avail - SVCS_HASH_SIZE,
+                                           prefix, want, &produced);
+            if (err == SVCS_OK) {
+                err = svcs_delta_target_size(prefix, produced, size);
+            }
+            if (err != SVCS_OK) {
+                return err;
+            }
+            have_size = 1;
+        }
+
+        svcs_hash_t base_hash;
+        memcpy(base_hash.bytes, stream, SVCS_HASH_SIZE);
+        if (!pack_find(pack, &base_hash, &offset)) {
+            return SVCS_ERROR_CORRUPT;
+        }
+    }
+
+    return SVCS_ERROR_CORRUPT;
+}
+
+svcs_error_t svcs_pack_object_info(svcs_repository_t *repo, const svcs_hash_t *hash,
+                                   svcs_object_type_t *type, size_t *size) {
+    if (!repo || !hash || !type || !size) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    uint64_t offset;
+    const svcs_pack_t *pack = pack_locate(repo, hash, &offset);
+    if (!pack) {
+        return SVCS_ERROR_NOT_FOUND;
+    }
+    return pack_entry_info(repo, pack, offset, type, size);
+}
+
+typedef struct {
+    svcs_hash_t hash;
+    uint64_t offset;
+    uint32_t name_hash;
+} pack_index_entry_t;
+
+static int compare_hashes(const void *a, const void *b) {
+    return memcmp(a, b, SVCS_HASH_SIZE);
+}
+
+// A pack being written goes straight to a temp file in the pack directory.
+// The checksum is hashed as the bytes go out, so no more than one entry is
+// ever held in memory.
+typedef struct {
+    char tmp_path[SVCS_MAX_PATH];
+    int fd;
+    svcs_hash_ctx_t hash;
+} pack_writer_t;
+
+static svcs_error_t pack_writer_write(pack_writer_t *writer, const void *data, size_t size) {
+    svcs_hash_ctx_update(&writer->hash, data, size);
+
+    const uint8_t *ptr = data;
+    while (size > 0) {
+        ssize_t n = write(writer->fd, ptr, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return SVCS_ERROR_IO;
+        }
+        ptr += n;
+        size -= (size_t)n;
+    }
+    return SVCS_OK;
+}
+
+// Entry content is written with the repository codec, like a loose object
+static svcs_error_t append_encoded(svcs_repository_t *repo, pack_writer_t *writer,
+                                   const void *data, size_t size) {
+    svcs_encoder_t *encoder;
+    svcs_error_t err = svcs_encoder_new(repo, svcs_codec_for_object(repo, size), size,
+                                        writer->fd, &writer->hash, &encoder);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    err = svcs_encoder_write(encoder, data, size);
+    if (err == SVCS_OK) {
+        err = svcs_encoder_finish(encoder);
+    }
+    svcs_encoder_free(encoder);
+    return err;
+}
+
+static svcs_error_t append_entry(svcs_repository_t *repo, pack_writer_t *writer, const svcs_object_t *obj) {
+    uint8_t header[16];
+    size_t header_len = encode_entry_header(header, obj->type, obj->size);
+    svcs_error_t err = pack_writer_write(writer, header, header_len);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    return append_encoded(repo, writer, obj->data, obj->size);
+}
+
+static svcs_error_t append_delta_entry(svcs_repository_t *repo, pack_writer_t *writer,
+                                       const svcs_hash_t *base, const void *delta, size_t delta_size) {
+    uint8_t header[16];
+    size_t header_len = encode_entry_header(header, PACK_OBJ_REF_DELTA, delta_size);
+    svcs_error_t err = pack_writer_write(writer, header, header_len);
+    if (err == SVCS_OK) {
+        err = pack_writer_write(writer, base->bytes, SVCS_HASH_SIZE);
+    }
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    return append_encoded(repo, writer, delta, delta_size);
+}
+
+// Hash of the path an object was found at, weighted towards its last
+// characters so that files with the same name (and similar extensions)
+// sort next to each other wherever they live. Extend a directory's hash
+// with "/<name>" to get that of an entry inside it.
+uint32_t svcs_pack_name_hash(uint32_t hash, const char *name, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)name[i];
+        if (isspace(c)) {
+            continue;
+        }
+        hash = (hash >> 2) + ((uint32_t)c << 24);
+    }
+    return hash;
+}
+
+// Objects are written grouped by type, then by path name hash, then in
+// decreasing size, so that revisions of the same file end up inside one
+// delta window.
+typedef struct {
+    size_t entry;
+    svcs_object_type_t type;
+    uint32_t name_hash;
+    size_t size;
+} pack_candidate_t;
+
+static int compare_candidates(const void *a, const void *b) {
+    const pack_candidate_t *x = a;
+    const pack_candidate_t *y = b;
+    if (x->type != y->type) {
+        return x->type < y->type ? -1 : 1;
+    }
+    if (x->name_hash != y->name_hash) {
+        return x->name_hash < y->name_hash ? -1 : 1;
+    }
+    if (x->size != y->size) {
+        return x->size > y->size ? -1 : 1;
+    }
+    return x->entry < y->entry ? -1 : (x->entry > y->entry);
+}
+
+typedef struct {
+    svcs_object_t *obj;
+    int depth;
+} pack_window_slot_t;
+
+// Pick the window entry that yields the smallest delta, if any beats half
+// the raw size. Returns the slot index or -1.
+static int find_delta_base(const pack_window_slot_t *window, const svcs_object_t *obj,
+                           void **delta, size_t *delta_size) {
+    int best = -1;
+    *delta = NULL;
+    *delta_size = obj->size / 2;
+
+    if (obj->size < PACK_DELTA_MIN_SIZE) {
+        return -1;
+    }
+
+    for (int slot = 0; slot < PACK_DELTA_WINDOW; slot++) {
+        const svcs_object_t *base = window[slot].obj;
+        if (!base || base->type != obj->type || window[slot].depth >= PACK_MAX_DELTA_DEPTH) {
+            continue;
+        }
+
+        void *candidate;
+        size_t candidate_size;
+        if (svcs_delta_create(base->data, base->size, obj->data, obj->size,
+                              *delta_size, &candidate, &candidate_size) != SVCS_OK) {
+            continue;
+        }
+
+        free(*delta);
+        *delta = candidate;
+        *delta_size = candidate_size;
+        best = slot;
+    }
+
+    return best;
+}
+
+static svcs_error_t append_objects(svcs_repository_t *repo, pack_writer_t *writer,
+                                   pack_index_entry_t *entries, size_t count) {
+    pack_candidate_t *order = calloc(count ? count : 1, sizeof(pack_candidate_t));
+    if (!order) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    // First pass only learns type and size so the window can stay small
+    svcs_error_t err = SVCS_OK;
+    for (size_t i = 0; i < count && err == SVCS_OK; i++) {
+        order[i].entry = i;
+        order[i].name_hash = entries[i].name_hash;
+        err = svcs_object_info(repo, &entries[i].hash, &order[i].type, &order[i].size);
+    }
+
+    qsort(order, count, sizeof(pack_candidate_t), compare_candidates);
+
+    pack_window_slot_t window[PACK_DELTA_WINDOW] = {{0}};
+    int next_slot = 0;
+
+    for (size_t i = 0; i < count && err == SVCS_OK; i++) {
+        pack_index_entry_t *entry = &entries[order[i].entry];
+
+        svcs_object_t *obj;
+        err = svcs_object_read(repo, &entry->hash, &obj);
+        if (err != SVCS_OK) {
+            break;
+        }
+
+        void *delta;
+        size_t delta_size;
+        int base = find_delta_base(window, obj, &delta, &delta_size);
+
+        off_t offset = lseek(writer->fd, 0, SEEK_CUR);
+        entry->offset = (uint64_t)offset;
+        if (offset < 0) {
+            err = SVCS_ERROR_IO;
+            free(delta);
+        } else if (base >= 0) {
+            err = append_delta_entry(repo, writer, &window[base].obj->hash, delta, delta_size);
+            free(delta);
+        } else {
+            err = append_entry(repo, writer, obj);
+        }
+
+        svcs_object_free(window[next_slot].obj);
+        window[next_slot].obj = obj;
+        window[next_slot].depth = base >= 0 ? window[base].depth + 1 : 0;
+        next_slot = (next_slot + 1) % PACK_DELTA_WINDOW;
+    }
+
+    for (int slot = 0; slot < PACK_DELTA_WINDOW; slot++) {
+        svcs_object_free(window[slot].obj);
+    }
+
+    free(order);
+    return err;
+}
+
+static svcs_error_t write_pack_index(svcs_repository_t *repo, const char *idx_path, const pack_index_entry_t *entries,
+                                     size_t count, const svcs_hash_t *pack_checksum) {
+    svcs_buffer_t buf = {0};
+    uint8_t word[8];
+    svcs_error_t err = svcs_buffer_append(&buf, PACK_IDX_SIGNATURE, 4);
+
+    svcs_put_be32(word, PACK_VERSION);
+    if (err == SVCS_OK) err = svcs_buffer_append(&buf, word, 4);
+
+    size_t next = 0;
+    for (int bucket = 0; bucket < 256 && err == SVCS_OK; bucket++) {
+        while (next < count && entries[next].hash.bytes[0] == bucket) {
+            next++;
+        }
+        svcs_put_be32(word, (uint32_t)next);
+        err = svcs_buffer_append(&buf, word, 4);
+    }
+
+    for (size_t i = 0; i < count && err == SVCS_OK; i++) {
+        err = svcs_buffer_append(&buf, entries[i].hash.bytes, SVCS_HASH_SIZE);
+    }
+
+    for (size_t i = 0; i < count && err == SVCS_OK; i++) {
+        svcs_put_be64(word, entries[i].offset);
+        err = svcs_buffer_append(&buf, word, 8);
+    }
+
+    if (err == SVCS_OK) err = svcs_buffer_append(&buf, pack_checksum->bytes, SVCS_HASH_SIZE);
+
+    if (err == SVCS_OK) {
+        svcs_hash_t idx_checksum;
+        svcs_hash_update(&idx_checksum, buf.data, buf.size);
+        err = svcs_buffer_append(&buf, idx_checksum.bytes, SVCS_HASH_SIZE);
+    }
+
+    if (err == SVCS_OK) {
+        err = svcs_repo_write_file(repo, idx_path, buf.data, buf.size);
+    }
+
+    svcs_buffer_free(&buf);
+    return err;
+}
+
+svcs_error_t svcs_pack_write(svcs_repository_t *repo, const svcs_hash_t *hashes, size_t count, svcs_hash_t *pack_hash) {
+    return svcs_pack_write_named(repo, hashes, NULL, count, pack_hash);
+}
+
+// name_hashes, if given, holds the svcs_pack_name_hash of the path each
+// object was reached through
+svcs_error_t svcs_pack_write_named(svcs_repository_t *repo, const svcs_hash_t *hashes, const uint32_t *name_hashes,
+                                   size_t count, svcs_hash_t *pack_hash) {
+    if (!repo || (!hashes && count > 0) || !pack_hash || count > UINT32_MAX) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    // Sort and de-duplicate; the index is written in hash order
+    pack_index_entry_t *entries = calloc(count ? count : 1, sizeof(pack_index_entry_t));
+    if (!entries) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        entries[i].hash = hashes[i];
+        entries[i].name_hash = name_hashes ? name_hashes[i] : 0;
+    }
+    qsort(entries, count, sizeof(pack_index_entry_t), compare_hashes);
+
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (unique == 0 || svcs_hash_compare(&entries[unique - 1].hash, &entries[i].hash) != 0) {
+            entries[unique++] = entries[i];
+        }
+    }
+
+    char dir_path[SVCS_MAX_PATH];
+    pack_dir_path(repo, dir_path, sizeof(dir_path));
+    svcs_error_t err = svcs_mkdir_recursive(dir_path);
+
+    pack_writer_t writer = { .fd = -1 };
+    if (err == SVCS_OK) {
+        err = svcs_hash_ctx_init(&writer.hash);
+    }
+    if (err == SVCS_OK) {
+        snprintf(writer.tmp_path, sizeof(writer.tmp_path), "%s/tmp_pack_XXXXXX", dir_path);
+        writer.fd = mkstemp(writer.tmp_path);
+        if (writer.fd < 0 || fchmod(writer.fd, 0644) != 0) {
+            err = SVCS_ERROR_IO;
+        }
+    }
+
+    if (err == SVCS_OK) {
+        uint8_t header[PACK_HEADER_SIZE];
+        memcpy(header, PACK_SIGNATURE, 4);
+        svcs_put_be32(header + 4, PACK_VERSION);
+        svcs_put_be32(header + 8, (uint32_t)unique);
+        err = pack_writer_write(&writer, header, sizeof(header));
+    }
+
+    if (err == SVCS_OK) {
+        err = append_objects(repo, &writer, entries, unique);
+    }
+
+    // Finishing also releases the context when the pack was abandoned
+    svcs_hash_ctx_final(&writer.hash, err == SVCS_OK ? pack_hash : NULL);
+    if (err == SVCS_OK) {
+        err = pack_writer_write(&writer, pack_hash->bytes, SVCS_HASH_SIZE);
+    }
+
+    // A write batch flushes the temp file itself on commit
+    if (err == SVCS_OK && !repo->write_batch && fsync(writer.fd) != 0) {
+        err = SVCS_ERROR_IO;
+    }
+    if (writer.fd >= 0 && close(writer.fd) != 0 && err == SVCS_OK) {
+        err = SVCS_ERROR_IO;
+    }
+
+    char hash_str[SVCS_HASH_HEX_SIZE];
+    char pack_path[SVCS_MAX_PATH];
+    char idx_path[SVCS_MAX_PATH];
+
+    // The pack must be complete before an index makes it visible. Both are
+    // durable once this returns, so callers may delete what they replace.
+    if (err == SVCS_OK) {
+        svcs_hash_to_string(pack_hash, hash_str);
+        snprintf(pack_path, sizeof(pack_path), "%s/pack-%s.pack", dir_path, hash_str);
+        snprintf(idx_path, sizeof(idx_path), "%s/pack-%s.idx", dir_path, hash_str);
+        err = svcs_repo_install_file(repo, writer.tmp_path, pack_path);
+    } else if (writer.fd >= 0) {
+        unlink(writer.tmp_path);
+    }
+
+    if (err == SVCS_OK) {
+        err = write_pack_index(repo, idx_path, entries, unique, pack_hash);
+    }
+
+    free(entries);
+
+    // Inside a write batch the pack appears on commit and is picked up by
+    // the next svcs_pack_load_all
+    if (err == SVCS_OK && !repo->write_batch && !pack_is_loaded(repo, pack_hash)) {
+        svcs_pack_t *pack;
+        err = pack_open(idx_path, &pack);
+        if (err == SVCS_OK) {
+            pack->next = repo->packs;
+            repo->packs = pack;
+            err = svcs_midx_write(repo);
+        }
+    }
+
+    return err;
+}
+
+// Delete every loaded pack except keep (if given) that was written before
+// expire_before, then reload what is left and index it again
+svcs_error_t svcs_pack_remove_old(svcs_repository_t *repo, const svcs_hash_t *keep,
+                                  time_t expire_before, size_t *removed) {
+    if (!repo || !removed) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    *removed = 0;
+    for (svcs_pack_t *pack = repo->packs; pack; pack = pack->next) {
+        if (keep && svcs_hash_compare(&pack->checksum, keep) == 0) {
+            continue;
+        }
+
+        struct stat st;
+        if (stat(pack->pack_path, &st) != 0 || st.st_mtime >= expire_before) {
+            continue;
+        }
+
+        // Index first, so the pack is never visible without its data
+        char idx_path[SVCS_MAX_PATH];
+        size_t len = strlen(pack->pack_path);
+        snprintf(idx_path, sizeof(idx_path), "%.*s.idx", (int)(len - 5), pack->pack_path);
+        if (unlink(idx_path) != 0 && errno != ENOENT) {
+            return SVCS_ERROR_IO;
+        }
+        unlink(pack->pack_path);
+        snprintf(idx_path, sizeof(idx_path), "%.*s.bitmap", (int)(len - 5), pack->pack_path);
+        unlink(idx_path);
+        (*removed)++;
+    }
+
+    if (*removed == 0) {
+        return SVCS_OK;
+    }
+
+    svcs_pack_free_all(repo);
+    svcs_error_t err = svcs_pack_load_all(repo);
+    if (err == SVCS_OK) {
+        err = svcs_midx_write(repo);
+    }
+    return err;
+}
+
+svcs_error_t svcs_pack_list_loose(svcs_repository_t *repo, svcs_hash_t **hashes, size_t *count) {
+    if (!repo || !hashes || !count) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    *hashes = NULL;
+    *count = 0;
+    size_t capacity = 0;
+
+    for (int bucket = 0; bucket < 256; bucket++) {
+        char dir_path[SVCS_MAX_PATH];
+        snprintf(dir_path, sizeof(dir_path), "%s/objects/%02x", repo->git_dir, bucket);
+
+        DIR *dir = opendir(dir_path);
+        if (!dir) {
+            continue;
+        }
+
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (!svcs_is_hex_string(entry->d_name, SVCS_HASH_HEX_SIZE - 3)) {
+                continue;
+            }
+
+            if (*count == capacity) {
+                capacity = capacity ? capacity * 2 : 256;
+                svcs_hash_t *grown = realloc(*hashes, capacity * sizeof(svcs_hash_t));
+                if (!grown) {
+                    closedir(dir);
+                    free(*hashes);
+                    *hashes = NULL;
+                    *count = 0;
+                    return SVCS_ERROR_MEMORY;
+                }
+                *hashes = grown;
+            }
+
+            char hash_str[SVCS_HASH_HEX_SIZE];
+            snprintf(hash_str, sizeof(hash_str), "%02x%s", bucket, entry->d_name);
+            svcs_hash_from_string(&(*hashes)[*count], hash_str);
+            (*count)++;
+        }
+
+        closedir(dir);
+    }
+
+    return SVCS_OK;
+}
@@ -0,0 +1,740 @@
+#include "svcs.h"
+#include "internal.h"
+#include <sys/mman.h>
+
+// Reachability bitmaps (pack-<hash>.bitmap next to the pack they index),
+// mapped read-only:
+//
+//   header   "SBMP", version, selected commit count, pack object count
+//            (4 bytes each), pack checksum
+//   entries  per selected commit: hash, offset of its bitmap (8 bytes),
+//            sorted by hash
+//   commits  EWAH bitmap of which objects are commits
+//   bitmaps  EWAH bitmap of everything each selected commit reaches
+//   checksum of everything above
+//
+// Bit i stands for object i of the pack in index (hash) order. Ref tips
+// and every BITMAP_COMMIT_INTERVAL-th commit by generation get a bitmap,
+// so answering a reachability question means walking at most a few
+// commits from each tip to the nearest bitmaps and ORing them in. Whole
+// sets then combine with AND and AND NOT instead of graph walks. Objects
+// outside the pack, such as commits made since the last gc, are walked
+// and kept in a hash set beside the bitmap.
+
+#define BITMAP_SIGNATURE "SBMP"
+#define BITMAP_VERSION 1
+#define BITMAP_HEADER_SIZE (16 + SVCS_HASH_SIZE)
+#define BITMAP_ENTRY_SIZE (SVCS_HASH_SIZE + 8)
+#define BITMAP_COMMIT_INTERVAL 100
+#define BITMAP_MODE_TREE 040000
+#define BITMAP_MODE_GITLINK 0160000
+
+struct svcs_pack_bitmap {
+    const uint8_t *map;
+    size_t size;
+    svcs_hash_t pack_checksum;
+    uint32_t entry_count;
+    uint32_t object_count;
+    const uint8_t *entries;
+    const uint8_t *commits;
+};
+
+// Stored bitmaps of selected commits, looked up by the walk below
+typedef svcs_error_t (*stored_bitmap_fn)(void *arg, const svcs_hash_t *commit, svcs_bitmap_t *bits, int *found);
+
+typedef struct {
+    svcs_repository_t *repo;
+    const svcs_pack_t *pack;  // Without a pack every object goes to outside
+    svcs_bitmap_t bits;       // Reached objects in the pack
+    svcs_hash_set_t outside;  // Reached objects that are not
+    int with_trees;           // Reach trees and blobs too, not just commits
+    stored_bitmap_fn stored;
+    void *stored_arg;
+    svcs_hash_t *stack;
+    size_t stack_count;
+    size_t stack_capacity;
+    svcs_hash_t *trees;       // Root trees of walked commits, walked last
+    size_t tree_count;
+    size_t tree_capacity;
+} reach_t;
+
+static void bitmap_path(const svcs_pack_t *pack, char *path, size_t path_size) {
+    const char *pack_path = svcs_pack_file(pack);
+    size_t len = strlen(pack_path);
+    snprintf(path, path_size, "%.*s.bitmap", (int)(len - 5), pack_path);
+}
+
+static int is_null_hash(const svcs_hash_t *hash) {
+    for (int i = 0; i < SVCS_HASH_SIZE; i++) {
+        if (hash->bytes[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void svcs_pack_bitmap_free(svcs_repository_t *repo) {
+    if (!repo || !repo->pack_bitmap) return;
+
+    munmap((void*)repo->pack_bitmap->map, repo->pack_bitmap->size);
+    free(repo->pack_bitmap);
+    repo->pack_bitmap = NULL;
+}
+
+static svcs_error_t load_bitmap(const svcs_pack_t *pack, const char *path, svcs_pack_bitmap_t **result) {
+    svcs_pack_bitmap_t *index = calloc(1, sizeof(svcs_pack_bitmap_t));
+    if (!index) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    svcs_error_t err = svcs_file_map(path, &index->map, &index->size);
+    if (err != SVCS_OK) {
+        free(index);
+        return err;
+    }
+
+    const uint8_t *map = index->map;
+    if (index->size < BITMAP_HEADER_SIZE + SVCS_HASH_SIZE ||
+        memcmp(map, BITMAP_SIGNATURE, 4) != 0 ||
+        svcs_get_be32(map + 4) != BITMAP_VERSION) {
+        err = SVCS_ERROR_CORRUPT;
+    } else {
+        index->entry_count = svcs_get_be32(map + 8);
+        index->object_count = svcs_get_be32(map + 12);
+        memcpy(index->pack_checksum.bytes, map + 16, SVCS_HASH_SIZE);
+        index->entries = map + BITMAP_HEADER_SIZE;
+        index->commits = index->entries + (size_t)index->entry_count * BITMAP_ENTRY_SIZE;
+
+        // Bitmaps of a different pack number different objects
+        if ((size_t)index->entry_count > (index->size - BITMAP_HEADER_SIZE - SVCS_HASH_SIZE) / BITMAP_ENTRY_SIZE ||
+            index->object_count != svcs_pack_object_count(pack) ||
+            svcs_hash_compare(&index->pack_checksum, svcs_pack_checksum(pack)) != 0) {
+            err = SVCS_ERROR_CORRUPT;
+        }
+    }
+
+    if (err != SVCS_OK) {
+        munmap((void*)index->map, index->size);
+        free(index);
+        return err;
+    }
+    *result = index;
+    return SVCS_OK;
+}
+
+// Map the bitmaps of the first pack that has them. Like the commit graph
+// they are only an accelerator, so a missing file is not an error.
+svcs_error_t svcs_pack_bitmap_load(svcs_repository_t *repo) {
+    if (!repo) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    svcs_pack_bitmap_free(repo);
+
+    for (svcs_pack_t *pack = svcs_pack_next(repo, NULL); pack; pack = svcs_pack_next(repo, pack)) {
+        char path[SVCS_MAX_PATH];
+        bitmap_path(pack, path, sizeof(path));
+        if (svcs_file_exists(path)) {
+            return load_bitmap(pack, path, &repo->pack_bitmap);
+        }
+    }
+    return SVCS_OK;
+}
+
+size_t svcs_pack_bitmap_count(svcs_repository_t *repo) {
+    return repo && repo->pack_bitmap ? repo->pack_bitmap->entry_count : 0;
+}
+
+// Reachability walks
+
+static svcs_error_t reach_init(reach_t *reach, svcs_repository_t *repo, const svcs_pack_t *pack, int with_trees) {
+    memset(reach, 0, sizeof(*reach));
+    reach->repo = repo;
+    reach->pack = pack;
+    reach->with_trees = with_trees;
+
+    svcs_error_t err = svcs_bitmap_init(&reach->bits, pack ? svcs_pack_object_count(pack) : 0);
+    if (err == SVCS_OK) {
+        err = svcs_hash_set_init(&reach->outside, 0);
+        if (err != SVCS_OK) {
+            svcs_bitmap_free(&reach->bits);
+        }
+    }
+    return err;
+}
+
+static void reach_free(reach_t *reach) {
+    svcs_bitmap_free(&reach->bits);
+    svcs_hash_set_free(&reach->outside);
+    free(reach->stack);
+    free(reach->trees);
+}
+
+static void reach_reset(reach_t *reach) {
+    memset(reach->bits.words, 0, reach->bits.word_count * sizeof(uint64_t));
+    svcs_hash_set_clear(&reach->outside);
+    reach->stack_count = 0;
+    reach->tree_count = 0;
+}
+
+static int reach_has(const reach_t *reach, const svcs_hash_t *hash) {
+    uint32_t pos;
+    if (reach->pack && svcs_pack_position(reach->pack, hash, &pos)) {
+        return svcs_bitmap_test(&reach->bits, pos);
+    }
+    return svcs_hash_set_contains(&reach->outside, hash);
+}
+
+static svcs_error_t reach_mark(reach_t *reach, const svcs_hash_t *hash, int *added) {
+    uint32_t pos;
+    if (reach->pack && svcs_pack_position(reach->pack, hash, &pos)) {
+        *added = !svcs_bitmap_test(&reach->bits, pos);
+        svcs_bitmap_set(&reach->bits, pos);
+        return SVCS_OK;
+    }
+    return svcs_hash_set_add(&reach->outside, hash, added);
+}
+
+static svcs_error_t hash_list_push(svcs_hash_t **items, size_t *count, size_t *capacity, const svcs_hash_t *hash) {
+    if (*count == *capacity) {
+        size_t grown_capacity = *capacity ? *capacity * 2 : 64;
+        svcs_hash_t *grown = realloc(*items, grown_capacity * sizeof(svcs_hash_t));
+        if (!grown) {
+            return SVCS_ERROR_MEMORY;
+        }
+        *items = grown;
+        *capacity = grown_capacity;
+    }
+    (*items)[(*count)++] = *hash;
+    return SVCS_OK;
+}
+
+static svcs_error_t reach_push(reach_t *reach, const svcs_hash_t *hash) {
+    return hash_list_push(&reach->stack, &reach->stack_count, &reach->stack_capacity, hash);
+}
+
+// Mark everything below a tree that has just been marked itself. Trees
+// are shallow, so plain recursion is fine here.
+static svcs_error_t reach_tree(reach_t *reach, const svcs_hash_t *tree) {
+    svcs_object_t *obj;
+    svcs_error_t err = svcs_object_read(reach->repo, tree, &obj);
+    if (err == SVCS_ERROR_NOT_FOUND) {
+        return SVCS_ERROR_CORRUPT;
+    }
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    const uint8_t *ptr = obj->data;
+    const uint8_t *end = ptr + obj->size;
+    while (ptr < end && err == SVCS_OK) {
+        const uint8_t *nul = memchr(ptr, '\0', end - ptr);
+        if (!nul || (size_t)(end - nul - 1) < SVCS_HASH_SIZE) {
+            err = SVCS_ERROR_CORRUPT;
+            break;
+        }
+
+        unsigned int mode = (unsigned int)strtoul((const char*)ptr, NULL, 8);
+        svcs_hash_t hash;
+        memcpy(hash.bytes, nul + 1, SVCS_HASH_SIZE);
+        ptr = nul + 1 + SVCS_HASH_SIZE;
+        if (mode == BITMAP_MODE_GITLINK) {
+            continue;
+        }
+
+        int added;
+        err = reach_mark(reach, &hash, &added);
+        if (err == SVCS_OK && added && mode == BITMAP_MODE_TREE) {
+            err = reach_tree(reach, &hash);
+        }
+    }
+
+    svcs_object_free(obj);
+    return err;
+}
+
+// Mark everything reachable from commits. A commit with a stored bitmap
+// is ORed in whole instead of walked. Trees are only walked once all
+// commits are done, so a tree some stored bitmap already covers is
+// skipped rather than read. If target is given the walk stops as soon as
+// it is reached.
+static svcs_error_t reach_commits(reach_t *reach, const svcs_hash_t *tips, size_t count, const svcs_hash_t *target) {
+    svcs_error_t err = SVCS_OK;
+    for (size_t i = 0; i < count && err == SVCS_OK; i++) {
+        err = reach_push(reach, &tips[i]);
+    }
+
+    while (err == SVCS_OK && reach->stack_count > 0) {
+        if (target && reach_has(reach, target)) {
+            break;
+        }
+
+        svcs_hash_t hash = reach->stack[--reach->stack_count];
+        if (reach_has(reach, &hash)) {
+            continue;
+        }
+
+        int found = 0;
+        if (reach->stored) {
+            err = reach->stored(reach->stored_arg, &hash, &reach->bits, &found);
+        }
+        if (err != SVCS_OK || found) {
+            continue;
+        }
+
+        int added;
+        svcs_commit_info_t info;
+        err = reach_mark(reach, &hash, &added);
+        if (err == SVCS_OK) {
+            err = svcs_commit_info(reach->repo, &hash, &info);
+        }
+        if (err == SVCS_OK && reach->with_trees && !is_null_hash(&info.tree)) {
+            err = hash_list_push(&reach->trees, &reach->tree_count, &reach->tree_capacity, &info.tree);
+        }
+        for (size_t p = 0; p < info.parent_count && err == SVCS_OK; p++) {
+            if (!reach_has(reach, &info.parents[p])) {
+                err = reach_push(reach, &info.parents[p]);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < reach->tree_count && err == SVCS_OK; i++) {
+        if (target && reach_has(reach, target)) {
+            break;
+        }
+
+        int added;
+        err = reach_mark(reach, &reach->trees[i], &added);
+        if (err == SVCS_OK && added) {
+            err = reach_tree(reach, &reach->trees[i]);
+        }
+    }
+    reach->tree_count = 0;
+    return err;
+}
+
+static svcs_error_t index_stored(void *arg, const svcs_hash_t *commit, svcs_bitmap_t *bits, int *found) {
+    const svcs_pack_bitmap_t *index = arg;
+    size_t lo = 0, hi = index->entry_count;
+    *found = 0;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const uint8_t *entry = index->entries + mid * BITMAP_ENTRY_SIZE;
+        int cmp = memcmp(entry, commit->bytes, SVCS_HASH_SIZE);
+        if (cmp == 0) {
+            uint64_t offset = svcs_get_be64(entry + SVCS_HASH_SIZE);
+            if (offset >= index->size - SVCS_HASH_SIZE) {
+                return SVCS_ERROR_CORRUPT;
+            }
+            *found = 1;
+            return svcs_ewah_or(index->map + offset, index->size - SVCS_HASH_SIZE - offset, bits, NULL);
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return SVCS_OK;
+}
+
+// Set up a walk that uses the stored bitmaps, if there are any
+static svcs_error_t reach_init_indexed(reach_t *reach, svcs_repository_t *repo, int with_trees) {
+    svcs_pack_bitmap_t *index = repo->pack_bitmap;
+    const svcs_pack_t *pack = index ? svcs_pack_by_checksum(repo, &index->pack_checksum) : NULL;
+
+    svcs_error_t err = reach_init(reach, repo, pack, with_trees);
+    if (err == SVCS_OK && pack) {
+        reach->stored = index_stored;
+        reach->stored_arg = index;
+    }
+    return err;
+}
+
+// Drop everything but commits from a walk's bitmap
+static svcs_error_t keep_commits(svcs_repository_t *repo, reach_t *reach) {
+    if (!reach->pack) {
+        return SVCS_OK;
+    }
+
+    const svcs_pack_bitmap_t *index = repo->pack_bitmap;
+    svcs_bitmap_t commits;
+    svcs_error_t err = svcs_bitmap_init(&commits, index->object_count);
+    if (err == SVCS_OK) {
+        err = svcs_ewah_or(index->commits, index->size - SVCS_HASH_SIZE - (size_t)(index->commits - index->map),
+                           &commits, NULL);
+    }
+    if (err == SVCS_OK) {
+        svcs_bitmap_and(&reach->bits, &commits);
+    }
+    svcs_bitmap_free(&commits);
+    return err;
+}
+
+// Objects outside the pack that one walk reached and another did not
+static size_t count_outside_only(const reach_t *reach, const reach_t *other) {
+    size_t count = 0;
+    for (size_t i = 0; i < reach->outside.slot_count; i++) {
+        if (reach->outside.used[i] && !svcs_hash_set_contains(&other->outside, &reach->outside.slots[i])) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Sets *ahead to the number of commits reachable from one but not from
+// two, and *behind to the reverse
+svcs_error_t svcs_commit_ahead_behind(svcs_repository_t *repo, const svcs_hash_t *one, const svcs_hash_t *two,
+                                      size_t *ahead, size_t *behind) {
+    if (!repo || !one || !two || !ahead || !behind) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    reach_t from_one, from_two;
+    svcs_error_t err = reach_init_indexed(&from_one, repo, 0);
+    if (err != SVCS_OK) {
+        return err;
+    }
+    err = reach_init_indexed(&from_two, repo, 0);
+    if (err != SVCS_OK) {
+        reach_free(&from_one);
+        return err;
+    }
+
+    err = reach_commits(&from_one, one, 1, NULL);
+    if (err == SVCS_OK) err = reach_commits(&from_two, two, 1, NULL);
+    if (err == SVCS_OK) err = keep_commits(repo, &from_one);
+    if (err == SVCS_OK) err = keep_commits(repo, &from_two);
+
+    if (err == SVCS_OK) {
+        *ahead = count_outside_only(&from_one, &from_two);
+        *behind = count_outside_only(&from_two, &from_one);
+
+        // The walks can be reused as scratch space now
+        svcs_bitmap_t one_only = from_one.bits;
+        svcs_bitmap_t two_only = from_two.bits;
+        for (size_t i = 0; i < one_only.word_count; i++) {
+            uint64_t a = one_only.words[i], b = two_only.words[i];
+            one_only.words[i] = a & ~b;
+            two_only.words[i] = b & ~a;
+        }
+        *ahead += svcs_bitmap_count(&one_only);
+        *behind += svcs_bitmap_count(&two_only);
+    }
+
+    reach_free(&from_one);
+    reach_free(&from_two);
+    return err;
+}
+
+// Every object reachable from the wanted commits but not from the ones the
+// other side already has, which is what a push or fetch has to send
+svcs_error_t svcs_objects_to_send(svcs_repository_t *repo, const svcs_hash_t *want, size_t want_count,
+                                  const svcs_hash_t *have, size_t have_count,
+                                  svcs_hash_t **objects, size_t *count) {
+    if (!repo || (!want && want_count) || (!have && have_count) || !objects || !count) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    *objects = NULL;
+    *count = 0;
+
+    reach_t wanted, had;
+    svcs_error_t err = reach_init_indexed(&wanted, repo, 1);
+    if (err != SVCS_OK) {
+        return err;
+    }
+    err = reach_init_indexed(&had, repo, 1);
+    if (err != SVCS_OK) {
+        reach_free(&wanted);
+        return err;
+    }
+
+    err = reach_commits(&wanted, want, want_count, NULL);
+    if (err == SVCS_OK) {
+        err = reach_commits(&had, have, have_count, NULL);
+    }
+
+    svcs_hash_t *result = NULL;
+    size_t n = 0;
+    if (err == SVCS_OK) {
+        svcs_bitmap_and_not(&wanted.bits, &had.bits);
+        size_t total = svcs_bitmap_count(&wanted.bits) + count_outside_only(&wanted, &had);
+        result = malloc((total ? total : 1) * sizeof(svcs_hash_t));
+        if (!result) {
+            err = SVCS_ERROR_MEMORY;
+        }
+    }
+
+    if (err == SVCS_OK) {
+        for (size_t w = 0; w < wanted.bits.word_count; w++) {
+            uint64_t word = wanted.bits.words[w];
+            while (word) {
+                uint32_t pos = (uint32_t)(w * 64 + (size_t)__builtin_ctzll(word));
+                svcs_pack_hash_at(wanted.pack, pos, &result[n++]);
+                word &= word - 1;
+            }
+        }
+        for (size_t i = 0; i < wanted.outside.slot_count; i++) {
+            if (wanted.outside.used[i] && !svcs_hash_set_contains(&had.outside, &wanted.outside.slots[i])) {
+                result[n++] = wanted.outside.slots[i];
+            }
+        }
+        *objects = result;
+        *count = n;
+    }
+
+    reach_free(&wanted);
+    reach_free(&had);
+    return err;
+}
+
+// Answers whether descendant reaches ancestor from the stored bitmaps.
+// Returns -1 if they cannot tell, e.g. when there are none or ancestor is
+// newer than the pack.
+int svcs_pack_bitmap_reaches(svcs_repository_t *repo, const svcs_hash_t *ancestor, const svcs_hash_t *descendant) {
+    svcs_pack_bitmap_t *index = repo->pack_bitmap;
+    const svcs_pack_t *pack = index ? svcs_pack_by_checksum(repo, &index->pack_checksum) : NULL;
+    uint32_t pos;
+    if (!pack || !svcs_pack_position(pack, ancestor, &pos)) {
+        return -1;
+    }
+
+    reach_t reach;
+    if (reach_init_indexed(&reach, repo, 0) != SVCS_OK) {
+        return -1;
+    }
+
+    int result = -1;
+    if (reach_commits(&reach, descendant, 1, ancestor) == SVCS_OK) {
+        result = svcs_bitmap_test(&reach.bits, pos);
+    }
+    reach_free(&reach);
+    return result;
+}
+
+// Writing
+
+typedef struct {
+    svcs_hash_t hash;
+    uint32_t generation;
+    int done;
+    uint64_t offset;  // Into the bitmap data
+} selected_commit_t;
+
+typedef struct {
+    selected_commit_t *commits;  // Sorted by hash
+    size_t count;
+    const svcs_buffer_t *data;
+} selection_t;
+
+static int compare_selected(const void *a, const void *b) {
+    return svcs_hash_compare(&((const selected_commit_t*)a)->hash, &((const selected_commit_t*)b)->hash);
+}
+
+static selected_commit_t* find_selected(const selection_t *selection, const svcs_hash_t *hash) {
+    selected_commit_t key = { .hash = *hash };
+    return bsearch(&key, selection->commits, selection->count, sizeof(selected_commit_t), compare_selected);
+}
+
+// Bitmaps already computed for commits earlier in generation order
+static svcs_error_t selection_stored(void *arg, const svcs_hash_t *commit, svcs_bitmap_t *bits, int *found) {
+    const selection_t *selection = arg;
+    const selected_commit_t *selected = find_selected(selection, commit);
+    *found = selected && selected->done;
+    if (!*found) {
+        return SVCS_OK;
+    }
+    return svcs_ewah_or(selection->data->data + selected->offset, selection->data->size - selected->offset,
+                        bits, NULL);
+}
+
+typedef struct {
+    svcs_hash_t hash;
+    uint32_t generation;
+} generation_entry_t;
+
+static int compare_generations(const void *a, const void *b) {
+    const generation_entry_t *x = a, *y = b;
+    if (x->generation != y->generation) {
+        return x->generation < y->generation ? -1 : 1;
+    }
+    return svcs_hash_compare(&x->hash, &y->hash);
+}
+
+static svcs_error_t add_tip(const svcs_hash_t *hash, void *arg) {
+    return svcs_hash_set_add(arg, hash, NULL);
+}
+
+// Pick the commits to store bitmaps for, in the order to compute them
+static svcs_error_t select_commits(svcs_repository_t *repo, selection_t *selection, generation_entry_t **order) {
+    size_t commit_count = svcs_commit_graph_count(repo);
+    generation_entry_t *commits = malloc((commit_count ? commit_count : 1) * sizeof(generation_entry_t));
+    if (!commits) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    svcs_hash_set_t tips;
+    svcs_error_t err = svcs_hash_set_init(&tips, 0);
+    if (err == SVCS_OK) {
+        err = svcs_refs_for_each(repo, add_tip, &tips);
+    }
+    for (size_t i = 0; i < commit_count && err == SVCS_OK; i++) {
+        svcs_commit_info_t info;
+        err = svcs_commit_graph_entry(repo, i, &commits[i].hash, &info);
+        commits[i].generation = info.generation;
+    }
+
+    size_t selected = 0;
+    if (err == SVCS_OK) {
+        qsort(commits, commit_count, sizeof(generation_entry_t), compare_generations);
+        for (size_t i = 0; i < commit_count; i++) {
+            if (svcs_hash_set_contains(&tips, &commits[i].hash) ||
+                i % BITMAP_COMMIT_INTERVAL == BITMAP_COMMIT_INTERVAL - 1) {
+                commits[selected++] = commits[i];
+            }
+        }
+
+        selection->commits = calloc(selected ? selected : 1, sizeof(selected_commit_t));
+        if (!selection->commits) {
+            err = SVCS_ERROR_MEMORY;
+        }
+    }
+    svcs_hash_set_free(&tips);
+
+    if (err != SVCS_OK) {
+        free(commits);
+        return err;
+    }
+
+    for (size_t i = 0; i < selected; i++) {
+        selection->commits[i].hash = commits[i].hash;
+        selection->commits[i].generation = commits[i].generation;
+    }
+    selection->count = selected;
+    qsort(selection->commits, selected, sizeof(selected_commit_t), compare_selected);
+    *order = commits;
+    return SVCS_OK;
+}
+
+static svcs_error_t commit_mask(svcs_repository_t *repo, const svcs_pack_t *pack, svcs_buffer_t *buf) {
+    svcs_bitmap_t commits;
+    svcs_error_t err = svcs_bitmap_init(&commits, svcs_pack_object_count(pack));
+    for (size_t i = 0; i < svcs_commit_graph_count(repo) && err == SVCS_OK; i++) {
+        svcs_hash_t hash;
+        svcs_commit_info_t info;
+        uint32_t pos;
+        err = svcs_commit_graph_entry(repo, i, &hash, &info);
+        if (err == SVCS_OK && svcs_pack_position(pack, &hash, &pos)) {
+            svcs_bitmap_set(&commits, pos);
+        }
+    }
+    if (err == SVCS_OK) {
+        err = svcs_ewah_encode(&commits, buf);
+    }
+    svcs_bitmap_free(&commits);
+    return err;
+}
+
+static svcs_error_t serialize_bitmaps(const svcs_pack_t *pack, const selection_t *selection,
+                                      const svcs_buffer_t *mask, const svcs_buffer_t *data, svcs_buffer_t *buf) {
+    uint8_t word[8];
+    svcs_error_t err = svcs_buffer_append(buf, BITMAP_SIGNATURE, 4);
+    svcs_put_be32(word, BITMAP_VERSION);
+    if (err == SVCS_OK) err = svcs_buffer_append(buf, word, 4);
+    svcs_put_be32(word, (uint32_t)selection->count);
+    if (err == SVCS_OK) err = svcs_buffer_append(buf, word, 4);
+    svcs_put_be32(word, svcs_pack_object_count(pack));
+    if (err == SVCS_OK) err = svcs_buffer_append(buf, word, 4);
+    if (err == SVCS_OK) err = svcs_buffer_append(buf, svcs_pack_checksum(pack)->bytes, SVCS_HASH_SIZE);
+
+    uint64_t data_start = BITMAP_HEADER_SIZE + (uint64_t)selection->count * BITMAP_ENTRY_SIZE + mask->size;
+    for (size_t i = 0; i < selection->count && err == SVCS_OK; i++) {
+        err = svcs_buffer_append(buf, selection->commits[i].hash.bytes, SVCS_HASH_SIZE);
+        svcs_put_be64(word, data_start + selection->commits[i].offset);
+        if (err == SVCS_OK) err = svcs_buffer_append(buf, word, 8);
+    }
+
+    if (err == SVCS_OK) err = svcs_buffer_append(buf, mask->data, mask->size);
+    if (err == SVCS_OK) err = svcs_buffer_append(buf, data->data, data->size);
+
+    if (err == SVCS_OK) {
+        svcs_hash_t checksum;
+        svcs_hash_update(&checksum, buf->data, buf->size);
+        err = svcs_buffer_append(buf, checksum.bytes, SVCS_HASH_SIZE);
+    }
+    return err;
+}
+
+// Write bitmaps for the pack named by pack_hash, which must hold every
+// object reachable from refs. Commits are taken from the commit graph, so
+// it has to be current.
+svcs_error_t svcs_pack_bitmap_write(svcs_repository_t *repo, const svcs_hash_t *pack_hash, size_t *count) {
+    if (!repo || !pack_hash) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    const svcs_pack_t *pack = svcs_pack_by_checksum(repo, pack_hash);
+    if (!pack) {
+        return SVCS_ERROR_NOT_FOUND;
+    }
+
+    svcs_buffer_t data = {0};
+    selection_t selection = { .data = &data };
+    generation_entry_t *order = NULL;
+    svcs_error_t err = select_commits(repo, &selection, &order);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    // Ancestors come first, so each walk stops at bitmaps already made
+    reach_t reach;
+    err = reach_init(&reach, repo, pack, 1);
+    if (err == SVCS_OK) {
+        reach.stored = selection_stored;
+        reach.stored_arg = &selection;
+        for (size_t i = 0; i < selection.count && err == SVCS_OK; i++) {
+            selected_commit_t *selected = find_selected(&selection, &order[i].hash);
+            reach_reset(&reach);
+            err = reach_commits(&reach, &selected->hash, 1, NULL);
+            if (err == SVCS_OK && reach.outside.count > 0) {
+                err = SVCS_ERROR_INVALID; // The pack is missing reachable objects
+            }
+            if (err == SVCS_OK) {
+                selected->offset = data.size;
+                err = svcs_ewah_encode(&reach.bits, &data);
+                selected->done = err == SVCS_OK;
+            }
+        }
+        reach_free(&reach);
+    }
+    free(order);
+
+    svcs_buffer_t mask = {0};
+    svcs_buffer_t buf = {0};
+    if (err == SVCS_OK) {
+        err = commit_mask(repo, pack, &mask);
+    }
+    if (err == SVCS_OK) {
+        err = serialize_bitmaps(pack, &selection, &mask, &data, &buf);
+    }
+    svcs_buffer_free(&mask);
+    svcs_buffer_free(&data);
+
+    char path[SVCS_MAX_PATH];
+    bitmap_path(pack, path, sizeof(path));
+    if (err == SVCS_OK) {
+        err = svcs_repo_write_file(repo, path, buf.data, buf.size);
+    }
+    svcs_buffer_free(&buf);
+
+    if (err == SVCS_OK && !repo->write_batch) {
+        err = svcs_pack_bitmap_load(repo);
+    }
+    if (err == SVCS_OK && count) {
+        *count = selection.count;
+    }
+    free(selection.commits);
+    return err;
+}
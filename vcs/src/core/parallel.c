@@ -0,0 +1,83 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "svcs.h"
+#include "internal.h"
+#include <pthread.h>
+#include <unistd.h>
+
+// Work is handed out one item at a time from a shared counter, so slow
+// items (large files) do not leave other workers idle behind a static split.
+
+#define PARALLEL_MAX_WORKERS 32
+
+typedef struct {
+    svcs_parallel_fn fn;
+    void *arg;
+    size_t count;
+    size_t next;
+    pthread_mutex_t lock;
+} parallel_job_t;
+
+static void* parallel_worker(void *ptr) {
+    parallel_job_t *job = ptr;
+
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        size_t i = job->next++;
+        pthread_mutex_unlock(&job->lock);
+
+        if (i >= job->count) {
+            break;
+        }
+        job->fn(job->arg, i);
+    }
+
+    return NULL;
+}
+
+size_t svcs_parallel_workers(size_t count, size_t min_items_per_worker) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t workers = cpus > 0 ? (size_t)cpus : 1;
+
+    if (workers > PARALLEL_MAX_WORKERS) {
+        workers = PARALLEL_MAX_WORKERS;
+    }
+    if (min_items_per_worker > 0 && workers > count / min_items_per_worker) {
+        workers = count / min_items_per_worker;
+    }
+    return workers ? workers : 1;
+}
+
+void svcs_parallel_for(size_t count, size_t min_items_per_worker, svcs_parallel_fn fn, void *arg) {
+    if (count == 0 || !fn) {
+        return;
+    }
+
+    parallel_job_t job = {
+        .fn = fn,
+        .arg = arg,
+        .count = count,
+        .next = 0
+    };
+    pthread_mutex_init(&job.lock, NULL);
+
+    size_t workers = svcs_parallel_workers(count, min_items_per_worker);
+    pthread_t threads[PARALLEL_MAX_WORKERS];
+    size_t started = 0;
+
+    // The calling thread is one of the workers
+    for (size_t t = 1; t < workers; t++) {
+        if (pthread_create(&threads[started], NULL, parallel_worker, &job) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    parallel_worker(&job);
+
+    for (size_t t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    pthread_mutex_destroy(&job.lock);
+}
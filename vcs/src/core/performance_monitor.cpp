@@ -366,6 +366,37 @@ void CacheMonitor::update_size(const std::string& cache_name, size_t current, si
     stats.max_size = max;
 }
 
+void CacheMonitor::attach(svcs_repository_t* repo, const std::string& cache_name) {
+    if (!repo) return;
+    
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        attachments_[repo] = cache_name;
+    }
+    poll();
+}
+
+void CacheMonitor::detach(svcs_repository_t* repo) {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    attachments_.erase(repo);
+}
+
+// The cache counts on its own without locking; reading its counters here
+// keeps the monitor off the read path
+void CacheMonitor::poll() {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    for (const auto& [repo, cache_name] : attachments_) {
+        svcs_cache_stats_t cache;
+        svcs_object_cache_stats(repo, &cache);
+        auto& stats = cache_stats_[cache_name];
+        stats.hits = cache.hits;
+        stats.misses = cache.misses;
+        stats.evictions = cache.evictions;
+        stats.current_size = cache.size;
+        stats.max_size = cache.max_size;
+    }
+}
+
 CacheMonitor::CacheStats CacheMonitor::get_stats(const std::string& cache_name) const {
     std::lock_guard<std::mutex> lock(stats_mutex_);
     auto it = cache_stats_.find(cache_name);
@@ -6,6 +6,8 @@
 #include <vector>
 #include <memory>
 #include <atomic>
+#include <mutex>
+#include "svcs.h"
 
 namespace svcs {
 
@@ -162,6 +164,14 @@ public:
     void record_eviction(const std::string& cache_name);
     void update_size(const std::string& cache_name, size_t current, size_t max);
     
+    // Report a repository's object cache under cache_name. The monitor must
+    // outlive the repository or be detached first.
+    void attach(svcs_repository_t* repo, const std::string& cache_name = "objects");
+    void detach(svcs_repository_t* repo);
+    
+    // Copy the counters of every attached cache into its stats
+    void poll();
+    
     CacheStats get_stats(const std::string& cache_name) const;
     std::map<std::string, CacheStats> get_all_stats() const;
     
@@ -169,6 +179,7 @@ public:
     
 private:
     std::map<std::string, CacheStats> cache_stats_;
+    std::map<svcs_repository_t*, std::string> attachments_;
     mutable std::mutex stats_mutex_;
 };
 
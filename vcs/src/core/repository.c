@@ -1,4 +1,5 @@
 #include "svcs.h"
+#include "internal.h"
 #include <unistd.h>
 
 svcs_error_t svcs_repository_init(const char *path) {
@@ -29,6 +30,18 @@ svcs_error_t svcs_repository_init(const char *path) {
         return SVCS_ERROR_IO;
     }
     
+    // Record the repository format; new repositories address objects by BLAKE3
+    char config_file[SVCS_MAX_PATH];
+    snprintf(config_file, sizeof(config_file), "%s/config", git_dir);
+    char config_content[256];
+    snprintf(config_content, sizeof(config_content),
+             "[core]\n\trepositoryformatversion = %d\n\tobjecthash = %s\n\tcompression = %s\n",
+             SVCS_REPOSITORY_FORMAT_VERSION, svcs_hash_algo_name(SVCS_HASH_BLAKE3),
+             svcs_codec_name(svcs_codec_default()));
+    if (svcs_file_write(config_file, config_content, strlen(config_content)) != SVCS_OK) {
+        return SVCS_ERROR_IO;
+    }
+    
     // Create empty index file
     char index_file[SVCS_MAX_PATH];
     snprintf(index_file, sizeof(index_file), "%s/index", git_dir);
@@ -40,6 +53,46 @@ svcs_error_t svcs_repository_init(const char *path) {
     return SVCS_OK;
 }
 
+// Version 0 repositories have no core.objecthash and always use SHA3-256
+static svcs_error_t load_repository_format(svcs_repository_t *repo) {
+    char value[64];
+    repo->hash_algo = SVCS_HASH_SHA3_256;
+    
+    if (svcs_config_get(repo, "core.repositoryformatversion", value, sizeof(value)) == SVCS_OK &&
+        atoi(value) > SVCS_REPOSITORY_FORMAT_VERSION) {
+        return SVCS_ERROR_INVALID;
+    }
+    
+    svcs_error_t err = svcs_config_get(repo, "core.objecthash", value, sizeof(value));
+    if (err == SVCS_ERROR_NOT_FOUND) {
+        return SVCS_OK;
+    }
+    if (err != SVCS_OK) {
+        return err;
+    }
+    
+    return svcs_hash_algo_from_name(value, &repo->hash_algo);
+}
+
+// core.objectcachesize takes a byte count with an optional k, m or g suffix
+static size_t object_cache_size(svcs_repository_t *repo) {
+    char value[64];
+    if (svcs_config_get(repo, "core.objectcachesize", value, sizeof(value)) != SVCS_OK) {
+        return SVCS_OBJECT_CACHE_DEFAULT_SIZE;
+    }
+    
+    char *end;
+    unsigned long long size = strtoull(value, &end, 10);
+    switch (*end) {
+        case 'g': case 'G': size <<= 10; // fall through
+        case 'm': case 'M': size <<= 10; // fall through
+        case 'k': case 'K': size <<= 10; break;
+        case '\0': break;
+        default: return SVCS_OBJECT_CACHE_DEFAULT_SIZE;
+    }
+    return size > SIZE_MAX ? SIZE_MAX : (size_t)size;
+}
+
 svcs_error_t svcs_repository_open(svcs_repository_t **repo, const char *path) {
     if (!repo || !path) {
         return SVCS_ERROR_INVALID;
@@ -63,13 +116,39 @@ svcs_error_t svcs_repository_open(svcs_repository_t **repo, const char *path) {
             strncpy((*repo)->git_dir, git_dir, sizeof((*repo)->git_dir) - 1);
             strncpy((*repo)->work_dir, current_path, sizeof((*repo)->work_dir) - 1);
             
+            // Refuse repositories written with a format we do not understand
+            svcs_error_t err = load_repository_format(*repo);
+            if (err != SVCS_OK) {
+                free(*repo);
+                *repo = NULL;
+                return err;
+            }
+            
+            // Codec settings and compression dictionaries
+            err = svcs_codec_load(*repo);
+            if (err != SVCS_OK) {
+                free(*repo);
+                *repo = NULL;
+                return err;
+            }
+            
             // Load index
             if (svcs_index_load(*repo) != SVCS_OK) {
+                svcs_codec_free(*repo);
                 free(*repo);
                 *repo = NULL;
                 return SVCS_ERROR_CORRUPT;
             }
             
+            // Map pack indexes so object lookups can skip loose files
+            svcs_pack_load_all(*repo);
+            svcs_commit_graph_load(*repo);
+            svcs_pack_bitmap_load(*repo);
+            
+            // Both caches are optional, so failing to create them is not fatal
+            svcs_object_cache_new(object_cache_size(*repo), &(*repo)->object_cache);
+            svcs_loose_cache_new(&(*repo)->loose_cache);
+            
             return SVCS_OK;
         }
         
@@ -90,17 +169,22 @@ svcs_error_t svcs_repository_open(svcs_repository_t **repo, const char *path) {
 void svcs_repository_free(svcs_repository_t *repo) {
     if (!repo) return;
     
-    if (repo->index) {
-        if (repo->index->entries) {
-            free(repo->index->entries);
-        }
-        free(repo->index);
-    }
+    svcs_index_free(repo->index);
     
     if (repo->current_branch) {
         free(repo->current_branch);
     }
     
+    // Writes never committed are discarded
+    svcs_write_batch_abort(repo);
+    
+    svcs_pack_free_all(repo);
+    svcs_commit_graph_free(repo);
+    svcs_pack_bitmap_free(repo);
+    svcs_codec_free(repo);
+    svcs_object_cache_free(repo->object_cache);
+    svcs_loose_cache_free(repo->loose_cache);
+    
     free(repo);
 }
 
@@ -0,0 +1,473 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "svcs.h"
+#include "internal.h"
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Sparse checkout in cone mode. .svcs/info/sparse-checkout lists
+// directories relative to the worktree, one per line. The worktree holds
+// the files at the top level, everything under the listed directories and
+// the files directly inside their parents. Any other directory is removed
+// from the worktree and kept in the index as one entry with mode 040000
+// and the hash of its tree, so the index, status and commits only deal
+// with the checked-out part.
+//
+// Changing the cone expands the collapsed entries the new cone reaches
+// into and checks their files out, then collapses everything outside it
+// again. Nothing is changed unless every file to be removed matches the
+// index and every file to be written is either missing or already right.
+
+#define SPARSE_CHECKOUT_FILE "info/sparse-checkout"
+
+typedef struct {
+    svcs_index_entry_t entry;
+    int from_tree;  // Expanded from a collapsed entry, so not in the worktree
+} sparse_item_t;
+
+typedef struct {
+    svcs_repository_t *repo;
+    const char *const *cone;  // Sorted; NULL for the full worktree
+    size_t cone_count;
+    sparse_item_t *items;
+    size_t count;
+    size_t capacity;
+} sparse_ctx_t;
+
+// Whether a directory is checked out: it is inside a cone directory or
+// leads to one
+static int dir_needed(const sparse_ctx_t *ctx, const char *dir, size_t len) {
+    if (!ctx->cone || len == 0) {
+        return 1;
+    }
+    for (size_t i = 0; i < ctx->cone_count; i++) {
+        const char *cone = ctx->cone[i];
+        size_t cone_len = strlen(cone);
+        size_t common = len < cone_len ? len : cone_len;
+        if (strncmp(dir, cone, common) == 0 &&
+            (len == cone_len || (len > cone_len ? dir[cone_len] : cone[len]) == '/')) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Length of the outermost directory of rel that is not checked out, or 0
+// if rel is checked out
+static size_t collapse_root(const sparse_ctx_t *ctx, const char *rel, int is_dir) {
+    for (const char *slash = strchr(rel, '/'); slash; slash = strchr(slash + 1, '/')) {
+        if (!dir_needed(ctx, rel, (size_t)(slash - rel))) {
+            return (size_t)(slash - rel);
+        }
+    }
+    size_t len = strlen(rel);
+    return is_dir && !dir_needed(ctx, rel, len) ? len : 0;
+}
+
+static void full_path(const svcs_repository_t *repo, char *out, size_t size, const char *rel) {
+    if (strcmp(repo->work_dir, ".") == 0) {
+        snprintf(out, size, "%s", rel);
+    } else {
+        snprintf(out, size, "%s/%s", repo->work_dir, rel);
+    }
+}
+
+static svcs_error_t push_item(sparse_ctx_t *ctx, const svcs_index_entry_t *entry, int from_tree) {
+    if (ctx->count == ctx->capacity) {
+        size_t capacity = ctx->capacity ? ctx->capacity * 2 : 64;
+        sparse_item_t *grown = realloc(ctx->items, capacity * sizeof(sparse_item_t));
+        if (!grown) {
+            return SVCS_ERROR_MEMORY;
+        }
+        ctx->items = grown;
+        ctx->capacity = capacity;
+    }
+    ctx->items[ctx->count].entry = *entry;
+    ctx->items[ctx->count++].from_tree = from_tree;
+    return SVCS_OK;
+}
+
+// Adds the tree's files, and its directories still outside the cone as
+// collapsed entries
+static svcs_error_t expand_tree(sparse_ctx_t *ctx, const char *dir, const svcs_hash_t *hash) {
+    svcs_object_t *tree;
+    svcs_error_t err = svcs_object_read(ctx->repo, hash, &tree);
+    if (err != SVCS_OK) {
+        return err == SVCS_ERROR_NOT_FOUND ? SVCS_ERROR_CORRUPT : err;
+    }
+    if (tree->type != SVCS_OBJ_TREE) {
+        svcs_object_free(tree);
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    size_t offset = 0;
+    svcs_tree_item_t item;
+    while ((err = svcs_tree_next(tree, &offset, &item)) == SVCS_OK) {
+        char rel[SVCS_MAX_PATH];
+        char path[SVCS_MAX_PATH];
+        snprintf(rel, sizeof(rel), "%s/%s", dir, item.name);
+        if (S_ISDIR(item.mode) && dir_needed(ctx, rel, strlen(rel))) {
+            err = expand_tree(ctx, rel, &item.hash);
+        } else {
+            full_path(ctx->repo, path, sizeof(path), rel);
+            svcs_index_entry_t entry = {
+                .path = svcs_index_intern_path(ctx->repo->index, path),
+                .hash = item.hash,
+                .mode = item.mode,
+                .status = SVCS_STATUS_ADDED
+            };
+            err = entry.path ? push_item(ctx, &entry, !S_ISDIR(item.mode)) : SVCS_ERROR_MEMORY;
+        }
+        if (err != SVCS_OK) {
+            break;
+        }
+    }
+    svcs_object_free(tree);
+    return err == SVCS_ERROR_NOT_FOUND ? SVCS_OK : err;
+}
+
+static int compare_items(const void *a, const void *b) {
+    return strcmp(((const sparse_item_t*)a)->entry.path, ((const sparse_item_t*)b)->entry.path);
+}
+
+// Items from first up to the end of the run under the directory rel[0..len)
+static size_t group_end(const sparse_ctx_t *ctx, size_t first, const char *rel, size_t len) {
+    size_t end = first;
+    while (end < ctx->count) {
+        const char *other = svcs_worktree_path(ctx->repo, ctx->items[end].entry.path);
+        if (!other || strncmp(other, rel, len) != 0 || (other[len] != '\0' && other[len] != '/')) {
+            break;
+        }
+        end++;
+    }
+    return end;
+}
+
+// Replaces a run of items below one directory with a single entry
+static svcs_error_t collapse_group(sparse_ctx_t *ctx, size_t first, size_t end, const char *rel, size_t len,
+                                   svcs_index_entry_t *collapsed) {
+    const svcs_index_entry_t *only = &ctx->items[first].entry;
+    char dir[SVCS_MAX_PATH];
+    char path[SVCS_MAX_PATH];
+    snprintf(dir, sizeof(dir), "%.*s", (int)len, rel);
+    full_path(ctx->repo, path, sizeof(path), dir);
+
+    // Already collapsed there
+    if (end == first + 1 && S_ISDIR(only->mode) && strcmp(only->path, path) == 0) {
+        *collapsed = *only;
+        return SVCS_OK;
+    }
+
+    svcs_index_entry_t *entries = malloc((end - first) * sizeof(svcs_index_entry_t));
+    if (!entries) {
+        return SVCS_ERROR_MEMORY;
+    }
+    svcs_error_t err = SVCS_OK;
+    for (size_t i = first; i < end; i++) {
+        const char *name = svcs_worktree_path(ctx->repo, ctx->items[i].entry.path) + len;
+        if (name[0] != '/') {
+            // A collapsed entry for the directory next to entries inside it
+            err = SVCS_ERROR_CORRUPT;
+            break;
+        }
+        entries[i - first] = ctx->items[i].entry;
+    }
+
+    // The same trees a commit of the full worktree would hold
+    memset(collapsed, 0, sizeof(*collapsed));
+    if (err == SVCS_OK) {
+        err = svcs_tree_build(ctx->repo, entries, end - first, strlen(path) + 1, &collapsed->hash);
+    }
+    free(entries);
+    if (err != SVCS_OK) {
+        return err;
+    }
+
+    collapsed->path = svcs_index_intern_path(ctx->repo->index, path);
+    collapsed->mode = SVCS_TREE_MODE_DIR;
+    collapsed->status = SVCS_STATUS_ADDED;
+    return collapsed->path ? SVCS_OK : SVCS_ERROR_MEMORY;
+}
+
+static svcs_error_t checkout_file(svcs_repository_t *repo, svcs_index_entry_t *entry) {
+    svcs_object_t *blob;
+    svcs_error_t err = svcs_object_read(repo, &entry->hash, &blob);
+    if (err != SVCS_OK) {
+        return err == SVCS_ERROR_NOT_FOUND ? SVCS_ERROR_CORRUPT : err;
+    }
+
+    char dir[SVCS_MAX_PATH];
+    snprintf(dir, sizeof(dir), "%s", entry->path);
+    char *slash = strrchr(dir, '/');
+    if (slash && slash != dir) {
+        *slash = '\0';
+        err = svcs_mkdir_recursive(dir);
+    }
+    if (err == SVCS_OK) {
+        err = svcs_file_write(entry->path, blob->data, blob->size);
+    }
+    svcs_object_free(blob);
+
+    struct stat st;
+    if (err == SVCS_OK && (entry->mode & 0111) && chmod(entry->path, entry->mode & 07777) != 0) {
+        err = SVCS_ERROR_IO;
+    }
+    if (err == SVCS_OK && lstat(entry->path, &st) != 0) {
+        err = SVCS_ERROR_IO;
+    }
+    if (err == SVCS_OK) {
+        svcs_index_entry_set_stat(entry, &st);
+    }
+    return err;
+}
+
+// Removes the file, then its directories as they become empty
+static void remove_file(const svcs_repository_t *repo, const char *path) {
+    if (unlink(path) != 0) {
+        return;
+    }
+    char dir[SVCS_MAX_PATH];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash;
+    while ((slash = strrchr(dir, '/')) != NULL && slash != dir) {
+        *slash = '\0';
+        if (strcmp(dir, repo->work_dir) == 0 || rmdir(dir) != 0) {
+            break;
+        }
+    }
+}
+
+// A file about to be checked out may already be there with the right
+// content; *missing tells whether it is not there at all
+static int checkout_clear(svcs_repository_t *repo, const svcs_index_entry_t *entry, char *missing) {
+    struct stat st;
+    *missing = 0;
+    if (lstat(entry->path, &st) != 0) {
+        *missing = errno == ENOENT;
+        return *missing;
+    }
+    svcs_hash_t hash;
+    return S_ISREG(st.st_mode) && svcs_hash_file_algo(repo->hash_algo, entry->path, &hash) == SVCS_OK &&
+           svcs_hash_compare(&hash, &entry->hash) == 0;
+}
+
+static svcs_error_t write_cone(svcs_repository_t *repo, const char *const *dirs, size_t count) {
+    char path[SVCS_MAX_PATH];
+    snprintf(path, sizeof(path), "%s/%s", repo->git_dir, SPARSE_CHECKOUT_FILE);
+
+    svcs_buffer_t buf = {0};
+    svcs_error_t err = SVCS_OK;
+    for (size_t i = 0; i < count && err == SVCS_OK; i++) {
+        err = svcs_buffer_append(&buf, dirs[i], strlen(dirs[i]));
+        if (err == SVCS_OK) {
+            err = svcs_buffer_append(&buf, "\n", 1);
+        }
+    }
+
+    char info_dir[SVCS_MAX_PATH];
+    snprintf(info_dir, sizeof(info_dir), "%s/info", repo->git_dir);
+    if (err == SVCS_OK) {
+        err = svcs_mkdir_recursive(info_dir);
+    }
+    if (err == SVCS_OK) {
+        err = svcs_repo_write_file(repo, path, buf.data ? (const void*)buf.data : "", buf.size);
+    }
+    svcs_buffer_free(&buf);
+    return err;
+}
+
+static svcs_error_t apply_cone(svcs_repository_t *repo, const char *const *cone, size_t cone_count) {
+    svcs_index_t *index = repo->index;
+    sparse_ctx_t ctx = { .repo = repo, .cone = cone, .cone_count = cone_count };
+    svcs_error_t err = SVCS_OK;
+
+    // Collapsed entries the cone now reaches into are opened up
+    for (size_t i = 0; i < index->entry_count && err == SVCS_OK; i++) {
+        const svcs_index_entry_t *entry = &index->entries[i];
+        const char *rel = svcs_worktree_path(repo, entry->path);
+        if (rel && S_ISDIR(entry->mode) && dir_needed(&ctx, rel, strlen(rel))) {
+            err = expand_tree(&ctx, rel, &entry->hash);
+        } else {
+            err = push_item(&ctx, entry, 0);
+        }
+    }
+    if (err == SVCS_OK && ctx.count > 1) {
+        qsort(ctx.items, ctx.count, sizeof(sparse_item_t), compare_items);
+    }
+
+    // Then everything outside it is folded into one entry per directory.
+    // The worktree is only touched once every file has been checked.
+    svcs_index_entry_t *entries = malloc((ctx.count ? ctx.count : 1) * sizeof(svcs_index_entry_t));
+    size_t *removals = malloc((ctx.count ? ctx.count : 1) * sizeof(size_t));
+    size_t *checkouts = malloc((ctx.count ? ctx.count : 1) * sizeof(size_t));
+    char *created = malloc(ctx.count ? ctx.count : 1);
+    size_t entry_count = 0, removal_count = 0, checkout_count = 0;
+    if (!entries || !removals || !checkouts || !created) {
+        err = SVCS_ERROR_MEMORY;
+    }
+
+    for (size_t i = 0; i < ctx.count && err == SVCS_OK;) {
+        const sparse_item_t *item = &ctx.items[i];
+        const char *rel = svcs_worktree_path(repo, item->entry.path);
+        size_t root = rel ? collapse_root(&ctx, rel, S_ISDIR(item->entry.mode)) : 0;
+        if (!root) {
+            if (item->from_tree) {
+                err = checkout_clear(repo, &item->entry, &created[checkout_count]) ? SVCS_OK : SVCS_ERROR_EXISTS;
+                checkouts[checkout_count++] = entry_count;
+            }
+            entries[entry_count++] = item->entry;
+            i++;
+            continue;
+        }
+
+        size_t end = group_end(&ctx, i, rel, root);
+        for (size_t j = i; j < end && err == SVCS_OK; j++) {
+            const svcs_index_entry_t *entry = &ctx.items[j].entry;
+            if (!ctx.items[j].from_tree && !S_ISDIR(entry->mode)) {
+                err = svcs_index_entry_clean(repo, entry) ? SVCS_OK : SVCS_ERROR_EXISTS;
+                removals[removal_count++] = j;
+            }
+        }
+        if (err == SVCS_OK) {
+            err = collapse_group(&ctx, i, end, rel, root, &entries[entry_count++]);
+        }
+        i = end;
+    }
+
+    // Files are checked out first, then the index and the cone file are
+    // written in one batch, and only then are files outside the cone
+    // removed. Failing before that puts the old entries back and removes
+    // the files this wrote.
+    size_t written = 0;
+    while (written < checkout_count && err == SVCS_OK) {
+        err = checkout_file(repo, &entries[checkouts[written++]]);
+    }
+
+    svcs_index_entry_t *old_entries = index->entries;
+    size_t old_count = index->entry_count;
+    size_t old_capacity = index->entry_capacity;
+    if (err == SVCS_OK) {
+        index->entries = entries;
+        index->entry_count = entry_count;
+        index->entry_capacity = ctx.count ? ctx.count : 1;
+        err = svcs_write_batch_begin(repo);
+        if (err == SVCS_OK) {
+            err = svcs_index_save(repo);
+            if (err == SVCS_OK && cone) {
+                err = write_cone(repo, cone, cone_count);
+            }
+            if (err == SVCS_OK) {
+                err = svcs_write_batch_commit(repo);
+            } else {
+                svcs_write_batch_abort(repo);
+            }
+        }
+        if (err == SVCS_OK) {
+            free(old_entries);
+            entries = NULL;
+            svcs_index_remove_stale_base(repo);
+        } else {
+            index->entries = old_entries;
+            index->entry_count = old_count;
+            index->entry_capacity = old_capacity;
+        }
+    }
+    for (size_t i = 0; i < written && err != SVCS_OK; i++) {
+        if (created[i]) {
+            remove_file(repo, entries[checkouts[i]].path);
+        }
+    }
+
+    // With the full worktree checked out and indexed, a cone file that
+    // cannot be removed only leaves the next change to redo that
+    if (err == SVCS_OK && !cone) {
+        char path[SVCS_MAX_PATH];
+        snprintf(path, sizeof(path), "%s/%s", repo->git_dir, SPARSE_CHECKOUT_FILE);
+        if (unlink(path) != 0 && errno != ENOENT) {
+            err = SVCS_ERROR_IO;
+        }
+    }
+    for (size_t i = 0; i < removal_count && err == SVCS_OK; i++) {
+        remove_file(repo, ctx.items[removals[i]].entry.path);
+    }
+
+    free(entries);
+    free(removals);
+    free(checkouts);
+    free(created);
+    free(ctx.items);
+    return err;
+}
+
+// A relative path of real names: no empty, "." or ".." component
+static int valid_cone_dir(const char *dir, size_t len) {
+    if (len == 0 || len >= SVCS_MAX_PATH || memchr(dir, '\n', len)) {
+        return 0;
+    }
+    const char *end = dir + len;
+    for (const char *name = dir; name <= end;) {
+        const char *slash = memchr(name, '/', (size_t)(end - name));
+        size_t name_len = slash ? (size_t)(slash - name) : (size_t)(end - name);
+        if (name_len == 0 || (name_len == 1 && name[0] == '.') ||
+            (name_len == 2 && name[0] == '.' && name[1] == '.')) {
+            return 0;
+        }
+        name += name_len + 1;
+    }
+    return 1;
+}
+
+static int compare_dirs(const void *a, const void *b) {
+    return strcmp(*(const char *const*)a, *(const char *const*)b);
+}
+
+svcs_error_t svcs_sparse_checkout_set(svcs_repository_t *repo, const char *const *dirs, size_t count) {
+    if (!repo || !repo->index || (!dirs && count > 0)) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    // Kept as given apart from trailing slashes, which the matching
+    // above does not expect
+    char **cone = malloc((count ? count : 1) * sizeof(char*));
+    if (!cone) {
+        return SVCS_ERROR_MEMORY;
+    }
+    svcs_error_t err = SVCS_OK;
+    size_t cone_count = 0;
+    for (size_t i = 0; i < count && err == SVCS_OK; i++) {
+        size_t len = strlen(dirs[i]);
+        while (len > 0 && dirs[i][len - 1] == '/') {
+            len--;
+        }
+        if (!valid_cone_dir(dirs[i], len)) {
+            err = SVCS_ERROR_INVALID;
+            break;
+        }
+        cone[cone_count] = malloc(len + 1);
+        if (!cone[cone_count]) {
+            err = SVCS_ERROR_MEMORY;
+            break;
+        }
+        memcpy(cone[cone_count], dirs[i], len);
+        cone[cone_count++][len] = '\0';
+    }
+
+    if (err == SVCS_OK) {
+        qsort(cone, cone_count, sizeof(char*), compare_dirs);
+        err = apply_cone(repo, (const char *const*)cone, cone_count);
+    }
+
+    for (size_t i = 0; i < cone_count; i++) {
+        free(cone[i]);
+    }
+    free(cone);
+    return err;
+}
+
+svcs_error_t svcs_sparse_checkout_disable(svcs_repository_t *repo) {
+    if (!repo || !repo->index) {
+        return SVCS_ERROR_INVALID;
+    }
+    return apply_cone(repo, NULL, 0);
+}
@@ -0,0 +1,527 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "svcs.h"
+#include "internal.h"
+#include <dirent.h>
+#include <sys/stat.h>
+
+// Untracked-file discovery and its cache, kept in the index as the UNTR
+// extension:
+//
+//   rules      hash of the ignore rules the cache was built under
+//   count      number of directories (4 bytes)
+//   per directory, sorted by path: mtime seconds (8 bytes) and
+//   nanoseconds (4), path length (4) and the path relative to the worktree
+//   ("" for the root), children length (4) and the children, each a kind
+//   byte, the name and a NUL
+//
+// A directory's mtime changes whenever a name in it is added, removed or
+// renamed, so while it stays the same the names recorded for it can be
+// used without reading it. Directories changed within the last second are
+// not cached: a second change within the same timestamp tick would go
+// unnoticed. Adding or removing an index entry changes which names are
+// untracked without touching the directory, so it drops that directory.
+
+#define CHILD_UNTRACKED 'u'
+#define CHILD_IGNORED 'i'
+#define CHILD_DIR 'd'
+#define UNTRACKED_DIR_FIXED_SIZE (8 + 4 + 4 + 4)
+
+typedef struct {
+    char *path;  // Relative to the worktree
+    time_t mtime;
+    uint32_t mtime_nsec;
+    int valid;
+    char *children;
+    size_t children_size;
+} untracked_dir_t;
+
+struct svcs_untracked_cache {
+    svcs_hash_t rules;
+    untracked_dir_t *dirs;  // Sorted by path
+    size_t count;
+    size_t capacity;
+};
+
+static char* copy_string(const void *data, size_t len) {
+    char *copy = malloc(len + 1);
+    if (copy) {
+        memcpy(copy, data, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+static void free_dir(untracked_dir_t *dir) {
+    free(dir->path);
+    free(dir->children);
+}
+
+void svcs_untracked_cache_free(svcs_untracked_cache_t *cache) {
+    if (!cache) return;
+
+    for (size_t i = 0; i < cache->count; i++) {
+        free_dir(&cache->dirs[i]);
+    }
+    free(cache->dirs);
+    free(cache);
+}
+
+static svcs_error_t push_dir(svcs_untracked_cache_t *cache, const untracked_dir_t *dir) {
+    if (cache->count == cache->capacity) {
+        size_t capacity = cache->capacity ? cache->capacity * 2 : 64;
+        untracked_dir_t *grown = realloc(cache->dirs, capacity * sizeof(untracked_dir_t));
+        if (!grown) {
+            return SVCS_ERROR_MEMORY;
+        }
+        cache->dirs = grown;
+        cache->capacity = capacity;
+    }
+    cache->dirs[cache->count++] = *dir;
+    return SVCS_OK;
+}
+
+static untracked_dir_t* find_dir(svcs_untracked_cache_t *cache, const char *path) {
+    size_t lo = 0, hi = cache->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(cache->dirs[mid].path, path);
+        if (cmp == 0) {
+            return &cache->dirs[mid];
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+svcs_error_t svcs_untracked_cache_parse(const uint8_t *data, size_t size, svcs_untracked_cache_t **cache) {
+    *cache = NULL;
+    if (size < SVCS_HASH_SIZE + 4) {
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    const uint8_t *ptr = data + SVCS_HASH_SIZE + 4;
+    const uint8_t *end = data + size;
+    uint32_t count = svcs_get_be32(data + SVCS_HASH_SIZE);
+    if (count > (size_t)(end - ptr) / UNTRACKED_DIR_FIXED_SIZE) {
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    svcs_untracked_cache_t *result = calloc(1, sizeof(svcs_untracked_cache_t));
+    if (!result) {
+        return SVCS_ERROR_MEMORY;
+    }
+    memcpy(result->rules.bytes, data, SVCS_HASH_SIZE);
+
+    svcs_error_t err = SVCS_OK;
+    for (uint32_t i = 0; i < count && err == SVCS_OK; i++) {
+        if ((size_t)(end - ptr) < UNTRACKED_DIR_FIXED_SIZE) {
+            err = SVCS_ERROR_CORRUPT;
+            break;
+        }
+
+        untracked_dir_t dir = {
+            .mtime = (time_t)(int64_t)svcs_get_be64(ptr),
+            .mtime_nsec = svcs_get_be32(ptr + 8),
+            .valid = 1
+        };
+        uint32_t path_len = svcs_get_be32(ptr + 12);
+        ptr += 16;
+        if (path_len > (size_t)(end - ptr) - 4 || path_len >= SVCS_MAX_PATH) {
+            err = SVCS_ERROR_CORRUPT;
+            break;
+        }
+        const uint8_t *path = ptr;
+        ptr += path_len;
+        dir.children_size = svcs_get_be32(ptr);
+        ptr += 4;
+        if (dir.children_size > (size_t)(end - ptr) ||
+            (dir.children_size > 0 && ptr[dir.children_size - 1] != '\0')) {
+            err = SVCS_ERROR_CORRUPT;
+            break;
+        }
+
+        dir.path = copy_string(path, path_len);
+        dir.children = copy_string(ptr, dir.children_size);
+        ptr += dir.children_size;
+        if (!dir.path || !dir.children) {
+            free_dir(&dir);
+            err = SVCS_ERROR_MEMORY;
+        } else if (result->count > 0 && strcmp(result->dirs[result->count - 1].path, dir.path) >= 0) {
+            free_dir(&dir);
+            err = SVCS_ERROR_CORRUPT;
+        } else {
+            err = push_dir(result, &dir);
+            if (err != SVCS_OK) {
+                free_dir(&dir);
+            }
+        }
+    }
+
+    if (err == SVCS_OK && ptr != end) {
+        err = SVCS_ERROR_CORRUPT;
+    }
+    if (err != SVCS_OK) {
+        svcs_untracked_cache_free(result);
+        return err;
+    }
+    *cache = result;
+    return SVCS_OK;
+}
+
+svcs_error_t svcs_untracked_cache_write(const svcs_untracked_cache_t *cache, svcs_buffer_t *buf) {
+    uint32_t count = 0;
+    for (size_t i = 0; i < cache->count; i++) {
+        count += cache->dirs[i].valid ? 1 : 0;
+    }
+
+    uint8_t header[SVCS_HASH_SIZE + 4];
+    memcpy(header, cache->rules.bytes, SVCS_HASH_SIZE);
+    svcs_put_be32(header + SVCS_HASH_SIZE, count);
+    svcs_error_t err = svcs_buffer_append(buf, header, sizeof(header));
+
+    for (size_t i = 0; i < cache->count && err == SVCS_OK; i++) {
+        const untracked_dir_t *dir = &cache->dirs[i];
+        if (!dir->valid) {
+            continue;
+        }
+
+        uint8_t fixed[16];
+        size_t path_len = strlen(dir->path);
+        svcs_put_be64(fixed, (uint64_t)(int64_t)dir->mtime);
+        svcs_put_be32(fixed + 8, dir->mtime_nsec);
+        svcs_put_be32(fixed + 12, (uint32_t)path_len);
+        uint8_t children_len[4];
+        svcs_put_be32(children_len, (uint32_t)dir->children_size);
+
+        err = svcs_buffer_append(buf, fixed, sizeof(fixed));
+        if (err == SVCS_OK) {
+            err = svcs_buffer_append(buf, dir->path, path_len);
+        }
+        if (err == SVCS_OK) {
+            err = svcs_buffer_append(buf, children_len, sizeof(children_len));
+        }
+        if (err == SVCS_OK) {
+            err = svcs_buffer_append(buf, dir->children, dir->children_size);
+        }
+    }
+    return err;
+}
+
+void svcs_untracked_cache_invalidate(svcs_repository_t *repo, const char *path) {
+    svcs_untracked_cache_t *cache = repo->index ? repo->index->untracked : NULL;
+    // Paths outside the worktree never count as tracked there
+    const char *rel = cache ? svcs_worktree_path(repo, path) : NULL;
+    if (!rel) {
+        return;
+    }
+
+    char dir_path[SVCS_MAX_PATH];
+    snprintf(dir_path, sizeof(dir_path), "%s", rel);
+    char *slash = strrchr(dir_path, '/');
+    if (slash) {
+        *slash = '\0';
+    } else {
+        dir_path[0] = '\0';
+    }
+
+    untracked_dir_t *dir = find_dir(cache, dir_path);
+    if (dir) {
+        dir->valid = 0;
+    }
+}
+
+// Walking the worktree
+
+typedef struct {
+    svcs_repository_t *repo;
+    svcs_untracked_cache_t *old;    // Cache from the last walk, if any
+    svcs_untracked_cache_t *cache;  // Cache being built
+    const char **tracked;           // Worktree paths of index entries, sorted
+    size_t tracked_count;
+    int flags;
+    time_t now;
+    svcs_buffer_t names;            // Results, each ending in NUL
+    size_t name_count;
+    size_t read_count;              // Directories read and cacheable
+} walk_t;
+
+typedef struct {
+    char kind;
+    char *name;
+} child_t;
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(const char *const*)a, *(const char *const*)b);
+}
+
+static int compare_children(const void *a, const void *b) {
+    return strcmp(((const child_t*)a)->name, ((const child_t*)b)->name);
+}
+
+static void join_path(char *out, size_t size, const char *dir, const char *name) {
+    if (dir[0]) {
+        snprintf(out, size, "%s/%s", dir, name);
+    } else {
+        snprintf(out, size, "%s", name);
+    }
+}
+
+// Paths as the caller would pass them to svcs_index_add
+static void full_path(const walk_t *w, char *out, size_t size, const char *rel) {
+    if (strcmp(w->repo->work_dir, ".") == 0) {
+        snprintf(out, size, "%s", rel[0] ? rel : ".");
+    } else {
+        join_path(out, size, w->repo->work_dir, rel);
+        if (!rel[0]) {
+            snprintf(out, size, "%s", w->repo->work_dir);
+        }
+    }
+}
+
+static int is_tracked(const walk_t *w, const char *rel) {
+    return bsearch(&rel, w->tracked, w->tracked_count, sizeof(char*), compare_strings) != NULL;
+}
+
+static svcs_error_t read_dir(walk_t *w, const char *rel, const char *abs_path, const struct stat *st,
+                             untracked_dir_t *dir) {
+    memset(dir, 0, sizeof(*dir));
+    dir->path = copy_string(rel, strlen(rel));
+    if (!dir->path) {
+        return SVCS_ERROR_MEMORY;
+    }
+    dir->mtime = st->st_mtim.tv_sec;
+    dir->mtime_nsec = (uint32_t)st->st_mtim.tv_nsec;
+    dir->valid = st->st_mtim.tv_sec < w->now - 1;
+
+    // An unreadable directory is listed as empty and not cached
+    DIR *handle = opendir(abs_path);
+    if (!handle) {
+        dir->valid = 0;
+        dir->children = copy_string("", 0);
+        return dir->children ? SVCS_OK : SVCS_ERROR_MEMORY;
+    }
+
+    child_t *children = NULL;
+    size_t count = 0, capacity = 0;
+    svcs_error_t err = SVCS_OK;
+    struct dirent *entry;
+    while ((entry = readdir(handle)) != NULL && err == SVCS_OK) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+            (!rel[0] && strcmp(entry->d_name, ".svcs") == 0)) {
+            continue;
+        }
+
+        char child_rel[SVCS_MAX_PATH];
+        char child_abs[SVCS_MAX_PATH];
+        join_path(child_rel, sizeof(child_rel), rel, entry->d_name);
+        full_path(w, child_abs, sizeof(child_abs), child_rel);
+
+        char kind;
+        struct stat child_st;
+        if (svcs_path_is_ignored(child_rel)) {
+            kind = CHILD_IGNORED;
+        } else if (lstat(child_abs, &child_st) == 0 && S_ISDIR(child_st.st_mode)) {
+            kind = CHILD_DIR;
+        } else if (is_tracked(w, child_rel)) {
+            continue;
+        } else {
+            kind = CHILD_UNTRACKED;
+        }
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            child_t *grown = realloc(children, capacity * sizeof(child_t));
+            if (!grown) {
+                err = SVCS_ERROR_MEMORY;
+                break;
+            }
+            children = grown;
+        }
+        children[count].kind = kind;
+        children[count].name = copy_string(entry->d_name, strlen(entry->d_name));
+        if (!children[count].name) {
+            err = SVCS_ERROR_MEMORY;
+            break;
+        }
+        count++;
+    }
+    closedir(handle);
+
+    // Names in order, so results do not depend on the filesystem
+    if (count > 1) {
+        qsort(children, count, sizeof(child_t), compare_children);
+    }
+    svcs_buffer_t blob = {0};
+    for (size_t i = 0; i < count && err == SVCS_OK; i++) {
+        err = svcs_buffer_append(&blob, &children[i].kind, 1);
+        if (err == SVCS_OK) {
+            err = svcs_buffer_append(&blob, children[i].name, strlen(children[i].name) + 1);
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        free(children[i].name);
+    }
+    free(children);
+
+    if (err == SVCS_OK) {
+        dir->children = copy_string(blob.data ? (const char*)blob.data : "", blob.size);
+        dir->children_size = blob.size;
+        err = dir->children ? SVCS_OK : SVCS_ERROR_MEMORY;
+    }
+    svcs_buffer_free(&blob);
+    return err;
+}
+
+static svcs_error_t add_result(walk_t *w, const char *rel) {
+    char path[SVCS_MAX_PATH];
+    full_path(w, path, sizeof(path), rel);
+    w->name_count++;
+    return svcs_buffer_append(&w->names, path, strlen(path) + 1);
+}
+
+static svcs_error_t walk_dir(walk_t *w, const char *rel) {
+    char abs_path[SVCS_MAX_PATH];
+    full_path(w, abs_path, sizeof(abs_path), rel);
+
+    // Gone since its parent was read
+    struct stat st;
+    if (lstat(abs_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return SVCS_OK;
+    }
+
+    untracked_dir_t dir;
+    untracked_dir_t *old = w->old ? find_dir(w->old, rel) : NULL;
+    svcs_error_t err = SVCS_OK;
+    if (old && old->valid && old->mtime == st.st_mtim.tv_sec && old->mtime_nsec == (uint32_t)st.st_mtim.tv_nsec) {
+        // Taken over by the new cache
+        dir = *old;
+        old->path = NULL;
+        old->children = NULL;
+        old->valid = 0;
+    } else {
+        err = read_dir(w, rel, abs_path, &st, &dir);
+        w->read_count += (err == SVCS_OK && dir.valid) ? 1 : 0;
+    }
+
+    if (err == SVCS_OK) {
+        err = push_dir(w->cache, &dir);
+    }
+    if (err != SVCS_OK) {
+        free_dir(&dir);
+        return err;
+    }
+
+    // The node may move as the cache grows; its children do not
+    const char *children = dir.children;
+    size_t children_size = dir.children_size;
+    for (const char *ptr = children; ptr < children + children_size && err == SVCS_OK; ptr += strlen(ptr) + 1) {
+        char child_rel[SVCS_MAX_PATH];
+        join_path(child_rel, sizeof(child_rel), rel, ptr + 1);
+        if (ptr[0] == CHILD_DIR) {
+            err = walk_dir(w, child_rel);
+        } else if ((ptr[0] == CHILD_UNTRACKED && (w->flags & SVCS_UNTRACKED_FILES)) ||
+                   (ptr[0] == CHILD_IGNORED && (w->flags & SVCS_UNTRACKED_IGNORED))) {
+            err = add_result(w, child_rel);
+        }
+    }
+    return err;
+}
+
+static int compare_dirs(const void *a, const void *b) {
+    return strcmp(((const untracked_dir_t*)a)->path, ((const untracked_dir_t*)b)->path);
+}
+
+// One allocation holding the pointer array and the strings
+static svcs_error_t pack_results(const walk_t *w, char ***paths) {
+    size_t pointers = w->name_count * sizeof(char*);
+    char **result = malloc(pointers + w->names.size + 1);
+    if (!result) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    char *strings = (char*)result + pointers;
+    if (w->names.size > 0) {
+        memcpy(strings, w->names.data, w->names.size);
+    }
+    for (size_t i = 0; i < w->name_count; i++) {
+        result[i] = strings;
+        strings += strlen(strings) + 1;
+    }
+    *paths = result;
+    return SVCS_OK;
+}
+
+svcs_error_t svcs_index_untracked(svcs_repository_t *repo, int flags, char ***paths, size_t *count) {
+    if (!repo || !repo->index || !paths || !count) {
+        return SVCS_ERROR_INVALID;
+    }
+    *paths = NULL;
+    *count = 0;
+
+    svcs_index_t *index = repo->index;
+    walk_t w = {
+        .repo = repo,
+        .old = index->untracked,
+        .flags = flags,
+        .now = time(NULL)
+    };
+    w.cache = calloc(1, sizeof(svcs_untracked_cache_t));
+    w.tracked = malloc((index->entry_count ? index->entry_count : 1) * sizeof(char*));
+    if (!w.cache || !w.tracked) {
+        free(w.cache);
+        free(w.tracked);
+        return SVCS_ERROR_MEMORY;
+    }
+    svcs_ignore_rules_hash(&w.cache->rules);
+
+    // Names recorded under other ignore rules may be classed wrongly
+    if (w.old && memcmp(w.old->rules.bytes, w.cache->rules.bytes, SVCS_HASH_SIZE) != 0) {
+        w.old = NULL;
+    }
+    size_t old_valid = 0;
+    for (size_t i = 0; w.old && i < w.old->count; i++) {
+        old_valid += w.old->dirs[i].valid ? 1 : 0;
+    }
+
+    for (size_t i = 0; i < index->entry_count; i++) {
+        const char *rel = svcs_worktree_path(repo, index->entries[i].path);
+        if (rel) {
+            w.tracked[w.tracked_count++] = rel;
+        }
+    }
+    qsort(w.tracked, w.tracked_count, sizeof(char*), compare_strings);
+
+    svcs_error_t err = walk_dir(&w, "");
+    if (err == SVCS_OK) {
+        err = pack_results(&w, paths);
+    }
+    free(w.tracked);
+    svcs_buffer_free(&w.names);
+    if (err != SVCS_OK) {
+        svcs_untracked_cache_free(w.cache);
+        return err;
+    }
+    *count = w.name_count;
+
+    // Reused directories were moved out of the old cache, so the saved
+    // cache differs only if a cacheable directory was read or one went away
+    qsort(w.cache->dirs, w.cache->count, sizeof(untracked_dir_t), compare_dirs);
+    size_t new_valid = 0;
+    for (size_t i = 0; i < w.cache->count; i++) {
+        new_valid += w.cache->dirs[i].valid ? 1 : 0;
+    }
+    int changed = !w.old || w.read_count > 0 || new_valid != old_valid;
+    svcs_untracked_cache_free(index->untracked);
+    index->untracked = w.cache;
+
+    // Best effort, the list is right either way
+    if (changed) {
+        svcs_index_save(repo);
+    }
+    return SVCS_OK;
+}
@@ -1,6 +1,12 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "svcs.h"
+#include "internal.h"
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 svcs_error_t svcs_file_read(const char *path, void **data, size_t *size) {
     if (!path || !data || !size) {
@@ -41,20 +47,115 @@ svcs_error_t svcs_file_read(const char *path, void **data, size_t *size) {
     return SVCS_OK;
 }
 
-svcs_error_t svcs_file_write(const char *path, const void *data, size_t size) {
-    if (!path || !data) {
+// Write data to a new temp file next to path, to be renamed over it later.
+// With sync set the data is on disk before this returns.
+svcs_error_t svcs_file_write_temp(const char *path, const void *data, size_t size, int sync,
+                                  char *tmp_path, size_t tmp_size) {
+    if (!path || (!data && size > 0) || !tmp_path) {
         return SVCS_ERROR_INVALID;
     }
     
-    FILE *file = fopen(path, "wb");
-    if (!file) {
+    int written = snprintf(tmp_path, tmp_size, "%s.tmp_XXXXXX", path);
+    if (written < 0 || (size_t)written >= tmp_size) {
+        return SVCS_ERROR_INVALID;
+    }
+    
+    int fd = mkstemp(tmp_path);
+    if (fd < 0) {
         return SVCS_ERROR_IO;
     }
     
-    size_t bytes_written = fwrite(data, 1, size, file);
-    fclose(file);
+    svcs_error_t err = fchmod(fd, 0644) == 0 ? SVCS_OK : SVCS_ERROR_IO;
+    const uint8_t *ptr = data;
+    size_t remaining = size;
+    while (err == SVCS_OK && remaining > 0) {
+        ssize_t n = write(fd, ptr, remaining);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            err = SVCS_ERROR_IO;
+            break;
+        }
+        ptr += n;
+        remaining -= (size_t)n;
+    }
     
-    if (bytes_written != size) {
+    if (err == SVCS_OK && sync && fsync(fd) != 0) {
+        err = SVCS_ERROR_IO;
+    }
+    if (close(fd) != 0 && err == SVCS_OK) {
+        err = SVCS_ERROR_IO;
+    }
+    
+    if (err != SVCS_OK) {
+        unlink(tmp_path);
+    }
+    return err;
+}
+
+// Make a rename or create in path's directory durable
+svcs_error_t svcs_fsync_parent_dir(const char *path) {
+    char dir_path[SVCS_MAX_PATH];
+    snprintf(dir_path, sizeof(dir_path), "%s", path);
+    char *last_slash = strrchr(dir_path, '/');
+    if (last_slash == dir_path) {
+        last_slash[1] = '\0';
+    } else if (last_slash) {
+        *last_slash = '\0';
+    } else {
+        snprintf(dir_path, sizeof(dir_path), ".");
+    }
+    
+    int fd = open(dir_path, O_RDONLY);
+    if (fd < 0) {
+        return SVCS_ERROR_IO;
+    }
+    svcs_error_t err = fsync(fd) == 0 ? SVCS_OK : SVCS_ERROR_IO;
+    close(fd);
+    return err;
+}
+
+// Map a whole file read-only; release it with munmap
+svcs_error_t svcs_file_map(const char *path, const uint8_t **map, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return SVCS_ERROR_IO;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return SVCS_ERROR_CORRUPT;
+    }
+
+    void *addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (addr == MAP_FAILED) {
+        return SVCS_ERROR_IO;
+    }
+
+    *map = addr;
+    *size = (size_t)st.st_size;
+    return SVCS_OK;
+}
+
+// Replace path atomically: readers see either the old or the new content,
+// never a partial write. This does not fsync; see svcs_repo_write_file.
+svcs_error_t svcs_file_write(const char *path, const void *data, size_t size) {
+    if (!path || !data) {
+        return SVCS_ERROR_INVALID;
+    }
+    
+    char tmp_path[SVCS_MAX_PATH];
+    svcs_error_t err = svcs_file_write_temp(path, data, size, 0, tmp_path, sizeof(tmp_path));
+    if (err != SVCS_OK) {
+        return err;
+    }
+    
+    if (rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
         return SVCS_ERROR_IO;
     }
     
@@ -139,6 +240,11 @@ char* svcs_path_relative(const char *base, const char *target) {
     return result;
 }
 
+// Ignore common temporary files
+static const char *ignored_patterns[] = {
+    ".tmp", ".temp", ".log", ".bak", "~", ".swp", ".swo"
+};
+
 // Check if path is ignored (simplified .gitignore-like functionality)
 int svcs_path_is_ignored(const char *path) {
     if (!path) return 1;
@@ -148,11 +254,6 @@ int svcs_path_is_ignored(const char *path) {
         return 1;
     }
     
-    // Ignore common temporary files
-    const char *ignored_patterns[] = {
-        ".tmp", ".temp", ".log", ".bak", "~", ".swp", ".swo"
-    };
-    
     for (size_t i = 0; i < sizeof(ignored_patterns) / sizeof(ignored_patterns[0]); i++) {
         if (strstr(path, ignored_patterns[i]) != NULL) {
             return 1;
@@ -162,6 +263,18 @@ int svcs_path_is_ignored(const char *path) {
     return 0;
 }
 
+// Identifies the rules svcs_path_is_ignored applies, so that results
+// cached under other rules can be recognized
+void svcs_ignore_rules_hash(svcs_hash_t *hash) {
+    char rules[256] = ".svcs";
+    size_t len = strlen(rules) + 1;
+    for (size_t i = 0; i < sizeof(ignored_patterns) / sizeof(ignored_patterns[0]); i++) {
+        len += (size_t)snprintf(rules + len, sizeof(rules) - len, "%s", ignored_patterns[i]) + 1;
+    }
+    svcs_hash_init(hash);
+    svcs_hash_update(hash, rules, len);
+}
+
 // Simple string utilities
 char* svcs_string_duplicate(const char *str) {
     if (!str) return NULL;
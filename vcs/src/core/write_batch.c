@@ -0,0 +1,350 @@
+#define _GNU_SOURCE
+
+#include "svcs.h"
+#include "internal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// Write batches make a group of writes durable with a constant number of
+// flushes. While a batch is open, loose objects and repository files are
+// written to temp files and only renamed into place on commit:
+//
+//   1. flush every temp file at once (syncfs; fsync per file elsewhere)
+//   2. rename objects into place, then files such as refs and the index,
+//      so nothing ever points at an object that is not yet durable
+//   3. flush again so the renames themselves survive a crash
+//
+// Objects waiting in the batch are visible to this process through
+// svcs_write_batch_find_object, so later writes and reads in the same
+// batch behave as if they were already in place.
+
+#define WRITE_BATCH_MIN_BUCKETS 256
+
+typedef struct pending_write {
+    char tmp_path[SVCS_MAX_PATH];
+    char path[SVCS_MAX_PATH];
+    int is_object;
+    svcs_hash_t hash;               // Objects only
+    struct pending_write *chain;    // Next object in the same bucket
+} pending_write_t;
+
+struct svcs_write_batch {
+    pthread_mutex_t lock;
+    int depth;
+    pending_write_t **items;
+    size_t count;
+    size_t capacity;
+    pending_write_t **buckets;
+    size_t bucket_count;
+};
+
+static size_t bucket_of(const svcs_write_batch_t *batch, const svcs_hash_t *hash) {
+    return svcs_get_be32(hash->bytes + 4) & (batch->bucket_count - 1);
+}
+
+static pending_write_t* find_object(const svcs_write_batch_t *batch, const svcs_hash_t *hash) {
+    for (pending_write_t *item = batch->buckets[bucket_of(batch, hash)]; item; item = item->chain) {
+        if (svcs_hash_compare(&item->hash, hash) == 0) {
+            return item;
+        }
+    }
+    return NULL;
+}
+
+static void free_batch(svcs_write_batch_t *batch, int discard) {
+    for (size_t i = 0; i < batch->count; i++) {
+        if (discard) {
+            unlink(batch->items[i]->tmp_path);
+        }
+        free(batch->items[i]);
+    }
+    free(batch->items);
+    free(batch->buckets);
+    pthread_mutex_destroy(&batch->lock);
+    free(batch);
+}
+
+// Called with the lock held
+static svcs_error_t append_item(svcs_write_batch_t *batch, pending_write_t *item) {
+    if (batch->count == batch->capacity) {
+        size_t capacity = batch->capacity ? batch->capacity * 2 : 64;
+        pending_write_t **grown = realloc(batch->items, capacity * sizeof(pending_write_t*));
+        if (!grown) {
+            return SVCS_ERROR_MEMORY;
+        }
+        batch->items = grown;
+        batch->capacity = capacity;
+    }
+
+    if (item->is_object && batch->count >= batch->bucket_count) {
+        size_t bucket_count = batch->bucket_count * 2;
+        pending_write_t **buckets = calloc(bucket_count, sizeof(pending_write_t*));
+        if (buckets) {
+            free(batch->buckets);
+            batch->buckets = buckets;
+            batch->bucket_count = bucket_count;
+            for (size_t i = 0; i < batch->count; i++) {
+                pending_write_t *other = batch->items[i];
+                if (other->is_object) {
+                    size_t bucket = bucket_of(batch, &other->hash);
+                    other->chain = buckets[bucket];
+                    buckets[bucket] = other;
+                }
+            }
+        }
+    }
+
+    if (item->is_object) {
+        size_t bucket = bucket_of(batch, &item->hash);
+        item->chain = batch->buckets[bucket];
+        batch->buckets[bucket] = item;
+    }
+
+    batch->items[batch->count++] = item;
+    return SVCS_OK;
+}
+
+// Flush everything written so far. One syncfs covers the whole filesystem;
+// without it each temp file (before renames) or each parent directory
+// (after renames) is flushed on its own.
+static svcs_error_t flush_batch(svcs_repository_t *repo, svcs_write_batch_t *batch, int renamed) {
+#ifdef __linux__
+    int fd = open(repo->git_dir, O_RDONLY);
+    if (fd >= 0) {
+        int synced = syncfs(fd) == 0;
+        close(fd);
+        if (synced) {
+            return SVCS_OK;
+        }
+    }
+#else
+    (void)repo;
+#endif
+
+    for (size_t i = 0; i < batch->count; i++) {
+        pending_write_t *item = batch->items[i];
+        svcs_error_t err;
+        if (renamed) {
+            err = svcs_fsync_parent_dir(item->path);
+        } else {
+            int file = open(item->tmp_path, O_RDONLY);
+            err = file >= 0 && fsync(file) == 0 ? SVCS_OK : SVCS_ERROR_IO;
+            if (file >= 0) {
+                close(file);
+            }
+        }
+        if (err != SVCS_OK) {
+            return err;
+        }
+    }
+    return SVCS_OK;
+}
+
+static svcs_error_t publish_item(svcs_repository_t *repo, pending_write_t *item) {
+    if (item->is_object) {
+        svcs_error_t err = svcs_loose_cache_mkdir(repo, &item->hash);
+        if (err != SVCS_OK) {
+            return err;
+        }
+    }
+
+    if (rename(item->tmp_path, item->path) != 0) {
+        return SVCS_ERROR_IO;
+    }
+
+    if (item->is_object) {
+        svcs_loose_cache_add(repo, &item->hash);
+    }
+    return SVCS_OK;
+}
+
+svcs_error_t svcs_write_batch_begin(svcs_repository_t *repo) {
+    if (!repo) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    // Nested batches join the outermost one
+    if (repo->write_batch) {
+        repo->write_batch->depth++;
+        return SVCS_OK;
+    }
+
+    svcs_write_batch_t *batch = calloc(1, sizeof(svcs_write_batch_t));
+    if (!batch) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    batch->bucket_count = WRITE_BATCH_MIN_BUCKETS;
+    batch->buckets = calloc(batch->bucket_count, sizeof(pending_write_t*));
+    if (!batch->buckets) {
+        free(batch);
+        return SVCS_ERROR_MEMORY;
+    }
+
+    pthread_mutex_init(&batch->lock, NULL);
+    batch->depth = 1;
+    repo->write_batch = batch;
+    return SVCS_OK;
+}
+
+svcs_error_t svcs_write_batch_commit(svcs_repository_t *repo) {
+    if (!repo || !repo->write_batch) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    svcs_write_batch_t *batch = repo->write_batch;
+    if (--batch->depth > 0) {
+        return SVCS_OK;
+    }
+    repo->write_batch = NULL;
+
+    if (batch->count == 0) {
+        free_batch(batch, 0);
+        return SVCS_OK;
+    }
+
+    svcs_error_t err = flush_batch(repo, batch, 0);
+
+    // Objects first, so refs and the index only ever name stored objects
+    for (int pass = 1; pass >= 0 && err == SVCS_OK; pass--) {
+        for (size_t i = 0; i < batch->count && err == SVCS_OK; i++) {
+            pending_write_t *item = batch->items[i];
+            if (item->is_object == pass) {
+                err = publish_item(repo, item);
+                if (err == SVCS_OK) {
+                    item->tmp_path[0] = '\0';
+                }
+            }
+        }
+    }
+
+    if (err == SVCS_OK) {
+        err = flush_batch(repo, batch, 1);
+    }
+
+    // Whatever was not published is discarded
+    for (size_t i = 0; i < batch->count; i++) {
+        if (batch->items[i]->tmp_path[0]) {
+            unlink(batch->items[i]->tmp_path);
+        }
+    }
+    free_batch(batch, 0);
+    return err;
+}
+
+void svcs_write_batch_abort(svcs_repository_t *repo) {
+    if (!repo || !repo->write_batch) return;
+
+    free_batch(repo->write_batch, 1);
+    repo->write_batch = NULL;
+}
+
+// Take ownership of a finished loose object temp file
+svcs_error_t svcs_write_batch_add_object(svcs_repository_t *repo, const char *tmp_path, const svcs_hash_t *hash) {
+    svcs_write_batch_t *batch = repo->write_batch;
+    pending_write_t *item = calloc(1, sizeof(pending_write_t));
+    if (!item) {
+        return SVCS_ERROR_MEMORY;
+    }
+
+    snprintf(item->tmp_path, sizeof(item->tmp_path), "%s", tmp_path);
+    item->is_object = 1;
+    item->hash = *hash;
+    svcs_error_t err = svcs_loose_object_path(repo, hash, item->path, sizeof(item->path));
+
+    pthread_mutex_lock(&batch->lock);
+    // Another thread may have stored the same content first
+    int duplicate = err == SVCS_OK && find_object(batch, hash);
+    if (err == SVCS_OK && !duplicate) {
+        err = append_item(batch, item);
+    }
+    pthread_mutex_unlock(&batch->lock);
+
+    if (err != SVCS_OK || duplicate) {
+        unlink(tmp_path);
+        free(item);
+    }
+    return err;
+}
+
+// Temp file holding a loose object that is waiting in the batch, or NULL.
+// The path stays valid until the batch ends.
+const char* svcs_write_batch_find_object(svcs_repository_t *repo, const svcs_hash_t *hash) {
+    svcs_write_batch_t *batch = repo->write_batch;
+    if (!batch) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    pending_write_t *item = find_object(batch, hash);
+    pthread_mutex_unlock(&batch->lock);
+    return item ? item->tmp_path : NULL;
+}
+
+// Write a repository file such as a ref or the index. Inside a batch it is
+// published on commit; otherwise it is flushed and renamed into place now.
+svcs_error_t svcs_repo_write_file(svcs_repository_t *repo, const char *path, const void *data, size_t size) {
+    if (!repo || !path || (!data && size > 0)) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    char tmp_path[SVCS_MAX_PATH];
+    svcs_error_t err = svcs_file_write_temp(path, data, size, repo->write_batch == NULL,
+                                            tmp_path, sizeof(tmp_path));
+    if (err != SVCS_OK) {
+        return err;
+    }
+    return svcs_repo_install_file(repo, tmp_path, path);
+}
+
+// Move a finished temp file over path, the same way svcs_repo_write_file
+// does. Outside a batch the temp file must already be flushed. The temp
+// file is gone once this returns, whether or not it succeeded.
+svcs_error_t svcs_repo_install_file(svcs_repository_t *repo, const char *tmp_path, const char *path) {
+    if (!repo || !tmp_path || !path) {
+        return SVCS_ERROR_INVALID;
+    }
+
+    svcs_write_batch_t *batch = repo->write_batch;
+    svcs_error_t err = SVCS_OK;
+    if (!batch) {
+        if (rename(tmp_path, path) != 0) {
+            unlink(tmp_path);
+            return SVCS_ERROR_IO;
+        }
+        return svcs_fsync_parent_dir(path);
+    }
+
+    pending_write_t *item = calloc(1, sizeof(pending_write_t));
+    if (!item) {
+        unlink(tmp_path);
+        return SVCS_ERROR_MEMORY;
+    }
+    snprintf(item->tmp_path, sizeof(item->tmp_path), "%s", tmp_path);
+    snprintf(item->path, sizeof(item->path), "%s", path);
+
+    pthread_mutex_lock(&batch->lock);
+    // A later write of the same file in the batch replaces the earlier one
+    for (size_t i = 0; i < batch->count; i++) {
+        pending_write_t *other = batch->items[i];
+        if (!other->is_object && strcmp(other->path, path) == 0) {
+            unlink(other->tmp_path);
+            snprintf(other->tmp_path, sizeof(other->tmp_path), "%s", tmp_path);
+            free(item);
+            item = NULL;
+            break;
+        }
+    }
+    if (item) {
+        err = append_item(batch, item);
+    }
+    pthread_mutex_unlock(&batch->lock);
+
+    if (err != SVCS_OK) {
+        unlink(tmp_path);
+        free(item);
+    }
+    return err;
+}
@@ -1,8 +1,12 @@
 #include <stdio.h>
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "svcs.h"
+#include "test_util.h"
 
+// Follows path one directory entry at a time from tree
 void test_commit_create() {
     const char *test_path = "/tmp/svcs_commit_test";
     const char *test_file = "/tmp/commit_test.txt";
@@ -190,6 +194,97 @@ void test_commit_multiple() {
     printf("✓ test_commit_multiple passed\n");
 }
 
+void test_commit_trees() {
+    const char *test_path = "/tmp/svcs_commit_test5";
+    const char *files[] = {
+        "/tmp/svcs_commit_files5/docs/guide.txt",
+        "/tmp/svcs_commit_files5/lib/a.txt",
+        "/tmp/svcs_commit_files5/lib/b.txt"
+    };
+    const char *author = "Test Author <test@example.com>";
+    
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_commit_test5 /tmp/svcs_commit_files5");
+    system("mkdir -p /tmp/svcs_commit_files5/docs /tmp/svcs_commit_files5/lib");
+    for (int i = 0; i < 3; i++) {
+        write_file(files[i], files[i]);
+    }
+    svcs_repository_init(test_path);
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    err = svcs_index_add_paths(repo, files, 3, 0);
+    assert(err == SVCS_OK);
+    
+    svcs_hash_t commit_hash;
+    err = svcs_commit_create(repo, "First commit", author, &commit_hash);
+    assert(err == SVCS_OK);
+    svcs_commit_info_t first;
+    err = svcs_commit_info(repo, &commit_hash, &first);
+    assert(err == SVCS_OK);
+    
+    // One tree per directory
+    svcs_hash_t lib, docs;
+    subtree(repo, &first.tree, "tmp/svcs_commit_files5/lib", &lib);
+    subtree(repo, &first.tree, "tmp/svcs_commit_files5/docs", &docs);
+    assert(svcs_hash_compare(&lib, &docs) != 0);
+    
+    // An unchanged directory keeps its tree, and the tree is not written
+    // again: it stays missing once removed
+    char lib_path[1024];
+    loose_path(repo, &lib, lib_path, sizeof(lib_path));
+    svcs_repository_free(repo);
+    assert(unlink(lib_path) == 0);
+    
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    write_file(files[0], "changed");
+    err = svcs_index_add_paths(repo, files, 2, 0);
+    assert(err == SVCS_OK);
+    err = svcs_commit_create(repo, "Second commit", author, &commit_hash);
+    assert(err == SVCS_OK);
+    svcs_commit_info_t second;
+    err = svcs_commit_info(repo, &commit_hash, &second);
+    assert(err == SVCS_OK);
+    
+    svcs_hash_t lib2, docs2;
+    subtree(repo, &second.tree, "tmp/svcs_commit_files5/docs", &docs2);
+    assert(svcs_hash_compare(&docs, &docs2) != 0);
+    assert(svcs_hash_compare(&first.tree, &second.tree) != 0);
+    assert(access(lib_path, F_OK) != 0);
+    
+    // Nothing staged since, so the same tree
+    err = svcs_commit_create(repo, "Third commit", author, &commit_hash);
+    assert(err == SVCS_OK);
+    svcs_commit_info_t third;
+    err = svcs_commit_info(repo, &commit_hash, &third);
+    assert(err == SVCS_OK);
+    assert(svcs_hash_compare(&second.tree, &third.tree) == 0);
+    svcs_repository_free(repo);
+    
+    // Without the cache the same trees are built
+    system("rm -f /tmp/svcs_commit_test5/.svcs/index");
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    err = svcs_index_add_paths(repo, files, 3, 0);
+    assert(err == SVCS_OK);
+    err = svcs_commit_create(repo, "Fourth commit", author, &commit_hash);
+    assert(err == SVCS_OK);
+    err = svcs_commit_info(repo, &commit_hash, &third);
+    assert(err == SVCS_OK);
+    assert(svcs_hash_compare(&second.tree, &third.tree) == 0);
+    subtree(repo, &third.tree, "tmp/svcs_commit_files5/lib", &lib2);
+    assert(svcs_hash_compare(&lib, &lib2) == 0);
+    assert(access(lib_path, F_OK) == 0);
+    svcs_repository_free(repo);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_commit_test5 /tmp/svcs_commit_files5");
+    
+    printf("✓ test_commit_trees passed\n");
+}
+
 int main() {
     printf("Running commit tests...\n");
     
@@ -197,6 +292,7 @@ int main() {
     test_commit_read();
     test_commit_empty_index();
     test_commit_multiple();
+    test_commit_trees();
     
     printf("All commit tests passed! ✓\n");
     return 0;
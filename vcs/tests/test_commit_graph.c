@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include "svcs.h"
+#include "test_util.h"
+
+static int hash_equal(const svcs_hash_t *a, const svcs_hash_t *b) {
+    return svcs_hash_compare(a, b) == 0;
+}
+
+// The shared history (see test_util.h) plus, oldest first:
+//
+//   X                    other (unrelated)
+//   O = octopus of B, C, E
+static void build_graph_history(svcs_repository_t *repo, history_t *h) {
+    build_history(repo, h);
+    make_commit(repo, &h->tree, NULL, 0, 1600, &h->x);
+    svcs_hash_t merge_parents[3] = { h->b, h->c, h->e };
+    make_commit(repo, &h->tree, merge_parents, 3, 1700, &h->o);
+
+    set_ref(repo, "other", &h->x);
+    set_ref(repo, "octopus", &h->o);
+}
+
+static void check_queries(svcs_repository_t *repo, const history_t *h) {
+    int result;
+    svcs_error_t err = svcs_commit_is_ancestor(repo, &h->a, &h->d, &result);
+    assert(err == SVCS_OK && result);
+    err = svcs_commit_is_ancestor(repo, &h->c, &h->d, &result);
+    assert(err == SVCS_OK && result);
+    err = svcs_commit_is_ancestor(repo, &h->d, &h->a, &result);
+    assert(err == SVCS_OK && !result);
+    err = svcs_commit_is_ancestor(repo, &h->e, &h->d, &result);
+    assert(err == SVCS_OK && !result);
+    err = svcs_commit_is_ancestor(repo, &h->d, &h->d, &result);
+    assert(err == SVCS_OK && result);
+
+    svcs_hash_t base;
+    err = svcs_commit_merge_base(repo, &h->d, &h->e, &base);
+    assert(err == SVCS_OK && hash_equal(&base, &h->c));
+    err = svcs_commit_merge_base(repo, &h->b, &h->c, &base);
+    assert(err == SVCS_OK && hash_equal(&base, &h->a));
+    err = svcs_commit_merge_base(repo, &h->a, &h->d, &base);
+    assert(err == SVCS_OK && hash_equal(&base, &h->a));
+    err = svcs_commit_merge_base(repo, &h->d, &h->x, &base);
+    assert(err == SVCS_ERROR_NOT_FOUND);
+}
+
+void test_commit_graph_write() {
+    const char *test_path = "/tmp/svcs_commit_graph_test";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_commit_graph_test");
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    history_t h;
+    build_graph_history(repo, &h);
+
+    // Parsed from the objects before there is a graph
+    assert(svcs_commit_graph_count(repo) == 0);
+    svcs_commit_info_t info;
+    err = svcs_commit_info(repo, &h.m, &info);
+    assert(err == SVCS_OK);
+    assert(info.parent_count == 2);
+    assert(info.time == 1300);
+    assert(info.generation == SVCS_GENERATION_INFINITY);
+    check_queries(repo, &h);
+
+    size_t count;
+    err = svcs_commit_graph_write(repo, &count);
+    assert(err == SVCS_OK);
+    assert(count == 8);
+    assert(svcs_commit_graph_count(repo) == 8);
+
+    // Answered from the graph
+    err = svcs_commit_info(repo, &h.a, &info);
+    assert(err == SVCS_OK);
+    assert(info.generation == 1);
+    assert(info.parent_count == 0);
+    assert(hash_equal(&info.tree, &h.tree));
+
+    err = svcs_commit_info(repo, &h.m, &info);
+    assert(err == SVCS_OK);
+    assert(info.generation == 3);
+    assert(info.time == 1300);
+    assert(info.parent_count == 2);
+    assert(hash_equal(&info.parents[0], &h.b));
+    assert(hash_equal(&info.parents[1], &h.c));
+
+    err = svcs_commit_info(repo, &h.o, &info);
+    assert(err == SVCS_OK);
+    assert(info.generation == 4);
+    assert(info.parent_count == 3);
+    assert(hash_equal(&info.parents[2], &h.e));
+
+    check_queries(repo, &h);
+
+    // Entries come back in hash order
+    svcs_hash_t prev, hash;
+    for (size_t i = 0; i < count; i++) {
+        err = svcs_commit_graph_entry(repo, i, &hash, &info);
+        assert(err == SVCS_OK);
+        assert(i == 0 || svcs_hash_compare(&prev, &hash) < 0);
+        prev = hash;
+    }
+
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_commit_graph_test");
+
+    printf("✓ test_commit_graph_write passed\n");
+}
+
+void test_commit_graph_newer_commits() {
+    const char *test_path = "/tmp/svcs_commit_graph_test2";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_commit_graph_test2");
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    history_t h;
+    build_graph_history(repo, &h);
+    err = svcs_commit_graph_write(repo, NULL);
+    assert(err == SVCS_OK);
+    svcs_repository_free(repo);
+
+    // The graph is mapped again on open
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(svcs_commit_graph_count(repo) == 8);
+
+    // A commit made after the graph was written mixes with graph commits
+    svcs_hash_t f;
+    make_commit(repo, &h.tree, &h.d, 1, 1800, &f);
+    svcs_commit_info_t info;
+    err = svcs_commit_info(repo, &f, &info);
+    assert(err == SVCS_OK);
+    assert(info.generation == SVCS_GENERATION_INFINITY);
+
+    int result;
+    err = svcs_commit_is_ancestor(repo, &h.a, &f, &result);
+    assert(err == SVCS_OK && result);
+    err = svcs_commit_is_ancestor(repo, &f, &h.d, &result);
+    assert(err == SVCS_OK && !result);
+
+    svcs_hash_t base;
+    err = svcs_commit_merge_base(repo, &f, &h.e, &base);
+    assert(err == SVCS_OK && hash_equal(&base, &h.c));
+
+    // Rewriting picks it up once a ref names it
+    set_ref(repo, "next", &f);
+    size_t count;
+    err = svcs_commit_graph_write(repo, &count);
+    assert(err == SVCS_OK);
+    assert(count == 9);
+    err = svcs_commit_info(repo, &f, &info);
+    assert(err == SVCS_OK);
+    assert(info.generation == 5);
+
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_commit_graph_test2");
+
+    printf("✓ test_commit_graph_newer_commits passed\n");
+}
+
+void test_commit_graph_merge_base_without_graph() {
+    const char *test_path = "/tmp/svcs_commit_graph_test3";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_commit_graph_test3");
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    // No graph is written, so every commit is ordered by time alone. Y is
+    // a child of X with an older, skewed timestamp, and P and Q both
+    // merge X and Y: Y is the best base, X only an ancestor of it.
+    svcs_hash_t tree, x, y, p, q, base;
+    make_tree(repo, "snippet", &tree);
+    make_commit(repo, &tree, NULL, 0, 2000, &x);
+    make_commit(repo, &tree, &x, 1, 1000, &y);
+    svcs_hash_t yx[2] = { y, x };
+    svcs_hash_t xy[2] = { x, y };
+    make_commit(repo, &tree, yx, 2, 3000, &p);
+    make_commit(repo, &tree, xy, 2, 3000, &q);
+    err = svcs_commit_merge_base(repo, &p, &q, &base);
+    assert(err == SVCS_OK && hash_equal(&base, &y));
+    err = svcs_commit_merge_base(repo, &q, &p, &base);
+    assert(err == SVCS_OK && hash_equal(&base, &y));
+
+    // The same with every timestamp equal; each merge has its own tree so
+    // the commits differ, and the queue order between them is arbitrary
+    svcs_hash_t trees[4], a, b;
+    const char *contents[4] = { "one", "two", "three", "four" };
+    for (int i = 0; i < 4; i++) {
+        make_tree(repo, contents[i], &trees[i]);
+    }
+    make_commit(repo, &trees[0], NULL, 0, 5000, &a);
+    make_commit(repo, &trees[1], &a, 1, 5000, &b);
+    svcs_hash_t ab[2] = { a, b };
+    svcs_hash_t ba[2] = { b, a };
+    make_commit(repo, &trees[2], ab, 2, 5000, &p);
+    make_commit(repo, &trees[3], ba, 2, 5000, &q);
+    err = svcs_commit_merge_base(repo, &p, &q, &base);
+    assert(err == SVCS_OK && hash_equal(&base, &b));
+    err = svcs_commit_merge_base(repo, &q, &p, &base);
+    assert(err == SVCS_OK && hash_equal(&base, &b));
+
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_commit_graph_test3");
+
+    printf("✓ test_commit_graph_merge_base_without_graph passed\n");
+}
+
+int main() {
+    printf("Running commit graph tests...\n");
+
+    test_commit_graph_write();
+    test_commit_graph_newer_commits();
+    test_commit_graph_merge_base_without_graph();
+
+    printf("All commit graph tests passed! ✓\n");
+    return 0;
+}
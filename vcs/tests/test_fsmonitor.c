@@ -0,0 +1,195 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "svcs.h"
+#include "test_util.h"
+
+static pid_t start_monitor(const char *test_path) {
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        svcs_repository_t *repo;
+        if (svcs_repository_open(&repo, test_path) != SVCS_OK) {
+            _exit(1);
+        }
+        svcs_error_t err = svcs_fsmonitor_run(repo);
+        svcs_repository_free(repo);
+        _exit(err == SVCS_OK ? 0 : 1);
+    }
+
+    // Wait for the socket
+    char socket_path[512];
+    snprintf(socket_path, sizeof(socket_path), "%s/.svcs/fsmonitor.sock", test_path);
+    for (int i = 0; i < 500 && access(socket_path, F_OK) != 0; i++) {
+        struct timespec delay = { 0, 10 * 1000 * 1000 };
+        nanosleep(&delay, NULL);
+    }
+    assert(access(socket_path, F_OK) == 0);
+    return pid;
+}
+
+static void stop_monitor(svcs_repository_t *repo, pid_t pid) {
+    svcs_error_t err = svcs_fsmonitor_stop(repo);
+    assert(err == SVCS_OK);
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+// Makes an entry's stat data and hash no longer fit the file, so that
+// only a status that looks at the file notices
+static void spoil_entry(svcs_repository_t *repo, size_t i) {
+    svcs_index_entry_t *entry = &repo->index->entries[i];
+    entry->hash.bytes[0] ^= 0xFF;
+    entry->mtime -= 100;
+}
+
+// Status may have saved the spoiled entry
+static void restore_entry(svcs_repository_t *repo, size_t i) {
+    svcs_index_entry_t *entry = &repo->index->entries[i];
+    entry->hash.bytes[0] ^= 0xFF;
+    entry->mtime += 100;
+    svcs_error_t err = svcs_index_save(repo);
+    assert(err == SVCS_OK);
+}
+
+void test_fsmonitor_status() {
+    const char *test_path = "/tmp/svcs_fsmonitor_test";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_fsmonitor_test");
+    svcs_repository_init(test_path);
+    system("mkdir -p /tmp/svcs_fsmonitor_test/snippets/python");
+    const char *paths[] = {
+        "/tmp/svcs_fsmonitor_test/readme.txt",
+        "/tmp/svcs_fsmonitor_test/snippets/python/sort.py",
+        "/tmp/svcs_fsmonitor_test/snippets/sort.c"
+    };
+    for (int i = 0; i < 3; i++) {
+        write_file(paths[i], paths[i]);
+    }
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    err = svcs_index_add_paths(repo, paths, 3, 0);
+    assert(err == SVCS_OK);
+
+    pid_t pid = start_monitor(test_path);
+
+    // The first status with the monitor checks every file and records the
+    // monitor's token
+    assert(status_of(repo, 0) == SVCS_STATUS_ADDED);
+    assert(repo->index->fsmonitor_token[0] != '\0');
+    svcs_repository_free(repo);
+
+    // Entries the monitor has seen no change to are not looked at
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(repo->index->fsmonitor_token[0] != '\0');
+    spoil_entry(repo, 1);
+    assert(status_of(repo, 1) == SVCS_STATUS_ADDED);
+    restore_entry(repo, 1);
+    svcs_repository_free(repo);
+
+    // Only the paths it reports
+    write_file(paths[0], "changed readme");
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    spoil_entry(repo, 1);
+    svcs_index_entry_t *entries;
+    size_t count;
+    err = svcs_index_status(repo, &entries, &count);
+    assert(err == SVCS_OK);
+    assert(count == 3);
+    assert(entries[0].status == SVCS_STATUS_MODIFIED);
+    assert(entries[1].status == SVCS_STATUS_ADDED);
+    assert(entries[2].status == SVCS_STATUS_ADDED);
+    free(entries);
+    restore_entry(repo, 1);
+    svcs_repository_free(repo);
+
+    // Removing a directory covers the files in it
+    system("rm -rf /tmp/svcs_fsmonitor_test/snippets/python");
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(status_of(repo, 1) == SVCS_STATUS_DELETED);
+    assert(status_of(repo, 2) == SVCS_STATUS_ADDED);
+
+    // Files in a directory created while the monitor runs are seen
+    system("mkdir -p /tmp/svcs_fsmonitor_test/snippets/python");
+    write_file(paths[1], paths[1]);
+    assert(status_of(repo, 1) == SVCS_STATUS_ADDED);
+    write_file(paths[1], "changed sort");
+    assert(status_of(repo, 1) == SVCS_STATUS_MODIFIED);
+
+    stop_monitor(repo, pid);
+
+    // Without the monitor every file is checked again
+    write_file(paths[1], paths[1]);
+    spoil_entry(repo, 2);
+    assert(status_of(repo, 2) == SVCS_STATUS_MODIFIED);
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_fsmonitor_test");
+
+    printf("✓ test_fsmonitor_status passed\n");
+}
+
+void test_fsmonitor_restart() {
+    const char *test_path = "/tmp/svcs_fsmonitor_test2";
+    const char *path = "/tmp/svcs_fsmonitor_test2/snippet.txt";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_fsmonitor_test2");
+    svcs_repository_init(test_path);
+    write_file(path, "snippet");
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    err = svcs_index_add(repo, path);
+    assert(err == SVCS_OK);
+
+    pid_t pid = start_monitor(test_path);
+    assert(status_of(repo, 0) == SVCS_STATUS_ADDED);
+
+    // Only one monitor per repository
+    err = svcs_fsmonitor_run(repo);
+    assert(err == SVCS_ERROR_EXISTS);
+    stop_monitor(repo, pid);
+
+    // A change made while no monitor ran is not in the next one's journal;
+    // its token is refused and everything is checked
+    write_file(path, "changed");
+    pid = start_monitor(test_path);
+    assert(status_of(repo, 0) == SVCS_STATUS_MODIFIED);
+    write_file(path, "snippet");
+    assert(status_of(repo, 0) == SVCS_STATUS_ADDED);
+    stop_monitor(repo, pid);
+
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_fsmonitor_test2");
+
+    printf("✓ test_fsmonitor_restart passed\n");
+}
+
+int main() {
+    printf("Running filesystem monitor tests...\n");
+
+    test_fsmonitor_status();
+    test_fsmonitor_restart();
+
+    printf("All filesystem monitor tests passed! ✓\n");
+    return 0;
+}
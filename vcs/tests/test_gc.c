@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <utime.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "svcs.h"
+#include "test_util.h"
+
+// Make a loose object look like it was written an hour ago
+static void age_object(svcs_repository_t *repo, const svcs_hash_t *hash) {
+    char path[1024];
+    loose_path(repo, hash, path, sizeof(path));
+
+    struct utimbuf times;
+    times.actime = times.modtime = time(NULL) - 3600;
+    assert(utime(path, &times) == 0);
+}
+
+void test_gc_repack_and_prune() {
+    const char *test_path = "/tmp/svcs_gc_test";
+    const char *test_file = "/tmp/gc_test.txt";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_gc_test");
+    FILE *f = fopen(test_file, "w");
+    assert(f != NULL);
+    fputs("Snippet kept by a commit", f);
+    fclose(f);
+
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    err = svcs_index_add(repo, test_file);
+    assert(err == SVCS_OK);
+
+    svcs_hash_t commit_hash;
+    err = svcs_commit_create(repo, "Initial commit", "Test Author <test@example.com>", &commit_hash);
+    assert(err == SVCS_OK);
+
+    svcs_hash_t old_garbage, new_garbage;
+    write_blob(repo, "unreachable and expired", &old_garbage);
+    write_blob(repo, "unreachable but recent", &new_garbage);
+    age_object(repo, &old_garbage);
+
+    svcs_gc_stats_t stats;
+    err = svcs_gc(repo, 60, &stats);
+    assert(err == SVCS_OK);
+
+    // Blob, the trees of / and /tmp, and commit
+    assert(stats.reachable_objects == 4);
+    assert(stats.pruned_objects == 1);
+    assert(stats.size_before > 0);
+
+    // The commit graph and multi-pack index are refreshed along the way
+    assert(svcs_commit_graph_count(repo) == 1);
+    assert(svcs_midx_pack_count(repo) == 1);
+
+    // Reachable objects now come from the pack
+    assert(!loose_exists(repo, &commit_hash));
+    svcs_object_t *obj;
+    err = svcs_object_read(repo, &commit_hash, &obj);
+    assert(err == SVCS_OK);
+    assert(obj->type == SVCS_OBJ_COMMIT);
+    svcs_object_free(obj);
+
+    // Garbage goes only once its grace period is over
+    assert(!svcs_object_exists(repo, &old_garbage));
+    assert(svcs_object_exists(repo, &new_garbage));
+    assert(loose_exists(repo, &new_garbage));
+
+    // Running again over the same objects rewrites the same pack
+    err = svcs_gc(repo, 60, &stats);
+    assert(err == SVCS_OK);
+    assert(stats.reachable_objects == 4);
+    assert(stats.pruned_objects == 0);
+    assert(stats.removed_packs == 0);
+    assert(svcs_object_exists(repo, &commit_hash));
+
+    svcs_repository_free(repo);
+
+    // Packed objects are found after reopening
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(svcs_object_exists(repo, &commit_hash));
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_gc_test");
+    system("rm -f /tmp/gc_test.txt");
+
+    printf("✓ test_gc_repack_and_prune passed\n");
+}
+
+void test_gc_missing_object() {
+    const char *test_path = "/tmp/svcs_gc_test2";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_gc_test2");
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    svcs_hash_t garbage, missing;
+    write_blob(repo, "expired garbage", &garbage);
+    age_object(repo, &garbage);
+
+    // A branch naming an object that does not exist
+    memset(missing.bytes, 0xab, SVCS_HASH_SIZE);
+    err = svcs_branch_create(repo, "broken", &missing);
+    assert(err == SVCS_OK);
+
+    // Nothing is deleted when the graph cannot be walked
+    svcs_gc_stats_t stats;
+    err = svcs_gc(repo, 60, &stats);
+    assert(err == SVCS_ERROR_CORRUPT);
+    assert(loose_exists(repo, &garbage));
+
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_gc_test2");
+
+    printf("✓ test_gc_missing_object passed\n");
+}
+
+void test_gc_keeps_cached_trees() {
+    const char *test_path = "/tmp/svcs_gc_test3";
+    const char *files[] = {
+        "/tmp/svcs_gc_files3/docs/guide.txt",
+        "/tmp/svcs_gc_files3/lib/a.txt"
+    };
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_gc_test3 /tmp/svcs_gc_files3");
+    system("mkdir -p /tmp/svcs_gc_files3/docs /tmp/svcs_gc_files3/lib");
+    for (int i = 0; i < 2; i++) {
+        FILE *f = fopen(files[i], "w");
+        assert(f != NULL);
+        fputs(files[i], f);
+        fclose(f);
+    }
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    // Commit on a branch that is then deleted, leaving its trees reachable
+    // only from the index's tree cache
+    svcs_hash_t tree, base, commit_hash;
+    make_tree(repo, "base", &tree);
+    make_commit(repo, &tree, NULL, 0, 1000, &base);
+    set_ref(repo, "base", &base);
+    set_ref(repo, "topic", &base);
+    assert(svcs_branch_checkout(repo, "topic") == SVCS_OK);
+    err = svcs_index_add_paths(repo, files, 2, 0);
+    assert(err == SVCS_OK);
+    err = svcs_commit_create(repo, "Topic", "Test Author <test@example.com>", &commit_hash);
+    assert(err == SVCS_OK);
+    svcs_commit_info_t info;
+    err = svcs_commit_info(repo, &commit_hash, &info);
+    assert(err == SVCS_OK);
+    svcs_hash_t lib;
+    subtree(repo, &info.tree, "tmp/svcs_gc_files3/lib", &lib);
+
+    assert(svcs_branch_checkout(repo, "base") == SVCS_OK);
+    assert(svcs_branch_delete(repo, "topic") == SVCS_OK);
+    system("find /tmp/svcs_gc_test3/.svcs/objects -type f -exec touch -d '2 hours ago' {} +");
+
+    svcs_gc_stats_t stats;
+    err = svcs_gc(repo, 60, &stats);
+    assert(err == SVCS_OK);
+    assert(!svcs_object_exists(repo, &commit_hash));
+    assert(svcs_object_exists(repo, &lib));
+
+    // The next commit reuses the cached tree, which is still there
+    FILE *f = fopen(files[0], "w");
+    assert(f != NULL);
+    fputs("changed", f);
+    fclose(f);
+    err = svcs_index_add(repo, files[0]);
+    assert(err == SVCS_OK);
+    err = svcs_commit_create(repo, "Changed", "Test Author <test@example.com>", &commit_hash);
+    assert(err == SVCS_OK);
+    err = svcs_commit_info(repo, &commit_hash, &info);
+    assert(err == SVCS_OK);
+    svcs_hash_t lib2;
+    subtree(repo, &info.tree, "tmp/svcs_gc_files3/lib", &lib2);
+    assert(svcs_hash_compare(&lib, &lib2) == 0);
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_gc_test3 /tmp/svcs_gc_files3");
+
+    printf("✓ test_gc_keeps_cached_trees passed\n");
+}
+
+void test_gc_keeps_reused_objects() {
+    const char *test_path = "/tmp/svcs_gc_test4";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_gc_test4");
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    svcs_hash_t tree, base;
+    make_tree(repo, "base", &tree);
+    make_commit(repo, &tree, NULL, 0, 1000, &base);
+    set_ref(repo, "main", &base);
+
+    // One unreachable blob loose and one packed, both past the grace period
+    svcs_hash_t loose, packed, pack_hash;
+    write_blob(repo, "reused while loose", &loose);
+    write_blob(repo, "reused while packed", &packed);
+    err = svcs_pack_write(repo, &packed, 1, &pack_hash);
+    assert(err == SVCS_OK);
+    char path[1024];
+    loose_path(repo, &packed, path, sizeof(path));
+    assert(unlink(path) == 0);
+    system("find /tmp/svcs_gc_test4/.svcs/objects -type f -exec touch -d '2 hours ago' {} +");
+
+    // Writing them again, as an add or commit that reuses them would, makes
+    // them recent again, so gc leaves them for the commit about to use them
+    svcs_hash_t again;
+    write_blob(repo, "reused while loose", &again);
+    write_blob(repo, "reused while packed", &again);
+    assert(!loose_exists(repo, &packed));
+
+    svcs_gc_stats_t stats;
+    err = svcs_gc(repo, 60, &stats);
+    assert(err == SVCS_OK);
+    assert(stats.pruned_objects == 0);
+    svcs_repository_free(repo);
+
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(svcs_object_exists(repo, &loose));
+    assert(svcs_object_exists(repo, &packed));
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_gc_test4");
+
+    printf("✓ test_gc_keeps_reused_objects passed\n");
+}
+
+// Size of the only pack gc left behind
+static long gc_pack_size(const char *pack_dir) {
+    long size = -1;
+    DIR *dir = opendir(pack_dir);
+    assert(dir != NULL);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len > 5 && strcmp(entry->d_name + len - 5, ".pack") == 0) {
+            assert(size == -1);
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/%s", pack_dir, entry->d_name);
+            struct stat st;
+            assert(stat(path, &st) == 0);
+            size = (long)st.st_size;
+        }
+    }
+    closedir(dir);
+    assert(size > 0);
+    return size;
+}
+
+void test_gc_groups_deltas_by_path() {
+    const char *test_path = "/tmp/svcs_gc_test5";
+    enum { FILES = 20 };
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_gc_test5");
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    // Twenty unrelated files, each later cut down to its first half. By size
+    // alone every full version sorts before every cut one, too far apart
+    // for the delta window; by path each pair sits side by side.
+    svcs_hash_t blobs[2][FILES];
+    for (int f = 0; f < FILES; f++) {
+        char content[4200];
+        size_t len = 0;
+        unsigned int seed = 7919u * (f + 1);
+        while (len < 4000 + (size_t)f) {
+            seed = seed * 1103515245u + 12345u;
+            len += snprintf(content + len, sizeof(content) - len, "%08x\n", seed);
+        }
+        write_object(repo, SVCS_OBJ_BLOB, content, len, &blobs[0][f]);
+        write_object(repo, SVCS_OBJ_BLOB, content, len / 2, &blobs[1][f]);
+    }
+
+    svcs_hash_t trees[2], commits[2];
+    for (int rev = 0; rev < 2; rev++) {
+        uint8_t tree_data[FILES * 64];
+        size_t len = 0;
+        for (int f = 0; f < FILES; f++) {
+            len += snprintf((char*)tree_data + len, sizeof(tree_data) - len, "100644 file_%02d.py", f) + 1;
+            memcpy(tree_data + len, blobs[rev][f].bytes, SVCS_HASH_SIZE);
+            len += SVCS_HASH_SIZE;
+        }
+        write_object(repo, SVCS_OBJ_TREE, tree_data, len, &trees[rev]);
+        make_commit(repo, &trees[rev], rev ? &commits[0] : NULL, rev, 1000 + rev, &commits[rev]);
+    }
+    set_ref(repo, "main", &commits[1]);
+
+    svcs_gc_stats_t stats;
+    err = svcs_gc(repo, 60, &stats);
+    assert(err == SVCS_OK);
+    assert(stats.reachable_objects == 2 * FILES + 4);
+    long named_size = gc_pack_size("/tmp/svcs_gc_test5/.svcs/objects/pack");
+
+    // The same objects packed without paths find no deltas
+    svcs_hash_t all[2 * FILES + 4];
+    memcpy(all, blobs, sizeof(blobs));
+    memcpy(all + 2 * FILES, trees, sizeof(trees));
+    memcpy(all + 2 * FILES + 2, commits, sizeof(commits));
+    svcs_hash_t pack_hash;
+    err = svcs_pack_write(repo, all, 2 * FILES + 4, &pack_hash);
+    assert(err == SVCS_OK);
+
+    char hash_str[SVCS_HASH_HEX_SIZE];
+    char path[1024];
+    svcs_hash_to_string(&pack_hash, hash_str);
+    snprintf(path, sizeof(path), "%s/.svcs/objects/pack/pack-%s.pack", test_path, hash_str);
+    struct stat st;
+    assert(stat(path, &st) == 0);
+    assert(named_size * 4 < (long)st.st_size * 3);
+
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_gc_test5");
+
+    printf("✓ test_gc_groups_deltas_by_path passed\n");
+}
+
+int main() {
+    printf("Running gc tests...\n");
+
+    test_gc_repack_and_prune();
+    test_gc_missing_object();
+    test_gc_keeps_cached_trees();
+    test_gc_keeps_reused_objects();
+    test_gc_groups_deltas_by_path();
+
+    printf("All gc tests passed! ✓\n");
+    return 0;
+}
@@ -81,6 +81,108 @@ void test_hash_object() {
     printf("✓ test_hash_object passed\n");
 }
 
+void test_hash_incremental() {
+    const char *test_data = "Hello, World! This is hashed in several pieces.";
+    size_t data_size = strlen(test_data);
+    
+    svcs_hash_t expected;
+    svcs_error_t err = svcs_hash_object(SVCS_OBJ_BLOB, test_data, data_size, &expected);
+    assert(err == SVCS_OK);
+    
+    // Feeding the content in pieces must match the one-shot hash
+    svcs_hash_ctx_t ctx;
+    err = svcs_hash_ctx_init_object(&ctx, SVCS_HASH_SHA3_256, SVCS_OBJ_BLOB, data_size);
+    assert(err == SVCS_OK);
+    
+    // A nested context on the same thread must not disturb the outer one
+    svcs_hash_ctx_t nested;
+    err = svcs_hash_ctx_init(&nested);
+    assert(err == SVCS_OK);
+    
+    for (size_t i = 0; i < data_size; i += 7) {
+        size_t len = data_size - i < 7 ? data_size - i : 7;
+        svcs_hash_ctx_update(&ctx, test_data + i, len);
+        svcs_hash_ctx_update(&nested, "noise", 5);
+    }
+    
+    svcs_hash_t nested_hash;
+    svcs_hash_ctx_final(&nested, &nested_hash);
+    
+    svcs_hash_t incremental;
+    svcs_hash_ctx_final(&ctx, &incremental);
+    assert(svcs_hash_compare(&expected, &incremental) == 0);
+    
+    // Streaming a file must match hashing its content as a blob
+    FILE *f = fopen("/tmp/svcs_hash_test_file", "wb");
+    assert(f != NULL);
+    for (int i = 0; i < 20000; i++) {
+        fputs(test_data, f);
+    }
+    fclose(f);
+    
+    size_t file_size = data_size * 20000;
+    char *file_data = malloc(file_size);
+    assert(file_data != NULL);
+    for (int i = 0; i < 20000; i++) {
+        memcpy(file_data + i * data_size, test_data, data_size);
+    }
+    
+    svcs_hash_t file_hash;
+    err = svcs_hash_file("/tmp/svcs_hash_test_file", &file_hash);
+    assert(err == SVCS_OK);
+    err = svcs_hash_object(SVCS_OBJ_BLOB, file_data, file_size, &expected);
+    assert(err == SVCS_OK);
+    assert(svcs_hash_compare(&expected, &file_hash) == 0);
+    
+    free(file_data);
+    remove("/tmp/svcs_hash_test_file");
+    
+    printf("✓ test_hash_incremental passed\n");
+}
+
+void test_hash_blake3() {
+    const char *test_data = "Hello, World!";
+    svcs_hash_t hash;
+    char hash_str[SVCS_HASH_HEX_SIZE];
+    
+    // Known-answer test: BLAKE3 of the empty input
+    svcs_hash_ctx_t ctx;
+    svcs_error_t err = svcs_hash_ctx_init_algo(&ctx, SVCS_HASH_BLAKE3);
+    assert(err == SVCS_OK);
+    svcs_hash_ctx_final(&ctx, &hash);
+    svcs_hash_to_string(&hash, hash_str);
+    assert(strcmp(hash_str, "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262") == 0);
+    
+    // Object hashes cover the "<type> <size>\0" header
+    err = svcs_hash_object_algo(SVCS_HASH_BLAKE3, SVCS_OBJ_BLOB, test_data, strlen(test_data), &hash);
+    assert(err == SVCS_OK);
+    svcs_hash_to_string(&hash, hash_str);
+    assert(strcmp(hash_str, "31b8bbe9b769eb85df218076c649d1a2beef589bbc0a326780f6d5a23488f811") == 0);
+    
+    // Multi-chunk input exercises the chaining value tree
+    uint8_t data[3073];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i % 251);
+    }
+    err = svcs_hash_ctx_init_algo(&ctx, SVCS_HASH_BLAKE3);
+    assert(err == SVCS_OK);
+    svcs_hash_ctx_update(&ctx, data, 100);
+    svcs_hash_ctx_update(&ctx, data + 100, sizeof(data) - 100);
+    svcs_hash_ctx_final(&ctx, &hash);
+    svcs_hash_to_string(&hash, hash_str);
+    assert(strcmp(hash_str, "7124b49501012f81cc7f11ca069ec9226cecb8a2c850cfe644e327d22d3e1cd3") == 0);
+    
+    // The two algorithms must never produce the same object id
+    svcs_hash_t sha3_hash;
+    err = svcs_hash_object(SVCS_OBJ_BLOB, test_data, strlen(test_data), &sha3_hash);
+    assert(err == SVCS_OK);
+    err = svcs_hash_object_algo(SVCS_HASH_BLAKE3, SVCS_OBJ_BLOB, test_data, strlen(test_data), &hash);
+    assert(err == SVCS_OK);
+    assert(svcs_hash_compare(&hash, &sha3_hash) != 0);
+    
+    printf("✓ test_hash_blake3 passed\n");
+}
+
 void test_hash_invalid_input() {
     svcs_hash_t hash;
     
@@ -105,6 +207,8 @@ int main() {
     test_hash_string_conversion();
     test_hash_compare();
     test_hash_object();
+    test_hash_incremental();
+    test_hash_blake3();
     test_hash_invalid_input();
     
     printf("All hash tests passed! ✓\n");
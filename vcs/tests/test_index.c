@@ -0,0 +1,613 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "svcs.h"
+#include "test_util.h"
+
+void test_index_add_paths() {
+    const char *test_path = "/tmp/svcs_index_test";
+    const int file_count = 64;
+    
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_index_test /tmp/svcs_index_files");
+    system("mkdir -p /tmp/svcs_index_files");
+    svcs_repository_init(test_path);
+    
+    char paths[64][128];
+    char contents[64][64];
+    const char *path_list[64];
+    for (int i = 0; i < file_count; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "/tmp/svcs_index_files/snippet_%02d.txt", i);
+        snprintf(contents[i], sizeof(contents[i]), "snippet number %d\n", i);
+        write_file(paths[i], contents[i]);
+        path_list[i] = paths[i];
+    }
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    
+    err = svcs_index_add_paths(repo, path_list, file_count, 0);
+    assert(err == SVCS_OK);
+    assert(repo->index->entry_count == (size_t)file_count);
+    
+    // Every entry must carry the hash of its own file's content
+    for (int i = 0; i < file_count; i++) {
+        svcs_hash_t expected;
+        err = svcs_hash_object_algo(repo->hash_algo, SVCS_OBJ_BLOB, contents[i], strlen(contents[i]), &expected);
+        assert(err == SVCS_OK);
+        assert(strcmp(repo->index->entries[i].path, paths[i]) == 0);
+        assert(svcs_hash_compare(&repo->index->entries[i].hash, &expected) == 0);
+        assert(svcs_object_exists(repo, &expected));
+    }
+    
+    svcs_repository_free(repo);
+    
+    // The index was saved once at the end
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(repo->index->entry_count == (size_t)file_count);
+    svcs_repository_free(repo);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_index_test /tmp/svcs_index_files");
+    
+    printf("✓ test_index_add_paths passed\n");
+}
+
+void test_index_add_paths_missing() {
+    const char *test_path = "/tmp/svcs_index_test2";
+    const char *present = "/tmp/svcs_index_present.txt";
+    const char *missing = "/tmp/svcs_index_missing.txt";
+    
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_index_test2");
+    remove(missing);
+    write_file(present, "present");
+    svcs_repository_init(test_path);
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    
+    const char *paths[] = { present, missing };
+    
+    // A missing path fails the whole batch and stages nothing
+    err = svcs_index_add_paths(repo, paths, 2, 0);
+    assert(err == SVCS_ERROR_NOT_FOUND);
+    assert(repo->index->entry_count == 0);
+    
+    // ...unless the caller asks for missing paths to be skipped
+    err = svcs_index_add_paths(repo, paths, 2, SVCS_ADD_IGNORE_MISSING);
+    assert(err == SVCS_OK);
+    assert(repo->index->entry_count == 1);
+    assert(strcmp(repo->index->entries[0].path, present) == 0);
+    
+    svcs_repository_free(repo);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_index_test2");
+    remove(present);
+    
+    printf("✓ test_index_add_paths_missing passed\n");
+}
+
+void test_index_v2_format() {
+    const char *test_path = "/tmp/svcs_index_test3";
+    const int file_count = 200;
+    
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_index_test3 /tmp/svcs_index_files3");
+    system("mkdir -p /tmp/svcs_index_files3/src/snippets");
+    svcs_repository_init(test_path);
+    
+    static char paths[200][128];
+    const char *path_list[200];
+    for (int i = 0; i < file_count; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "/tmp/svcs_index_files3/src/snippets/snippet_%03d.py", i);
+        write_file(paths[i], paths[i]);
+        path_list[i] = paths[i];
+    }
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    err = svcs_index_add_paths(repo, path_list, file_count, 0);
+    assert(err == SVCS_OK);
+    svcs_index_entry_t saved = repo->index->entries[17];
+    svcs_hash_t saved_hash = saved.hash;
+    svcs_repository_free(repo);
+    
+    // Shared directory prefixes are stored once per entry, not in full
+    struct stat st;
+    assert(stat("/tmp/svcs_index_test3/.svcs/index", &st) == 0);
+    assert((size_t)st.st_size < (size_t)file_count * 100);
+    
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(repo->index->entry_count == (size_t)file_count);
+    for (int i = 0; i < file_count; i++) {
+        assert(strcmp(repo->index->entries[i].path, paths[i]) == 0);
+    }
+    assert(svcs_hash_compare(&repo->index->entries[17].hash, &saved_hash) == 0);
+    assert(repo->index->entries[17].mtime == saved.mtime);
+    assert(repo->index->entries[17].size == strlen(paths[17]));
+    svcs_repository_free(repo);
+    
+    // A damaged index is refused rather than half read
+    FILE *f = fopen("/tmp/svcs_index_test3/.svcs/index", "r+b");
+    assert(f != NULL);
+    fseek(f, 100, SEEK_SET);
+    fputc(0xff, f);
+    fclose(f);
+    err = svcs_repository_open(&repo, test_path);
+    assert(err != SVCS_OK);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_index_test3 /tmp/svcs_index_files3");
+    
+    printf("✓ test_index_v2_format passed\n");
+}
+
+// Entries as version 1 files stored them
+typedef struct {
+    char path[SVCS_MAX_PATH];
+    svcs_hash_t hash;
+    uint32_t mode;
+    time_t mtime;
+    size_t size;
+    svcs_file_status_t status;
+} v1_entry_t;
+
+void test_index_v1_compat() {
+    const char *test_path = "/tmp/svcs_index_test4";
+    const char *added = "/tmp/svcs_index_added.txt";
+    
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_index_test4");
+    write_file(added, "added after upgrade");
+    svcs_repository_init(test_path);
+    
+    v1_entry_t old[2];
+    memset(old, 0, sizeof(old));
+    strcpy(old[0].path, "/tmp/legacy/a.txt");
+    memset(old[0].hash.bytes, 0x11, SVCS_HASH_SIZE);
+    old[0].mode = 0100644;
+    old[0].mtime = 1234;
+    old[0].size = 5;
+    strcpy(old[1].path, "/tmp/legacy/b.txt");
+    memset(old[1].hash.bytes, 0x22, SVCS_HASH_SIZE);
+    
+    FILE *f = fopen("/tmp/svcs_index_test4/.svcs/index", "wb");
+    assert(f != NULL);
+    uint32_t header[2] = { 1, 2 };
+    fwrite(header, sizeof(header), 1, f);
+    fwrite(old, sizeof(old), 1, f);
+    fclose(f);
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(repo->index->entry_count == 2);
+    assert(strcmp(repo->index->entries[0].path, "/tmp/legacy/a.txt") == 0);
+    assert(strcmp(repo->index->entries[1].path, "/tmp/legacy/b.txt") == 0);
+    assert(repo->index->entries[0].mtime == 1234);
+    assert(repo->index->entries[0].mode == 0100644);
+    assert(repo->index->entries[1].hash.bytes[0] == 0x22);
+    
+    // The next save upgrades the file
+    err = svcs_index_add(repo, added);
+    assert(err == SVCS_OK);
+    svcs_repository_free(repo);
+    
+    f = fopen("/tmp/svcs_index_test4/.svcs/index", "rb");
+    assert(f != NULL);
+    char signature[4];
+    assert(fread(signature, 1, 4, f) == 4);
+    fclose(f);
+    assert(memcmp(signature, "SNDX", 4) == 0);
+    
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(repo->index->entry_count == 3);
+    assert(strcmp(repo->index->entries[1].path, "/tmp/legacy/b.txt") == 0);
+    assert(strcmp(repo->index->entries[2].path, added) == 0);
+    svcs_repository_free(repo);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_index_test4");
+    remove(added);
+    
+    printf("✓ test_index_v1_compat passed\n");
+}
+
+void test_index_sorted() {
+    const char *test_path = "/tmp/svcs_index_test5";
+    const char *names[] = { "delta", "alpha", "echo", "charlie", "bravo", "alpha" };
+    const char *sorted[] = { "alpha", "bravo", "charlie", "delta", "echo" };
+    
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_index_test5 /tmp/svcs_index_files5");
+    system("mkdir -p /tmp/svcs_index_files5");
+    svcs_repository_init(test_path);
+    
+    char paths[6][128];
+    const char *path_list[6];
+    for (int i = 0; i < 6; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "/tmp/svcs_index_files5/%s", names[i]);
+        write_file(paths[i], names[i]);
+        path_list[i] = paths[i];
+    }
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    
+    // Added out of order, with one path twice
+    err = svcs_index_add_paths(repo, path_list, 3, 0);
+    assert(err == SVCS_OK);
+    err = svcs_index_add_paths(repo, path_list + 3, 3, 0);
+    assert(err == SVCS_OK);
+    assert(repo->index->entry_count == 5);
+    for (int i = 0; i < 5; i++) {
+        char expected[128];
+        snprintf(expected, sizeof(expected), "/tmp/svcs_index_files5/%s", sorted[i]);
+        assert(strcmp(repo->index->entries[i].path, expected) == 0);
+    }
+    
+    // Re-adding a changed file updates its entry where it is
+    write_file(paths[2], "echo, changed");
+    err = svcs_index_add(repo, paths[2]);
+    assert(err == SVCS_OK);
+    assert(repo->index->entry_count == 5);
+    svcs_hash_t expected;
+    err = svcs_hash_object_algo(repo->hash_algo, SVCS_OBJ_BLOB, "echo, changed", 13, &expected);
+    assert(err == SVCS_OK);
+    assert(svcs_hash_compare(&repo->index->entries[4].hash, &expected) == 0);
+    
+    err = svcs_index_remove(repo, paths[4]);
+    assert(err == SVCS_OK);
+    err = svcs_index_remove(repo, paths[4]);
+    assert(err == SVCS_ERROR_NOT_FOUND);
+    assert(repo->index->entry_count == 4);
+    assert(strstr(repo->index->entries[1].path, "charlie") != NULL);
+    
+    svcs_hash_t commit;
+    svcs_commit_info_t first;
+    err = svcs_commit_create(repo, "Sorted", "Test <test@example.com>", &commit);
+    assert(err == SVCS_OK);
+    err = svcs_commit_info(repo, &commit, &first);
+    assert(err == SVCS_OK);
+    svcs_repository_free(repo);
+    
+    // The same files added in a different order give the same tree
+    system("rm -rf /tmp/svcs_index_test5");
+    svcs_repository_init(test_path);
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    const char *reversed[] = { paths[3], paths[2], paths[1], paths[0] };
+    err = svcs_index_add_paths(repo, reversed, 4, 0);
+    assert(err == SVCS_OK);
+    svcs_commit_info_t second;
+    err = svcs_commit_create(repo, "Reversed", "Test <test@example.com>", &commit);
+    assert(err == SVCS_OK);
+    err = svcs_commit_info(repo, &commit, &second);
+    assert(err == SVCS_OK);
+    assert(svcs_hash_compare(&first.tree, &second.tree) == 0);
+    svcs_repository_free(repo);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_index_test5 /tmp/svcs_index_files5");
+    
+    printf("✓ test_index_sorted passed\n");
+}
+
+void test_index_stat_cache() {
+    const char *test_path = "/tmp/svcs_index_test6";
+    const char *file = "/tmp/svcs_index_stat.txt";
+    
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_index_test6");
+    write_file(file, "cached snippet");
+    svcs_repository_init(test_path);
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    err = svcs_index_add(repo, file);
+    assert(err == SVCS_OK);
+    
+    struct stat st;
+    assert(stat(file, &st) == 0);
+    svcs_index_entry_t *entry = &repo->index->entries[0];
+    assert(entry->mtime == st.st_mtim.tv_sec);
+    assert(entry->mtime_nsec == (uint32_t)st.st_mtim.tv_nsec);
+    assert(entry->ctime == st.st_ctim.tv_sec);
+    assert(entry->ino == (uint64_t)st.st_ino);
+    assert(entry->dev == (uint64_t)st.st_dev);
+    svcs_repository_free(repo);
+    
+    // Stat data survives a reload
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    entry = &repo->index->entries[0];
+    assert(entry->mtime_nsec == (uint32_t)st.st_mtim.tv_nsec);
+    assert(entry->ctime_nsec == (uint32_t)st.st_ctim.tv_nsec);
+    assert(entry->ino == (uint64_t)st.st_ino);
+    
+    // With the stat data matching and the entry older than the index, the
+    // file is not read: a wrong hash goes unnoticed
+    svcs_hash_t real_hash = entry->hash;
+    entry->hash.bytes[0] ^= 0xFF;
+    repo->index->timestamp = entry->mtime + 1;
+    assert(status_of(repo, 0) == SVCS_STATUS_ADDED);
+    
+    // A racy entry is always hashed
+    repo->index->timestamp = entry->mtime;
+    repo->index->timestamp_nsec = entry->mtime_nsec;
+    assert(status_of(repo, 0) == SVCS_STATUS_MODIFIED);
+    
+    // and saved so that the stat check fails from then on
+    err = svcs_index_save(repo);
+    assert(err == SVCS_OK);
+    svcs_repository_free(repo);
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(repo->index->entries[0].size == 0);
+    assert(status_of(repo, 0) == SVCS_STATUS_MODIFIED);
+    repo->index->entries[0].hash = real_hash;
+    assert(status_of(repo, 0) == SVCS_STATUS_ADDED);
+    svcs_repository_free(repo);
+    
+    // Status refreshed the entry when the content matched
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(repo->index->entries[0].size == strlen("cached snippet"));
+    svcs_repository_free(repo);
+    
+    // A touched file with the same content is clean and refreshed
+    struct timespec times[2] = { { st.st_mtim.tv_sec + 10, 0 }, { st.st_mtim.tv_sec + 10, 0 } };
+    assert(utimensat(AT_FDCWD, file, times, 0) == 0);
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(status_of(repo, 0) == SVCS_STATUS_ADDED);
+    svcs_repository_free(repo);
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(repo->index->entries[0].mtime == st.st_mtim.tv_sec + 10);
+    
+    // Content changed with the size kept
+    write_file(file, "cached snippeT");
+    assert(status_of(repo, 0) == SVCS_STATUS_MODIFIED);
+    
+    remove(file);
+    assert(status_of(repo, 0) == SVCS_STATUS_DELETED);
+    svcs_repository_free(repo);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_index_test6");
+    
+    printf("✓ test_index_stat_cache passed\n");
+}
+
+void test_index_status_parallel() {
+    const char *test_path = "/tmp/svcs_index_test7";
+    const int file_count = 500;
+    
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_index_test7 /tmp/svcs_index_files7");
+    system("mkdir -p /tmp/svcs_index_files7");
+    svcs_repository_init(test_path);
+    
+    static char paths[500][128];
+    const char *path_list[500];
+    for (int i = 0; i < file_count; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "/tmp/svcs_index_files7/snippet_%03d.txt", i);
+        write_file(paths[i], paths[i]);
+        path_list[i] = paths[i];
+    }
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    err = svcs_index_add_paths(repo, path_list, file_count, 0);
+    assert(err == SVCS_OK);
+    svcs_repository_free(repo);
+    
+    // Every seventh file changed, every eleventh gone
+    for (int i = 0; i < file_count; i++) {
+        if (i % 11 == 0) {
+            remove(paths[i]);
+        } else if (i % 7 == 0) {
+            write_file(paths[i], "changed");
+        }
+    }
+    
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    for (int round = 0; round < 2; round++) {
+        svcs_index_entry_t *entries;
+        size_t count;
+        err = svcs_index_status(repo, &entries, &count);
+        assert(err == SVCS_OK);
+        assert(count == (size_t)file_count);
+        
+        // Results come back in index order however the work was split
+        for (int i = 0; i < file_count; i++) {
+            assert(strcmp(entries[i].path, paths[i]) == 0);
+            if (i % 11 == 0) {
+                assert(entries[i].status == SVCS_STATUS_DELETED);
+            } else if (i % 7 == 0) {
+                assert(entries[i].status == SVCS_STATUS_MODIFIED);
+            } else {
+                assert(entries[i].status == SVCS_STATUS_ADDED);
+            }
+        }
+        free(entries);
+    }
+    svcs_repository_free(repo);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_index_test7 /tmp/svcs_index_files7");
+    
+    printf("✓ test_index_status_parallel passed\n");
+}
+
+static size_t count_shared_indexes(const char *git_dir) {
+    DIR *dir = opendir(git_dir);
+    assert(dir != NULL);
+    size_t count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        count += strncmp(entry->d_name, "sharedindex.", 12) == 0;
+    }
+    closedir(dir);
+    return count;
+}
+
+static off_t index_file_size(const char *git_dir) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/index", git_dir);
+    struct stat st;
+    assert(stat(path, &st) == 0);
+    return st.st_size;
+}
+
+static svcs_index_entry_t* index_entry(svcs_repository_t *repo, const char *path) {
+    for (size_t i = 0; i < repo->index->entry_count; i++) {
+        if (strcmp(repo->index->entries[i].path, path) == 0) {
+            return &repo->index->entries[i];
+        }
+    }
+    return NULL;
+}
+
+void test_index_split() {
+    const char *test_path = "/tmp/svcs_index_split";
+    const char *git_dir = "/tmp/svcs_index_split/.svcs";
+    enum { BASE_FILES = 200, MORE_FILES = 60 };
+    
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_index_split /tmp/svcs_index_split_files");
+    system("mkdir -p /tmp/svcs_index_split_files");
+    svcs_repository_init(test_path);
+    system("printf '[core]\\n\\tsplitindex = true\\n' >> /tmp/svcs_index_split/.svcs/config");
+    
+    static char paths[BASE_FILES + MORE_FILES][128];
+    const char *path_list[BASE_FILES + MORE_FILES];
+    for (int i = 0; i < BASE_FILES + MORE_FILES; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "/tmp/svcs_index_split_files/snippet_%03d.txt", i);
+        write_file(paths[i], paths[i]);
+        path_list[i] = paths[i];
+    }
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    
+    // The first save writes every entry to the base
+    err = svcs_index_add_paths(repo, path_list, BASE_FILES, 0);
+    assert(err == SVCS_OK);
+    assert(count_shared_indexes(git_dir) == 1);
+    off_t empty_size = index_file_size(git_dir);
+    
+    // Single changes only touch the small index file
+    const char *extra = "/tmp/svcs_index_split_files/extra.txt";
+    write_file(extra, "extra");
+    err = svcs_index_add(repo, extra);
+    assert(err == SVCS_OK);
+    assert(index_file_size(git_dir) < empty_size + 256);
+    err = svcs_index_remove(repo, paths[0]);
+    assert(err == SVCS_OK);
+    write_file(paths[1], "changed");
+    err = svcs_index_add(repo, paths[1]);
+    assert(err == SVCS_OK);
+    assert(index_file_size(git_dir) < empty_size + 1024);
+    assert(count_shared_indexes(git_dir) == 1);
+    
+    svcs_hash_t changed_hash;
+    err = svcs_hash_file_algo(repo->hash_algo, paths[1], &changed_hash);
+    assert(err == SVCS_OK);
+    svcs_repository_free(repo);
+    
+    // Loading merges the base and the changes
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(repo->index->entry_count == BASE_FILES);
+    assert(index_entry(repo, extra) != NULL);
+    assert(index_entry(repo, paths[0]) == NULL);
+    assert(svcs_hash_compare(&index_entry(repo, paths[1])->hash, &changed_hash) == 0);
+    for (size_t i = 1; i < repo->index->entry_count; i++) {
+        assert(strcmp(repo->index->entries[i - 1].path, repo->index->entries[i].path) < 0);
+    }
+    
+    svcs_index_entry_t *entries;
+    size_t count;
+    err = svcs_index_status(repo, &entries, &count);
+    assert(err == SVCS_OK);
+    assert(count == BASE_FILES);
+    for (size_t i = 0; i < count; i++) {
+        assert(entries[i].status == SVCS_STATUS_ADDED);
+    }
+    free(entries);
+    
+    // Enough changes rewrite the base and remove the old one
+    err = svcs_index_add_paths(repo, path_list + BASE_FILES, MORE_FILES, 0);
+    assert(err == SVCS_OK);
+    assert(count_shared_indexes(git_dir) == 1);
+    assert(index_file_size(git_dir) == empty_size);
+    svcs_repository_free(repo);
+    
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(repo->index->entry_count == BASE_FILES + MORE_FILES);
+    
+    // Removals rewrite it the same way
+    for (int i = BASE_FILES; i < BASE_FILES + MORE_FILES; i++) {
+        err = svcs_index_remove(repo, paths[i]);
+        assert(err == SVCS_OK);
+        assert(count_shared_indexes(git_dir) == 1);
+    }
+    svcs_repository_free(repo);
+    
+    // Without core.splitindex the next save writes the whole index again
+    system("printf '[core]\\n\\tsplitindex = false\\n' >> /tmp/svcs_index_split/.svcs/config");
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    err = svcs_index_add(repo, paths[0]);
+    assert(err == SVCS_OK);
+    assert(count_shared_indexes(git_dir) == 0);
+    assert(index_file_size(git_dir) > empty_size + 1024);
+    svcs_repository_free(repo);
+    
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(repo->index->entry_count == BASE_FILES + 1);
+    svcs_repository_free(repo);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_index_split /tmp/svcs_index_split_files");
+    
+    printf("✓ test_index_split passed\n");
+}
+
+int main() {
+    printf("Running index tests...\n");
+    
+    test_index_add_paths();
+    test_index_add_paths_missing();
+    test_index_v2_format();
+    test_index_v1_compat();
+    test_index_sorted();
+    test_index_stat_cache();
+    test_index_status_parallel();
+    test_index_split();
+    
+    printf("All index tests passed! ✓\n");
+    return 0;
+}
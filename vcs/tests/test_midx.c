@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "svcs.h"
+#include "test_util.h"
+
+static void check_blob(svcs_repository_t *repo, const svcs_hash_t *hash, const char *content) {
+    assert(svcs_object_exists(repo, hash));
+
+    svcs_object_t *obj;
+    svcs_error_t err = svcs_object_read(repo, hash, &obj);
+    assert(err == SVCS_OK);
+    assert(obj->size == strlen(content));
+    assert(memcmp(obj->data, content, obj->size) == 0);
+    svcs_object_free(obj);
+}
+
+static void remove_pack(const char *test_path, const svcs_hash_t *pack_hash) {
+    char hash_str[SVCS_HASH_HEX_SIZE];
+    svcs_hash_to_string(pack_hash, hash_str);
+    char command[1024];
+    snprintf(command, sizeof(command), "rm -f %s/.svcs/objects/pack/pack-%s.*", test_path, hash_str);
+    system(command);
+}
+
+void test_midx_incremental() {
+    const char *test_path = "/tmp/svcs_midx_test";
+    enum { PACKS = 4, PER_PACK = 5 };
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_midx_test");
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(svcs_midx_pack_count(repo) == 0);
+
+    // Each new pack is merged into the index as it is written
+    char contents[PACKS][PER_PACK][64];
+    svcs_hash_t hashes[PACKS][PER_PACK];
+    svcs_hash_t pack_hash;
+    for (int p = 0; p < PACKS; p++) {
+        for (int i = 0; i < PER_PACK; i++) {
+            snprintf(contents[p][i], sizeof(contents[p][i]), "snippet %d from import %d", i, p);
+            write_blob(repo, contents[p][i], &hashes[p][i]);
+        }
+        err = svcs_pack_write(repo, hashes[p], PER_PACK, &pack_hash);
+        assert(err == SVCS_OK);
+        assert(svcs_midx_pack_count(repo) == (size_t)p + 1);
+        assert(svcs_midx_object_count(repo) == (size_t)(p + 1) * PER_PACK);
+    }
+
+    // An object in two packs is indexed once
+    svcs_hash_t extra[2];
+    extra[0] = hashes[0][0];
+    write_blob(repo, "one more snippet", &extra[1]);
+    err = svcs_pack_write(repo, extra, 2, &pack_hash);
+    assert(err == SVCS_OK);
+    assert(svcs_midx_pack_count(repo) == PACKS + 1);
+    assert(svcs_midx_object_count(repo) == PACKS * PER_PACK + 1);
+
+    system("rm -rf /tmp/svcs_midx_test/.svcs/objects/[0-9a-f][0-9a-f]");
+    svcs_repository_free(repo);
+
+    // The index is mapped again on open and serves every read
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(svcs_midx_pack_count(repo) == PACKS + 1);
+    for (int p = 0; p < PACKS; p++) {
+        for (int i = 0; i < PER_PACK; i++) {
+            check_blob(repo, &hashes[p][i], contents[p][i]);
+        }
+    }
+    check_blob(repo, &extra[1], "one more snippet");
+
+    svcs_hash_t missing = hashes[1][1];
+    missing.bytes[SVCS_HASH_SIZE - 1] ^= 0xFF;
+    svcs_object_t *obj;
+    err = svcs_object_read(repo, &missing, &obj);
+    assert(err == SVCS_ERROR_NOT_FOUND);
+    assert(!svcs_object_exists(repo, &missing));
+
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_midx_test");
+
+    printf("✓ test_midx_incremental passed\n");
+}
+
+void test_midx_uncovered_and_stale() {
+    const char *test_path = "/tmp/svcs_midx_test2";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_midx_test2");
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    svcs_hash_t first, second, first_pack, second_pack;
+    write_blob(repo, "indexed snippet", &first);
+    err = svcs_pack_write(repo, &first, 1, &first_pack);
+    assert(err == SVCS_OK);
+    assert(svcs_midx_pack_count(repo) == 1);
+
+    // A pack published by a batch is not in the index yet
+    err = svcs_write_batch_begin(repo);
+    assert(err == SVCS_OK);
+    write_blob(repo, "batched snippet", &second);
+    err = svcs_pack_write(repo, &second, 1, &second_pack);
+    assert(err == SVCS_OK);
+    err = svcs_write_batch_commit(repo);
+    assert(err == SVCS_OK);
+
+    system("rm -rf /tmp/svcs_midx_test2/.svcs/objects/[0-9a-f][0-9a-f]");
+    svcs_repository_free(repo);
+
+    // Packs the index does not cover are still searched
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(svcs_midx_pack_count(repo) == 1);
+    check_blob(repo, &first, "indexed snippet");
+    check_blob(repo, &second, "batched snippet");
+    svcs_repository_free(repo);
+
+    // An index naming a pack that is gone is ignored until rewritten
+    remove_pack(test_path, &first_pack);
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(svcs_midx_pack_count(repo) == 0);
+    assert(!svcs_object_exists(repo, &first));
+    check_blob(repo, &second, "batched snippet");
+
+    err = svcs_midx_write(repo);
+    assert(err == SVCS_OK);
+    assert(svcs_midx_pack_count(repo) == 1);
+    assert(svcs_midx_object_count(repo) == 1);
+    check_blob(repo, &second, "batched snippet");
+
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_midx_test2");
+
+    printf("✓ test_midx_uncovered_and_stale passed\n");
+}
+
+int main() {
+    printf("Running multi-pack index tests...\n");
+
+    test_midx_incremental();
+    test_midx_uncovered_and_stale();
+
+    printf("All multi-pack index tests passed! ✓\n");
+    return 0;
+}
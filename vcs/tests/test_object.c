@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <pthread.h>
 #include "svcs.h"
 
 void test_object_create_blob() {
@@ -55,6 +56,67 @@ void test_object_create_blob() {
     printf("✓ test_object_create_blob passed\n");
 }
 
+void test_object_create_blob_large() {
+    const char *test_path = "/tmp/svcs_object_test4";
+    const char *test_file = "/tmp/test_blob_large.txt";
+    
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_object_test4");
+    
+    // Larger than one I/O chunk so the blob is streamed in pieces
+    size_t size = 300 * 1024 + 17;
+    char *content = malloc(size);
+    assert(content != NULL);
+    for (size_t i = 0; i < size; i++) {
+        content[i] = (char)('a' + (i * 31 + i / 1000) % 26);
+    }
+    
+    FILE *f = fopen(test_file, "wb");
+    assert(f != NULL);
+    fwrite(content, 1, size, f);
+    fclose(f);
+    
+    svcs_repository_init(test_path);
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    
+    svcs_hash_t hash;
+    err = svcs_object_create_blob(repo, test_file, &hash);
+    assert(err == SVCS_OK);
+    
+    svcs_hash_t expected;
+    err = svcs_hash_object_algo(repo->hash_algo, SVCS_OBJ_BLOB, content, size, &expected);
+    assert(err == SVCS_OK);
+    assert(svcs_hash_compare(&hash, &expected) == 0);
+    
+    // Storing it again must not leave temp files behind
+    err = svcs_object_create_blob(repo, test_file, &hash);
+    assert(err == SVCS_OK);
+    assert(system("ls /tmp/svcs_object_test4/.svcs/objects/tmp_obj_* >/dev/null 2>&1") != 0);
+    
+    svcs_object_t *obj;
+    err = svcs_object_read(repo, &hash, &obj);
+    assert(err == SVCS_OK);
+    assert(obj->size == size);
+    assert(memcmp(obj->data, content, size) == 0);
+    svcs_object_free(obj);
+    
+    // Missing files are reported as such
+    err = svcs_object_create_blob(repo, "/tmp/svcs_no_such_file", &hash);
+    assert(err == SVCS_ERROR_NOT_FOUND);
+    
+    svcs_repository_free(repo);
+    free(content);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_object_test4");
+    remove(test_file);
+    
+    printf("✓ test_object_create_blob_large passed\n");
+}
+
 void test_object_write_read() {
     const char *test_path = "/tmp/svcs_object_test2";
     
@@ -69,13 +131,14 @@ void test_object_write_read() {
     // Create a test object
     const char *test_data = "Test object content";
     svcs_hash_t hash;
-    err = svcs_hash_object(SVCS_OBJ_BLOB, test_data, strlen(test_data), &hash);
+    err = svcs_hash_object_algo(repo->hash_algo, SVCS_OBJ_BLOB, test_data, strlen(test_data), &hash);
     assert(err == SVCS_OK);
     
     svcs_object_t obj = {
         .type = SVCS_OBJ_BLOB,
         .size = strlen(test_data),
-        .hash = hash
+        .hash = hash,
+        .data = (void*)test_data
     };
     
     // Write object
@@ -92,6 +155,7 @@ void test_object_write_read() {
     assert(read_obj->type == SVCS_OBJ_BLOB);
     assert(read_obj->size == strlen(test_data));
     assert(svcs_hash_compare(&read_obj->hash, &hash) == 0);
+    assert(memcmp(read_obj->data, test_data, strlen(test_data)) == 0);
     
     svcs_object_free(read_obj);
     svcs_repository_free(repo);
@@ -130,12 +194,554 @@ void test_object_nonexistent() {
     printf("✓ test_object_nonexistent passed\n");
 }
 
+static int loose_codec_byte(svcs_repository_t *repo, const svcs_hash_t *hash) {
+    char hash_str[SVCS_HASH_HEX_SIZE];
+    svcs_hash_to_string(hash, hash_str);
+    
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/objects/%.2s/%s", repo->git_dir, hash_str, hash_str + 2);
+    
+    FILE *f = fopen(path, "rb");
+    assert(f != NULL);
+    int byte = fgetc(f);
+    fclose(f);
+    return byte;
+}
+
+// Pack a single object and return the codec byte its entry starts with
+static int pack_codec_byte(svcs_repository_t *repo, const svcs_hash_t *hash) {
+    svcs_hash_t pack_hash;
+    svcs_error_t err = svcs_pack_write(repo, hash, 1, &pack_hash);
+    assert(err == SVCS_OK);
+    
+    char hash_str[SVCS_HASH_HEX_SIZE];
+    svcs_hash_to_string(&pack_hash, hash_str);
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/objects/pack/pack-%s.pack", repo->git_dir, hash_str);
+    
+    // Skip the pack header and the entry's type/size varint
+    FILE *f = fopen(path, "rb");
+    assert(f != NULL);
+    assert(fseek(f, 12, SEEK_SET) == 0);
+    int byte;
+    while ((byte = fgetc(f)) & 0x80) {
+        assert(byte != EOF);
+    }
+    byte = fgetc(f);
+    fclose(f);
+    return byte;
+}
+
+static void write_blob(svcs_repository_t *repo, const char *content, size_t size, svcs_hash_t *hash) {
+    svcs_error_t err = svcs_hash_object_algo(repo->hash_algo, SVCS_OBJ_BLOB, content, size, hash);
+    assert(err == SVCS_OK);
+    
+    svcs_object_t obj = {
+        .type = SVCS_OBJ_BLOB,
+        .size = size,
+        .hash = *hash,
+        .data = (void*)content
+    };
+    err = svcs_object_write(repo, &obj);
+    assert(err == SVCS_OK);
+}
+
+static void assert_blob(svcs_repository_t *repo, const svcs_hash_t *hash, const char *content, size_t size) {
+    svcs_object_t *obj;
+    svcs_error_t err = svcs_object_read(repo, hash, &obj);
+    assert(err == SVCS_OK);
+    assert(obj->size == size);
+    assert(memcmp(obj->data, content, size) == 0);
+    svcs_object_free(obj);
+}
+
+void test_object_codecs() {
+    const char *test_path = "/tmp/svcs_object_test5";
+    
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_object_test5");
+    svcs_repository_init(test_path);
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    
+    // Tiny objects are stored uncompressed
+    svcs_hash_t tiny_hash;
+    write_blob(repo, "x = 1", 5, &tiny_hash);
+    assert(loose_codec_byte(repo, &tiny_hash) == 0);
+    assert_blob(repo, &tiny_hash, "x = 1", 5);
+    
+    // Larger objects go through the configured codec
+    char large[4096];
+    for (size_t i = 0; i < sizeof(large); i++) {
+        large[i] = "def snippet(): return 42\n"[i % 25];
+    }
+    svcs_hash_t large_hash;
+    write_blob(repo, large, sizeof(large), &large_hash);
+    int codec = loose_codec_byte(repo, &large_hash);
+    assert(codec == 1 || codec == 2);
+    assert_blob(repo, &large_hash, large, sizeof(large));
+    
+    // Objects written before codecs existed are bare zlib streams
+    const char *legacy = "legacy snippet content";
+    char raw[64];
+    int raw_len = snprintf(raw, sizeof(raw), "blob %zu", strlen(legacy)) + 1;
+    memcpy(raw + raw_len, legacy, strlen(legacy));
+    raw_len += strlen(legacy);
+    
+    svcs_hash_t legacy_hash;
+    err = svcs_hash_object_algo(repo->hash_algo, SVCS_OBJ_BLOB, legacy, strlen(legacy), &legacy_hash);
+    assert(err == SVCS_OK);
+    
+    void *compressed;
+    size_t compressed_size;
+    err = svcs_compress(raw, raw_len, &compressed, &compressed_size);
+    assert(err == SVCS_OK);
+    
+    char hash_str[SVCS_HASH_HEX_SIZE];
+    svcs_hash_to_string(&legacy_hash, hash_str);
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/objects/%.2s", repo->git_dir, hash_str);
+    svcs_mkdir_recursive(path);
+    snprintf(path, sizeof(path), "%s/objects/%.2s/%s", repo->git_dir, hash_str, hash_str + 2);
+    err = svcs_file_write(path, compressed, compressed_size);
+    assert(err == SVCS_OK);
+    free(compressed);
+    
+    assert_blob(repo, &legacy_hash, legacy, strlen(legacy));
+    
+    // Pack entries use the same codecs
+    assert(pack_codec_byte(repo, &tiny_hash) == 0);
+    assert(pack_codec_byte(repo, &large_hash) == codec);
+    system("rm -rf /tmp/svcs_object_test5/.svcs/objects/[0-9a-f][0-9a-f]");
+    svcs_repository_free(repo);
+    
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert_blob(repo, &tiny_hash, "x = 1", 5);
+    assert_blob(repo, &large_hash, large, sizeof(large));
+    svcs_repository_free(repo);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_object_test5");
+    
+    printf("✓ test_object_codecs passed\n");
+}
+
+void test_object_compression_dict() {
+    const char *test_path = "/tmp/svcs_object_test6";
+    const int sample_count = 600;
+    
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_object_test6");
+    svcs_repository_init(test_path);
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    
+    // Nothing to sample, with or without zstd
+    uint32_t dict_id;
+    assert(svcs_compression_train_dict(repo, 1000, &dict_id) == SVCS_ERROR_INVALID);
+    svcs_hash_t empty;
+    write_blob(repo, "", 0, &empty);
+    assert(svcs_compression_train_dict(repo, 1000, &dict_id) == SVCS_ERROR_INVALID);
+    
+    // Many small snippets sharing boilerplate, as a dictionary would see
+    char snippet[512];
+    for (int i = 0; i < sample_count; i++) {
+        int len = snprintf(snippet, sizeof(snippet),
+                           "import os\nimport sys\n\ndef handler_%d(request):\n"
+                           "    value = request.get('field_%d', %d)\n"
+                           "    return {'status': 'ok', 'value': value * %d}\n",
+                           i, i % 37, i * 13, i % 7);
+        svcs_hash_t hash;
+        write_blob(repo, snippet, len, &hash);
+    }
+    
+    err = svcs_compression_train_dict(repo, 1000, &dict_id);
+    if (err == SVCS_ERROR_INVALID) {
+        // Built without zstd
+        svcs_repository_free(repo);
+        system("rm -rf /tmp/svcs_object_test6");
+        printf("✓ test_object_compression_dict skipped (no zstd)\n");
+        return;
+    }
+    assert(err == SVCS_OK);
+    assert(dict_id != 0);
+    
+    // New small objects use the dictionary
+    int len = snprintf(snippet, sizeof(snippet),
+                       "import os\nimport sys\n\ndef handler_new(request):\n"
+                       "    value = request.get('field_new', 1)\n"
+                       "    return {'status': 'ok', 'value': value}\n");
+    svcs_hash_t hash;
+    write_blob(repo, snippet, len, &hash);
+    assert(loose_codec_byte(repo, &hash) == 3);
+    assert_blob(repo, &hash, snippet, len);
+    svcs_repository_free(repo);
+    
+    // ...and stay readable after reopening
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert_blob(repo, &hash, snippet, len);
+    
+    // Packing keeps the dictionary
+    assert(pack_codec_byte(repo, &hash) == 3);
+    
+    svcs_hash_t *loose;
+    size_t loose_count;
+    err = svcs_pack_list_loose(repo, &loose, &loose_count);
+    assert(err == SVCS_OK);
+    svcs_hash_t pack_hash;
+    err = svcs_pack_write(repo, loose, loose_count, &pack_hash);
+    assert(err == SVCS_OK);
+    free(loose);
+    system("rm -rf /tmp/svcs_object_test6/.svcs/objects/[0-9a-f][0-9a-f]");
+    svcs_repository_free(repo);
+    
+    // Packed blobs are read through the dictionary and still sampled
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert_blob(repo, &hash, snippet, len);
+    uint32_t packed_dict_id;
+    assert(svcs_compression_train_dict(repo, 1000, &packed_dict_id) == SVCS_OK);
+    svcs_repository_free(repo);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_object_test6");
+    
+    printf("✓ test_object_compression_dict passed\n");
+}
+
+void test_object_decompress_exact() {
+    char input[10000];
+    for (size_t i = 0; i < sizeof(input); i++) {
+        input[i] = "snippet body\n"[i % 13];
+    }
+    
+    void *compressed;
+    size_t compressed_size;
+    svcs_error_t err = svcs_compress(input, sizeof(input), &compressed, &compressed_size);
+    assert(err == SVCS_OK);
+    
+    // Decompressing into a buffer of the known size needs no retries
+    char output[sizeof(input)];
+    err = svcs_decompress_into(compressed, compressed_size, output, sizeof(output));
+    assert(err == SVCS_OK);
+    assert(memcmp(output, input, sizeof(input)) == 0);
+    
+    // A size that does not match the stream is rejected either way
+    err = svcs_decompress_into(compressed, compressed_size, output, sizeof(output) - 1);
+    assert(err == SVCS_ERROR_CORRUPT);
+    char *larger = malloc(sizeof(input) + 1);
+    err = svcs_decompress_into(compressed, compressed_size, larger, sizeof(input) + 1);
+    assert(err == SVCS_ERROR_CORRUPT);
+    free(larger);
+    
+    // Truncated streams fail rather than returning partial output
+    err = svcs_decompress_into(compressed, compressed_size / 2, output, sizeof(output));
+    assert(err == SVCS_ERROR_CORRUPT);
+    
+    // The growing path still handles output far larger than its first guess
+    void *grown;
+    size_t grown_size;
+    err = svcs_decompress(compressed, compressed_size, &grown, &grown_size);
+    assert(err == SVCS_OK);
+    assert(grown_size == sizeof(input));
+    assert(memcmp(grown, input, sizeof(input)) == 0);
+    free(grown);
+    
+    err = svcs_decompress(compressed, compressed_size / 2, &grown, &grown_size);
+    assert(err == SVCS_ERROR_CORRUPT);
+    free(compressed);
+    
+    printf("✓ test_object_decompress_exact passed\n");
+}
+
+void test_object_corrupt_header() {
+    const char *test_path = "/tmp/svcs_object_test7";
+    
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_object_test7");
+    svcs_repository_init(test_path);
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    
+    svcs_hash_t hash;
+    const char *content = "header says more than the stream holds";
+    write_blob(repo, content, strlen(content), &hash);
+    
+    // Rewrite the object with a header that overstates the content size
+    char raw[128];
+    int raw_len = snprintf(raw, sizeof(raw), "blob %zu", strlen(content) + 10) + 1;
+    memcpy(raw + raw_len, content, strlen(content));
+    raw_len += strlen(content);
+    
+    void *compressed;
+    size_t compressed_size;
+    err = svcs_compress(raw, raw_len, &compressed, &compressed_size);
+    assert(err == SVCS_OK);
+    
+    char hash_str[SVCS_HASH_HEX_SIZE];
+    svcs_hash_to_string(&hash, hash_str);
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/objects/%.2s/%s", repo->git_dir, hash_str, hash_str + 2);
+    err = svcs_file_write(path, compressed, compressed_size);
+    assert(err == SVCS_OK);
+    free(compressed);
+    
+    svcs_object_t *obj;
+    err = svcs_object_read(repo, &hash, &obj);
+    assert(err == SVCS_ERROR_CORRUPT);
+    
+    svcs_repository_free(repo);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_object_test7");
+    
+    printf("✓ test_object_corrupt_header passed\n");
+}
+
+void test_object_info() {
+    const char *test_path = "/tmp/svcs_object_test8";
+    
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_object_test8");
+    svcs_repository_init(test_path);
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    
+    svcs_hash_t tiny_hash;
+    write_blob(repo, "x = 1", 5, &tiny_hash);
+    
+    // Poorly compressible content spans many blocks of the compressed stream
+    size_t large_size = 300 * 1024;
+    char *large = malloc(large_size);
+    uint32_t state = 12345;
+    for (size_t i = 0; i < large_size; i++) {
+        state = state * 1103515245 + 12345;
+        large[i] = (char)(state >> 16);
+    }
+    svcs_hash_t large_hash;
+    write_blob(repo, large, large_size, &large_hash);
+    free(large);
+    
+    svcs_object_type_t type;
+    size_t size;
+    err = svcs_object_info(repo, &tiny_hash, &type, &size);
+    assert(err == SVCS_OK);
+    assert(type == SVCS_OBJ_BLOB);
+    assert(size == 5);
+    
+    err = svcs_object_info(repo, &large_hash, &type, &size);
+    assert(err == SVCS_OK);
+    assert(type == SVCS_OBJ_BLOB);
+    assert(size == large_size);
+    
+    svcs_hash_t missing;
+    memset(&missing, 0xAB, sizeof(missing));
+    err = svcs_object_info(repo, &missing, &type, &size);
+    assert(err == SVCS_ERROR_NOT_FOUND);
+    
+    svcs_repository_free(repo);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_object_test8");
+    
+    printf("✓ test_object_info passed\n");
+}
+
+void test_object_cache() {
+    const char *test_path = "/tmp/svcs_object_test9";
+    
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_object_test9");
+    svcs_repository_init(test_path);
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    
+    svcs_hash_t hashes[64];
+    char contents[64][32];
+    for (int i = 0; i < 64; i++) {
+        snprintf(contents[i], sizeof(contents[i]), "cached snippet %d", i);
+        write_blob(repo, contents[i], strlen(contents[i]), &hashes[i]);
+    }
+    
+    // The first read misses, later reads are served from memory
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 64; i++) {
+            assert_blob(repo, &hashes[i], contents[i], strlen(contents[i]));
+        }
+    }
+    
+    svcs_cache_stats_t stats;
+    svcs_object_cache_stats(repo, &stats);
+    assert(stats.misses == 64);
+    assert(stats.hits == 128);
+    assert(stats.count == 64);
+    assert(stats.evictions == 0);
+    
+    // Cached objects no longer touch the object store
+    system("rm -rf /tmp/svcs_object_test9/.svcs/objects/[0-9a-f][0-9a-f]");
+    assert_blob(repo, &hashes[0], contents[0], strlen(contents[0]));
+    
+    // Shrinking the budget evicts down to it
+    svcs_object_cache_set_limit(repo, 16 * 64);
+    svcs_object_cache_stats(repo, &stats);
+    assert(stats.size <= 16 * 64);
+    assert(stats.evictions > 0);
+    
+    // A zero budget disables the cache entirely
+    svcs_object_cache_set_limit(repo, 0);
+    svcs_object_cache_stats(repo, &stats);
+    assert(stats.count == 0);
+    svcs_object_t *obj;
+    err = svcs_object_read(repo, &hashes[1], &obj);
+    assert(err == SVCS_ERROR_NOT_FOUND);
+    
+    svcs_repository_free(repo);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_object_test9");
+    
+    printf("✓ test_object_cache passed\n");
+}
+
+typedef struct {
+    svcs_repository_t *repo;
+    const svcs_hash_t *hashes;
+    char (*contents)[32];
+} cache_reader_t;
+
+static void* read_cached_blobs(void *arg) {
+    cache_reader_t *reader = arg;
+    for (int round = 0; round < 50; round++) {
+        for (int i = 0; i < 64; i++) {
+            assert_blob(reader->repo, &reader->hashes[i], reader->contents[i], strlen(reader->contents[i]));
+        }
+    }
+    return NULL;
+}
+
+void test_object_cache_concurrent() {
+    const char *test_path = "/tmp/svcs_object_test9b";
+    
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_object_test9b");
+    svcs_repository_init(test_path);
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    
+    svcs_hash_t hashes[64];
+    char contents[64][32];
+    for (int i = 0; i < 64; i++) {
+        snprintf(contents[i], sizeof(contents[i]), "shared snippet %d", i);
+        write_blob(repo, contents[i], strlen(contents[i]), &hashes[i]);
+    }
+    
+    // The limit changes and the counters are read while other threads read
+    enum { READERS = 4 };
+    pthread_t threads[READERS];
+    cache_reader_t reader = { repo, hashes, contents };
+    for (int i = 0; i < READERS; i++) {
+        assert(pthread_create(&threads[i], NULL, read_cached_blobs, &reader) == 0);
+    }
+    svcs_cache_stats_t stats;
+    for (int i = 0; i < 200; i++) {
+        svcs_object_cache_set_limit(repo, i % 2 ? 16 * 64 : 1024 * 1024);
+        svcs_object_cache_stats(repo, &stats);
+    }
+    for (int i = 0; i < READERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    
+    // Every read was counted exactly once
+    svcs_object_cache_stats(repo, &stats);
+    assert(stats.hits + stats.misses == READERS * 50 * 64);
+    
+    svcs_repository_free(repo);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_object_test9b");
+    
+    printf("✓ test_object_cache_concurrent passed\n");
+}
+
+void test_object_loose_cache() {
+    const char *test_path = "/tmp/svcs_object_test10";
+    
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_object_test10");
+    svcs_repository_init(test_path);
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    
+    svcs_hash_t first;
+    write_blob(repo, "first snippet", 13, &first);
+    assert(svcs_object_exists(repo, &first));
+    
+    // Find another object that lands in the same fanout directory
+    char content[64];
+    svcs_hash_t second;
+    for (int i = 0;; i++) {
+        snprintf(content, sizeof(content), "second snippet %d", i);
+        svcs_hash_object_algo(repo->hash_algo, SVCS_OBJ_BLOB, content, strlen(content), &second);
+        if (second.bytes[0] == first.bytes[0]) {
+            break;
+        }
+    }
+    assert(!svcs_object_exists(repo, &second));
+    
+    // Writes recover when a directory known to exist has been removed
+    char command[256];
+    snprintf(command, sizeof(command), "rm -rf %s/objects/%02x", repo->git_dir, first.bytes[0]);
+    system(command);
+    write_blob(repo, content, strlen(content), &second);
+    assert(svcs_object_exists(repo, &second));
+    assert_blob(repo, &second, content, strlen(content));
+    
+    svcs_repository_free(repo);
+    
+    // A fresh listing sees exactly what is on disk
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(!svcs_object_exists(repo, &first));
+    assert(svcs_object_exists(repo, &second));
+    svcs_repository_free(repo);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_object_test10");
+    
+    printf("✓ test_object_loose_cache passed\n");
+}
+
 int main() {
     printf("Running object tests...\n");
     
     test_object_create_blob();
+    test_object_create_blob_large();
     test_object_write_read();
     test_object_nonexistent();
+    test_object_codecs();
+    test_object_compression_dict();
+    test_object_decompress_exact();
+    test_object_corrupt_header();
+    test_object_info();
+    test_object_cache();
+    test_object_cache_concurrent();
+    test_object_loose_cache();
     
     printf("All object tests passed! ✓\n");
     return 0;
@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <dirent.h>
+#include "svcs.h"
+#include "test_util.h"
+
+void test_pack_write_read() {
+    const char *test_path = "/tmp/svcs_pack_test";
+    const char *contents[] = {
+        "int main() { return 0; }",
+        "print('hello snippet')",
+        "",
+        "SELECT * FROM snippets;"
+    };
+    const size_t count = sizeof(contents) / sizeof(contents[0]);
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_pack_test");
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    svcs_hash_t hashes[4];
+    for (size_t i = 0; i < count; i++) {
+        write_blob(repo, contents[i], &hashes[i]);
+    }
+
+    svcs_hash_t *loose;
+    size_t loose_count;
+    err = svcs_pack_list_loose(repo, &loose, &loose_count);
+    assert(err == SVCS_OK);
+    assert(loose_count == count);
+
+    svcs_hash_t pack_hash;
+    err = svcs_pack_write(repo, loose, loose_count, &pack_hash);
+    assert(err == SVCS_OK);
+    free(loose);
+
+    // Remove loose copies so reads must be served from the pack
+    system("rm -rf /tmp/svcs_pack_test/.svcs/objects/[0-9a-f][0-9a-f]");
+    svcs_repository_free(repo);
+
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    for (size_t i = 0; i < count; i++) {
+        assert(svcs_object_exists(repo, &hashes[i]));
+
+        svcs_object_t *obj;
+        err = svcs_object_read(repo, &hashes[i], &obj);
+        assert(err == SVCS_OK);
+        assert(obj->type == SVCS_OBJ_BLOB);
+        assert(obj->size == strlen(contents[i]));
+        assert(memcmp(obj->data, contents[i], obj->size) == 0);
+        svcs_object_free(obj);
+    }
+
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_pack_test");
+
+    printf("✓ test_pack_write_read passed\n");
+}
+
+void test_pack_missing_object() {
+    const char *test_path = "/tmp/svcs_pack_test2";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_pack_test2");
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    svcs_hash_t hash;
+    write_blob(repo, "packed content", &hash);
+
+    svcs_hash_t pack_hash;
+    err = svcs_pack_write(repo, &hash, 1, &pack_hash);
+    assert(err == SVCS_OK);
+
+    // Lookups for hashes in the same fanout bucket must still miss cleanly
+    svcs_hash_t missing = hash;
+    missing.bytes[SVCS_HASH_SIZE - 1] ^= 0xFF;
+
+    svcs_object_t *obj;
+    err = svcs_object_read(repo, &missing, &obj);
+    assert(err == SVCS_ERROR_NOT_FOUND);
+    assert(obj == NULL);
+    assert(!svcs_object_exists(repo, &missing));
+
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_pack_test2");
+
+    printf("✓ test_pack_missing_object passed\n");
+}
+
+void test_pack_bad_fanout() {
+    const char *test_path = "/tmp/svcs_pack_test4";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_pack_test4");
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    svcs_hash_t hash;
+    write_blob(repo, "packed content", &hash);
+
+    svcs_hash_t pack_hash;
+    err = svcs_pack_write(repo, &hash, 1, &pack_hash);
+    assert(err == SVCS_OK);
+    svcs_repository_free(repo);
+    system("rm -rf /tmp/svcs_pack_test4/.svcs/objects/[0-9a-f][0-9a-f]");
+    system("rm -f /tmp/svcs_pack_test4/.svcs/objects/pack/multi-pack-index");
+
+    char hash_str[SVCS_HASH_HEX_SIZE];
+    char idx_path[1024];
+    svcs_hash_to_string(&pack_hash, hash_str);
+    snprintf(idx_path, sizeof(idx_path), "%s/.svcs/objects/pack/pack-%s.idx", test_path, hash_str);
+
+    // A bucket claiming more objects than the one after it, and then a
+    // last entry claiming more objects than the index holds
+    svcs_hash_t probe = hash;
+    probe.bytes[0] = hash.bytes[0] < 255 ? hash.bytes[0] : 0;
+    uint8_t bad_counts[][4] = { { 0xFF, 0xFF, 0xFF, 0xFF }, { 0, 0, 0, 2 } };
+    long offsets[] = { 8 + probe.bytes[0] * 4, 8 + 255 * 4 };
+    for (int i = 0; i < 2; i++) {
+        FILE *f = fopen(idx_path, "r+b");
+        assert(f != NULL);
+        uint8_t saved[4];
+        assert(fseek(f, offsets[i], SEEK_SET) == 0);
+        assert(fread(saved, 1, 4, f) == 4);
+        assert(fseek(f, offsets[i], SEEK_SET) == 0);
+        assert(fwrite(bad_counts[i], 1, 4, f) == 4);
+        fclose(f);
+
+        // The pack is skipped rather than searched out of bounds
+        err = svcs_repository_open(&repo, test_path);
+        assert(err == SVCS_OK);
+        svcs_object_t *obj;
+        err = svcs_object_read(repo, &probe, &obj);
+        assert(err == SVCS_ERROR_NOT_FOUND);
+        err = svcs_object_read(repo, &hash, &obj);
+        assert(err == SVCS_ERROR_NOT_FOUND);
+        svcs_repository_free(repo);
+
+        f = fopen(idx_path, "r+b");
+        assert(f != NULL);
+        assert(fseek(f, offsets[i], SEEK_SET) == 0);
+        assert(fwrite(saved, 1, 4, f) == 4);
+        fclose(f);
+    }
+
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(svcs_object_exists(repo, &hash));
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_pack_test4");
+
+    printf("✓ test_pack_bad_fanout passed\n");
+}
+
+void test_pack_delta_revisions() {
+    const char *test_path = "/tmp/svcs_pack_test3";
+    const int revisions = 20;
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_pack_test3");
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    // Successive revisions of one snippet, each a one-line edit
+    char *contents[20];
+    svcs_hash_t hashes[20];
+    size_t raw_total = 0;
+    for (int rev = 0; rev < revisions; rev++) {
+        contents[rev] = malloc(8192);
+        size_t len = 0;
+        for (int line = 0; line < 100; line++) {
+            len += snprintf(contents[rev] + len, 8192 - len, "    value_%d = compute(%d, %d);\n",
+                            line, line, line == rev ? rev * 7 : line);
+        }
+        raw_total += len;
+        write_blob(repo, contents[rev], &hashes[rev]);
+    }
+
+    svcs_hash_t pack_hash;
+    err = svcs_pack_write(repo, hashes, revisions, &pack_hash);
+    assert(err == SVCS_OK);
+
+    char hash_str[SVCS_HASH_HEX_SIZE];
+    svcs_hash_to_string(&pack_hash, hash_str);
+    char pack_path[1024];
+    snprintf(pack_path, sizeof(pack_path), "%s/.svcs/objects/pack/pack-%s.pack", test_path, hash_str);
+
+    // Deltas should make the pack far smaller than the revisions combined
+    struct stat st;
+    assert(stat(pack_path, &st) == 0);
+    assert((size_t)st.st_size * 5 < raw_total);
+
+    system("rm -rf /tmp/svcs_pack_test3/.svcs/objects/[0-9a-f][0-9a-f]");
+    svcs_repository_free(repo);
+
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    for (int rev = 0; rev < revisions; rev++) {
+        // Delta entries report the size of the object they rebuild
+        svcs_object_type_t type;
+        size_t size;
+        err = svcs_object_info(repo, &hashes[rev], &type, &size);
+        assert(err == SVCS_OK);
+        assert(type == SVCS_OBJ_BLOB);
+        assert(size == strlen(contents[rev]));
+
+        svcs_object_t *obj;
+        err = svcs_object_read(repo, &hashes[rev], &obj);
+        assert(err == SVCS_OK);
+        assert(obj->size == strlen(contents[rev]));
+        assert(memcmp(obj->data, contents[rev], obj->size) == 0);
+        svcs_object_free(obj);
+        free(contents[rev]);
+    }
+
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_pack_test3");
+
+    printf("✓ test_pack_delta_revisions passed\n");
+}
+
+// Files in the pack directory whose name starts with prefix
+static int count_pack_files(const char *pack_dir, const char *prefix) {
+    int count = 0;
+    DIR *dir = opendir(pack_dir);
+    assert(dir != NULL);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, prefix, strlen(prefix)) == 0) {
+            count++;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+void test_pack_write_in_batch() {
+    const char *test_path = "/tmp/svcs_pack_test5";
+    const char *pack_dir = "/tmp/svcs_pack_test5/.svcs/objects/pack";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_pack_test5");
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    svcs_hash_t hashes[2];
+    write_blob(repo, "first batched snippet", &hashes[0]);
+    write_blob(repo, "second batched snippet", &hashes[1]);
+
+    // The pack is streamed to a temp file that only gets its name on commit
+    assert(svcs_write_batch_begin(repo) == SVCS_OK);
+    svcs_hash_t pack_hash;
+    err = svcs_pack_write(repo, hashes, 2, &pack_hash);
+    assert(err == SVCS_OK);
+
+    char hash_str[SVCS_HASH_HEX_SIZE];
+    char pack_path[1024];
+    svcs_hash_to_string(&pack_hash, hash_str);
+    snprintf(pack_path, sizeof(pack_path), "%s/pack-%s.pack", pack_dir, hash_str);
+    assert(!svcs_file_exists(pack_path));
+    assert(count_pack_files(pack_dir, "tmp_pack_") == 1);
+
+    assert(svcs_write_batch_commit(repo) == SVCS_OK);
+    assert(svcs_file_exists(pack_path));
+    assert(count_pack_files(pack_dir, "tmp_pack_") == 0);
+
+    // The trailing checksum covers everything before it
+    void *data;
+    size_t size;
+    err = svcs_file_read(pack_path, &data, &size);
+    assert(err == SVCS_OK);
+    assert(size > SVCS_HASH_SIZE);
+    svcs_hash_t checksum;
+    svcs_hash_update(&checksum, data, size - SVCS_HASH_SIZE);
+    assert(svcs_hash_compare(&checksum, &pack_hash) == 0);
+    assert(memcmp((uint8_t*)data + size - SVCS_HASH_SIZE, pack_hash.bytes, SVCS_HASH_SIZE) == 0);
+    free(data);
+
+    system("rm -rf /tmp/svcs_pack_test5/.svcs/objects/[0-9a-f][0-9a-f]");
+    svcs_repository_free(repo);
+
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    for (int i = 0; i < 2; i++) {
+        svcs_object_t *obj;
+        err = svcs_object_read(repo, &hashes[i], &obj);
+        assert(err == SVCS_OK);
+        svcs_object_free(obj);
+    }
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_pack_test5");
+
+    printf("✓ test_pack_write_in_batch passed\n");
+}
+
+int main() {
+    printf("Running pack tests...\n");
+
+    test_pack_write_read();
+    test_pack_missing_object();
+    test_pack_delta_revisions();
+    test_pack_bad_fanout();
+    test_pack_write_in_batch();
+
+    printf("All pack tests passed! ✓\n");
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "svcs.h"
+#include "test_util.h"
+
+static void check_ahead_behind(svcs_repository_t *repo, const svcs_hash_t *one, const svcs_hash_t *two,
+                               size_t expected_ahead, size_t expected_behind) {
+    size_t ahead, behind;
+    svcs_error_t err = svcs_commit_ahead_behind(repo, one, two, &ahead, &behind);
+    assert(err == SVCS_OK);
+    assert(ahead == expected_ahead);
+    assert(behind == expected_behind);
+}
+
+static size_t count_to_send(svcs_repository_t *repo, const svcs_hash_t *want, const svcs_hash_t *have,
+                            size_t have_count) {
+    svcs_hash_t *objects;
+    size_t count;
+    svcs_error_t err = svcs_objects_to_send(repo, want, 1, have, have_count, &objects, &count);
+    assert(err == SVCS_OK);
+    for (size_t i = 0; i < count; i++) {
+        assert(svcs_object_exists(repo, &objects[i]));
+    }
+    free(objects);
+    return count;
+}
+
+// Queries over the history from test_util.h
+static void check_queries(svcs_repository_t *repo, const history_t *h) {
+    check_ahead_behind(repo, &h->d, &h->e, 3, 1);
+    check_ahead_behind(repo, &h->e, &h->d, 1, 3);
+    check_ahead_behind(repo, &h->d, &h->d, 0, 0);
+    check_ahead_behind(repo, &h->m, &h->a, 3, 0);
+
+    // D, M and B plus D's tree and blob
+    assert(count_to_send(repo, &h->d, &h->e, 1) == 5);
+    // Everything reachable from E: three commits, one tree, one blob
+    assert(count_to_send(repo, &h->e, NULL, 0) == 5);
+    assert(count_to_send(repo, &h->e, &h->d, 1) == 1);
+    svcs_hash_t both[2] = { h->b, h->c };
+    assert(count_to_send(repo, &h->m, both, 2) == 1);
+
+    int result;
+    svcs_error_t err = svcs_commit_is_ancestor(repo, &h->a, &h->d, &result);
+    assert(err == SVCS_OK && result);
+    err = svcs_commit_is_ancestor(repo, &h->c, &h->d, &result);
+    assert(err == SVCS_OK && result);
+    err = svcs_commit_is_ancestor(repo, &h->e, &h->d, &result);
+    assert(err == SVCS_OK && !result);
+    err = svcs_commit_is_ancestor(repo, &h->d, &h->a, &result);
+    assert(err == SVCS_OK && !result);
+}
+
+void test_pack_bitmap_queries() {
+    const char *test_path = "/tmp/svcs_pack_bitmap_test";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_pack_bitmap_test");
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    history_t h;
+    build_history(repo, &h);
+
+    // Walked from the objects before there are bitmaps
+    assert(svcs_pack_bitmap_count(repo) == 0);
+    check_queries(repo, &h);
+
+    // gc stores one bitmap per branch tip
+    svcs_gc_stats_t stats;
+    err = svcs_gc(repo, 60, &stats);
+    assert(err == SVCS_OK);
+    assert(svcs_pack_bitmap_count(repo) == 2);
+    check_queries(repo, &h);
+
+    svcs_repository_free(repo);
+
+    // Bitmaps are mapped again on open, and commits made since the pack
+    // are walked on top of them
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(svcs_pack_bitmap_count(repo) == 2);
+    check_queries(repo, &h);
+
+    svcs_commit_info_t info;
+    err = svcs_commit_info(repo, &h.d, &info);
+    assert(err == SVCS_OK);
+    svcs_hash_t f;
+    make_commit(repo, &info.tree, &h.d, 1, 1600, &f);
+    check_ahead_behind(repo, &f, &h.e, 4, 1);
+    assert(count_to_send(repo, &f, &h.d, 1) == 1);
+
+    // F shares D's tree, which D's bitmap already covers, so only F itself
+    // is read on the way
+    svcs_cache_stats_t before, after;
+    svcs_object_cache_stats(repo, &before);
+    assert(count_to_send(repo, &f, NULL, 0) == 10);
+    svcs_object_cache_stats(repo, &after);
+    assert(after.hits + after.misses == before.hits + before.misses + 1);
+
+    int result;
+    err = svcs_commit_is_ancestor(repo, &h.c, &f, &result);
+    assert(err == SVCS_OK && result);
+    err = svcs_commit_is_ancestor(repo, &f, &h.d, &result);
+    assert(err == SVCS_OK && !result);
+
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_pack_bitmap_test");
+
+    printf("✓ test_pack_bitmap_queries passed\n");
+}
+
+void test_pack_bitmap_long_history() {
+    const char *test_path = "/tmp/svcs_pack_bitmap_test2";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_pack_bitmap_test2");
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    // A chain long enough that commits between the tips get sampled
+    enum { CHAIN = 250 };
+    svcs_hash_t tree;
+    make_tree(repo, "snippet", &tree);
+    svcs_hash_t *chain = malloc(CHAIN * sizeof(svcs_hash_t));
+    assert(chain != NULL);
+    for (size_t i = 0; i < CHAIN; i++) {
+        make_commit(repo, &tree, i ? &chain[i - 1] : NULL, i ? 1 : 0, 1000 + (long)i, &chain[i]);
+    }
+    set_ref(repo, "main", &chain[CHAIN - 1]);
+    set_ref(repo, "old", &chain[10]);
+
+    svcs_gc_stats_t stats;
+    err = svcs_gc(repo, 60, &stats);
+    assert(err == SVCS_OK);
+    assert(stats.reachable_objects == CHAIN + 2);
+    // Two tips and the 100th and 200th commit
+    assert(svcs_pack_bitmap_count(repo) == 4);
+
+    check_ahead_behind(repo, &chain[CHAIN - 1], &chain[50], CHAIN - 51, 0);
+    check_ahead_behind(repo, &chain[10], &chain[CHAIN - 1], 0, CHAIN - 11);
+    check_ahead_behind(repo, &chain[150], &chain[149], 1, 0);
+    assert(count_to_send(repo, &chain[CHAIN - 1], NULL, 0) == CHAIN + 2);
+    assert(count_to_send(repo, &chain[CHAIN - 1], &chain[10], 1) == CHAIN - 11);
+
+    int result;
+    err = svcs_commit_is_ancestor(repo, &chain[0], &chain[CHAIN - 1], &result);
+    assert(err == SVCS_OK && result);
+    err = svcs_commit_is_ancestor(repo, &chain[120], &chain[119], &result);
+    assert(err == SVCS_OK && !result);
+
+    free(chain);
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_pack_bitmap_test2");
+
+    printf("✓ test_pack_bitmap_long_history passed\n");
+}
+
+int main() {
+    printf("Running pack bitmap tests...\n");
+
+    test_pack_bitmap_queries();
+    test_pack_bitmap_long_history();
+
+    printf("All pack bitmap tests passed! ✓\n");
+    return 0;
+}
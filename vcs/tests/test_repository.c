@@ -129,6 +129,42 @@ void test_repository_nested_discovery() {
     printf("✓ test_repository_nested_discovery passed\n");
 }
 
+void test_repository_object_hash() {
+    const char *test_path = "/tmp/svcs_test_repo4";
+    
+    // New repositories address objects by BLAKE3
+    system("rm -rf /tmp/svcs_test_repo4");
+    svcs_repository_init(test_path);
+    
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(repo->hash_algo == SVCS_HASH_BLAKE3);
+    svcs_repository_free(repo);
+    
+    // Repositories without core.objecthash keep SHA3-256
+    system("printf '[remote \"origin\"]\\n\\turl = https://example.com\\n' > /tmp/svcs_test_repo4/.svcs/config");
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(repo->hash_algo == SVCS_HASH_SHA3_256);
+    svcs_repository_free(repo);
+    
+    // Unknown hashes and newer formats are refused rather than misread
+    system("printf '[core]\\n\\tobjecthash = md5\\n' > /tmp/svcs_test_repo4/.svcs/config");
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_ERROR_INVALID);
+    assert(repo == NULL);
+    
+    system("printf '[core]\\n\\trepositoryformatversion = 99\\n' > /tmp/svcs_test_repo4/.svcs/config");
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_ERROR_INVALID);
+    
+    // Cleanup
+    system("rm -rf /tmp/svcs_test_repo4");
+    
+    printf("✓ test_repository_object_hash passed\n");
+}
+
 int main() {
     printf("Running repository tests...\n");
     
@@ -136,6 +172,7 @@ int main() {
     test_repository_open();
     test_repository_is_valid();
     test_repository_nested_discovery();
+    test_repository_object_hash();
     
     printf("All repository tests passed! ✓\n");
     return 0;
@@ -0,0 +1,213 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "svcs.h"
+#include "test_util.h"
+
+#define ROOT "/tmp/svcs_sparse_test"
+
+static int file_holds(const char *path, const char *content) {
+    char buf[256];
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return 0;
+    }
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    return strcmp(buf, content) == 0;
+}
+
+static const svcs_index_entry_t* find_entry(svcs_repository_t *repo, const char *path) {
+    for (size_t i = 0; i < repo->index->entry_count; i++) {
+        if (strcmp(repo->index->entries[i].path, path) == 0) {
+            return &repo->index->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static int is_collapsed(svcs_repository_t *repo, const char *path) {
+    const svcs_index_entry_t *entry = find_entry(repo, path);
+    return entry && S_ISDIR(entry->mode);
+}
+
+static const char *files[] = {
+    ROOT "/docs/guide.txt",
+    ROOT "/readme.txt",
+    ROOT "/snippets/index.txt",
+    ROOT "/snippets/java/Sort.java",
+    ROOT "/snippets/java/util/List.java",
+    ROOT "/snippets/python/lib/util.py",
+    ROOT "/snippets/python/sort.py"
+};
+#define FILE_COUNT (sizeof(files) / sizeof(files[0]))
+
+void test_sparse_checkout_cone() {
+    // Clean up and setup
+    system("rm -rf " ROOT);
+    svcs_repository_init(ROOT);
+    system("mkdir -p " ROOT "/docs " ROOT "/snippets/java/util " ROOT "/snippets/python/lib");
+    for (size_t i = 0; i < FILE_COUNT; i++) {
+        write_file(files[i], files[i]);
+    }
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, ROOT);
+    assert(err == SVCS_OK);
+    err = svcs_index_add_paths(repo, files, FILE_COUNT, 0);
+    assert(err == SVCS_OK);
+    svcs_hash_t commit_hash;
+    err = svcs_commit_create(repo, "Everything", "tester", &commit_hash);
+    assert(err == SVCS_OK);
+    svcs_commit_info_t full;
+    err = svcs_commit_info(repo, &commit_hash, &full);
+    assert(err == SVCS_OK);
+
+    // Directories outside the cone become single entries and leave the
+    // worktree; files in the cone's parents stay
+    const char *cone[] = { "snippets/python/" };
+    err = svcs_sparse_checkout_set(repo, cone, 1);
+    assert(err == SVCS_OK);
+    assert(repo->index->entry_count == 6);
+    assert(is_collapsed(repo, ROOT "/docs"));
+    assert(is_collapsed(repo, ROOT "/snippets/java"));
+    assert(find_entry(repo, ROOT "/snippets/index.txt") != NULL);
+    assert(find_entry(repo, ROOT "/snippets/python/lib/util.py") != NULL);
+    assert(access(ROOT "/docs", F_OK) != 0);
+    assert(access(ROOT "/snippets/java", F_OK) != 0);
+    assert(access(ROOT "/snippets/index.txt", F_OK) == 0);
+    assert(access(ROOT "/.svcs/info/sparse-checkout", F_OK) == 0);
+
+    // A collapsed directory holds the tree a full commit has for it, so
+    // rebuilding its parent gives the same tree as before
+    write_file(files[2], "changed");
+    err = svcs_index_add(repo, files[2]);
+    assert(err == SVCS_OK);
+    write_file(files[2], files[2]);
+    err = svcs_index_add(repo, files[2]);
+    assert(err == SVCS_OK);
+    err = svcs_commit_create(repo, "Sparse", "tester", &commit_hash);
+    assert(err == SVCS_OK);
+    svcs_commit_info_t sparse;
+    err = svcs_commit_info(repo, &commit_hash, &sparse);
+    assert(err == SVCS_OK);
+    assert(svcs_hash_compare(&full.tree, &sparse.tree) == 0);
+
+    // Status leaves the collapsed directories alone
+    svcs_index_entry_t *entries;
+    size_t count;
+    err = svcs_index_status(repo, &entries, &count);
+    assert(err == SVCS_OK);
+    assert(count == 6);
+    for (size_t i = 0; i < count; i++) {
+        assert(entries[i].status == SVCS_STATUS_ADDED);
+    }
+    free(entries);
+
+    // Paths inside a collapsed directory cannot be staged on their own
+    err = svcs_index_add(repo, ROOT "/snippets/java/New.java");
+    assert(err == SVCS_ERROR_INVALID);
+    err = svcs_index_add(repo, "");
+    assert(err == SVCS_ERROR_NOT_FOUND);
+
+    // Commits carry the collapsed trees along
+    write_file(files[6], "sorted differently");
+    err = svcs_index_add(repo, files[6]);
+    assert(err == SVCS_OK);
+    err = svcs_commit_create(repo, "Python only", "tester", &commit_hash);
+    assert(err == SVCS_OK);
+    svcs_repository_free(repo);
+
+    // An index that cannot be saved leaves the cone, the index and the
+    // worktree as they were
+    err = svcs_repository_open(&repo, ROOT);
+    assert(err == SVCS_OK);
+    assert(repo->index->entry_count == 6);
+    system("mv " ROOT "/.svcs/index " ROOT "/.svcs/index.saved && mkdir -p " ROOT "/.svcs/index/blocked");
+    const char *java[] = { "snippets/java" };
+    err = svcs_sparse_checkout_set(repo, java, 1);
+    assert(err != SVCS_OK);
+    assert(is_collapsed(repo, ROOT "/snippets/java"));
+    assert(repo->index->entry_count == 6);
+    assert(access(ROOT "/snippets/java", F_OK) != 0);
+    assert(access(files[5], F_OK) == 0);
+    assert(file_holds(ROOT "/.svcs/info/sparse-checkout", "snippets/python\n"));
+    svcs_repository_free(repo);
+    system("rm -r " ROOT "/.svcs/index && mv " ROOT "/.svcs/index.saved " ROOT "/.svcs/index");
+
+    // Moving the cone checks the other directory out
+    err = svcs_repository_open(&repo, ROOT);
+    assert(err == SVCS_OK);
+    assert(repo->index->entry_count == 6);
+    assert(is_collapsed(repo, ROOT "/snippets/java"));
+    err = svcs_sparse_checkout_set(repo, java, 1);
+    assert(err == SVCS_OK);
+    assert(is_collapsed(repo, ROOT "/snippets/python"));
+    assert(access(ROOT "/snippets/python", F_OK) != 0);
+    assert(file_holds(files[3], files[3]));
+    assert(file_holds(files[4], files[4]));
+    assert(find_entry(repo, files[4]) != NULL);
+
+    // Checked-out files get their stat data, so status need not read them
+    err = svcs_index_status(repo, &entries, &count);
+    assert(err == SVCS_OK);
+    for (size_t i = 0; i < count; i++) {
+        assert(entries[i].status == SVCS_STATUS_ADDED);
+    }
+    free(entries);
+
+    // A file with unstaged changes is never removed
+    write_file(files[2], "not staged");
+    err = svcs_sparse_checkout_set(repo, NULL, 0);
+    assert(err == SVCS_ERROR_EXISTS);
+    assert(file_holds(files[3], files[3]));
+    assert(find_entry(repo, files[2]) != NULL);
+    write_file(files[2], files[2]);
+
+    // Cone directories are relative paths of plain names
+    const char *bad[] = { "/docs", "docs/../snippets", "./docs", "docs//java", ".." };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        err = svcs_sparse_checkout_set(repo, &bad[i], 1);
+        assert(err == SVCS_ERROR_INVALID);
+    }
+
+    // Only the top level, as a cone naming a directory that is not there
+    const char *missing[] = { "v1..2" };
+    err = svcs_sparse_checkout_set(repo, missing, 1);
+    assert(err == SVCS_OK);
+    assert(repo->index->entry_count == 3);
+    assert(is_collapsed(repo, ROOT "/snippets"));
+    assert(access(ROOT "/snippets", F_OK) != 0);
+    assert(access(files[1], F_OK) == 0);
+
+    // Turning it off restores every file, with the staged change
+    err = svcs_sparse_checkout_disable(repo);
+    assert(err == SVCS_OK);
+    assert(repo->index->entry_count == FILE_COUNT);
+    for (size_t i = 0; i < FILE_COUNT; i++) {
+        assert(file_holds(files[i], i == 6 ? "sorted differently" : files[i]));
+        assert(find_entry(repo, files[i]) != NULL);
+    }
+    assert(access(ROOT "/.svcs/info/sparse-checkout", F_OK) != 0);
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf " ROOT);
+
+    printf("✓ test_sparse_checkout_cone passed\n");
+}
+
+int main() {
+    printf("Running sparse checkout tests...\n");
+
+    test_sparse_checkout_cone();
+
+    printf("All sparse checkout tests passed! ✓\n");
+    return 0;
+}
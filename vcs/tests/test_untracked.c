@@ -0,0 +1,145 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "svcs.h"
+#include "test_util.h"
+
+// Directories changed within the last second are never cached
+static void set_mtime(const char *path, time_t mtime) {
+    struct timespec times[2] = { { mtime, 0 }, { mtime, 0 } };
+    assert(utimensat(AT_FDCWD, path, times, 0) == 0);
+}
+
+// Checks the listing against the expected paths, in order
+static void check_untracked(svcs_repository_t *repo, int flags, const char *const *expected, size_t expected_count) {
+    char **paths;
+    size_t count;
+    svcs_error_t err = svcs_index_untracked(repo, flags, &paths, &count);
+    assert(err == SVCS_OK);
+    assert(count == expected_count);
+    for (size_t i = 0; i < count; i++) {
+        assert(strcmp(paths[i], expected[i]) == 0);
+    }
+    free(paths);
+}
+
+void test_untracked_list() {
+    const char *test_path = "/tmp/svcs_untracked_test";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_untracked_test");
+    svcs_repository_init(test_path);
+    system("mkdir -p /tmp/svcs_untracked_test/snippets /tmp/svcs_untracked_test/empty");
+    write_file("/tmp/svcs_untracked_test/readme.txt", "readme");
+    write_file("/tmp/svcs_untracked_test/notes.txt", "notes");
+    write_file("/tmp/svcs_untracked_test/debug.log", "log");
+    write_file("/tmp/svcs_untracked_test/snippets/draft.c", "draft");
+    write_file("/tmp/svcs_untracked_test/snippets/old.bak", "backup");
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    err = svcs_index_add(repo, "/tmp/svcs_untracked_test/readme.txt");
+    assert(err == SVCS_OK);
+
+    const char *untracked[] = {
+        "/tmp/svcs_untracked_test/notes.txt",
+        "/tmp/svcs_untracked_test/snippets/draft.c"
+    };
+    const char *ignored[] = {
+        "/tmp/svcs_untracked_test/debug.log",
+        "/tmp/svcs_untracked_test/snippets/old.bak"
+    };
+    const char *both[] = {
+        "/tmp/svcs_untracked_test/debug.log",
+        "/tmp/svcs_untracked_test/notes.txt",
+        "/tmp/svcs_untracked_test/snippets/draft.c",
+        "/tmp/svcs_untracked_test/snippets/old.bak"
+    };
+    check_untracked(repo, SVCS_UNTRACKED_FILES, untracked, 2);
+    check_untracked(repo, SVCS_UNTRACKED_IGNORED, ignored, 2);
+    check_untracked(repo, SVCS_UNTRACKED_FILES | SVCS_UNTRACKED_IGNORED, both, 4);
+
+    // Staging and unstaging move files in and out of the list
+    err = svcs_index_add(repo, untracked[0]);
+    assert(err == SVCS_OK);
+    check_untracked(repo, SVCS_UNTRACKED_FILES, untracked + 1, 1);
+    err = svcs_index_remove(repo, untracked[0]);
+    assert(err == SVCS_OK);
+    check_untracked(repo, SVCS_UNTRACKED_FILES, untracked, 2);
+
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_untracked_test");
+
+    printf("✓ test_untracked_list passed\n");
+}
+
+void test_untracked_cache() {
+    const char *test_path = "/tmp/svcs_untracked_test2";
+    const char *dir = "/tmp/svcs_untracked_test2/snippets";
+    const char *draft = "/tmp/svcs_untracked_test2/snippets/draft.c";
+    const char *added = "/tmp/svcs_untracked_test2/snippets/added.c";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_untracked_test2");
+    svcs_repository_init(test_path);
+    system("mkdir -p /tmp/svcs_untracked_test2/snippets");
+    write_file(draft, "draft");
+    set_mtime(dir, 1000000000);
+    set_mtime(test_path, 1000000000);
+
+    // The first listing builds the cache and saves it with the index
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    check_untracked(repo, SVCS_UNTRACKED_FILES, &draft, 1);
+    svcs_repository_free(repo);
+
+    // A directory whose mtime is unchanged is not read again, so a file
+    // slipped in behind its back is not seen
+    write_file(added, "added");
+    set_mtime(dir, 1000000000);
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    check_untracked(repo, SVCS_UNTRACKED_FILES, &draft, 1);
+
+    // Until its mtime moves
+    set_mtime(dir, 1000000100);
+    const char *both[] = { added, draft };
+    check_untracked(repo, SVCS_UNTRACKED_FILES, both, 2);
+    svcs_repository_free(repo);
+
+    // Staging a file drops its directory from the cache without any
+    // change to the directory itself
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    err = svcs_index_add(repo, added);
+    assert(err == SVCS_OK);
+    check_untracked(repo, SVCS_UNTRACKED_FILES, &draft, 1);
+    err = svcs_index_remove(repo, added);
+    assert(err == SVCS_OK);
+    check_untracked(repo, SVCS_UNTRACKED_FILES, both, 2);
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_untracked_test2");
+
+    printf("✓ test_untracked_cache passed\n");
+}
+
+int main() {
+    printf("Running untracked file tests...\n");
+
+    test_untracked_list();
+    test_untracked_cache();
+
+    printf("All untracked file tests passed! ✓\n");
+    return 0;
+}
@@ -0,0 +1,153 @@
+#ifndef SVCS_TEST_UTIL_H
+#define SVCS_TEST_UTIL_H
+
+// Helpers shared by the tests that build files, objects and history by hand
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "svcs.h"
+
+static inline void write_file(const char *path, const char *content) {
+    FILE *f = fopen(path, "w");
+    assert(f != NULL);
+    fwrite(content, 1, strlen(content), f);
+    fclose(f);
+}
+
+// Status of the i-th entry as svcs_index_status reports it
+static inline svcs_file_status_t status_of(svcs_repository_t *repo, size_t i) {
+    svcs_index_entry_t *entries;
+    size_t count;
+    svcs_error_t err = svcs_index_status(repo, &entries, &count);
+    assert(err == SVCS_OK);
+    assert(i < count);
+    svcs_file_status_t status = entries[i].status;
+    free(entries);
+    return status;
+}
+
+static inline void write_object(svcs_repository_t *repo, svcs_object_type_t type, const void *data, size_t size,
+                                svcs_hash_t *hash) {
+    svcs_error_t err = svcs_hash_object_algo(repo->hash_algo, type, data, size, hash);
+    assert(err == SVCS_OK);
+
+    svcs_object_t obj = {
+        .type = type,
+        .size = size,
+        .hash = *hash,
+        .data = (void*)data
+    };
+    err = svcs_object_write(repo, &obj);
+    assert(err == SVCS_OK);
+}
+
+static inline void write_blob(svcs_repository_t *repo, const char *content, svcs_hash_t *hash) {
+    write_object(repo, SVCS_OBJ_BLOB, content, strlen(content), hash);
+}
+
+// A tree holding one file with content
+static inline void make_tree(svcs_repository_t *repo, const char *content, svcs_hash_t *tree) {
+    svcs_hash_t blob;
+    write_blob(repo, content, &blob);
+
+    uint8_t tree_data[64];
+    memcpy(tree_data, "100644 file", 12);
+    memcpy(tree_data + 12, blob.bytes, SVCS_HASH_SIZE);
+    write_object(repo, SVCS_OBJ_TREE, tree_data, 12 + SVCS_HASH_SIZE, tree);
+}
+
+static inline void make_commit(svcs_repository_t *repo, const svcs_hash_t *tree, const svcs_hash_t *parents,
+                               size_t parent_count, long time, svcs_hash_t *hash) {
+    char content[4096];
+    char hash_str[SVCS_HASH_HEX_SIZE];
+    svcs_hash_to_string(tree, hash_str);
+    int len = snprintf(content, sizeof(content), "tree %s\n", hash_str);
+    for (size_t i = 0; i < parent_count; i++) {
+        svcs_hash_to_string(&parents[i], hash_str);
+        len += snprintf(content + len, sizeof(content) - len, "parent %s\n", hash_str);
+    }
+    len += snprintf(content + len, sizeof(content) - len,
+                    "author Test <test@example.com> %ld +0000\n"
+                    "committer Test <test@example.com> %ld +0000\n"
+                    "\n"
+                    "Commit at %ld\n", time, time, time);
+    write_object(repo, SVCS_OBJ_COMMIT, content, len, hash);
+}
+
+static inline void set_ref(svcs_repository_t *repo, const char *name, const svcs_hash_t *hash) {
+    svcs_error_t err = svcs_branch_create(repo, name, hash);
+    assert(err == SVCS_OK);
+}
+
+static inline void loose_path(svcs_repository_t *repo, const svcs_hash_t *hash, char *path, size_t size) {
+    char hash_str[SVCS_HASH_HEX_SIZE];
+    svcs_hash_to_string(hash, hash_str);
+    snprintf(path, size, "%s/objects/%.2s/%s", repo->git_dir, hash_str, hash_str + 2);
+}
+
+static inline int loose_exists(svcs_repository_t *repo, const svcs_hash_t *hash) {
+    char path[1024];
+    loose_path(repo, hash, path, sizeof(path));
+    return svcs_file_exists(path);
+}
+
+// Follows path one directory entry at a time from tree
+static inline void subtree(svcs_repository_t *repo, const svcs_hash_t *tree, const char *path, svcs_hash_t *result) {
+    *result = *tree;
+    while (*path) {
+        const char *slash = strchr(path, '/');
+        size_t len = slash ? (size_t)(slash - path) : strlen(path);
+        svcs_object_t *obj;
+        assert(svcs_object_read(repo, result, &obj) == SVCS_OK);
+        assert(obj->type == SVCS_OBJ_TREE);
+
+        int found = 0;
+        const char *ptr = obj->data;
+        const char *end = ptr + obj->size;
+        while (ptr < end && !found) {
+            const char *name = strchr(ptr, ' ') + 1;
+            const char *hash = name + strlen(name) + 1;
+            if (strncmp(ptr, "40000 ", 6) == 0 && strlen(name) == len && strncmp(name, path, len) == 0) {
+                memcpy(result->bytes, hash, SVCS_HASH_SIZE);
+                found = 1;
+            }
+            ptr = hash + SVCS_HASH_SIZE;
+        }
+        svcs_object_free(obj);
+        assert(found);
+        path += slash ? len + 1 : len;
+    }
+}
+
+// History used by the commit graph and bitmap tests, oldest first:
+//
+//   A - B - M - D        main
+//    \     /
+//     - C ---- E         side
+//
+// D has its own tree; every other commit shares tree. x and o are left
+// for tests that add commits of their own.
+typedef struct {
+    svcs_hash_t tree, a, b, c, m, d, e, x, o;
+} history_t;
+
+static inline void build_history(svcs_repository_t *repo, history_t *h) {
+    svcs_hash_t other_tree;
+    make_tree(repo, "snippet", &h->tree);
+    make_tree(repo, "changed snippet", &other_tree);
+
+    make_commit(repo, &h->tree, NULL, 0, 1000, &h->a);
+    make_commit(repo, &h->tree, &h->a, 1, 1100, &h->b);
+    make_commit(repo, &h->tree, &h->a, 1, 1200, &h->c);
+    svcs_hash_t merge_parents[2] = { h->b, h->c };
+    make_commit(repo, &h->tree, merge_parents, 2, 1300, &h->m);
+    make_commit(repo, &other_tree, &h->m, 1, 1400, &h->d);
+    make_commit(repo, &h->tree, &h->c, 1, 1500, &h->e);
+
+    set_ref(repo, "main", &h->d);
+    set_ref(repo, "side", &h->e);
+}
+
+#endif
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <dirent.h>
+#include "svcs.h"
+#include "test_util.h"
+
+// Count leftover temp files anywhere under dir
+static int count_temp_files(const char *dir_path) {
+    DIR *dir = opendir(dir_path);
+    if (!dir) return 0;
+
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (strstr(entry->d_name, "tmp_")) {
+            count++;
+        }
+
+        char child[1024];
+        snprintf(child, sizeof(child), "%s/%s", dir_path, entry->d_name);
+        count += count_temp_files(child);
+    }
+    closedir(dir);
+    return count;
+}
+
+void test_write_batch_commit() {
+    const char *test_path = "/tmp/svcs_batch_test";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_batch_test");
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    err = svcs_write_batch_begin(repo);
+    assert(err == SVCS_OK);
+
+    svcs_hash_t hash;
+    write_blob(repo, "batched snippet", &hash);
+    err = svcs_branch_create(repo, "feature", &hash);
+    assert(err == SVCS_OK);
+
+    // Pending objects are usable by this process but not yet in place
+    assert(svcs_object_exists(repo, &hash));
+    assert(!loose_exists(repo, &hash));
+
+    svcs_object_t *obj;
+    err = svcs_object_read(repo, &hash, &obj);
+    assert(err == SVCS_OK);
+    assert(obj->size == strlen("batched snippet"));
+    svcs_object_free(obj);
+
+    char branch_path[1024];
+    snprintf(branch_path, sizeof(branch_path), "%s/refs/heads/feature", repo->git_dir);
+    assert(!svcs_file_exists(branch_path));
+
+    // Nested batches publish only with the outermost commit
+    err = svcs_write_batch_begin(repo);
+    assert(err == SVCS_OK);
+    err = svcs_write_batch_commit(repo);
+    assert(err == SVCS_OK);
+    assert(!loose_exists(repo, &hash));
+
+    err = svcs_write_batch_commit(repo);
+    assert(err == SVCS_OK);
+    assert(loose_exists(repo, &hash));
+    assert(svcs_file_exists(branch_path));
+    assert(count_temp_files(repo->git_dir) == 0);
+
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_batch_test");
+
+    printf("✓ test_write_batch_commit passed\n");
+}
+
+void test_write_batch_abort() {
+    const char *test_path = "/tmp/svcs_batch_test2";
+
+    // Clean up and setup
+    system("rm -rf /tmp/svcs_batch_test2");
+    svcs_repository_init(test_path);
+
+    svcs_repository_t *repo;
+    svcs_error_t err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+
+    err = svcs_write_batch_begin(repo);
+    assert(err == SVCS_OK);
+
+    svcs_hash_t hash;
+    write_blob(repo, "abandoned snippet", &hash);
+    assert(svcs_object_exists(repo, &hash));
+
+    svcs_write_batch_abort(repo);
+    assert(!svcs_object_exists(repo, &hash));
+    assert(count_temp_files(repo->git_dir) == 0);
+
+    // Batches left open are discarded when the repository is freed
+    err = svcs_write_batch_begin(repo);
+    assert(err == SVCS_OK);
+    write_blob(repo, "never committed", &hash);
+    svcs_repository_free(repo);
+
+    err = svcs_repository_open(&repo, test_path);
+    assert(err == SVCS_OK);
+    assert(!svcs_object_exists(repo, &hash));
+    assert(count_temp_files(repo->git_dir) == 0);
+    svcs_repository_free(repo);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_batch_test2");
+
+    printf("✓ test_write_batch_abort passed\n");
+}
+
+void test_file_write_atomic() {
+    const char *test_dir = "/tmp/svcs_batch_test3";
+    const char *test_file = "/tmp/svcs_batch_test3/file";
+
+    system("rm -rf /tmp/svcs_batch_test3");
+    svcs_mkdir_recursive(test_dir);
+
+    svcs_error_t err = svcs_file_write(test_file, "first version", 13);
+    assert(err == SVCS_OK);
+    err = svcs_file_write(test_file, "second", 6);
+    assert(err == SVCS_OK);
+
+    void *data;
+    size_t size;
+    err = svcs_file_read(test_file, &data, &size);
+    assert(err == SVCS_OK);
+    assert(size == 6);
+    assert(memcmp(data, "second", 6) == 0);
+    free(data);
+
+    assert(count_temp_files(test_dir) == 0);
+
+    // Cleanup
+    system("rm -rf /tmp/svcs_batch_test3");
+
+    printf("✓ test_file_write_atomic passed\n");
+}
+
+int main() {
+    printf("Running write batch tests...\n");
+
+    test_write_batch_commit();
+    test_write_batch_abort();
+    test_file_write_atomic();
+
+    printf("All write batch tests passed! ✓\n");
+    return 0;
+}